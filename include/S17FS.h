@@ -2,6 +2,7 @@
 #define _S17FS_H__
 
 #include <sys/types.h>
+#include <sys/uio.h>
 
 #include <dyn_array.h>
 
@@ -11,9 +12,51 @@ typedef enum { FS_SEEK_SET, FS_SEEK_CUR, FS_SEEK_END } seek_t;
 
 typedef enum { FS_REGULAR, FS_DIRECTORY } file_t;
 
+// How a mounted volume reaches its file
+//   MMAP maps the whole image, URING goes through a block cache filled with io_uring,
+//   FILE does plain pread/pwrite for every block
+typedef enum { FS_BACKEND_MMAP, FS_BACKEND_URING, FS_BACKEND_FILE } fs_backend_t;
+
+// Layout of a volume made with fs_format_ex, a zero field gets what fs_format uses
+//   block_size is a power of two from 512 to 4096 bytes
+//   inode_count at most 256, dir_records at most block_size / sizeof(file_record_t)
+//   journal_blocks of 0 means no journal, otherwise it's at least 6 (see fs_format_journaled)
+//   pointer_bytes is 2 or 4, 16 bit block pointers reach 65536 blocks and 32 bit ones UINT32_MAX,
+//   left at 0 it's 2 unless block_count needs 4
+//   inode_limit above inode_count lets the inode table grow into the data region as files are
+//   made, up to 65536 inodes, 0 keeps it at inode_count
+//   block_limit above block_count starts the image at block_count and grows it as it fills, or
+//   with fs_grow, up to block_limit, 0 keeps it at block_count
+//   inode_size is 64, 128 or 256 bytes, the bigger ones only pay off with inline_data
+//   inline_data keeps a new regular file's data in its inode until it grows past
+//   inode_size - 24 bytes, then it moves out to a data block like any other file
+//   tail_packing packs the last partial block of a file ending in its first five blocks into
+//   sixteenths of a shared block when it's closed, it's moved back out when a write reaches it
+typedef struct {
+    fs_backend_t backend;
+    size_t block_size;
+    size_t block_count;
+    size_t inode_count;
+    size_t dir_records;  // Most files and directories one directory holds
+    size_t journal_blocks;
+    size_t pointer_bytes;
+    size_t inode_limit;
+    size_t block_limit;
+    size_t inode_size;
+    bool inline_data;
+    bool tail_packing;
+} fs_format_opts_t;
+
 #define FS_FNAME_MAX (64)
 // INCLUDING null terminator
 
+#define FS_IOV_MAX (1024)
+// Most segments fs_readv/fs_writev take in one call
+
+#define FS_PAGE_BLOCK_SIZE (4096)
+// Block size for fs_format_ex that puts every block on a page of its own, so each one is
+// mapped, prefetched and punched out of the file by itself
+
 typedef struct {
     uint16_t inode_num;
     uint8_t record_count;
@@ -23,6 +66,49 @@ typedef struct {
     file_t type;
 } file_record_t;
 
+// A piece of a file as it sits in the volume, see fs_read_view
+typedef struct {
+    const void *base;
+    size_t len;
+} fs_span_t;
+
+// Operations fs_submit can queue
+typedef enum {
+    FS_OP_NOP,
+    FS_OP_OPEN,
+    FS_OP_CLOSE,
+    FS_OP_CREATE,
+    FS_OP_REMOVE,
+    FS_OP_READ,
+    FS_OP_WRITE,
+    FS_OP_PREAD,
+    FS_OP_PWRITE,
+    FS_OP_FLUSH
+} fs_opcode_t;
+
+#define FS_OP_LINK (1)
+// Op flag, the next op in the array waits for this one and is skipped if it fails
+
+// One queued operation, the fields mirror the arguments of the matching call
+//   path and buf have to stay valid until the op's completion is reaped
+typedef struct {
+    fs_opcode_t opcode;
+    uint32_t flags;
+    int fd;
+    const char *path;
+    file_t type;
+    void *buf;
+    size_t nbyte;
+    off_t offset;
+    uint64_t user_data;  // Handed back untouched in the completion
+} fs_op_t;
+
+// The outcome of one fs_op_t, result is what the matching call would have returned
+typedef struct {
+    uint64_t user_data;
+    ssize_t result;
+} fs_completion_t;
+
 ///
 /// Formats (and mounts) an S17FS file for use
 /// \param fname The file to format
@@ -39,6 +125,88 @@ S17FS_t *fs_format(const char *path);
 ///
 S17FS_t *fs_mount(const char *path);
 
+///
+/// Formats (and mounts) an S17FS file for use, on the given backend
+///   fs_format is the same as this with FS_BACKEND_MMAP
+/// \param path The file to format
+/// \param backend How to reach the file while it's mounted
+/// \return Mounted S17FS object, NULL on error
+///
+S17FS_t *fs_format_backend(const char *path, fs_backend_t backend);
+
+///
+/// Mounts an S17FS object and prepares it for use, on the given backend
+///   fs_mount is the same as this with FS_BACKEND_MMAP
+/// \param path The file to mount
+/// \param backend How to reach the file while it's mounted
+/// \return Mounted S17FS object, NULL on error
+///
+S17FS_t *fs_mount_backend(const char *path, fs_backend_t backend);
+
+///
+/// Formats (and mounts) an S17FS volume that lives only in memory
+///   Nothing survives the unmount unless it's written out with fs_serialize first
+/// \param huge_pages true to ask for huge pages behind the volume, it falls back to normal ones
+/// \return Mounted S17FS object, NULL on error
+///
+S17FS_t *fs_format_memory(bool huge_pages);
+
+///
+/// Formats (and mounts) a memory volume like fs_format_memory, with the given layout
+///   The backend is ignored, and block_limit has to be 0 since there's no file for it to grow into
+/// \param opts The layout to use, NULL for the same volume fs_format_memory makes
+/// \param huge_pages true to ask for huge pages behind the volume, it falls back to normal ones
+/// \return Mounted S17FS object, NULL on error or if the layout can't be made
+///
+S17FS_t *fs_format_memory_ex(const fs_format_opts_t *opts, bool huge_pages);
+
+///
+/// Formats a file like fs_format_backend, but with a metadata journal at the end of the volume
+///   Metadata changes are logged and committed together by fs_sync and fs_fsync, a mount
+///   after a crash puts the metadata back the way the last commit left it
+/// \param path The file to format
+/// \param backend How to reach the file while it's mounted
+/// \return Mounted S17FS object, NULL on error
+///
+S17FS_t *fs_format_journaled(const char *path, fs_backend_t backend);
+
+///
+/// Formats (and mounts) a file with the given layout, which is kept in the volume's superblock
+///   so the mount functions pick it up again on their own
+/// \param path The file to format
+/// \param opts The layout and backend to use, NULL for the same volume fs_format makes
+/// \return Mounted S17FS object, NULL on error or if the layout can't be made
+///
+S17FS_t *fs_format_ex(const char *path, const fs_format_opts_t *opts);
+
+///
+/// Writes a complete image of the volume to a file, which fs_mount can then mount
+///   The file is replaced in one step, or just synced if it's the volume's own file
+///   Writes still in flight on other threads may or may not make it in
+/// \param fs The S17FS object to write out
+/// \param path The file to write to
+/// \return 0 on success, < 0 on failure
+///
+int fs_serialize(S17FS_t *fs, const char *path);
+
+///
+/// Makes everything written to the volume so far durable, and waits for it to get there
+///   Only what changed since the last sync is written
+/// \param fs The S17FS object to sync
+/// \return 0 on success, < 0 on failure
+///
+int fs_sync(S17FS_t *fs);
+
+///
+/// Makes the volume's image longer, ahead of it filling up
+///   Only volumes formatted with a block_limit grow, and never past it, a volume that already
+///   has the blocks asked for is left as it is
+/// \param fs The S17FS object to grow
+/// \param block_count Blocks it has afterwards, the free block map's included
+/// \return 0 on success, < 0 on failure
+///
+int fs_grow(S17FS_t *fs, size_t block_count);
+
 ///
 /// Unmounts the given object and frees all related resources
 /// \param fs The S17FS object to unmount
@@ -104,6 +272,8 @@ ssize_t fs_read(S17FS_t *fs, int fd, void *dst, size_t nbyte);
 ///   Writing past EOF extends the file
 ///   Writing inside a file overwrites existing data
 ///   R/W position in incremented by the number of bytes written
+///   A buffered descriptor (see fs_set_write_buffer) only takes bytes it has room on the volume for,
+///   errno is ENOSPC when that cuts the write short or turns it away
 /// \param fs The S17FS containing the file
 /// \param fd The file to write to
 /// \param dst The buffer to read from
@@ -112,6 +282,122 @@ ssize_t fs_read(S17FS_t *fs, int fd, void *dst, size_t nbyte);
 ///
 ssize_t fs_write(S17FS_t *fs, int fd, const void *src, size_t nbyte);
 
+///
+/// Reads data from the file at the given offset
+///   The R/W position of the descriptor is neither used nor changed
+///   Reading past EOF returns data up to EOF
+/// \param fs The S17FS containing the file
+/// \param fd The file to read from
+/// \param dst The buffer to write to
+/// \param nbyte The number of bytes to read
+/// \param offset Offset from BOF to start reading at
+/// \return number of bytes read (< nbyte IFF read passes EOF), < 0 on error
+///
+ssize_t fs_pread(S17FS_t *fs, int fd, void *dst, size_t nbyte, off_t offset);
+
+///
+/// Writes data to the file at the given offset
+///   The R/W position of the descriptor is neither used nor changed
+///   Writing past EOF extends the file, but the write can't start past EOF
+/// \param fs The S17FS containing the file
+/// \param fd The file to write to
+/// \param src The buffer to read from
+/// \param nbyte The number of bytes to write
+/// \param offset Offset from BOF to start writing at
+/// \return number of bytes written (< nbyte IFF out of space), < 0 on error
+///
+ssize_t fs_pwrite(S17FS_t *fs, int fd, const void *src, size_t nbyte, off_t offset);
+
+///
+/// Reads data from the file into several buffers, filling each in order
+///   Behaves like one fs_read of the combined length
+/// \param fs The S17FS containing the file
+/// \param fd The file to read from
+/// \param iov The buffers to fill
+/// \param iovcnt Number of buffers, at most FS_IOV_MAX
+/// \return number of bytes read (< total length IFF read passes EOF), < 0 on error
+///
+ssize_t fs_readv(S17FS_t *fs, int fd, const struct iovec *iov, int iovcnt);
+
+///
+/// Writes data from several buffers to the file, draining each in order
+///   Behaves like one fs_write of the combined length
+/// \param fs The S17FS containing the file
+/// \param fd The file to write to
+/// \param iov The buffers to write
+/// \param iovcnt Number of buffers, at most FS_IOV_MAX
+/// \return number of bytes written (< total length IFF out of space), < 0 on error
+///
+ssize_t fs_writev(S17FS_t *fs, int fd, const struct iovec *iov, int iovcnt);
+
+///
+/// Maps blocks for a range of the file ahead of the writes that will fill it, as one run where
+///   there's room, so those writes don't allocate as they go and the file comes out contiguous
+///   The size doesn't change and the blocks aren't cleared, nothing past EOF can be read anyway
+///   Blocks mapped before running out of room stay with the file
+/// \param fs The S17FS containing the file
+/// \param fd The file to allocate for
+/// \param offset Offset from BOF the range starts at, it may start and end past EOF
+/// \param len Length of the range in bytes
+/// \return 0 on success, < 0 on failure or if the whole range couldn't be mapped
+///
+int fs_fallocate(S17FS_t *fs, int fd, off_t offset, size_t len);
+
+///
+/// Maps a range of the file without copying it
+///   The spans point directly into the volume and, in order, cover the range
+///   They are read-only and only valid until the next call that modifies the
+///   volume, or until the view is released, whichever comes first
+///   Only FS_BACKEND_MMAP volumes can be viewed
+///   Viewing past EOF covers data up to EOF
+/// \param fs The S17FS containing the file
+/// \param fd The file to view
+/// \param offset Offset from BOF the view starts at
+/// \param nbyte The number of bytes to view
+/// \param spans_out Set to a dyn_array of fs_span_t, release it with fs_release_view
+/// \return number of bytes covered by the spans, < 0 on error
+///
+ssize_t fs_read_view(S17FS_t *fs, int fd, off_t offset, size_t nbyte, dyn_array_t **spans_out);
+
+///
+/// Releases a view made by fs_read_view
+/// \param fs The S17FS the view came from
+/// \param spans The spans to release
+/// \return 0 on success, < 0 on failure
+///
+int fs_release_view(S17FS_t *fs, dyn_array_t *spans);
+
+///
+/// Turns write-back buffering on or off for the given descriptor
+///   Buffered writes smaller than a block are collected, up to 64KB, and written out together
+///   with the blocks they need past the end of the file allocated as one run where there's room
+///   Pending data is flushed when the buffer fills, on seek, close, fs_flush, and
+///   before any read or unbuffered write of the same file
+///   Errors writing buffered data surface on the call that flushes it
+/// \param fs The S17FS containing the file
+/// \param fd The descriptor to change
+/// \param enable true to buffer writes, false to flush and stop buffering
+/// \return 0 on success, < 0 on failure
+///
+int fs_set_write_buffer(S17FS_t *fs, int fd, bool enable);
+
+///
+/// Writes out any data buffered for the given descriptor
+/// \param fs The S17FS containing the file
+/// \param fd The descriptor to flush
+/// \return 0 on success, < 0 on failure
+///
+int fs_flush(S17FS_t *fs, int fd);
+
+///
+/// Makes what's been written through the descriptor durable, and waits for it to get there
+///   Its write buffer is flushed first, then the volume is synced like fs_sync
+/// \param fs The S17FS containing the file
+/// \param fd The file descriptor to sync
+/// \return 0 on success, < 0 on failure
+///
+int fs_fsync(S17FS_t *fs, int fd);
+
 ///
 /// Deletes the specified file and closes all open descriptors to the file
 ///   Directories can only be removed when empty
@@ -130,6 +416,29 @@ int fs_remove(S17FS_t *fs, const char *path);
 ///
 dyn_array_t *fs_get_dir(S17FS_t *fs, const char *path);
 
+///
+/// Queues operations to run on the volume's worker threads and returns without waiting
+///   Ops run in any order and concurrently, unless chained with FS_OP_LINK
+///   A skipped op of a failed chain completes with a result of -1
+///   Every queued op posts exactly one completion, collect them with fs_reap
+/// \param fs The S17FS to run the ops on
+/// \param ops The ops to queue, copied before the call returns
+/// \param n Number of ops
+/// \return number of ops queued (< n IFF the rest couldn't be), < 0 on error
+///
+int fs_submit(S17FS_t *fs, const fs_op_t *ops, size_t n);
+
+///
+/// Collects completions of ops queued with fs_submit, in the order they finished
+///   Waits for at least one when none are ready yet but some are still outstanding
+/// \param fs The S17FS the ops were queued on
+/// \param completions Buffer to fill
+/// \param max Most completions to collect
+/// \return number of completions collected (0 IFF nothing is outstanding), < 0 on error
+///
+int fs_reap(S17FS_t *fs, fs_completion_t *completions, size_t max);
+
+///
 /// Moves the file from one location to the other
 ///   Moving files does not affect open descriptors
 /// \param fs The S17FS containing the file
@@ -3,50 +3,82 @@
 #include "S17FS.h"
 #include <block_store.h>
 #include <bitmap.h>
+#include <worker_pool.h>
+#include <journal.h>
 #include <stdint.h>
+#include <pthread.h>
 #include <sys/types.h>
 
 /***************Constants**************/
 
+//Everything sized by the block, inode count or directory size here is the default a volume gets
+//without fs_format_ex, the mounted volume's own numbers are in its geometry_t
+
 #define FS_FNAME_MAX (64)
 #define DIR_REC_MAX (7)
 
 #define FS_PATH_MAX (16322)
 #define DESCRIPTOR_MAX (256)
 #define BLOCK_SIZE (512)
+#define BLOCK_SIZE_MIN (512)
+#define BLOCK_SIZE_MAX (4096)
 #define INODE_BLOCK_TOTAL (32)
-#define INODES_PER_BLOCK (BLOCK_SIZE / sizeof(inode_t))
+#define INODE_CORE_BYTES (64)  // What an inode takes on the volume by default, and all it takes in block 0
+#define INODE_SIZE_MAX (256)
+#define INLINE_CORE_BYTES (40)  // ptrs_hi, padding and data_ptrs, what inline data has of the core
+#define DIR_REC_LIMIT (BLOCK_SIZE_MAX / sizeof(file_record_t))  // Most records any directory block holds
 
-#define INODE_TOTAL (((INODE_BLOCK_TOTAL) * (BLOCK_SIZE)) / sizeof(inode_t))
+#define INODE_TOTAL (((INODE_BLOCK_TOTAL) * (BLOCK_SIZE)) / INODE_CORE_BYTES)
 #define INODE_BLOCK_OFFSET (0)
-#define DATA_BLOCK_OFFSET ((INODE_BLOCK_OFFSET) + (INODE_BLOCK_TOTAL))
 
-#define ROOT_DIR_BLOCK (DATA_BLOCK_OFFSET)
 #define INODE_PTR_TOTAL (8)
 #define DIRECT_TOTAL (5)
-#define INDIRECT_TOTAL 2*((BLOCK_SIZE) / sizeof(block_ptr_t))
-#define DBL_INDIRECT_TOTAL ((INDIRECT_TOTAL) * (INDIRECT_TOTAL))
-#define FILE_SIZE_MAX ((DIRECT_TOTAL + INDIRECT_TOTAL + DBL_INDIRECT_TOTAL) * BLOCK_SIZE)
 #define DATA_BLOCK_MAX (65536)
+#define WIDE_BLOCK_MAX (UINT32_MAX)  // On volumes with 32 bit block pointers, block 0 still means none
 
 #define INODE_TO_BLOCK(inode) (((inode)) + INODE_BLOCK_OFFSET)
 
-#define INODE_INNER_IDX(inode) ((inode) &0x07)
-#define INODE_INNER_OFFSET(inode) (INODE_INNER_IDX(inode) * sizeof(inode_t))
-
 #define FILE_RECORD_POS(offset) (offset * sizeof(file_record_t))
 
-#define DIRECT_PER_BLOCK (BLOCK_SIZE / sizeof(block_ptr_t))
+// In bytes, so they mean the same whatever the block size, the geometry has them in blocks
+#define READAHEAD_MIN_BYTES (4096)    // One page
+#define READAHEAD_MAX_BYTES (131072)  // 128KB like the Linux default
+
+#define PARALLEL_MIN_BYTES (1048576)    // 1MB, smaller transfers aren't worth handing out
+#define PARALLEL_CHUNK_BYTES (131072)   // Least a worker gets handed, 128KB
+#define PARALLEL_BATCH_BYTES (8388608)  // Looked up per round of handing out, 8MB
+
+#define WRITEBACK_BYTES (65536)  // A buffered descriptor's write-back buffer, 64KB
+#define WORKER_MAX (8)
+
+#define SEQ_RETRY_MAX (64)  // Lock-free read attempts before falling back to the lock
+
+#define JOURNAL_BLOCKS (1024)  // Right below the free block map on volumes that have one
+
+#define INODE_LIMIT_MAX (65536)  // Inode numbers have to fit in a file_record_t
+#define TABLE_SLOT (3)           // Inode sized slot of block 0 holding the inode table's own inode, see table_inode
 
-#define BITMAP_BITS (DATA_BLOCK_MAX - ((DATA_BLOCK_MAX / 8) / BLOCK_SIZE))
+#define SUPERBLOCK_SLOT (2)    // Inode sized slot of block 0 holding the superblock, the same byte offset whatever the block size
+#define SUPERBLOCK_MAGIC (0x53373153)
+#define SUPERBLOCK_VERSION (2)  // 2 added ptr_bytes, version 1 volumes all have 16 bit pointers
+#define SUPERBLOCK_INLINE (0x1)  // features bit, new regular files keep their data in the inode while it fits
+#define SUPERBLOCK_TAILS (0x2)   // features bit, short files' last partial blocks are packed into fragment blocks
+
+#define INODE_INLINE (0x1)  // mdata flags bit, the pointer fields and spare bytes hold the file's data, see inline_copy
+#define INODE_TAIL (0x2)    // mdata flags bit, the last partial block lives in a fragment block, see inode_tail
+
+#define FRAGMENTS_PER_BLOCK (16)  // A fragment block's first fragment holds the map of which ones are in use
+
+//Data and pointer blocks sit between the inode table and the free block map
+#define BLOCK_PTR_VALID(fs, block) ((block) >= (fs)->geo.table_blocks && (block) < (fs)->geo.data_end)
 
 /***************Structs & Typedefs**************/
 
 typedef enum { DIRECT = 0, INDIRECT1 = 5, INDIRECT2 = 6, DBL_INDIRECT = 7 } START_PTR_t;
 
-typedef uint8_t data_block_t[BLOCK_SIZE];  // c is weird
-typedef uint16_t block_ptr_t;
-typedef uint8_t inode_ptr_t;
+typedef uint8_t data_block_t[BLOCK_SIZE_MAX];  // c is weird, and big enough for any block size
+typedef uint32_t block_ptr_t;  // A block number in memory, on the volume it's 16 or 32 bits wide
+typedef uint32_t inode_ptr_t;  // An inode number in memory, records hold 16 bits of it
 typedef struct {
     uint32_t size;    // Probably all I'll use for directory file metadata
     uint32_t record_count;    
@@ -54,35 +86,186 @@ typedef struct {
     uint32_t a_time;  // access
     uint32_t m_time;  // modificatione INODE_TO_BLOCK(inode) (((inode)) + INODE_BLOCK_OFFSET)
 
-    inode_ptr_t parent;  // SO NICE TO HAVE. You'll be so mad if you didn't think of it, too
+    uint8_t parent;  // SO NICE TO HAVE. You'll be so mad if you didn't think of it, too
     uint8_t type;
-    uint8_t padding[26];
+    uint16_t ptrs_hi[8];  // High halves of data_ptrs on volumes with 32 bit pointers, zero otherwise
+    uint8_t parent_hi;    // Bits 8-15 of parent
+    uint8_t flags;
+    uint8_t padding[8];   // Inline data, or where a packed tail is, read through inode_tail
 } mdata_t;
 
+// Pointers are read and set through inode_ptr and set_inode_ptr, which take care of the high halves
+//  The first INODE_CORE_BYTES are the same on every volume, extra is only on the volume when its inodes are bigger
 typedef struct {
     //char fname[FS_FNAME_MAX];
     mdata_t mdata;
-    block_ptr_t data_ptrs[8];
+    uint16_t data_ptrs[8];
+    uint8_t extra[INODE_SIZE_MAX - INODE_CORE_BYTES];
 } inode_t;
 
 typedef struct {
     bitmap_t *fd_status;
     size_t fd_pos[DESCRIPTOR_MAX];
     inode_ptr_t fd_inode[DESCRIPTOR_MAX];
+    uint8_t *fd_wbuf[DESCRIPTOR_MAX];     // Write-back buffer for a run of file blocks, NULL when unbuffered
+    size_t fd_wbuf_block[DESCRIPTOR_MAX]; // First file block the buffer holds
+    uint32_t fd_wbuf_lo[DESCRIPTOR_MAX];  // Pending bytes are [lo, hi) from the start of that block, and hi is always fd_pos
+    uint32_t fd_wbuf_hi[DESCRIPTOR_MAX];
+    size_t fd_wbuf_from[DESCRIPTOR_MAX];  // First file block past what the file had when buffering started
+    size_t fd_wbuf_reserved[DESCRIPTOR_MAX]; // Blocks held back for the buffer's flush, under alloc_lock
+    size_t wbuf_pending;                  // Descriptors currently holding unflushed bytes
+    size_t fd_ra_prev[DESCRIPTOR_MAX];    // Offset the last read ended at, a read starting here is sequential
+    size_t fd_ra_size[DESCRIPTOR_MAX];    // Current read-ahead window in blocks, 0 when the stream isn't sequential
+    size_t fd_ra_end[DESCRIPTOR_MAX];     // First file block past everything prefetched so far
+    pthread_mutex_t status_lock;          // Guards fd_status and which inode each descriptor points at
+    pthread_mutex_t fd_lock[DESCRIPTOR_MAX]; // Serializes calls on one descriptor, its position and buffer move together
 } fd_table_t;
 
+// Sits in block 0 next to the inode bitmap and says how the volume is laid out
+//  Volumes formatted before there was one have zeros here, and get the defaults
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t block_size;
+    uint32_t block_count;     // Every block on the volume, the free block map's included
+    uint32_t inode_count;
+    uint32_t dir_records;     // Records one directory holds
+    uint32_t journal_start;   // First block of the journal area, 0 without one
+    uint32_t journal_blocks;
+    uint32_t ptr_bytes;       // Width of a block pointer, 2 or 4
+    uint32_t inode_limit;     // Most inodes the table grows to out of the data region, 0 when it's only inode_count
+    uint32_t block_limit;     // Most blocks the volume grows to as it fills, 0 when it stays at block_count
+    uint32_t inode_size;      // Bytes each inode past block 0 takes, 0 for INODE_CORE_BYTES
+    uint32_t features;        // SUPERBLOCK_ bits
+    uint8_t padding[12];
+} superblock_t;
+
+// The mounted volume's layout, worked out from its superblock
+typedef struct {
+    size_t block_size;
+    size_t block_count;       // Every block on the volume, the free block map's included, changes as it grows
+    size_t block_limit;       // Most it can grow to, the same as block_count when it can't
+    size_t data_end;          // First block past the ones that can be handed out, where the free block map starts
+    size_t inode_total;       // Inodes in the fixed table, the inode bitmap in block 0 covers these
+    size_t inode_limit;       // Inodes the table can grow to, the same as inode_total unless it grows
+    size_t inode_size;        // Block 0 still holds INODE_CORE_BYTES slots
+    size_t inodes_per_block;
+    size_t inline_max;        // Most bytes a new regular file keeps in its inode, 0 when they don't
+    size_t fragment_bytes;    // 0 when tails aren't packed
+    size_t table_blocks;      // Fixed inode table, block 0 included, the root directory's block comes right after
+    size_t table_max;         // Inode table blocks once it's grown all the way, fixed ones included
+    size_t ptr_bytes;
+    size_t ptrs_per_block;
+    size_t file_blocks_max;   // Blocks one file can reach through its pointers
+    size_t dir_records;
+    size_t journal_start;
+    size_t journal_blocks;
+    size_t readahead_min;     // The byte tunables above, in blocks
+    size_t readahead_max;
+    size_t parallel_min;
+    size_t parallel_chunk;
+    size_t parallel_batch;
+    size_t writeback_bytes;
+} geometry_t;
+
+// A directory's data block, read and written whole
+typedef union {
+    data_block_t block;
+    file_record_t records[DIR_REC_LIMIT];
+} dir_block_t;
+
+// Position inside an iovec array
+typedef struct {
+    int index;
+    size_t offset;
+} iov_cursor_t;
+
+// Remembers the last indirect block walked so sequential block lookups don't re-read it
+typedef struct {
+    block_ptr_t block;
+    data_block_t ptrs;  // As it sits on the volume, read with get_ptr
+    block_ptr_t run_next;  // Blocks already taken for the data blocks about to be mapped, handed out in order
+    size_t run_left;
+} file_map_t;
+
+// One inode's lock and lookup version
+typedef struct {
+    pthread_rwlock_t lock;  // File data and size, or a directory's records
+    uint32_t dir_seq;       // Bumped around every change to a directory's records
+} inode_sync_t;
+
+// One block of the inode table, made when the block joins the table and kept until unmount
+typedef struct {
+    block_ptr_t block;           // Where it lives, past the fixed table it's wherever it was allocated
+    pthread_mutex_t table_lock;  // The block is rewritten whole, one writer at a time
+    uint32_t table_seq;          // Bumped around every writeback
+    inode_sync_t inodes[];       // inodes_per_block of them
+} table_block_t;
+
 struct S17FS {
     block_store_t *bs;
+    geometry_t geo;
     fd_table_t fd_table;
     bitmap_t *inode_bitmap;
     char *origin;
+    size_t views_outstanding;  // fs_read_view results not yet released
+    journal_t *journal;        // Metadata log, NULL unless the volume was formatted with one
+
+    //Locks are always taken descriptor first, then inodes from the root down, then the short leaf locks below
+    //Seqlock versions for lock-free lookups, odd while a writer is partway through, sit next to them
+    table_block_t **table;       // Indexed by inode table block, table_max of them, NULL until a block joins
+    pthread_mutex_t grow_lock;   // Adding inode table blocks, taken before alloc_lock and the table locks
+    inode_t table_inode;         // Maps the table's blocks past the fixed ones, like a file's data, under grow_lock
+    pthread_mutex_t alloc_lock;  // Free block map and inode bitmap
+    size_t blocks_reserved;      // Free blocks held back for write buffers, under alloc_lock
+    pthread_mutex_t frag_lock;   // Fragment block maps and frag_block, taken before alloc_lock
+    block_ptr_t frag_block;      // Fragment block new tails are packed into first, 0 for none yet
+
+    pthread_mutex_t pool_lock;  // Only for starting the pool
+    worker_pool_t *pool;        // Started the first time something needs it
+
+    //Ops queued by fs_submit, everything below is guarded by async_lock
+    pthread_mutex_t async_lock;
+    pthread_cond_t async_done;  // Broadcast whenever an op completes
+    dyn_array_t *completions;   // Finished ops not yet reaped
+    size_t async_running;       // Queued ops that haven't finished
+    size_t async_unreaped;      // Queued ops that haven't been reaped
 };
 
 /***************Function Prototypes**************/
 
+bool init_S17FS_locks(S17FS_t *fs);
+void destroy_S17FS_locks(S17FS_t *fs);
+void lock_inode(S17FS_t *fs, const inode_ptr_t inode_number, const bool exclusive);
+void unlock_inode(S17FS_t *fs, const inode_ptr_t inode_number);
+bool lock_descriptor(S17FS_t *fs, const int fd, const bool for_write);
+void unlock_descriptor(S17FS_t *fs, const int fd);
+worker_pool_t *get_worker_pool(S17FS_t *fs);
+size_t allocate_block(S17FS_t *fs);
+bool grow_volume(S17FS_t *fs, const size_t block_count);
+void release_block(S17FS_t *fs, const size_t block);
+bool release_file_blocks(S17FS_t *fs, const inode_t *inode);
+bool sync_store(S17FS_t *fs);
+size_t allocate_inode_number(S17FS_t *fs);
+void release_inode_number(S17FS_t *fs, const size_t inode_number);
+int allocate_descriptor(S17FS_t *fs, const inode_ptr_t inode_number);
+void release_descriptor(S17FS_t *fs, const int fd);
+bool pin_descriptor(S17FS_t *fs, const int fd);
+void unpin_descriptor(S17FS_t *fs, const int fd);
+bool lookup_dir(S17FS_t *fs, const char *path, const size_t length, const bool exclusive, inode_t *dir, dir_block_t *contents);
+bool peek_dir(S17FS_t *fs, const char *path, const size_t length, inode_t *dir, dir_block_t *contents, uint32_t *version);
+bool dir_unchanged(S17FS_t *fs, const inode_ptr_t inode_number, const uint32_t version);
+void begin_dir_update(S17FS_t *fs, const inode_ptr_t inode_number);
+void end_dir_update(S17FS_t *fs, const inode_ptr_t inode_number);
 bool remove_files_file_descriptors(S17FS_t *const fs, const inode_ptr_t inode_number);
-bool read_inode(const S17FS_t *fs, void *data, const inode_ptr_t inode_number);
-bool fd_valid(const S17FS_t *const fs, int fd);
+bool read_inode(S17FS_t *fs, void *data, const inode_ptr_t inode_number);
+block_ptr_t inode_ptr(const inode_t *inode, const size_t ptr);
+void set_inode_ptr(inode_t *inode, const size_t ptr, const block_ptr_t block);
+block_ptr_t inode_tail(const inode_t *inode, size_t *fragment);
+void set_inode_tail(inode_t *inode, const block_ptr_t block, const size_t fragment);
+block_ptr_t get_ptr(const S17FS_t *fs, const void *ptr_block, const size_t index);
+void set_ptr(const S17FS_t *fs, void *ptr_block, const size_t index, const block_ptr_t block);
+bool fd_valid(S17FS_t *const fs, int fd);
 bool initialize_indirect_block(S17FS_t *fs, const block_ptr_t block);
 file_record_t* get_dir_contents(S17FS_t *fs, const block_ptr_t block);
 inode_t* get_root_dir(S17FS_t *fs);
@@ -92,6 +275,24 @@ inode_t* get_inode(S17FS_t *fs, const inode_ptr_t inode_number);
 bool write_inode(S17FS_t *fs, const void *data, const inode_ptr_t inode_number);
 bool write_root_inode(S17FS_t *fs, const void *data, const inode_ptr_t inode_number);
 bool write_S17FS_to_block_store(S17FS_t *fs);
-S17FS_t *ready_file(const char *path, const bool format);
+block_ptr_t get_file_block(S17FS_t *fs, inode_t *inode, file_map_t *map, const size_t file_block, const bool allocate);
+size_t map_file_range(S17FS_t *fs, inode_t *inode, const size_t first, const size_t count);
+ssize_t view_file(S17FS_t *fs, inode_t *inode, dyn_array_t *spans, const size_t nbyte, const size_t offset);
+size_t iov_total(const struct iovec *iov, const int iovcnt);
+ssize_t read_file_vec(S17FS_t *fs, inode_t *inode, const struct iovec *iov, const int iovcnt, const size_t offset);
+ssize_t read_file(S17FS_t *fs, inode_t *inode, void *dst, const size_t nbyte, const size_t offset);
+ssize_t write_file_vec(S17FS_t *fs, inode_t *inode, const struct iovec *iov, const int iovcnt, const size_t offset);
+ssize_t write_file(S17FS_t *fs, inode_t *inode, const void *src, const size_t nbyte, const size_t offset);
+void readahead(S17FS_t *fs, const int fd, inode_t *inode, const size_t offset, const size_t nbyte);
+bool pack_tail(S17FS_t *fs, const inode_ptr_t inode_number);
+bool preallocate_file(S17FS_t *fs, inode_t *inode, const size_t offset, const size_t length);
+bool flush_write_buffer(S17FS_t *fs, const int fd);
+bool flush_inode_write_buffers(S17FS_t *fs, const inode_ptr_t inode_number, const int skip_fd);
+ssize_t write_buffered(S17FS_t *fs, const int fd, const void *src, const size_t nbyte);
+block_store_t *open_block_store(const char *path, const bool format, const fs_backend_t backend, const superblock_t *superblock);
+bool read_superblock(const char *path, superblock_t *superblock);
+bool default_superblock(superblock_t *superblock, const fs_format_opts_t *opts);
+S17FS_t *ready_file(const char *path, const bool format, const fs_backend_t backend, const superblock_t *superblock);
+S17FS_t *ready_volume(block_store_t *bs, const char *origin, const bool format, const superblock_t *superblock);
 
 #endif
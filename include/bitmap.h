@@ -66,6 +66,22 @@ size_t bitmap_ffs(const bitmap_t *const bitmap);
 ///
 size_t bitmap_ffz(const bitmap_t *const bitmap);
 
+///
+/// Find first zero at or after a given bit
+/// \param bitmap The bitmap
+/// \param start The first bit to look at
+/// \return The first zero bit address from start on, SIZE_MAX on error/not found
+///
+size_t bitmap_ffz_from(const bitmap_t *const bitmap, const size_t start);
+
+///
+/// Find first set at or after a given bit
+/// \param bitmap The bitmap
+/// \param start The first bit to look at
+/// \return The first one bit address from start on, SIZE_MAX on error/not found
+///
+size_t bitmap_ffs_from(const bitmap_t *const bitmap, const size_t start);
+
 ///
 /// Count all bits set
 /// \param bitmap the bitmap
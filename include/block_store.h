@@ -36,6 +36,85 @@ block_store_t *block_store_create(const char *const fname);
 ///// \return a pointer to the new object, NULL on error
 /////
 block_store_t *block_store_open(const char *const fname);
+
+///
+/// Creates a new back_store file like block_store_create, but instead of mapping
+///  it, blocks go through an in-process cache filled and written back with io_uring
+///  (or pread/pwrite where io_uring isn't available). Blocks can't be reached in place
+/// \param fname the file to create
+/// \return a pointer to the new object, NULL on error
+///
+block_store_t *block_store_create_uring(const char *const fname);
+
+///
+/// Opens the specified back_store file like block_store_open, through the io_uring cache
+/// \param fname the file to open
+/// \return a pointer to the new object, NULL on error
+///
+block_store_t *block_store_open_uring(const char *const fname);
+
+///
+/// Creates a new back_store file like block_store_create, but reaches it with
+///  plain pread/pwrite instead of mapping it. Blocks can't be reached in place
+/// \param fname the file to create
+/// \return a pointer to the new object, NULL on error
+///
+block_store_t *block_store_create_file(const char *const fname);
+
+///
+/// Opens the specified back_store file like block_store_open, with pread/pwrite
+/// \param fname the file to open
+/// \return a pointer to the new object, NULL on error
+///
+block_store_t *block_store_open_file(const char *const fname);
+
+///
+/// Creates a new BS device in anonymous memory, with no file behind it
+///  Everything on it is gone once it's destroyed, unless it's serialized first
+/// \param huge_pages true to back it with huge pages, reserved ones if there are any,
+///  transparent ones otherwise
+/// \return a pointer to the new object, NULL on error
+///
+block_store_t *block_store_create_memory(const bool huge_pages);
+
+///
+/// Creates a new BS device in anonymous memory like block_store_create_memory, but with its own geometry
+///  It can't grow, there's no file to extend
+/// \param block_size Bytes per block, a power of two from 512 to 65536
+/// \param block_count Blocks in the device, free block map included
+/// \param huge_pages true to back it with huge pages, as for block_store_create_memory
+/// \return a pointer to the new object, NULL on error
+///
+block_store_t *block_store_create_memory_ex(const size_t block_size, const size_t block_count, const bool huge_pages);
+
+// The ways a device can reach its file, for block_store_create_ex and block_store_open_ex
+typedef enum { BLOCK_STORE_MAPPED, BLOCK_STORE_URING, BLOCK_STORE_FILE } block_store_device_t;
+
+///
+/// Creates a new back_store file like the other create functions, but with its own geometry
+///  The free block map takes whole blocks off the end, so fewer than block_count are addressable
+/// \param fname the file to create
+/// \param device How to reach the file
+/// \param block_size Bytes per block, a power of two from 512 to 65536
+/// \param block_count Blocks in the file, free block map included
+/// \param block_limit Most blocks block_store_grow can take it to, 0 if it never grows
+/// \return a pointer to the new object, NULL on error
+///
+block_store_t *block_store_create_ex(const char *const fname, const block_store_device_t device,
+                                     const size_t block_size, const size_t block_count, const size_t block_limit);
+
+///
+/// Opens the specified back_store file, which has to have the given geometry
+/// \param fname the file to open
+/// \param device How to reach the file
+/// \param block_size Bytes per block it was created with
+/// \param block_count Blocks it has now
+/// \param block_limit Most blocks block_store_grow can take it to, 0 if it never grows
+/// \return a pointer to the new object, NULL on error
+///
+block_store_t *block_store_open_ex(const char *const fname, const block_store_device_t device,
+                                   const size_t block_size, const size_t block_count, const size_t block_limit);
+
 ///
 /// Destroys the provided block storage device
 /// This is an idempotent operation, so there is no return value
@@ -43,6 +122,28 @@ block_store_t *block_store_open(const char *const fname);
 ///
 void block_store_destroy(block_store_t *const bs);
 
+///
+/// Writes everything the device holds back to where it's kept, and waits for it to get there
+///  Mapped devices only write the pages changed since the last sync, neighbouring ones together
+///  Memory devices have nowhere to write to and always succeed
+/// \param bs BS device
+/// \return boolean indicating success of operation
+///
+bool block_store_sync(block_store_t *const bs);
+
+///
+/// Makes the file longer and moves the free block map to the new end, the blocks the old one
+///  took up are free afterwards, and everything else stays where it was
+///  Mapped devices grow into address space set aside when they were made, so pointers from
+///  block_store_get_ptr stay good
+///  Nothing may be allocating, releasing or syncing while it happens
+///  Memory devices, and devices made without a block_limit, can't grow
+/// \param bs BS device
+/// \param block_count Blocks in the file afterwards, free block map included, at most block_limit
+/// \return boolean indicating success of operation
+///
+bool block_store_grow(block_store_t *const bs, const size_t block_count);
+
 ///
 /// Searches for a free block, marks it as in use, and returns the block's id
 /// \param bs BS device
@@ -50,6 +151,14 @@ void block_store_destroy(block_store_t *const bs);
 ///
 size_t block_store_allocate(block_store_t *const bs);
 
+///
+/// Searches for a run of free blocks, first fit, marks them all as in use, and returns the first one's id
+/// \param bs BS device
+/// \param count Length of the run
+/// \return First block of the run, SIZE_MAX on error or when no free run is that long
+///
+size_t block_store_allocate_run(block_store_t *const bs, const size_t count);
+
 ///
 /// Attempts to allocate the requested block id
 /// \param bs the block store object
@@ -65,6 +174,16 @@ bool block_store_request(block_store_t *const bs, const size_t block_id);
 ///
 void block_store_release(block_store_t *const bs, const size_t block_id);
 
+///
+/// Gives the storage behind a run of free blocks back to the host, they read as zeros afterwards
+///  Only whole pages with every block free are given back, and only on devices that can do it
+///  Nothing may be reading or writing the free blocks while it happens
+/// \param bs BS device
+/// \param block_id First block of the run
+/// \param count Number of blocks in the run
+///
+void block_store_discard(block_store_t *const bs, const size_t block_id, const size_t count);
+
 ///
 /// Counts the number of blocks marked as in use
 /// \param bs BS device
@@ -82,10 +201,25 @@ size_t block_store_get_free_blocks(const block_store_t *const bs);
 ///
 /// Returns the total number of user-addressable blocks
 ///  (since this is constant, you don't even need the bs object)
+///  Only true of devices with the default geometry, see block_store_get_capacity
 /// \return Total blocks
 ///
 size_t block_store_get_total_blocks();
 
+///
+/// Returns the number of user-addressable blocks on this device
+/// \param bs BS device
+/// \return Total blocks, 0 on error
+///
+size_t block_store_get_capacity(const block_store_t *const bs);
+
+///
+/// Returns the size of one block on this device
+/// \param bs BS device
+/// \return Bytes per block, 0 on error
+///
+size_t block_store_get_block_size(const block_store_t *const bs);
+
 ///
 /// Reads data from the specified block and writes it to the designated buffer
 /// \param bs BS device
@@ -104,6 +238,53 @@ size_t block_store_read(const block_store_t *const bs, const size_t block_id, vo
 ///
 size_t block_store_write(block_store_t *const bs, const size_t block_id, const void *buffer);
 
+///
+/// Reads a run of consecutive blocks into the designated buffer
+/// \param bs BS device
+/// \param block_id First block of the run
+/// \param count Number of blocks in the run
+/// \param buffer Data buffer to write to, count blocks long
+/// \return Number of bytes read, 0 on error
+///
+size_t block_store_read_blocks(const block_store_t *const bs, const size_t block_id, const size_t count, void *buffer);
+
+///
+/// Writes a run of consecutive blocks from the designated buffer
+/// \param bs BS device
+/// \param block_id First block of the run
+/// \param count Number of blocks in the run
+/// \param buffer Data buffer to read from, count blocks long
+/// \return Number of bytes written, 0 on error
+///
+size_t block_store_write_blocks(block_store_t *const bs, const size_t block_id, const size_t count, const void *buffer);
+
+///
+/// Gets a pointer straight into the storage for the specified block
+///  The pointer stays valid until the device is destroyed, but the contents
+///  change with any write to (or reuse of) the block
+///  Only mapped devices have one, the io_uring backed ones always give NULL
+/// \param bs BS device
+/// \param block_id The block to look up
+/// \return Pointer to the start of the block, NULL on error
+///
+const void *block_store_get_ptr(const block_store_t *const bs, const size_t block_id);
+
+///
+/// Tells whether the blocks can be reached in place through block_store_get_ptr
+/// \param bs BS device
+/// \return true if the image is mapped
+///
+bool block_store_is_mapped(const block_store_t *const bs);
+
+///
+/// Hints that the given range of blocks will be read soon so the pages can be
+///  brought in ahead of time. Purely advisory, the contents are not touched
+/// \param bs BS device
+/// \param block_id First block of the range
+/// \param count Number of blocks in the range
+///
+void block_store_prefetch(const block_store_t *const bs, const size_t block_id, const size_t count);
+
 ///
 /// Imports BS device from the given file - for grads/bonus
 /// \param filename The file to load
@@ -113,11 +294,14 @@ block_store_t *block_store_deserialize(const char *const filename);
 
 ///
 /// Writes the entirety of the BS device to file, overwriting it if it exists - for grads/bonus
+///  The file is laid out like any other back_store file, so block_store_open can open it
+///  Given the device's own file, it's just synced
+///  The device isn't locked while it's read, so it shouldn't be changing
 /// \param bs BS device
 /// \param filename The file to write to
 /// \return Number of bytes written, 0 on error
 ///
-size_t block_store_serialize(const block_store_t *const bs, const char *const filename);
+size_t block_store_serialize(block_store_t *const bs, const char *const filename);
 
 
 #ifdef __cplusplus
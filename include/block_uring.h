@@ -0,0 +1,88 @@
+#ifndef BLOCK_URING_H__
+#define BLOCK_URING_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Block cache in front of an image file, filled and written back through io_uring
+//  Falls back to pread/pwrite when the kernel won't give us a ring
+typedef struct block_uring block_uring_t;
+
+///
+/// Sets up the cache and ring for the given file
+/// \param fd Open image file, still owned by the caller
+/// \param block_size Size of one block in bytes
+/// \return a pointer to the new object, NULL on error
+///
+block_uring_t *block_uring_create(const int fd, const size_t block_size);
+
+///
+/// Writes back anything dirty, then tears down the cache and ring
+///  The file descriptor is left open
+/// \param ring The object to destroy
+///
+void block_uring_destroy(block_uring_t *const ring);
+
+///
+/// Reads a run of consecutive blocks into the designated buffer
+///  Misses, and any prefetches still queued, go to the kernel in one submission
+/// \param ring The cache to read through
+/// \param block_id First block of the run
+/// \param count Number of blocks in the run
+/// \param buffer Data buffer to write to, count blocks long
+/// \return boolean indicating success of operation
+///
+bool block_uring_read(block_uring_t *const ring, const size_t block_id, const size_t count, void *buffer);
+
+///
+/// Writes a run of consecutive blocks from the designated buffer
+///  Short runs land in the cache and go out later, long ones go straight to the file
+/// \param ring The cache to write through
+/// \param block_id First block of the run
+/// \param count Number of blocks in the run
+/// \param buffer Data buffer to read from, count blocks long
+/// \return boolean indicating success of operation
+///
+bool block_uring_write(block_uring_t *const ring, const size_t block_id, const size_t count, const void *buffer);
+
+///
+/// Queues reads of the given range so the next read submits them along with its own
+///  Purely advisory, blocks that would push out dirty or queued ones are skipped
+/// \param ring The cache to fill
+/// \param block_id First block of the range
+/// \param count Number of blocks in the range
+///
+void block_uring_prefetch(block_uring_t *const ring, const size_t block_id, const size_t count);
+
+///
+/// Drops any cached copies of the given range, dirty ones included, without writing them back
+///  For blocks that were just freed, so nothing is lost
+/// \param ring The cache to drop them from
+/// \param block_id First block of the range
+/// \param count Number of blocks in the range
+///
+void block_uring_forget(block_uring_t *const ring, const size_t block_id, const size_t count);
+
+///
+/// Writes every dirty cached block back to the file
+/// \param ring The cache to flush
+/// \return boolean indicating success of operation
+///
+bool block_uring_flush(block_uring_t *const ring);
+
+///
+/// Tells whether I/O goes through io_uring, or the pread/pwrite fallback
+/// \param ring The object to query
+/// \return true when a ring is in use
+///
+bool block_uring_active(const block_uring_t *const ring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
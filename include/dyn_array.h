@@ -184,6 +184,18 @@ bool dyn_array_erase(dyn_array_t *const dyn_array, const size_t index);
 ///
 bool dyn_array_extract(dyn_array_t *const dyn_array, const size_t index, void *const object);
 
+///
+/// Removes a run of objects starting at the given index and places them at the desired location,
+/// moving the rest of the contents up once for the whole run
+/// Does not destruct the objects since they are returned to the user
+/// \param dyn_array the dynamic array
+/// \param index the index of the first object to extract
+/// \param count the number of objects to extract
+/// \param object destination for extracted objects, count objects long
+/// \return bool representing success of the operation
+///
+bool dyn_array_extract_range(dyn_array_t *const dyn_array, const size_t index, const size_t count, void *const object);
+
 
 ///
 /// Removes and optionally destructs all array elements
@@ -0,0 +1,156 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#ifdef __cplusplus
+  extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "block_store.h"
+
+#define JOURNAL_BLOCKS_MIN 6  // Two halves, each with room for a descriptor, an image and a commit block
+
+// Write-ahead log of whole metadata blocks, kept in a fixed run of blocks on the device
+//  Changed blocks are held in memory and only go home once the transaction they're in is durable
+//  in the log, so a crash finds every block as some commit left it
+//  Updates run inside handles, and every handle open on a transaction finishes before it's
+//  committed, so a committed transaction never holds half an update
+//  A commit takes everything written since the last one, however many updates that was, and
+//  waits on the device once
+typedef struct journal journal_t;
+
+// Called right before a transaction is taken, with every handle closed, to push out
+// anything that only lives in memory so far
+typedef void (*journal_prepare_t)(void *arg);
+
+// Makes everything written to the device durable, the journal included
+typedef bool (*journal_sync_t)(void *arg);
+
+// Hands back blocks given up in a transaction, once it's committed and nothing can replay over them
+//  The list is the callee's to reorder, it's freed once the call returns
+typedef void (*journal_release_t)(void *arg, size_t *blocks, const size_t count);
+
+///
+/// Clears a journal area so the next mount finds nothing to replay
+/// \param bs Device holding the journal
+/// \param start First block of the journal area
+/// \param blocks Length of the journal area, in blocks, at least JOURNAL_BLOCKS_MIN
+/// \param block_size Size of one block in bytes
+/// \return bool representing success of operation
+///
+bool journal_format(block_store_t *const bs, const size_t start, const size_t blocks, const size_t block_size);
+
+///
+/// Writes the committed transactions found in the journal area back to where their blocks live,
+///  oldest first, then clears the area, transactions that never finished committing are ignored
+/// \param bs Device holding the journal
+/// \param start First block of the journal area
+/// \param blocks Length of the journal area, in blocks
+/// \param block_size Size of one block in bytes
+/// \return 1 if a transaction was replayed, 0 if there was none, -1 on error
+///
+int journal_replay(block_store_t *const bs, const size_t start, const size_t blocks, const size_t block_size);
+
+///
+/// Starts logging metadata updates to a journal area
+/// \param bs Device holding the journal
+/// \param start First block of the journal area
+/// \param blocks Length of the journal area, in blocks
+/// \param block_size Size of one block in bytes
+/// \param prepare Run before each transaction is taken, may be NULL
+/// \param sync Makes the device durable, once per commit
+/// \param release Gets the blocks given up in each committed transaction
+/// \param arg Handed to prepare, sync and release
+/// \return new journal pointer, NULL on error
+///
+journal_t *journal_create(block_store_t *const bs, const size_t start, const size_t blocks, const size_t block_size,
+                          const journal_prepare_t prepare, const journal_sync_t sync, const journal_release_t release,
+                          void *arg);
+
+///
+/// Clears the journal area and frees the journal, anything not committed yet is lost
+/// \param journal The journal to destroy
+///
+void journal_destroy(journal_t *const journal);
+
+///
+/// Opens a handle, an update made inside one goes into a single transaction
+///   Handles nest on the same thread, and have to be opened before taking any lock a
+///   commit's prepare step might need
+/// \param journal The journal to log to, NULL does nothing
+///
+void journal_begin(journal_t *const journal);
+
+///
+/// Closes a handle, committing right away if the transaction is getting too big for half the journal
+/// \param journal The journal the handle was opened on, NULL does nothing
+///
+void journal_end(journal_t *const journal);
+
+///
+/// Puts a new copy of a whole block in the running transaction, it goes home after the transaction commits
+/// \param journal The journal to log to
+/// \param block_id The block that changed
+/// \param data Its new contents, a block long
+/// \return bool representing success of operation
+///
+bool journal_write(journal_t *const journal, const size_t block_id, const void *data);
+
+///
+/// Copies part of the newest copy of a block the journal holds
+/// \param journal The journal to look in
+/// \param block_id The block to read
+/// \param offset Where in the block to start
+/// \param length Bytes to copy
+/// \param buffer Where they go
+/// \return true if the journal holds the block, false if the device has the newest copy
+///
+bool journal_read(journal_t *const journal, const size_t block_id, const size_t offset, const size_t length, void *buffer);
+
+///
+/// Points at the newest copy of a block the journal holds, good until the next write of the block,
+///  or until the last pin is dropped once it's gone home
+/// \param journal The journal to look in
+/// \param block_id The block to view
+/// \return The copy, NULL if the device has the newest one
+///
+const void *journal_view(journal_t *const journal, const size_t block_id);
+
+///
+/// Keeps copies the journal lets go of around, for views that could still be pointing at them
+/// \param journal The journal to pin, NULL does nothing
+///
+void journal_pin(journal_t *const journal);
+
+///
+/// Drops a pin, the copies kept for it are freed with the last one
+/// \param journal The journal to unpin, NULL does nothing
+///
+void journal_unpin(journal_t *const journal);
+
+///
+/// Gives up a block in the running transaction, it's handed to release once the transaction commits
+///  and whatever the transaction held of it never goes home
+/// \param journal The journal to log to
+/// \param block_id The block given up
+/// \return bool representing success of operation
+///
+bool journal_free(journal_t *const journal, const size_t block_id);
+
+///
+/// Commits everything written so far and waits for it to be durable, then sends it home
+///   Callers arriving while a commit is being written wait for it and share the next one
+///   A transaction too big for the whole journal goes home anyway but isn't atomic, and fails
+///   A failed commit nobody was waiting on, one a handle closing started, fails the next call too
+/// \param journal The journal to commit
+/// \return bool representing success of operation
+///
+bool journal_commit(journal_t *const journal);
+
+#ifdef __cplusplus
+  }
+#endif
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#ifdef __cplusplus
+  extern "C" {
+#endif
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct worker_pool worker_pool_t;
+
+// A job gets handed the argument it was queued with
+typedef void (*worker_job_t)(void *arg);
+
+///
+/// Starts a pool of worker threads sharing one FIFO job queue
+/// \param threads Number of worker threads to start (at least 1)
+/// \return new worker pool pointer, NULL on error
+///
+worker_pool_t *worker_pool_create(const size_t threads);
+
+///
+/// Finishes every queued job, then stops and joins the workers and frees the pool
+/// \param pool The pool to destroy
+///
+void worker_pool_destroy(worker_pool_t *const pool);
+
+///
+/// Number of worker threads in the pool
+/// \param pool The pool to query
+/// \return worker count, 0 on error
+///
+size_t worker_pool_threads(const worker_pool_t *const pool);
+
+///
+/// Queues a job to run on some worker, and returns without waiting for it
+/// \param pool The pool to run the job on
+/// \param job The job to run
+/// \param arg Argument passed to the job
+/// \return bool representing success of operation
+///
+bool worker_pool_submit(worker_pool_t *const pool, const worker_job_t job, void *arg);
+
+///
+/// Runs a job once for each element of an argument array and waits for all of them
+///   The calling thread runs jobs from the batch too, so it's safe to call from a job
+/// \param pool The pool to run the jobs on
+/// \param job The job to run
+/// \param args Array of count arguments, each arg_size bytes, the job gets a pointer to its element
+/// \param count Number of elements in args
+/// \param arg_size Size of each element in bytes
+/// \return bool representing success of operation (the jobs ran to completion)
+///
+bool worker_pool_run(worker_pool_t *const pool, const worker_job_t job, void *args, const size_t count,
+                     const size_t arg_size);
+
+#ifdef __cplusplus
+  }
+#endif
+
+#endif
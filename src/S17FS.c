@@ -1,5 +1,6 @@
 /***************Includes***************/
 
+#include <limits.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
@@ -22,10 +23,6 @@
 #define FS_NUM_DIR_PTRS 5
 #define FS_NUM_INDIR_PTRS 2
 
-/***************Global Variables***************/
-
-int overhead = 0;
-
 /***************Functions***************/
 
 S17FS_t *fs_format(const char *path)
@@ -40,7 +37,7 @@ S17FS_t *fs_format(const char *path)
     } //End else if(path[0] == '\0')
     else
     {
-        return ready_file(path, true);
+        return ready_file(path, true, FS_BACKEND_MMAP, NULL);
     } //End else
 
 } //End S17FS_t *fs_format(const char *path)
@@ -59,354 +56,291 @@ S17FS_t *fs_mount(const char *path)
     } //End else if(path[0] == '\0')
     else
     {
-        return ready_file(path, false);
+        return ready_file(path, false, FS_BACKEND_MMAP, NULL);
     } //End else
 
 } //End S17FS_t *fs_mount(const char *path)
 
 /***************************************************/
 
-int fs_unmount(S17FS_t *fs)
+S17FS_t *fs_format_backend(const char *path, fs_backend_t backend)
 {
-    if (fs)
+    if (path == NULL || path[0] == '\0' || (backend != FS_BACKEND_MMAP && backend != FS_BACKEND_URING && backend != FS_BACKEND_FILE))
     {
-        write_S17FS_to_block_store(fs);
-        //block_store_serialize(fs->bs, fs->origin);
+        return NULL;
+    } //End 
 
-        block_store_destroy(fs->bs);
-        bitmap_destroy(fs->fd_table.fd_status);
-        bitmap_destroy(fs->inode_bitmap);
-        free(fs->origin);
-        free(fs);
-        return 0;
-    } //End if (fs)
-    else
+    return ready_file(path, true, backend, NULL);
+} //End 
+
+/***************************************************/
+
+S17FS_t *fs_mount_backend(const char *path, fs_backend_t backend)
+{
+    if (path == NULL || path[0] == '\0' || (backend != FS_BACKEND_MMAP && backend != FS_BACKEND_URING && backend != FS_BACKEND_FILE))
     {
-        return -1;
-    } //End else
+        return NULL;
+    } //End 
 
-} //End int fs_unmount(S17FS_t *fs)
+    return ready_file(path, false, backend, NULL);
+} //End 
 
 /***************************************************/
 
-int fs_create(S17FS_t *fs, const char *path, file_t type)
+S17FS_t *fs_format_memory(bool huge_pages)
 {
-    //printf("----------------------------------------------\n"); 
-    //printf("Path: %s\n", path);
+    return fs_format_memory_ex(NULL, huge_pages);
+} //End 
 
-    //Check that the parameters are valid
-    if (fs == NULL || path == NULL  || (strcmp(path, "") == 0) || (type != FS_REGULAR && type != FS_DIRECTORY) || strlen(path) >= FS_NAME_MAX || path[0] != '/' || path[strlen(path)-1] == '/')
+/***************************************************/
+
+S17FS_t *fs_format_memory_ex(const fs_format_opts_t *opts, bool huge_pages)
+{
+    superblock_t superblock;
+    if ((opts && opts->block_limit) || !default_superblock(&superblock, opts))
     {
-        return -1;
-    } //End if (fs == NULL || path == NULL  || (strcmp(path, "") == 0) || (type != FS_REGULAR && type != FS_DIRECTORY) || strlen(path) >= FS_NAME_MAX || path[0] != '/' || path[strlen(path)-1] == '/')
+        return NULL;
+    } //End 
 
-    //Get the root directory
-    inode_t* root = get_root_dir(fs);
-    //printf("\nroot->data_ptrs[0] == %u", root->data_ptrs[0]);
+    return ready_volume(block_store_create_memory_ex(superblock.block_size, superblock.block_count, huge_pages), NULL, true, &superblock);
+} //End 
 
-    if (root == NULL || (root->data_ptrs[0] <= 32 && root->data_ptrs[0] > 0))
-    {
-        //printf("\nroot == %p", root);
-        //printf("\nroot->data_ptrs[0] == %u", root->data_ptrs[0]);
-        //printf("\nReturn 1\n");
-        free(root);
-        return -1;
-    } //End if (root == NULL || (root->data_ptrs[0] <= 32 && root->data_ptrs[0] > 0))
+/***************************************************/
+
+S17FS_t *fs_format_journaled(const char *path, fs_backend_t backend)
+{
+    fs_format_opts_t opts = {.backend = backend, .journal_blocks = JOURNAL_BLOCKS};
+    return fs_format_ex(path, &opts);
+} //End 
 
+/***************************************************/
 
-    //Get the contents of the root directory
-    void* dir_contents = get_dir_contents(fs, root->data_ptrs[0]);
-    if (dir_contents == NULL)
+S17FS_t *fs_format_ex(const char *path, const fs_format_opts_t *opts)
+{
+    fs_backend_t backend = opts ? opts->backend : FS_BACKEND_MMAP;
+    superblock_t superblock;
+    if (path == NULL || path[0] == '\0' || (backend != FS_BACKEND_MMAP && backend != FS_BACKEND_URING && backend != FS_BACKEND_FILE)
+        || !default_superblock(&superblock, opts))
     {
-        //printf("\nReturn 2\n");
-        free(root);
-        return -1;
-    } //End if (dir_contents == NULL)
+        return NULL;
+    } //End 
+
+    return ready_file(path, true, backend, &superblock);
+} //End 
 
-    //Determine how long the path is
-    int path_depth = 0;
-    for (size_t i = 0; i < strlen(path); i++)
+/***************************************************/
+
+//Buffered bytes and the inode bitmap only live in memory until they're pushed to the store
+static bool push_volume(S17FS_t *fs)
+{
+    bool written = true;
+    for (int fd = 0; fd < DESCRIPTOR_MAX; fd++)
     {
-        if (path[i] == '/')
+        if (fd_valid(fs, fd) && lock_descriptor(fs, fd, true))
         {
-            path_depth++;
-        } //End if (path[i] == '/')
-    } //End for (size_t i = 0; i < strlen(path); i++)
-    //printf("Path depth: %d", path_depth);
+            written = flush_write_buffer(fs, fd) && written;
+            unlock_descriptor(fs, fd);
+        } //End 
+    } //End 
+    return write_S17FS_to_block_store(fs) && written;
+} //End 
+
+/***************************************************/
 
-    //Tokenize the path and determine if the path exists
-    char* path_copy = (char *)malloc(sizeof(char)*64);
-    memcpy(path_copy, path, strlen(path)+1);
+int fs_serialize(S17FS_t *fs, const char *path)
+{
+    if (fs == NULL || path == NULL || path[0] == '\0')
+    {
+        return -1;
+    } //End 
 
-    char* token = NULL;
-    const char delims[2] = "/";
-    token = strtok(path_copy, delims);
+    bool written = push_volume(fs);
 
-    inode_t* cur_dir_inode = NULL;
-    if (path_depth == 1)
+    //The copy gets the journal too, what it would replay has to match what's home
+    if (fs->journal)
     {
-        //printf("\n1: cur_dir_inode == root");
-        cur_dir_inode = root;
-    } //End if (path_depth == 1)
+        written = journal_commit(fs->journal) && written;
+    } //End 
+
+    //The free block map can't change halfway through being copied out
+    pthread_mutex_lock(&fs->alloc_lock);
+    written = written && block_store_serialize(fs->bs, path) != 0;
+    pthread_mutex_unlock(&fs->alloc_lock);
 
-    int cur_depth = 1;
-    int next_rec_found = 0;
-    int j = 0;
+    return written ? 0 : -1;
+} //End 
 
-    //printf("\n");
-    //printf("1:Dir: %s \n",((file_record_t *)dir_contents)[j].name);
+/***************************************************/
 
-    while (token != NULL && path_depth > 1)
+int fs_unmount(S17FS_t *fs)
+{
+    if (fs)
     {
-        //printf("/%s", token);
-        if(cur_depth == path_depth)
+        //Let queued ops finish before anything they touch goes away, unreaped completions are dropped
+        pthread_mutex_lock(&fs->async_lock);
+        while (fs->async_running)
         {
-            //Found where the new record should go
-            break;
-        } //End if(cur_depth == path_depth)
-
-        next_rec_found = 0;
+            pthread_cond_wait(&fs->async_done, &fs->async_lock);
+        } //End 
+        pthread_mutex_unlock(&fs->async_lock);
 
-        //Compare the path with the contents of the current directory
-        for (j = 0; j < DIR_REC_MAX; j++)
+        //Push out anything still sitting in descriptor write buffers
+        for (int fd = 0; fd < DESCRIPTOR_MAX; fd++)
         {
-            if (strcmp(((file_record_t *)dir_contents)[j].name, token) == 0 && ((file_record_t *)dir_contents)[j].type == FS_DIRECTORY)
+            if (fd_valid(fs, fd))
             {
-                //The current path was found
-                //printf("I happened!\n");
-                next_rec_found = 1;
+                flush_write_buffer(fs, fd);
+            } //End 
+            free(fs->fd_table.fd_wbuf[fd]);
+        } //End 
 
-                //Get the data blocks of the next part of the path
-                free(cur_dir_inode);
-                cur_dir_inode = get_dir(fs, ((file_record_t *)dir_contents)[j].inode_num);
+        write_S17FS_to_block_store(fs);
+        //block_store_serialize(fs->bs, fs->origin);
 
-                if (cur_dir_inode == NULL || (cur_dir_inode->data_ptrs[0] <= 32 && cur_dir_inode->data_ptrs[0] > 0))
-                {
-                    //printf("\nReturn 4: cur_dir-inode->data_ptrs[0] = %u\n", cur_dir_inode->data_ptrs[0]);
-                    free(root);
-                    free(dir_contents);
-                    free(path_copy);
-                    free(cur_dir_inode);
-                    return -1;
-                } //End if (cur_dir_inode == NULL || (cur_dir_inode->data_ptrs[0] <= 32 && cur_dir_inode->data_ptrs[0] > 0))
-
-                if (block_store_read(fs->bs, cur_dir_inode->data_ptrs[0], dir_contents) <= 0)
-                {
-                    //printf("\nReturn 5\n");
-                    free(root);
-                    free(dir_contents);
-                    free(path_copy);
-                    free(cur_dir_inode);
-                    return -1;
-                } //End if (block_store_read(fs->bs, cur_dir_inode->data_ptrs[0], dir_contents) <= 0)
-            } //End if (strcmp(((file_record_t *)dir_contents)[j].name, token) == 0 && ((file_record_t *)dir_contents)[j].type == FS_DIRECTORY)
-        } //End for (j = 0; j < DIR_REC_MAX; j++)
-
-        if (next_rec_found == 0)
+        //The last transaction goes home, then there's nothing left for a mount to replay
+        if (fs->journal)
         {
-            //printf("\nReturn 6\n");
-            //Directory wasn't found
-            free(root);
-            free(dir_contents);
-            free(path_copy);
-            free(cur_dir_inode);
-            return -1;
-        } //End if (next_rec_found == 0)
+            journal_commit(fs->journal);
+            journal_destroy(fs->journal);
+        } //End 
+
+        block_store_destroy(fs->bs);
+        bitmap_destroy(fs->fd_table.fd_status);
+        bitmap_destroy(fs->inode_bitmap);
+        destroy_S17FS_locks(fs);
+        free(fs->origin);
+        free(fs);
+        return 0;
+    } //End if (fs)
+    else
+    {
+        return -1;
+    } //End else
+
+} //End int fs_unmount(S17FS_t *fs)
 
-        token = strtok(NULL, delims);
-        cur_depth++;
+/***************************************************/
+
+static int create_file(S17FS_t *fs, const char *path, file_t type)
+{
+    //Check that the parameters are valid
+    if (fs == NULL || path == NULL  || (strcmp(path, "") == 0) || (type != FS_REGULAR && type != FS_DIRECTORY) || strlen(path) >= FS_NAME_MAX || path[0] != '/' || path[strlen(path)-1] == '/')
+    {
+        return -1;
+    } //End if (fs == NULL || path == NULL  || (strcmp(path, "") == 0) || (type != FS_REGULAR && type != FS_DIRECTORY) || strlen(path) >= FS_NAME_MAX || path[0] != '/' || path[strlen(path)-1] == '/')
+
+    //The new record goes in the directory named by everything before the last slash,
+    //which stays locked exclusively until the record is in place
+    const char *name = strrchr(path, '/') + 1;
+    inode_t dir_inode;
+    dir_block_t dir_contents;
+    if (!lookup_dir(fs, path, name - path, true, &dir_inode, &dir_contents))
+    {
+        return -1;
     } //End 
-    //printf("\n");
-    //printf("2:Dir: %s\n",((file_record_t *)dir_contents)[j].name);
+    inode_ptr_t dir_inode_num = dir_inode.mdata.self_inode_num;
 
-    //printf("\nDir: ");
-    //Check if the record already exists in the target directory
-    for (int i = 0; i < DIR_REC_MAX; i++)
+    //Check if the record already exists in the target directory, and find a free slot for it
+    int slot = -1;
+    for (size_t i = 0; i < fs->geo.dir_records; i++)
     {
-        //printf("%s - ", ((file_record_t *)dir_contents)[i].name);
-        if (strcmp(((file_record_t *)dir_contents)[i].name, token) == 0)
+        if (strcmp(dir_contents.records[i].name, name) == 0)
         {
-            //printf("\nReturn 7\n");
             //Record already exists in the target directory
-            free(root);
-            free(dir_contents);
-            free(path_copy);
-            if (path_depth > 1)
-            {
-                free(cur_dir_inode);
-            } //End if (path_depth > 1)
+            unlock_inode(fs, dir_inode_num);
             return -1;
-        } //End if (strcmp(((file_record_t *)dir_contents)[i].name, token) == 0)
-    } //End for (int i = 0; i < DIR_REC_MAX; i++)
-    //printf("\n3:Dir: %s ",((file_record_t *)dir_contents)[j].name);
+        } //End if (strcmp(dir_contents.records[i].name, name) == 0)
 
-    //printf("\nAfter checking for duplicates, token = %s\n", token);
+        if (slot < 0 && dir_contents.records[i].name[0] == '\0')
+        {
+            slot = i;
+        } //End 
+    } //End for (size_t i = 0; i < fs->geo.dir_records; i++)
 
     //Found the target directory, and the record doesn't already exist, awesome
     //Get and check for a new inode number
-    size_t new_inode_num = bitmap_ffz(fs->inode_bitmap);
-    //printf("new_inode_num == %zu\n", new_inode_num);
-    if (new_inode_num > 255)
-    {
-        free(root);
-        free(dir_contents);
-        free(path_copy);
-        if (path_depth > 1)
-        {
-            free(cur_dir_inode);
-        } //End if (path_depth > 1)
+    size_t new_inode_num = allocate_inode_number(fs);
+    if (new_inode_num == SIZE_MAX)
+    {
+        unlock_inode(fs, dir_inode_num);
         return -1;
-    } //End if (new_inode_num > 255)
-    //printf("\n\nNew inum: %zu", new_inode_num);
-    //printf("\ndir_contents.inode_num == %u\n", ((file_record_t *)dir_contents)[j].inode_num);
+    } //End if (new_inode_num == SIZE_MAX)
 
     //Create a new inode for the new record
     uint32_t right_now = time(NULL);
+    uint8_t flags = type == FS_REGULAR && fs->geo.inline_max ? INODE_INLINE : 0;
     inode_t new_inode = {
-        {0, 0, new_inode_num, right_now, right_now, ((file_record_t *)dir_contents)[j].inode_num, type, {0}},
-        {0, 0, 0, 0, 0, 0, 0, 0}};
+        {0, 0, new_inode_num, right_now, right_now, (uint8_t) dir_inode_num, type, {0}, (uint8_t)(dir_inode_num >> 8), flags, {0}},
+        {0, 0, 0, 0, 0, 0, 0, 0}, {0}};
 
     //Find an empty data block for the new record if it is a directory
+    size_t new_data_block_num = SIZE_MAX;
     if (type == FS_DIRECTORY)
     {
-        //Get the new block number
-        size_t new_data_block_num = -1;
-        new_data_block_num = block_store_allocate(fs->bs);
-
-        //printf("Data block num: %zu\n", new_data_block_num);
-
-        if (new_data_block_num <= INODE_BLOCK_TOTAL || new_data_block_num == SIZE_MAX)
+        new_data_block_num = allocate_block(fs);
+        if (new_data_block_num < fs->geo.table_blocks || new_data_block_num == SIZE_MAX || !initialize_indirect_block(fs, new_data_block_num))
         {
-            //printf("\nReturn 8\nnew data block num = %zu\n", new_data_block_num);
             //Something went wrong allocating a new data block
-            free(root);
-            free(dir_contents);
-            free(path_copy);
-            if (path_depth > 1)
+            if (new_data_block_num != SIZE_MAX)
             {
-                free(cur_dir_inode);
-            } //End if (path_depth > 1)
+                release_block(fs, new_data_block_num);
+            } //End 
+            release_inode_number(fs, new_inode_num);
+            unlock_inode(fs, dir_inode_num);
             return -1;
-        } //End if (new_data_block_num <= INODES_BLOCK_TOTAL || new_data_block_num == SIZE_MAX)
+        } //End 
 
-        new_inode.data_ptrs[0] = new_data_block_num;
+        set_inode_ptr(&new_inode, 0, new_data_block_num);
     } //End if (type == FS_DIRECTORY)
 
     //Check if their is space for a new record
-    //printf("\tDir count = %u\n", cur_dir_inode->mdata.record_count);
-    if (cur_dir_inode->mdata.record_count < DIR_REC_MAX)
+    bool created = false;
+    if (slot >= 0 && dir_inode.mdata.record_count < fs->geo.dir_records)
     {
         //Yay, make the new records
         file_record_t new_record;
+        memset(&new_record, 0, sizeof(file_record_t));
         new_record.inode_num = new_inode_num;
         new_record.record_count = 0;
-        memcpy(&(new_record.name), token, strlen(token)+1);
+        memcpy(&(new_record.name), name, strlen(name)+1);
         new_record.type = type;
 
-        //printf("\nnew record: inum = %u - record count = %u - name = %s - type = %d\n", new_record.inode_num, new_record.record_count, new_record.name, new_record.type);
-        //printf("\ncur_dir_inode->record_count = %u\n", cur_dir_inode->mdata.record_count);
-        //printf("\nDir: %s record count before write: %u ",((file_record_t *)dir_contents)[j].name, cur_dir_inode->mdata.record_count);
-
-        //Write it back to the block_store
-        if (write_record(fs, &new_record, cur_dir_inode->data_ptrs[0], cur_dir_inode->mdata.record_count) == false)
-        {
-            //printf("\nReturn 9\n");
-            free(root);
-            free(dir_contents);
-            free(path_copy);
-            if (path_depth > 1)
-            {
-                free(cur_dir_inode);
-            } //End if (path_depth > 1)
-            return -1;
-        } //End if (write_record(fs, &new_record, cur_dir_inode->data_ptrs[0], cur_dir_inode->mdata.record_count) == false)
-
-        //printf("\nDir: %s record count before: %u ",((file_record_t *)dir_contents)[j].name, cur_dir_inode->mdata.record_count);
-        //Added a record
-        cur_dir_inode->mdata.record_count++;
-        //printf("after %u\n", cur_dir_inode->mdata.record_count);
-
-        //Are we in root?
-        if (path_depth == 1)
-        {
-            //printf("write_root_inode\n");
-            //We're in root
-            //Write back the root inode to the block_store
-            if (write_root_inode(fs, cur_dir_inode, cur_dir_inode->mdata.self_inode_num) == false)
-            {
-                //printf("\nReturn 10\n");
-                free(root);
-                free(dir_contents);
-                free(path_copy);
-                if (path_depth > 1)
-                {
-                    free(cur_dir_inode);
-                } //End if (path_depth > 1)
-                return -1;
-            } //End if (write_root_inode(fs, cur_dir_inode, cur_dir_inode->mdata.self_inode_num) == false)
-        } //End if (path_depth == 1)
-        else 
-        {
-            //printf("write_inode\n");
-            //Not in root
-            //Write the updated inode back to block_store
-            if (write_inode(fs, cur_dir_inode, cur_dir_inode->mdata.self_inode_num) == false)
-            {
-                //printf("\nReturn 11\n");
-                free(root);
-                free(dir_contents);
-                free(path_copy);
-                if (path_depth > 1)
-                {
-                    free(cur_dir_inode);
-                } //End if (path_depth > 1)
-                return -1;
-            } //End if (write_inode(fs, cur_dir_inode, cur_dir_inode->mdata.self_inode_num) == false)
-        } //End else
-
-        //Write the new inode back to the block_store
-        if (write_inode(fs, &new_inode, new_inode_num) == false)
+        //The inode goes out before the record that points at it, then the directory picks up the count
+        dir_inode.mdata.record_count++;
+        created = write_inode(fs, &new_inode, new_inode_num);
+        if (created)
         {
-            //printf("\nReturn 12\n");
-            free(root);
-            free(dir_contents);
-            free(path_copy);
-            if (path_depth > 1)
-            {
-                free(cur_dir_inode);
-            } //End 
-            return -1;
+            begin_dir_update(fs, dir_inode_num);
+            created = write_record(fs, &new_record, inode_ptr(&dir_inode, 0), slot) && write_inode(fs, &dir_inode, dir_inode_num);
+            end_dir_update(fs, dir_inode_num);
         } //End 
-
-        bitmap_set(fs->inode_bitmap, new_inode_num);
     } //End 
-    else
+
+    if (!created)
     {
-        //printf("\nReturn 13\n");
-        free(root);
-        free(dir_contents);
-        free(path_copy);
-        if (path_depth > 1)
+        if (new_data_block_num != SIZE_MAX)
         {
-            free(cur_dir_inode);
+            release_block(fs, new_data_block_num);
         } //End 
-        return -1;
-    } //End else
-
-    //printf("root->data_ptrs[0] == %u\n", root->data_ptrs[0]);
-
-    //Clean up everything, and return happily
-    free(root);
-    free(dir_contents);
-    free(path_copy);
-    if (path_depth > 1)
-    {
-        free(cur_dir_inode);
+        release_inode_number(fs, new_inode_num);
     } //End 
 
-    return 0;
+    unlock_inode(fs, dir_inode_num);
+    return created ? 0 : -1;
 } //End int fs_create(S17FS_t *fs, const char *path, file_t type)
 
+
+/***************************************************/
+
+int fs_create(S17FS_t *fs, const char *path, file_t type)
+{
+    //Every block the create touches lands in one transaction
+    journal_t *journal = fs ? fs->journal : NULL;
+    journal_begin(journal);
+    int result = create_file(fs, path, type);
+    journal_end(journal);
+    return result;
+} //End 
 /***************************************************/
 
 int fs_open(S17FS_t *fs, const char *path)
@@ -416,165 +350,58 @@ int fs_open(S17FS_t *fs, const char *path)
     {
         return -1;
     } //End
-    //printf("\nPath: %s\n", path);
-
-    //Get the root directory
-    inode_t* root = get_root_dir(fs);
-    //printf("\nroot->data_ptrs[0] == %u", root->data_ptrs[0]);
-
-    if (root == NULL || (root->data_ptrs[0] <= 32 && root->data_ptrs[0] > 0))
-    {
-        //printf("\nroot == %p", root);
-        //printf("\nroot->data_ptrs[0] == %u", root->data_ptrs[0]);
-        //printf("fs_open: Return 1\n");
-        free(root);
-        return -1;
-    } //End 
-
-    //Get the contents of the root directory
-    //void* dir_contents = (file_record_t *)malloc(sizeof(data_block_t));
-    file_record_t* dir_contents = get_dir_contents(fs, root->data_ptrs[0]);
-    if (dir_contents == NULL)
-    {
-        //printf("fs_open: Return 2\n");
-        free(root);
-        return -1;
-    } //End 
-
-    //Determine how long the path is
-    int path_depth = 0;
-    for (size_t i = 0; i < strlen(path); i++)
-    {
-        //printf("%c", path[i]);
-        if (path[i] == '/')
-        {
-            path_depth++;
-        } //End 
-    } //End 
-
-    //Tokenize the path and determine if the path exists
-    char* path_copy = (char *)malloc(sizeof(char)*64);
-    memcpy(path_copy, path, strlen(path)+1);
-
-    char* token = NULL;
-    const char delims[2] = "/";
-    token = strtok(path_copy, delims);
 
-    inode_t* cur_dir_inode = NULL;
-    if (path_depth == 1)
-    {
-        cur_dir_inode = root;
-    } //End 
+    const char *name = strrchr(path, '/') + 1;
+    inode_t dir_inode;
+    dir_block_t dir_contents;
+    int fd = -1;
+    size_t i = 0;
 
-    int cur_depth = 1;
-    int next_rec_found = 0;
-    int j = 0;
-
-    //printf("\n%s", token);
-    while (token != NULL && path_depth > 1)
+    //Try without locks first, the directory's version is checked again once the descriptor exists
+    //and a remove that got in between sends us round the locked way
+    uint32_t version;
+    if (peek_dir(fs, path, name - path, &dir_inode, &dir_contents, &version))
     {
-        //printf("/%s", token);
-        if(cur_depth == path_depth)
-        {
-            //Found where the new record should go
-            break;
-        } //End 
-
-        next_rec_found = 0;
-
-        for (j = 0; j < DIR_REC_MAX; j++)
+        for (i = 0; i < fs->geo.dir_records; i++)
         {
-            if (strcmp(dir_contents[j].name, token) == 0 && dir_contents[j].type == FS_DIRECTORY)
+            if (strcmp(dir_contents.records[i].name, name) == 0 && dir_contents.records[i].type == FS_REGULAR)
             {
-                //The current path was found
-                //printf("\nI happened!\n");
-                next_rec_found = 1;
-
-                //Get the data blocks of the next part of the path
-                free(cur_dir_inode);
-                cur_dir_inode = get_dir(fs, dir_contents[j].inode_num);
-
-                if (cur_dir_inode == NULL || (cur_dir_inode->data_ptrs[0] <= 32 && cur_dir_inode->data_ptrs[0] > 0))
-                {
-                    //printf("\nReturn 4: cur_dir-inode->data_ptrs[0] = %u\n", cur_dir_inode->data_ptrs[0]);
-
-                    free(root);
-                    free(dir_contents);
-                    free(path_copy);
-                    free(cur_dir_inode);
-                    return -1;
-                } //End
-
-                if (block_store_read(fs->bs, cur_dir_inode->data_ptrs[0], dir_contents) <= 0)
-                {
-                    //printf("\nReturn 5\n");
-
-                    free(root);
-                    free(dir_contents);
-                    free(path_copy);
-                    free(cur_dir_inode);
-                    return -1;
-                } //End 
-
+                break;
             } //End 
         } //End
-
-        if (next_rec_found == 0)
+        if (i == fs->geo.dir_records)
         {
-            //printf("\nReturn 6\n");
-            //Directory wasn't found
-            free(root);
-            free(dir_contents);
-            free(path_copy);
-            free(cur_dir_inode);
             return -1;
         } //End 
 
-        token = strtok(NULL, delims);
-        cur_depth++;
+        fd = allocate_descriptor(fs, dir_contents.records[i].inode_num);
+        if (fd < 0 || dir_unchanged(fs, dir_inode.mdata.self_inode_num, version))
+        {
+            return fd;
+        } //End 
+        release_descriptor(fs, fd);
+        fd = -1;
+    } //End 
+
+    //The directory stays share locked until the descriptor exists, so the file can't be removed in between
+    if (!lookup_dir(fs, path, name - path, false, &dir_inode, &dir_contents))
+    {
+        return -1;
     } //End 
 
     //Search for the record in the target directory
-    for (int i = 0; i < DIR_REC_MAX; i++)
+    for (i = 0; i < fs->geo.dir_records; i++)
     {
-        //printf("\ndir_contents[%d].name = %s - token = %s\ndir_contents[%d].inum = %u\n", i, dir_contents[i].name, token, i, dir_contents[i].inode_num);
-        if (strcmp(dir_contents[i].name, token) == 0 && dir_contents[i].type == FS_REGULAR)
+        if (strcmp(dir_contents.records[i].name, name) == 0 && dir_contents.records[i].type == FS_REGULAR)
         {
-            //printf("\nReturn 7\n");
-            //Found the record
-            //Check if there is space for a new file descriptor
-            size_t fd = bitmap_ffz(fs->fd_table.fd_status);
-
-            if (fd != SIZE_MAX)
-            {
-                bitmap_set(fs->fd_table.fd_status, fd);
-                fs->fd_table.fd_inode[fd] = dir_contents[i].inode_num;
-                fs->fd_table.fd_pos[fd] = 0;
-
-                free(root);
-                free(dir_contents);
-                free(path_copy);
-                if (path_depth > 1)
-                {
-                    free(cur_dir_inode);
-                } //End
-
-                return fd;
-            } //End 
+            //Found the record, check if there is space for a new file descriptor
+            fd = allocate_descriptor(fs, dir_contents.records[i].inode_num);
+            break;
         } //End 
     } //End
 
-    free(root);
-    free(dir_contents);
-    free(path_copy);
-    if (path_depth > 1)
-    {
-        free(cur_dir_inode);
-    } //End 
-
-    //printf("\nReturn 8: file not found\n");
-
-    return -1;
+    unlock_inode(fs, dir_inode.mdata.self_inode_num);
+    return fd;
 } //End 
 
 /***************************************************/
@@ -588,9 +415,25 @@ int fs_close(S17FS_t *fs, int fd)
     } //End if (fs == NULL || fd < 0)
 
     //Reset the bit for the given file descriptor
-    if (bitmap_test(fs->fd_table.fd_status, fd))
-    {
-        //printf("Passed the bitmap_test\n");
+    if (lock_descriptor(fs, fd, true))
+    {
+        //Another descriptor still on the file may keep appending, which would only unpack the tail
+        //again, so it's packed when the last one closes
+        inode_ptr_t inode_number = fs->fd_table.fd_inode[fd];
+        bool last = true;
+        pthread_mutex_lock(&fs->fd_table.status_lock);
+        for (int i = 0; i < DESCRIPTOR_MAX && last; i++)
+        {
+            last = i == fd || fs->fd_table.fd_inode[i] != inode_number || !bitmap_test(fs->fd_table.fd_status, i);
+        } //End 
+        pthread_mutex_unlock(&fs->fd_table.status_lock);
+
+        //Closing flushes the write buffer and packs the file's tail, a failure still closes but reports it
+        bool flushed = flush_write_buffer(fs, fd) && (!last || pack_tail(fs, inode_number));
+        free(fs->fd_table.fd_wbuf[fd]);
+        fs->fd_table.fd_wbuf[fd] = NULL;
+
+        pthread_mutex_lock(&fs->fd_table.status_lock);
         bitmap_reset(fs->fd_table.fd_status, fd);
 
         //Reset the given file descriptors position
@@ -598,8 +441,12 @@ int fs_close(S17FS_t *fs, int fd)
 
         //Reset the the inode the given file descriptor is associated with
         fs->fd_table.fd_inode[fd] = 0;
+        pthread_mutex_unlock(&fs->fd_table.status_lock);
 
-        return 0;
+        unlock_inode(fs, inode_number);
+        pthread_mutex_unlock(&fs->fd_table.fd_lock[fd]);
+        journal_end(fs->journal);
+        return flushed ? 0 : -1;
     } //End 
 
     return -1;
@@ -609,74 +456,54 @@ int fs_close(S17FS_t *fs, int fd)
 
 off_t fs_seek(S17FS_t *fs, int fd, off_t offset, seek_t whence)
 {
-    if (fs && fd_valid(fs, fd))
+    //Seeking only moves this descriptor, and the size comes off a lock-free inode read, so the file
+    //itself only gets locked when write buffers are pending, a seek ends any run of buffered appends
+    bool pinned = fs && (whence == FS_SEEK_SET || whence == FS_SEEK_CUR || whence == FS_SEEK_END) && pin_descriptor(fs, fd);
+    if (pinned || (fs && (whence == FS_SEEK_SET || whence == FS_SEEK_CUR || whence == FS_SEEK_END) && lock_descriptor(fs, fd, false)))
     {
+        size_t *position = fs->fd_table.fd_pos + fd;
+        off_t result = -1;
+
+        //A descriptor never sits past EOF, so anything at or behind the current position
+        //is already inside the file and doesn't need the inode to clamp it
         inode_t file_inode;
-        if (read_inode(fs, &file_inode, fs->fd_table.fd_inode[fd]))
+        if (whence != FS_SEEK_END && offset <= (whence == FS_SEEK_CUR ? 0 : (off_t) *position))
+        {
+            off_t target = whence == FS_SEEK_CUR ? (off_t) *position + offset : offset;
+            *position = target > 0 ? (size_t) target : 0;
+            result = *position;
+        } //End 
+        else if (read_inode(fs, &file_inode, fs->fd_table.fd_inode[fd]))
         {
-            size_t *position = fs->fd_table.fd_pos + fd;
-            uint32_t *size   = &file_inode.mdata.size;
-            off_t resulting_pos;
-            switch (whence)
+            off_t size = file_inode.mdata.size;
+            off_t base = whence == FS_SEEK_SET ? 0 : (whence == FS_SEEK_CUR ? (off_t) *position : size);
+
+            //Past EOF lands on EOF, before BOF lands on BOF
+            if (offset >= size - base)
             {
-                case FS_SEEK_SET:
-                    if (offset <= 0)
-                    {
-                        *position     = 0;
-                        resulting_pos = 0;
-                    }   
-                    else if (offset > (off_t) *size)
-                    {
-                        *position     = *size;
-                        resulting_pos = *size;
-                    }
-                    else
-                    {
-                        *position     = offset;
-                        resulting_pos = *position;
-                    }
-                    break;
-                case FS_SEEK_CUR:
-                    if (offset >= ((off_t) *size - (off_t) *position))
-                    {
-                        *position     = *size;
-                        resulting_pos = *size;
-                    }
-                    else if (-offset >= (off_t) *position)
-                    {
-                        *position     = 0;
-                        resulting_pos = 0;
-                    }
-                    else
-                    {
-                        *position += offset;
-                        resulting_pos = *position;
-                    } //End else
-                    break;
-                case FS_SEEK_END:
-                    if (offset >= 0)
-                    {
-                        *position     = *size;
-                        resulting_pos = *size;
-                    }
-                    else if ((offset + (off_t) *size) < 0)
-                    {
-                        *position     = 0;
-                        resulting_pos = 0;
-                    }
-                    else
-                    {
-                        *position += offset;
-                        resulting_pos = *position;
-                    }
-                    break;
-                default:
-                    resulting_pos = -1;
-                    break;
-            }
-            return resulting_pos;
-        }
-    }
+                *position = size;
+            } //End 
+            else if (-offset >= base)
+            {
+                *position = 0;
+            } //End 
+            else
+            {
+                *position = base + offset;
+            } //End else
+            result = *position;
+        } //End 
+
+        if (pinned)
+        {
+            unpin_descriptor(fs, fd);
+        } //End 
+        else
+        {
+            unlock_descriptor(fs, fd);
+        } //End else
+        return result;
+    } //End 
     return -1;
 } //End 
 
@@ -684,1134 +511,475 @@ off_t fs_seek(S17FS_t *fs, int fd, off_t offset, seek_t whence)
 
 ssize_t fs_read(S17FS_t *fs, int fd, void *dst, size_t nbyte)
 {
-    //Check that the parameters are valid
-    if (fs == NULL || fd < 0 || dst == NULL)
+    //Check that the parameters are valid, anything still sitting in a
+    //write buffer for this file gets flushed so the read sees it
+    if (fs == NULL || dst == NULL || !lock_descriptor(fs, fd, false))
     {
-        //printf("fs_read: Return 1\n");
         return -1;
     } //End 
 
-    if (!bitmap_test(fs->fd_table.fd_status, fd))
+    inode_t fd_inode;
+    ssize_t total_bytes_read = -1;
+    if (read_inode(fs, &fd_inode, fs->fd_table.fd_inode[fd]))
     {
-        //printf("Return 2\n");
-        return -1;
-    } //End
+        //Sequential streams get the next window of blocks hinted in before we need them
+        readahead(fs, fd, &fd_inode, fs->fd_table.fd_pos[fd], nbyte);
 
-    //Declare variables
-    bool finished = false;
-    bool initial_bytes_read = false;
-    size_t total_bytes_read = 0;
-    data_block_t buffer;
-    uint16_t indirect_block[256];
-    uint16_t dbl_indirect_block[256];
-    inode_t* fd_inode = get_inode(fs, fs->fd_table.fd_inode[fd]);
-
-    if (fd_inode == NULL)
-    {
-        //printf("Return 3\n");
-        return -1;
+        total_bytes_read = read_file(fs, &fd_inode, dst, nbyte, fs->fd_table.fd_pos[fd]);
+        if (total_bytes_read > 0)
+        {
+            fs->fd_table.fd_pos[fd] += total_bytes_read;
+        } //End 
     } //End 
 
-    START_PTR_t start_index = DIRECT;
+    unlock_descriptor(fs, fd);
+    return total_bytes_read;
+} //End 
 
-    size_t cur_pos = fs->fd_table.fd_pos[fd];
-    size_t starting_block = cur_pos / BLOCK_SIZE;
-    size_t indir_index = 0;
-    size_t dbl_indir_index1 = 0; 
-    size_t dbl_indir_index2 = 0;
+/***************************************************/
 
-    ///printf("cur_pos = %zu - starting_block = %zu\n", cur_pos, starting_block);
+ssize_t fs_write(S17FS_t *fs, int fd, const void *src, size_t nbyte)
+{
+    //Check that the parameters are valid
+    if (fs == NULL || src == NULL || !lock_descriptor(fs, fd, true))
+    {
+        return -1;
+    } //End 
 
-    //Determine which pointer the write should start in
-    if (starting_block < 5)
+    ssize_t total_bytes_written = 0;
+    inode_t fd_inode;
+    if (nbyte == 0)
     {
-        start_index = starting_block;
+        total_bytes_written = 0;
     } //End 
-    else if (starting_block >= 5 && starting_block < 261)
+    else if (fs->fd_table.fd_wbuf[fd] && nbyte < fs->geo.block_size)
     {
-        //First indirect pointer
-        indir_index = (starting_block - (DIRECT_TOTAL)) % DIRECT_PER_BLOCK;
-        start_index = INDIRECT1;
+        //Small writes on a buffered descriptor get collected into whole blocks
+        total_bytes_written = write_buffered(fs, fd, src, nbyte);
     } //End 
-    else if (starting_block >= 261 && starting_block < 517)
+    else if (!flush_inode_write_buffers(fs, fs->fd_table.fd_inode[fd], -1) || !read_inode(fs, &fd_inode, fs->fd_table.fd_inode[fd]))
     {
-        //Second indirect pointer
-        indir_index = (starting_block - (DIRECT_TOTAL + DIRECT_PER_BLOCK)) % DIRECT_PER_BLOCK;
-        start_index = INDIRECT2;
+        total_bytes_written = -1;
     } //End 
     else
     {
-        //Double indirect pointer
-        dbl_indir_index1 = (starting_block - (DIRECT_TOTAL + INDIRECT_TOTAL)) / DIRECT_PER_BLOCK;
-        dbl_indir_index2 = (starting_block - (DIRECT_TOTAL + INDIRECT_TOTAL)) % DIRECT_PER_BLOCK;
-        start_index = DBL_INDIRECT;
+        total_bytes_written = write_file(fs, &fd_inode, src, nbyte, fs->fd_table.fd_pos[fd]);
+        if (total_bytes_written < 0 || !write_inode(fs, &fd_inode, fs->fd_table.fd_inode[fd]))
+        {
+            total_bytes_written = -1;
+        } //End 
+        else
+        {
+            fs->fd_table.fd_pos[fd] += total_bytes_written;
+        } //End else
     } //End else
 
-    //Caclulate how many blocks are needed, as well as figure out depending on 
-    //the starting position of the file descriptor how much the first and last
-    //blocks needed should be read
-    uint32_t num_blocks_needed = 1 + (uint32_t)((nbyte-1)/BLOCK_SIZE);
-    uint32_t num_blocks_used = 0;
-    uint32_t initial_bytes = BLOCK_SIZE - (cur_pos - BLOCK_SIZE * starting_block);  
-    uint32_t remainder_bytes = (nbyte - initial_bytes) % BLOCK_SIZE;
-
-    if (initial_bytes == 512)
-    {
-        initial_bytes = 1 + ((nbyte - 1) % BLOCK_SIZE);
-        remainder_bytes = 0;
-    } //End
-
-    //printf("num_blocks_needed = %u - num_blocks_used = %u - initial_bytes = %u - remainder_bytes = %u\n", num_blocks_needed, num_blocks_used, initial_bytes, remainder_bytes);
+    unlock_descriptor(fs, fd);
+    return total_bytes_written;
+} //End 
 
-    uint32_t i = 0;
-    uint32_t j = 0;
-    uint32_t k = 0;
+/***************************************************/
 
-    for (i = start_index; i < INODE_PTR_TOTAL && total_bytes_read < nbyte && !finished && num_blocks_used <= num_blocks_needed; i++)
+ssize_t fs_pread(S17FS_t *fs, int fd, void *dst, size_t nbyte, off_t offset)
+{
+    //Check that the parameters are valid
+    if (fs == NULL || dst == NULL || offset < 0 || !lock_descriptor(fs, fd, false))
     {
-        //printf("\ti = %u\n", i);
-        if (i < 5)
-        {
-            //Direct Pointers
-            if (fd_inode->data_ptrs[i] < 33 || fd_inode->data_ptrs[i] >= BITMAP_BITS)
-            {
-                //printf("\tdirect: fd_inode->data_ptrs[%u] = %u\n", i, fd_inode->data_ptrs[i]);
-
-                fs->fd_table.fd_pos[fd] += total_bytes_read;
-                write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                //printf("fs_write: Return 4\nnew data block num = %zu\n", new_data_block_num);
-                //Something went wrong allocating a new data block
-                free(fd_inode);
-                return total_bytes_read;
-            } //End if (fd_inode->data_ptrs[i] < 33)
-
-            if (block_store_read(fs->bs, fd_inode->data_ptrs[i], buffer))
-            {   
-                if (!initial_bytes_read && cur_pos == 0)
-                {
-                    memcpy(dst, buffer, initial_bytes);
-                    total_bytes_read += initial_bytes;
-                    initial_bytes_read= true;
-                    num_blocks_used++;
-                } //End 
-                else if (!initial_bytes_read && cur_pos > 0)
-                {
-                    memcpy(dst, &(buffer[BLOCK_SIZE - initial_bytes]), initial_bytes);
-                    total_bytes_read += initial_bytes;
-                    initial_bytes_read = true;
-                    num_blocks_used++;
-                } //End 
-                else if (num_blocks_used == num_blocks_needed && remainder_bytes % BLOCK_SIZE != 0)
-                {
-                    memcpy(&(((uint8_t *)dst)[total_bytes_read]), buffer, remainder_bytes);
-                    total_bytes_read += remainder_bytes;
-                    //printf("\n1: total_bytes_read = %zu\n", total_bytes_read);
-                    num_blocks_used++;
-                }
-                else
-                {
-                    memcpy(&(((uint8_t *)dst)[total_bytes_read]), buffer, BLOCK_SIZE);
-                    total_bytes_read += BLOCK_SIZE;
-                    //printf("\n2: total_bytes_read = %zu\n", total_bytes_read);
-                    num_blocks_used++;
-
-                    if (total_bytes_read == nbyte)
-                    {
-                        //printf("1: I happened------------------------------------------------------------------------\n");
-                        finished = true;
-                    } //End
-                } //End else
-            } //End if (block_store_read(fs->bs, fd_inode->data_ptrs[i], buffer))
-            else
-            {
-                fs->fd_table.fd_pos[fd] += total_bytes_read;
-                write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                free(fd_inode);
-                return total_bytes_read;
-            } //End else
-        } //End if (i < 5)
-        else if (i < 7)
-        {
-            //Indirect pointers
-            if (fd_inode->data_ptrs[i] < 33 || fd_inode->data_ptrs[i] >= BITMAP_BITS)
-            {
-                //printf("\tindirect: fd_inode->data_ptrs[%u] = %u\n", i, fd_inode->data_ptrs[i]);
-
-                fs->fd_table.fd_pos[fd] += total_bytes_read;
-                write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                //printf("fs_write: Return 5\nnew data block num = %zu\n", new_data_block_num);
-                //Something went wrong allocating a new data block
-                free(fd_inode);
-                return total_bytes_read;
-            } //End if (fd_inode->data_ptrs[i] < 33)
-
-            if (block_store_read(fs->bs, fd_inode->data_ptrs[i], indirect_block))
-            {
-                //printf("\tindir: before loop: j =  %u, indir_index = %zu\n", j, indir_index);
-                if (!total_bytes_read)
-                {
-                    j = indir_index;
-                } //End 
-                else
-                {
-                    j = 0;
-                } //End else
+        return -1;
+    } //End 
 
-                for (; j < BLOCK_SIZE/sizeof(block_ptr_t) && total_bytes_read < nbyte && !finished && num_blocks_used <= num_blocks_needed; j++)
-                {
-                    //printf("i = %u : j = %u total_bytes_read = %zu\n", i, j, total_bytes_read);
-                    if (indirect_block[j] < 33 || indirect_block[j] >= BITMAP_BITS)
-                    {
-                        //printf("\tindirect: indirect_block[%u] = %u\n", j, indirect_block[j]);
-                        fs->fd_table.fd_pos[fd] += total_bytes_read;
-                        write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                        //printf("fs_write: Return 6\nnew data block num = %zu\n", new_data_block_num);
-                        //Something went wrong allocating a new data block
-                        free(fd_inode);
-                        return total_bytes_read;
-                    } //End 
-
-                    if (block_store_read(fs->bs, indirect_block[j], buffer))
-                    {   
-                        if (!initial_bytes_read && cur_pos == 0)
-                        {
-                            finished = true;
-                            memcpy(dst, buffer, initial_bytes);
-                            total_bytes_read += initial_bytes;
-                            initial_bytes_read = true;
-                            num_blocks_used++;
-                        } //End 
-                        else if (!initial_bytes_read && cur_pos > 0)
-                        {
-                            memcpy(dst, &(buffer[BLOCK_SIZE - initial_bytes]), initial_bytes);
-                            total_bytes_read += initial_bytes;
-                            initial_bytes_read = true;
-                            num_blocks_used++;
-                        } //End 
-                        else if (num_blocks_used == num_blocks_needed && remainder_bytes % BLOCK_SIZE != 0)
-                        {
-                            memcpy(&(((uint8_t *)dst)[total_bytes_read]), buffer, remainder_bytes);
-                            total_bytes_read += remainder_bytes;
-                            finished = true;
-                            //printf("\n1: total_bytes_read = %zu\n", total_bytes_read);
-                            num_blocks_used++;
-                        }
-                        else
-                        {
-                            memcpy(&(((uint8_t *)dst)[total_bytes_read]), buffer, BLOCK_SIZE);
-                            total_bytes_read += BLOCK_SIZE;
-                            num_blocks_used++;
-
-                            if (total_bytes_read == nbyte)
-                            {
-                                //printf("1: I happened------------------------------------------------------------------------\n");
-                                finished = true;
-                            } //End 
-                            //printf("\n2: total_bytes_read = %zu\n", total_bytes_read);
-                        } //End else
-                    } //End 
-                    else
-                    {
-                        fs->fd_table.fd_pos[fd] += total_bytes_read;
-                        fd_inode->mdata.size += total_bytes_read;
-                        write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                        free(fd_inode);
-                        return total_bytes_read;
-                    } //End else
-
-                    if (finished)
-                    {
-                        //printf("2: I happened------------------------------------------------------------------------\n");
-                        break;
-                    } //End 
-                } //End for (uint32_t j = 0; j < num_blocks_needed - i && j < BLOCK_SIZE/sizeof(block_ptr_t) && !finished; j++)
-                //printf("\tindirect: after indirect: j = %u\n", j);
-            } //End
-        } //End
-        else
-        {
-            //Double indirect pointer
-            if (fd_inode->data_ptrs[i] < 33 || fd_inode->data_ptrs[i] >= BITMAP_BITS)
-            {
-                //printf("\tdbl_indir: fd_inode->data_ptrs[%u] = %u\n", i, fd_inode->data_ptrs[i]);
-                fs->fd_table.fd_pos[fd] += total_bytes_read;
-                write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                //printf("fs_write: Return 7\nnew data block num = %zu\n", new_data_block_num);
-                //Something went wrong allocating a new data block
-                free(fd_inode);
-                return total_bytes_read; 
-            } //End if (fd_inode->data_ptrs[i] < 33)
-
-            if (block_store_read(fs->bs, fd_inode->data_ptrs[i], indirect_block))
-            {
-                //printf("\tdbl_indir: before loop: j =  %u, dbl_indir_inddx1 = %zu\n", j, dbl_indir_index1); 
-                if (!total_bytes_read)
-                {
-                    j = dbl_indir_index1;
-                } //End 
-                else if (total_bytes_read && !dbl_indir_index1)
-                {
-                    j = 0;
-                } //End else
+    inode_t fd_inode;
+    ssize_t total_bytes_read = -1;
+    if (read_inode(fs, &fd_inode, fs->fd_table.fd_inode[fd]))
+    {
+        total_bytes_read = read_file(fs, &fd_inode, dst, nbyte, offset);
+    } //End 
 
-                for (; j < BLOCK_SIZE/sizeof(block_ptr_t) && total_bytes_read < nbyte && !finished && num_blocks_used <= num_blocks_needed; j++)
-                {
-                    if (indirect_block[j] < 33 || indirect_block[j] >= BITMAP_BITS)
-                    {
-                        //printf("\tdbl_indir: indirect_block[%u] = %u\n", j, indirect_block[j]);
-                        fs->fd_table.fd_pos[fd] += total_bytes_read;
-                        write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                        //printf("fs_write: Return 8\nnew data block num = %zu\n", new_data_block_num);
-                        //Something went wrong allocating a new data block
-                        free(fd_inode);
-                        return total_bytes_read; 
-                    } //End
-
-                    if (block_store_read(fs->bs, indirect_block[j], dbl_indirect_block))
-                    {
-                        //printf("\tdbl_indir: before loop: k =  %u, dbl_indir_inddx2 = %zu\n", k, dbl_indir_index2);
-                        if (!total_bytes_read)
-                        {
-                            k = dbl_indir_index2;
-                        } //End 
-                        else
-                        {
-                            k = 0;
-                        } //End else
-
-                        for (; k < BLOCK_SIZE/sizeof(block_ptr_t) && total_bytes_read < nbyte && !finished && num_blocks_used <= num_blocks_needed; k++)
-                        {
-                            if (dbl_indirect_block[k] < 33 || dbl_indirect_block[k] >= BITMAP_BITS)
-                            {
-                                //printf("\tdbl_indir: j = %u - dbl_indirect_block[%u] = %u\n", j, k, dbl_indirect_block[k]);
-                                fs->fd_table.fd_pos[fd] += total_bytes_read;
-                                fd_inode->mdata.size += total_bytes_read;
-                                write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                                //printf("fs_write: Return 9\nnew data block num = %zu\n", new_data_block_num);
-                                //Something went wrong allocating a new data block
-                                free(fd_inode);
-                                return total_bytes_read;
-                            } //End if (indirect_block[j] < 33)
-
-                            if (block_store_read(fs->bs, dbl_indirect_block[k], buffer))
-                            {
-                                if (!initial_bytes_read && cur_pos == 0)
-                                {
-                                    memcpy(dst, buffer, initial_bytes);
-                                    total_bytes_read += initial_bytes;
-                                    initial_bytes_read = true;
-                                    num_blocks_used++;
-                                } //End 
-                                else if (!initial_bytes_read && cur_pos > 0)
-                                {
-                                    memcpy(dst, &(buffer[BLOCK_SIZE - initial_bytes]), initial_bytes);
-                                    total_bytes_read += initial_bytes;
-                                    initial_bytes_read = true;
-                                    num_blocks_used++;
-                                } //End 
-                                else if (num_blocks_used == num_blocks_needed && remainder_bytes % BLOCK_SIZE != 0)
-                                {
-                                    memcpy(&(((uint8_t *)dst)[total_bytes_read]), buffer, remainder_bytes);
-                                    total_bytes_read += remainder_bytes;
-                                    finished = true;
-                                    //printf("\n1: total_bytes_read = %zu\n", total_bytes_read);
-                                    num_blocks_used++;
-                                }
-                                else
-                                {
-                                    memcpy(&(((uint8_t *)dst)[total_bytes_read]), buffer, BLOCK_SIZE);
-                                    total_bytes_read += BLOCK_SIZE;
-                                    num_blocks_used++;
-
-                                    if (total_bytes_read == nbyte)
-                                    {
-                                        //printf("1: I happened-----------------------------------\n");
-                                        finished = true;
-                                    } //End 
-                                    //printf("\n2: total_bytes_read = %zu\n", total_bytes_read);
-                                } //End else
-                            } //End 
-                            else
-                            {
-                                fs->fd_table.fd_pos[fd] += total_bytes_read;
-                                fd_inode->mdata.size = total_bytes_read;
-                                write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                                free(fd_inode);
-                                return total_bytes_read;
-                            } //End else
-
-                            if (finished)
-                            {
-                                finished = true;
-                                //printf("2: I happened------------------------------------------------------------------------\n");
-                                break;
-                            } //End
-                        } //End for (k = dbl_indir_index2; k < BLOCK_SIZE/sizeof(block_ptr_t) && total_bytes_read < nbyte && !finished && num_blocks_used <= num_blocks_needed; k++)
-                        //printf("\tdbl_indirect: after dbl_indirect: k = %u\n", k);
-                    } //End 
-                    else
-                    {
-                        fs->fd_table.fd_pos[fd] += total_bytes_read;
-                        fd_inode->mdata.size += total_bytes_read;
-                        write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                        free(fd_inode);
-                        return total_bytes_read;
-                    } //End else
-
-                    if (finished)
-                    {
-                        //printf("2: I happened------------------------------------------------------------------------\n");
-                        break;
-                    } //End
-                } //End for (j = dbl_indir_index1; j < BLOCK_SIZE/sizeof(block_ptr_t) && total_bytes_read < nbyte && !finished && num_blocks_used <= num_blocks_needed; j++)
-                //printf("\tdbl_indirect: after indirect: j = %u\n", j);
-            } //End if (block_store_read(fs->bs, fd_inode->data_ptrs[i], indirect_block)) 
+    unlock_descriptor(fs, fd);
+    return total_bytes_read;
+} //End 
 
+/***************************************************/
 
-        } //End else
+ssize_t fs_pwrite(S17FS_t *fs, int fd, const void *src, size_t nbyte, off_t offset)
+{
+    //Check that the parameters are valid
+    if (fs == NULL || src == NULL || offset < 0 || !lock_descriptor(fs, fd, true))
+    {
+        return -1;
+    } //End 
 
-        if (total_bytes_read == nbyte || finished)
+    //Buffered data on any descriptor, this one included, may overlap the write
+    inode_t fd_inode;
+    ssize_t total_bytes_written = -1;
+    if (flush_inode_write_buffers(fs, fs->fd_table.fd_inode[fd], -1) && read_inode(fs, &fd_inode, fs->fd_table.fd_inode[fd]))
+    {
+        //Files can't have holes, so the write has to start inside the file or right at EOF
+        if ((size_t) offset > fd_inode.mdata.size)
         {
-            //printf("3: I happened------------------------------------------------------------------------\n");
-            break;
+            total_bytes_written = -1;
         } //End 
-    } //End for (int i = 0; i < num_blocks_needed; i++)
-
-    //printf("i = %u\n", i);
-    fs->fd_table.fd_pos[fd] += total_bytes_read;
-    write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-    free(fd_inode);
-
-    //printf("total_bytes_read = %zu\n", total_bytes_read);
+        else if (nbyte == 0)
+        {
+            total_bytes_written = 0;
+        } //End 
+        else
+        {
+            total_bytes_written = write_file(fs, &fd_inode, src, nbyte, offset);
+            if (total_bytes_written < 0 || !write_inode(fs, &fd_inode, fs->fd_table.fd_inode[fd]))
+            {
+                total_bytes_written = -1;
+            } //End 
+        } //End else
+    } //End 
 
-    return total_bytes_read;
+    unlock_descriptor(fs, fd);
+    return total_bytes_written;
 } //End 
 
 /***************************************************/
 
-ssize_t fs_write(S17FS_t *fs, int fd, const void *src, size_t nbyte)
+ssize_t fs_readv(S17FS_t *fs, int fd, const struct iovec *iov, int iovcnt)
 {
     //Check that the parameters are valid
-    if (fs == NULL || fd < 0 || src == NULL)
+    size_t nbyte = iov_total(iov, iovcnt);
+    if (fs == NULL || nbyte == SIZE_MAX || !lock_descriptor(fs, fd, false))
     {
-        //printf("fs_write: Return 1\n");
         return -1;
     } //End 
 
-    if (!bitmap_test(fs->fd_table.fd_status, fd))
+    inode_t fd_inode;
+    ssize_t total_bytes_read = -1;
+    if (read_inode(fs, &fd_inode, fs->fd_table.fd_inode[fd]))
     {
-        //printf("fs_write: Return 2\n");
-        return -1;
+        readahead(fs, fd, &fd_inode, fs->fd_table.fd_pos[fd], nbyte);
+
+        total_bytes_read = read_file_vec(fs, &fd_inode, iov, iovcnt, fs->fd_table.fd_pos[fd]);
+        if (total_bytes_read > 0)
+        {
+            fs->fd_table.fd_pos[fd] += total_bytes_read;
+        } //End 
     } //End 
 
-    //Declare variables
-    bool finished = false;
-    bool initial_bytes_written = false;
-    size_t total_bytes_written = 0;
-    data_block_t buffer;
-    uint16_t indirect_block[256];
-    uint16_t dbl_indirect_block[256];
-    inode_t* fd_inode = get_inode(fs, fs->fd_table.fd_inode[fd]);
+    unlock_descriptor(fs, fd);
+    return total_bytes_read;
+} //End 
+
+/***************************************************/
 
-    if (fd_inode == NULL)
+ssize_t fs_writev(S17FS_t *fs, int fd, const struct iovec *iov, int iovcnt)
+{
+    //Check that the parameters are valid
+    size_t nbyte = iov_total(iov, iovcnt);
+    if (fs == NULL || nbyte == SIZE_MAX || !lock_descriptor(fs, fd, true))
     {
-        //printf("fs_write: Return 3\n");
         return -1;
     } //End 
 
-    START_PTR_t start_index = DIRECT;
-
-    size_t cur_pos = fs->fd_table.fd_pos[fd];
-    size_t starting_block = cur_pos / BLOCK_SIZE;
-    size_t indir_index = 0;
-    size_t dbl_indir_index1 = 0; 
-    size_t dbl_indir_index2 = 0;
-
-    //printf("cur_pos = %zu\n", cur_pos);
-
-    //Determine which pointer the write should start in
-    if (starting_block < 5)
+    ssize_t total_bytes_written = 0;
+    inode_t fd_inode;
+    if (nbyte == 0)
     {
-        start_index = starting_block;
+        total_bytes_written = 0;
     } //End 
-    else if (starting_block >= 5 && starting_block < 261)
+    else if (fs->fd_table.fd_wbuf[fd] && nbyte < fs->geo.block_size)
     {
-        //First indirect pointer
-        indir_index = (starting_block - (DIRECT_TOTAL)) % DIRECT_PER_BLOCK;
-        start_index = INDIRECT1;
+        //Small records on a buffered descriptor still go through the buffer, a segment at a time
+        for (int i = 0; i < iovcnt; i++)
+        {
+            ssize_t written = iov[i].iov_len ? write_buffered(fs, fd, iov[i].iov_base, iov[i].iov_len) : 0;
+            if (written < 0)
+            {
+                total_bytes_written = total_bytes_written ? total_bytes_written : -1;
+                break;
+            } //End 
+            total_bytes_written += written;
+            if ((size_t) written < iov[i].iov_len)
+            {
+                break;
+            } //End 
+        } //End 
     } //End 
-    else if (starting_block >= 261 && starting_block < 517)
+    else if (!flush_inode_write_buffers(fs, fs->fd_table.fd_inode[fd], -1) || !read_inode(fs, &fd_inode, fs->fd_table.fd_inode[fd]))
     {
-        //Second indirect pointer
-        indir_index = (starting_block - (DIRECT_TOTAL + DIRECT_PER_BLOCK)) % DIRECT_PER_BLOCK;
-        start_index = INDIRECT2;
+        total_bytes_written = -1;
     } //End 
     else
     {
-        //Double indirect pointer
-        dbl_indir_index1 = (starting_block - (DIRECT_TOTAL + INDIRECT_TOTAL)) / DIRECT_PER_BLOCK;
-        dbl_indir_index2 = (starting_block - (DIRECT_TOTAL + INDIRECT_TOTAL)) % DIRECT_PER_BLOCK;
-        start_index = DBL_INDIRECT;
+        //One walk of the block map and one inode writeback for the whole batch
+        total_bytes_written = write_file_vec(fs, &fd_inode, iov, iovcnt, fs->fd_table.fd_pos[fd]);
+        if (total_bytes_written < 0 || !write_inode(fs, &fd_inode, fs->fd_table.fd_inode[fd]))
+        {
+            total_bytes_written = -1;
+        } //End 
+        else
+        {
+            fs->fd_table.fd_pos[fd] += total_bytes_written;
+        } //End else
     } //End else
 
-    //Caclulate how many blocks are needed, as well as figure out depending on 
-    //the starting position of the file descriptor how much the first and last
-    //blocks needed should be written
-    uint32_t num_blocks_needed = 1 + (uint32_t)((nbyte-1)/BLOCK_SIZE);
-    uint32_t num_blocks_used = 0;
-    uint32_t initial_bytes = BLOCK_SIZE - (cur_pos - BLOCK_SIZE * starting_block);  
-    uint32_t remainder_bytes = (nbyte - initial_bytes) % BLOCK_SIZE;
+    unlock_descriptor(fs, fd);
+    return total_bytes_written;
+} //End 
+
+/***************************************************/
 
-    if (initial_bytes == 512)
+int fs_fallocate(S17FS_t *fs, int fd, off_t offset, size_t len)
+{
+    //Check that the parameters are valid
+    if (fs == NULL || offset < 0 || len == 0 || !lock_descriptor(fs, fd, true))
     {
-        initial_bytes = 1 + ((nbyte - 1) % BLOCK_SIZE);
-        remainder_bytes = 0;
+        return -1;
     } //End 
 
-    //printf("\nnum_blocks_needed = %u\n", num_blocks_needed);
-
-    uint32_t i = 0;
-    uint32_t j = 0;
-    uint32_t k = 0;
-    for (i = start_index; i < INODE_PTR_TOTAL && total_bytes_written < nbyte && !finished && num_blocks_used <= num_blocks_needed; i++)
+    //Bytes still in write buffers don't have to go out first, they'll find their blocks mapped when they do
+    inode_t fd_inode;
+    int result = -1;
+    if (read_inode(fs, &fd_inode, fs->fd_table.fd_inode[fd]))
     {
-        //printf("i = %u\n", i);
-        if (i < 5)
-        {
-            //Direct Pointers
-            if (fd_inode->data_ptrs[i] < 33 || fd_inode->data_ptrs[i] >= BITMAP_BITS)
-            {
-                //printf("\tdirect: fd_inode->data_ptrs[%u] = %u\n", i, fd_inode->data_ptrs[i]);
-                size_t new_data_block_num = -1;
-                new_data_block_num = block_store_allocate(fs->bs);
-
-                //printf("\tData block num: %zu\n", new_data_block_num);
-
-                if (new_data_block_num <= 32 || new_data_block_num == SIZE_MAX || new_data_block_num >= BITMAP_BITS)
-                {
-                    fs->fd_table.fd_pos[fd] += total_bytes_written;
-                    fd_inode->mdata.size += total_bytes_written;
-                    write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                    //printf("fs_write: Return 4\nnew data block num = %zu\n", new_data_block_num);
-                    //Something went wrong allocating a new data block
-                    free(fd_inode);
-                    return total_bytes_written;
-                } //End 
-
-                fd_inode->data_ptrs[i] = new_data_block_num;
-            } //End if (fd_inode->data_ptrs[i] < 33)
-
-            if (block_store_read(fs->bs, fd_inode->data_ptrs[i], buffer))
-            {   
-                if (!initial_bytes_written && cur_pos == 0)
-                {
-                    memcpy(buffer, src, initial_bytes);
-                    total_bytes_written += initial_bytes;
-                    initial_bytes_written = true;
-                    num_blocks_used++;
-                } //End 
-                else if (!initial_bytes_written && cur_pos > 0)
-                {
-                    memcpy(&(buffer[BLOCK_SIZE - initial_bytes]), src, initial_bytes);
-                    total_bytes_written += initial_bytes;
-                    initial_bytes_written = true;
-                    num_blocks_used++;
-                } //End 
-                else if (num_blocks_used == num_blocks_needed && remainder_bytes % BLOCK_SIZE != 0)
-                {
-                    memcpy(buffer, &(((uint8_t *)src)[total_bytes_written]), remainder_bytes);
-                    total_bytes_written += remainder_bytes;
-                    //printf("\n1: total_bytes_written = %zu\n", total_bytes_written);
-                    num_blocks_used++;
-                }
-                else
-                {
-                    memcpy(buffer, &(((uint8_t *)src)[total_bytes_written]), BLOCK_SIZE);
-                    total_bytes_written += BLOCK_SIZE;
-                    //printf("\n2: total_bytes_written = %zu\n", total_bytes_written);
-                    num_blocks_used++;
-
-                    if (total_bytes_written == nbyte)
-                    {
-                        //printf("1: I happened------------------------------------------------------------------------\n");
-                        finished = true;
-                    } //End
-                } //End else
-
-                if (!block_store_write(fs->bs, fd_inode->data_ptrs[i], buffer))
-                {
-                    fs->fd_table.fd_pos[fd] += total_bytes_written;
-                    fd_inode->mdata.size += total_bytes_written;
-                    write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                    free(fd_inode);
-                    return total_bytes_written;
-                } //End else
-            } //End if (block_store_read(fs->bs, fd_inode->data_ptrs[i], buffer))
-            else
-            {
-                fs->fd_table.fd_pos[fd] += total_bytes_written;
-                fd_inode->mdata.size += total_bytes_written;
-                write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                free(fd_inode);
-                return total_bytes_written;
-            } //End else
-        } //End if (i < 5)
-        else if (i < 7)
-        {
-            //Indirect pointers
-            if (fd_inode->data_ptrs[i] < 33 || fd_inode->data_ptrs[i] >= BITMAP_BITS)
-            {
-                //printf("\tindirect: fd_inode->data_ptrs[%u] = %u\n", i, fd_inode->data_ptrs[i]);
-                size_t new_data_block_num = -1; 
-                new_data_block_num = block_store_allocate(fs->bs);
-
-                //printf("\tData block num: %zu\n", new_data_block_num);
-
-                if (new_data_block_num <= 32 || new_data_block_num == SIZE_MAX || new_data_block_num >= BITMAP_BITS)
-                {
-                    fs->fd_table.fd_pos[fd] += total_bytes_written;
-                    fd_inode->mdata.size += total_bytes_written;
-                    write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                    //printf("fs_write: Return 5\nnew data block num = %zu\n", new_data_block_num);
-                    //Something went wrong allocating a new data block
-                    free(fd_inode);
-                    return total_bytes_written;
-                } //End 
-
-                overhead++;
-                fd_inode->data_ptrs[i] = new_data_block_num;
-                initialize_indirect_block(fs, fd_inode->data_ptrs[i]);
-            } //End if (fd_inode->data_ptrs[i] < 33)
-
-            if (block_store_read(fs->bs, fd_inode->data_ptrs[i], indirect_block))
-            {
-                //printf("\tindir: before loop: j =  %u, indir_index = %zu\n", j, indir_index);
-                if (!total_bytes_written)
-                {
-                    j = indir_index;
-                } //End 
-                else
-                {
-                    j = 0;
-                } //End else
+        //Whatever did get mapped is the file's now, so the inode is written either way
+        bool mapped = preallocate_file(fs, &fd_inode, offset, len);
+        result = write_inode(fs, &fd_inode, fs->fd_table.fd_inode[fd]) && mapped ? 0 : -1;
+    } //End 
 
-                for (; j < BLOCK_SIZE/sizeof(block_ptr_t) && total_bytes_written < nbyte && !finished && num_blocks_used <= num_blocks_needed; j++)
-                {
-                    //printf("i = %u : j = %u total_bytes_written = %zu\n", i, j, total_bytes_written);
-                    if (indirect_block[j] < 33 || indirect_block[j] >= BITMAP_BITS)
-                    {
-                        //printf("\tindirect: indirect_block[%u] = %u\n", j, indirect_block[j]);
-                        size_t new_data_block_num = -1;
-                        new_data_block_num = block_store_allocate(fs->bs);
-                        //printf("\tData block num: %zu\n", new_data_block_num);
-
-                        if (new_data_block_num <= 32 || new_data_block_num == SIZE_MAX || new_data_block_num >= BITMAP_BITS)
-                        {
-                            fs->fd_table.fd_pos[fd] += total_bytes_written;
-                            fd_inode->mdata.size += total_bytes_written;
-                            write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                            //printf("fs_write: Return 6\nnew data block num = %zu\n", new_data_block_num);
-                            //Something went wrong allocating a new data block
-                            free(fd_inode);
-                            return total_bytes_written;
-                        } //End
-
-                        indirect_block[j] = new_data_block_num;
-
-                        if (!block_store_write(fs->bs, fd_inode->data_ptrs[i], indirect_block))
-                        {
-                            fs->fd_table.fd_pos[fd] += total_bytes_written;
-                            fd_inode->mdata.size = total_bytes_written;
-                            write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                            free(fd_inode);
-                            return total_bytes_written;
-                        } //End
-                    } //End 
-
-
-                    if (block_store_read(fs->bs, indirect_block[j], buffer))
-                    {   
-                        if (!initial_bytes_written && cur_pos == 0)
-                        {
-                            finished = true;
-                            memcpy(buffer, src, initial_bytes);
-                            total_bytes_written += initial_bytes;
-                            initial_bytes_written = true;
-                            num_blocks_used++;
-                        } //End 
-                        else if (!initial_bytes_written && cur_pos > 0)
-                        {
-                            memcpy(&(buffer[BLOCK_SIZE - initial_bytes]), src, initial_bytes);
-                            total_bytes_written += initial_bytes;
-                            initial_bytes_written = true;
-                            num_blocks_used++;
-                        } //End 
-                        else if (num_blocks_used == num_blocks_needed && remainder_bytes % BLOCK_SIZE != 0)
-                        {
-                            memcpy(buffer, &(((uint8_t *)src)[total_bytes_written]), remainder_bytes);
-                            total_bytes_written += remainder_bytes;
-                            finished = true;
-                            //printf("\n1: total_bytes_written = %zu\n", total_bytes_written);
-                            num_blocks_used++;
-                        }
-                        else
-                        {
-                            memcpy(buffer, &(((uint8_t *)src)[total_bytes_written]), BLOCK_SIZE);
-                            total_bytes_written += BLOCK_SIZE;
-                            num_blocks_used++;
-
-                            if (total_bytes_written == nbyte)
-                            {
-                                //printf("1: I happened------------------------------------------------------------------------\n");
-                                finished = true;
-                            } //End 
-                            //printf("\n2: total_bytes_written = %zu\n", total_bytes_written);
-                        } //End else
-
-                        //if (!block_store_write(fs->bs, fd_inode->data_ptrs[i], buffer))
-                        if (!block_store_write(fs->bs, indirect_block[j], buffer))
-                        {
-                            fs->fd_table.fd_pos[fd] += total_bytes_written;
-                            fd_inode->mdata.size += total_bytes_written;
-                            write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                            free(fd_inode);
-                            return total_bytes_written;
-                        } //End else
-                    } //End 
-                    else
-                    {
-                        fs->fd_table.fd_pos[fd] += total_bytes_written;
-                        fd_inode->mdata.size += total_bytes_written;
-                        write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                        free(fd_inode);
-                        return total_bytes_written;
-                    } //End else
-
-                    if (finished)
-                    {
-                        //printf("2: I happened------------------------------------------------------------------------\n");
-                        break;
-                    } //End 
-                } //End for (uint32_t j = 0; j < num_blocks_needed - i && j < BLOCK_SIZE/sizeof(block_ptr_t) && !finished; j++)
-                //printf("\tindirect: after indirect: j = %u\n", j);
-            } //End
-        } //End
-        else
-        {
-            //Double indirect pointer
-            //printf("\nHey you made it to the double indirect pointers\n\n");
-            if (fd_inode->data_ptrs[i] < 33 || fd_inode->data_ptrs[i] >= BITMAP_BITS)
-            {
-                //printf("\tdbl_indir: fd_inode->data_ptrs[%u] = %u\n", i, fd_inode->data_ptrs[i]);
-                size_t new_data_block_num = -1;
-                new_data_block_num = block_store_allocate(fs->bs);
+    unlock_descriptor(fs, fd);
+    return result;
+} //End 
 
-                //printf("\tData block num: %zu\n", new_data_block_num);
+/***************************************************/
 
-                if (new_data_block_num <= 32 || new_data_block_num == SIZE_MAX || new_data_block_num >= BITMAP_BITS)
-                {
-                    fs->fd_table.fd_pos[fd] += total_bytes_written;
-                    fd_inode->mdata.size += total_bytes_written;
-                    write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                    //printf("fs_write: Return 7\nnew data block num = %zu\n", new_data_block_num);
-                    //Something went wrong allocating a new data block
-                    free(fd_inode);
-                    return total_bytes_written;
-                } //End 
+ssize_t fs_read_view(S17FS_t *fs, int fd, off_t offset, size_t nbyte, dyn_array_t **spans_out)
+{
+    //Check that the parameters are valid, the view has to show what's been written, buffered or not
+    if (fs == NULL || spans_out == NULL || offset < 0 || !lock_descriptor(fs, fd, false))
+    {
+        return -1;
+    } //End 
 
-                overhead++;
-                fd_inode->data_ptrs[i] = new_data_block_num;
-                initialize_indirect_block(fs, fd_inode->data_ptrs[i]);
-            } //End if (fd_inode->data_ptrs[i] < 33)
+    //Spans can point at the journal's copy of an inline file's table block, the pin keeps it until they're released
+    inode_t fd_inode;
+    dyn_array_t *spans = NULL;
+    ssize_t total_bytes_viewed = -1;
+    journal_pin(fs->journal);
+    if (read_inode(fs, &fd_inode, fs->fd_table.fd_inode[fd]) && (spans = dyn_array_create(1 + nbyte / fs->geo.block_size / 8, sizeof(fs_span_t), NULL)) != NULL)
+    {
+        total_bytes_viewed = view_file(fs, &fd_inode, spans, nbyte, offset);
+    } //End 
+    unlock_descriptor(fs, fd);
 
-            if (block_store_read(fs->bs, fd_inode->data_ptrs[i], indirect_block))
-            {
-                //printf("\tdbl_indir: before loop: j =  %u, dbl_indir_inddx1 = %zu\n", j, dbl_indir_index1); 
-                if (!total_bytes_written)
-                {
-                    j = dbl_indir_index1;
-                } //End 
-                else if (total_bytes_written && !dbl_indir_index1)
-                {
-                    j = 0;
-                } //End else
+    if (total_bytes_viewed < 0)
+    {
+        journal_unpin(fs->journal);
+        dyn_array_destroy(spans);
+        return -1;
+    } //End 
 
-                for (; j < BLOCK_SIZE/sizeof(block_ptr_t) && total_bytes_written < nbyte && !finished && num_blocks_used <= num_blocks_needed; j++)
-                {
-                    if (indirect_block[j] < 33 || indirect_block[j] >= BITMAP_BITS)
-                    {
-                        //printf("\tdbl_indir: indirect_block[%u] = %u\n", j, indirect_block[j]);
-                        size_t new_data_block_num = -1;
-                        new_data_block_num = block_store_allocate(fs->bs);
-
-                        //printf("\tData block num: %zu\n", new_data_block_num);
-
-                        if (new_data_block_num <= 32 || new_data_block_num == SIZE_MAX || new_data_block_num >= BITMAP_BITS)
-                        {
-                            fs->fd_table.fd_pos[fd] += total_bytes_written;
-                            fd_inode->mdata.size += total_bytes_written;
-                            write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                            //printf("fs_write: Return 8\nnew data block num = %zu\n", new_data_block_num);
-                            //Something went wrong allocating a new data block
-                            free(fd_inode);
-                            return total_bytes_written;
-                        } //End
-
-                        overhead++;
-                        indirect_block[j] = new_data_block_num;
-                        initialize_indirect_block(fs, indirect_block[j]);
-
-                        if (!block_store_write(fs->bs, fd_inode->data_ptrs[i], indirect_block))
-                        {
-                            fs->fd_table.fd_pos[fd] += total_bytes_written;
-                            fd_inode->mdata.size += total_bytes_written;
-                            write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                            free(fd_inode);
-                            return total_bytes_written;
-                        } //End 
-                    } //End
-
-                    if (block_store_read(fs->bs, indirect_block[j], dbl_indirect_block))
-                    {
-                        //printf("\tdbl_indir: before loop: k =  %u, dbl_indir_inddx2 = %zu\n", k, dbl_indir_index2);
-                        if (!total_bytes_written)
-                        {
-                            k = dbl_indir_index2;
-                        } //End 
-                        else
-                        {
-                            k = 0;
-                        } //End else
-
-                        for (; k < BLOCK_SIZE/sizeof(block_ptr_t) && total_bytes_written < nbyte && !finished && num_blocks_used <= num_blocks_needed; k++)
-                        {
-                            if (dbl_indirect_block[k] < 33 || dbl_indirect_block[k] >= BITMAP_BITS)
-                            {
-                                //printf("\tdbl_indir: j = %u - dbl_indirect_block[%u] = %u\n", j, k, dbl_indirect_block[k]);
-                                size_t new_data_block_num = -1;
-                                new_data_block_num = block_store_allocate(fs->bs);
-                                //printf("\tData block num: %zu\n", new_data_block_num);
-
-                                if (new_data_block_num <= 32 || new_data_block_num == SIZE_MAX || new_data_block_num >= BITMAP_BITS)
-                                {
-                                    fs->fd_table.fd_pos[fd] += total_bytes_written;
-                                    fd_inode->mdata.size += total_bytes_written;
-                                    write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                                    //printf("fs_write: Return 9\nnew data block num = %zu\n", new_data_block_num);
-                                    //Something went wrong allocating a new data block
-                                    free(fd_inode);
-                                    return total_bytes_written;
-                                } //End
-
-                                dbl_indirect_block[k] = new_data_block_num; 
-
-                                if (!block_store_write(fs->bs, indirect_block[j], dbl_indirect_block))
-                                {
-                                    fs->fd_table.fd_pos[fd] += total_bytes_written;
-                                    fd_inode->mdata.size += total_bytes_written;
-                                    write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                                    //printf("fs_write: Return 10\nnew data block num = %zu\n", new_data_block_num);
-                                    //Something went wrong allocating a new data block
-                                    free(fd_inode);
-                                    return total_bytes_written;
-                                } //End if (!block_store_write(fs->bs, indirect_block[j], dbl_indirect_block))
-                            } //End if (indirect_block[j] < 33)
-
-                            if (block_store_read(fs->bs, dbl_indirect_block[k], buffer))
-                            {
-                                if (!initial_bytes_written && cur_pos == 0)
-                                {
-                                    memcpy(buffer, src, initial_bytes);
-                                    total_bytes_written += initial_bytes;
-                                    initial_bytes_written = true;
-                                    num_blocks_used++;
-                                } //End 
-                                else if (!initial_bytes_written && cur_pos > 0)
-                                {
-                                    memcpy(&(buffer[BLOCK_SIZE - initial_bytes]), src, initial_bytes);
-                                    total_bytes_written += initial_bytes;
-                                    initial_bytes_written = true;
-                                    num_blocks_used++;
-                                } //End 
-                                else if (num_blocks_used == num_blocks_needed && remainder_bytes % BLOCK_SIZE != 0)
-                                {
-                                    memcpy(buffer, &(((uint8_t *)src)[total_bytes_written]), remainder_bytes);
-                                    total_bytes_written += remainder_bytes;
-                                    finished = true;
-                                    //printf("\n1: total_bytes_written = %zu\n", total_bytes_written);
-                                    num_blocks_used++;
-                                }
-                                else
-                                {
-                                    memcpy(buffer, &(((uint8_t *)src)[total_bytes_written]), BLOCK_SIZE);
-                                    memcpy(buffer, src, BLOCK_SIZE);
-                                    total_bytes_written += BLOCK_SIZE;
-                                    num_blocks_used++;
-
-                                    if (total_bytes_written == nbyte)
-                                    {
-                                        //printf("1: I happened-----------------------------------\n");
-                                        finished = true;
-                                    } //End 
-                                    //printf("\n2: total_bytes_written = %zu\n", total_bytes_written);
-                                } //End else
-
-                                //if (!block_store_write(fs->bs, indirect_block[j], buffer))
-                                if (!block_store_write(fs->bs, dbl_indirect_block[k], buffer))
-                                {
-                                    fs->fd_table.fd_pos[fd] += total_bytes_written;
-                                    fd_inode->mdata.size += total_bytes_written;
-                                    write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                                    free(fd_inode);
-                                    return total_bytes_written;
-                                } //End else
-                            } //End 
-                            else
-                            {
-                                fs->fd_table.fd_pos[fd] += total_bytes_written;
-                                fd_inode->mdata.size = total_bytes_written;
-                                write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                                free(fd_inode);
-                                return total_bytes_written;
-                            } //End else
-
-                            if (finished /*|| cur_pos + total_bytes_written >= 33398272*//*33529344 33396736*/)
-                            {
-                                finished = true;
-                                //printf("2: I happened------------------------------------------------------------------------\n");
-                                break;
-                            } //End
-                        } //End for (k = dbl_indir_index2; k < BLOCK_SIZE/sizeof(block_ptr_t) && total_bytes_written < nbyte && !finished && num_blocks_used <= num_blocks_needed; k++)
-                        //printf("\tdbl_indirect: after dbl_indirect: k = %u\n", k);
-                    } //End 
-                    else
-                    {
-                        fs->fd_table.fd_pos[fd] += total_bytes_written;
-                        fd_inode->mdata.size += total_bytes_written;
-                        write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-                        free(fd_inode);
-                        return total_bytes_written;
-                    } //End else
-
-                    if (finished)
-                    {
-                        //printf("2: I happened------------------------------------------------------------------------\n");
-                        break;
-                    } //End
-                } //End for (j = dbl_indir_index1; j < BLOCK_SIZE/sizeof(block_ptr_t) && total_bytes_written < nbyte && !finished && num_blocks_used <= num_blocks_needed; j++)
-                //printf("\tdbl_indirect: after indirect: j = %u\n", j);
-            } //End if (block_store_read(fs->bs, fd_inode->data_ptrs[i], indirect_block)) 
+    __atomic_add_fetch(&fs->views_outstanding, 1, __ATOMIC_RELAXED);
+    *spans_out = spans;
+    return total_bytes_viewed;
+} //End 
 
+/***************************************************/
 
-        } //End else
+int fs_release_view(S17FS_t *fs, dyn_array_t *spans)
+{
+    if (fs == NULL || spans == NULL)
+    {
+        return -1;
+    } //End 
 
-        if (total_bytes_written == nbyte || finished)
+    //Never let the count wrap if a view is released twice
+    size_t outstanding = __atomic_load_n(&fs->views_outstanding, __ATOMIC_RELAXED);
+    do
+    {
+        if (outstanding == 0)
         {
-            //printf("3: I happened------------------------------------------------------------------------\n");
-            break;
+            return -1;
         } //End 
-    } //End for (int i = 0; i < num_blocks_needed; i++)
+    } while (!__atomic_compare_exchange_n(&fs->views_outstanding, &outstanding, outstanding - 1, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
 
-    //printf("i = %u\n", i);
-    fs->fd_table.fd_pos[fd] += total_bytes_written;
-    fd_inode->mdata.size += total_bytes_written;
-    write_inode(fs, fd_inode, fd_inode->mdata.self_inode_num);
-    free(fd_inode);
-
-    //printf("total_bytes_written = %zu\n", total_bytes_written);
-    //printf("AFTER: overhead = %d\n", overhead);
-    return total_bytes_written;
+    journal_unpin(fs->journal);
+    dyn_array_destroy(spans);
+    return 0;
 } //End 
 
 /***************************************************/
 
-int fs_remove(S17FS_t *fs, const char *path)
+int fs_set_write_buffer(S17FS_t *fs, int fd, bool enable)
 {
-    //Check that the parameters are valid
-    if (fs == NULL || path == NULL  || (strcmp(path, "") == 0) || strlen(path) >= FS_NAME_MAX || path[0] != '/' || path[strlen(path)-1] == '/' || (strlen(path) == 1))
+    if (!lock_descriptor(fs, fd, true))
     {
-        //printf("fs_remove: Return 0\n");
         return -1;
-    } //End
-    //printf("\nPath: %s\n", path);
-
-    //Get the root directory
-    inode_t* root = get_root_dir(fs);
-    //printf("\nroot->data_ptrs[0] == %u", root->data_ptrs[0]);
+    } //End 
 
-    if (root == NULL || (root->data_ptrs[0] <= 32 && root->data_ptrs[0] > 0))
+    int result = 0;
+    if (enable)
     {
-        //printf("\nroot == %p", root);
-        //printf("\nroot->data_ptrs[0] == %u", root->data_ptrs[0]);
-        //printf("fs_remove: Return 1\n");
-        free(root);
-        return -1;
+        if (fs->fd_table.fd_wbuf[fd] == NULL)
+        {
+            fs->fd_table.fd_wbuf[fd] = (uint8_t *)malloc(fs->geo.writeback_bytes);
+            result = fs->fd_table.fd_wbuf[fd] ? 0 : -1;
+        } //End 
     } //End 
+    else
+    {
+        //Turning it off writes out whatever is pending first
+        result = flush_write_buffer(fs, fd) ? 0 : -1;
+        free(fs->fd_table.fd_wbuf[fd]);
+        fs->fd_table.fd_wbuf[fd] = NULL;
+    } //End else
+
+    unlock_descriptor(fs, fd);
+    return result;
+} //End 
+
+/***************************************************/
 
-    //Get the contents of the root directory
-    //void* dir_contents = (file_record_t *)malloc(sizeof(data_block_t));
-    file_record_t* dir_contents = get_dir_contents(fs, root->data_ptrs[0]);
-    if (dir_contents == NULL)
+int fs_flush(S17FS_t *fs, int fd)
+{
+    if (!lock_descriptor(fs, fd, true))
     {
-        //printf("fs_remove: Return 2\n");
-        free(root);
         return -1;
     } //End 
 
-    //Determine how long the path is
-    int path_depth = 0;
-    for (size_t i = 0; i < strlen(path); i++)
-    {
-        //printf("%c", path[i]);
-        if (path[i] == '/')
-        {
-            path_depth++;
-        } //End 
-    } //End 
+    int result = flush_write_buffer(fs, fd) ? 0 : -1;
+    unlock_descriptor(fs, fd);
+    return result;
+} //End 
+
+/***************************************************/
 
-    //Tokenize the path and determine if the path exists
-    char* path_copy = (char *)malloc(sizeof(char)*64);
-    memcpy(path_copy, path, strlen(path)+1);
+//A journaled volume commits instead, the commit syncs the store once the metadata is logged
+static bool sync_volume(S17FS_t *fs)
+{
+    return fs->journal ? journal_commit(fs->journal) : sync_store(fs);
+} //End 
 
-    char* token = NULL;
-    const char delims[2] = "/";
-    token = strtok(path_copy, delims);
+/***************************************************/
 
-    inode_t* cur_dir_inode = NULL;
-    if (path_depth == 1)
+int fs_fsync(S17FS_t *fs, int fd)
+{
+    if (!lock_descriptor(fs, fd, true))
     {
-        cur_dir_inode = root;
+        return -1;
     } //End 
 
-    int cur_depth = 1;
-    int next_rec_found = 0;
-    int j = 0;
+    //The file's blocks and inode don't get synced on their own, the store only knows which pages changed
+    bool flushed = flush_write_buffer(fs, fd);
+    unlock_descriptor(fs, fd);
+    return flushed && sync_volume(fs) ? 0 : -1;
+} //End 
+
+/***************************************************/
 
-    //printf("\n%s", token);
-    while (token != NULL && path_depth > 1)
+int fs_sync(S17FS_t *fs)
+{
+    if (fs == NULL)
     {
-        //printf("/%s", token);
-        if(cur_depth == path_depth)
-        {
-            //Found where the new record should go
-            break;
-        } //End 
+        return -1;
+    } //End 
 
-        next_rec_found = 0;
+    bool pushed = push_volume(fs);
+    return sync_volume(fs) && pushed ? 0 : -1;
+} //End 
 
-        for (j = 0; j < DIR_REC_MAX; j++)
-        {
-            if (strcmp(dir_contents[j].name, token) == 0 && dir_contents[j].type == FS_DIRECTORY)
-            {
-                //The current path was found
-                //printf("\nI happened!\n");
-                next_rec_found = 1;
+/***************************************************/
 
-                //Get the data blocks of the next part of the path
-                free(cur_dir_inode);
-                cur_dir_inode = get_dir(fs, dir_contents[j].inode_num);
+int fs_grow(S17FS_t *fs, size_t block_count)
+{
+    if (fs == NULL)
+    {
+        return -1;
+    } //End 
 
-                if (cur_dir_inode == NULL || (cur_dir_inode->data_ptrs[0] <= 32 && cur_dir_inode->data_ptrs[0] > 0))
-                {
-                    //printf("fs_remove: Return 4: cur_dir-inode->data_ptrs[0] = %u\n", cur_dir_inode->data_ptrs[0]);
-                    free(root);
-                    free(dir_contents);
-                    free(path_copy);
-                    free(cur_dir_inode);
-                    return -1;
-                } //End
-
-                if (block_store_read(fs->bs, cur_dir_inode->data_ptrs[0], dir_contents) <= 0)
-                {
-                    //printf("fs_remove: Return 5\n");
-                    free(root);
-                    free(dir_contents);
-                    free(path_copy);
-                    free(cur_dir_inode);
-                    return -1;
-                } //End 
+    journal_begin(fs->journal);
+    bool grown = grow_volume(fs, block_count);
+    journal_end(fs->journal);
+    return grown ? 0 : -1;
+} //End 
 
-            } //End 
-        } //End
+/***************************************************/
 
-        if (next_rec_found == 0)
-        {
-            //printf("fs_remove: Return 6\n");
-            //Directory wasn't found
-            free(root);
-            free(dir_contents);
-            free(path_copy);
-            free(cur_dir_inode);
-            return -1;
-        } //End 
+static int remove_file(S17FS_t *fs, const char *path)
+{
+    //Check that the parameters are valid
+    if (fs == NULL || path == NULL  || (strcmp(path, "") == 0) || strlen(path) >= FS_NAME_MAX || path[0] != '/' || path[strlen(path)-1] == '/' || (strlen(path) == 1))
+    {
+        return -1;
+    } //End
 
-        token = strtok(NULL, delims);
-        cur_depth++;
+    //The directory holding the record is locked exclusively for the whole removal
+    const char *name = strrchr(path, '/') + 1;
+    inode_t dir_inode;
+    dir_block_t dir_contents;
+    if (!lookup_dir(fs, path, name - path, true, &dir_inode, &dir_contents))
+    {
+        return -1;
     } //End 
+    inode_ptr_t dir_inode_num = dir_inode.mdata.self_inode_num;
 
     //Search for the record in the target directory
-    for (int i = 0; i < DIR_REC_MAX; i++)
+    int result = -1;
+    for (size_t i = 0; i < fs->geo.dir_records; i++)
     {
-        //printf("\ndir_contents[%d].name = %s - token = %s\ndir_contents[%d].inum = %u - *.type = %u - *.record_count = %u\n", i, dir_contents[i].name, token, i, dir_contents[i].inode_num, dir_contents[i].type, dir_contents[i].record_count);
-        //printf("Results of strcmp = %d\n\tstr**%s**\n\t**%s**\n", strcmp(dir_contents[i].name, token), dir_contents[i].name, token);
-        if (strcmp(dir_contents[i].name, token) == 0 /*&& ((dir_contents[i].record_count == 0 && dir_contents[i].type == FS_DIRECTORY) || dir_contents[i].type == FS_REGULAR)*/)
+        file_record_t *record = &dir_contents.records[i];
+        if (strcmp(record->name, name) == 0)
         {
-            inode_t* dir_inode = get_inode(fs, dir_contents[i].inode_num);
-            if (dir_contents[i].type == FS_DIRECTORY)
+            //Nobody can be partway through a call on the file while it goes away
+            inode_ptr_t target = record->inode_num;
+            lock_inode(fs, target, true);
+
+            //Directories have to be empty first
+            inode_t target_inode;
+            bool removable = read_inode(fs, &target_inode, target) && (record->type != FS_DIRECTORY || target_inode.mdata.record_count == 0);
+            if (removable)
             {
-                if (!dir_inode)
+                //Lock-free lookups that saw the record, or walked into the directory being removed, have to notice
+                begin_dir_update(fs, dir_inode_num);
+                begin_dir_update(fs, target);
+
+                //Found the record, need to remove it from the directory, and remove any related file descriptors
+                remove_files_file_descriptors(fs, target);
+
+                memset(record->name, 0, FS_FNAME_MAX);
+                record->type = -1;
+                record->inode_num = 0;
+                dir_inode.mdata.record_count -= 1;
+                if (write_record(fs, record, inode_ptr(&dir_inode, 0), i) && write_inode(fs, &dir_inode, dir_inode_num))
                 {
-                    break;
+                    result = 0;
                 } //End 
 
-                //printf("fs_remove: dir_inode->mdata.record_count = %u\n", dir_inode->mdata.record_count);
-
-                if (dir_inode->mdata.record_count > 0)
+                end_dir_update(fs, target);
+                end_dir_update(fs, dir_inode_num);
+                //A record that couldn't be cleared still points at the inode, so it can't be handed out again
+                if (result == 0)
                 {
-                    free(dir_inode);
-                    break;
-                } //End
+                    release_file_blocks(fs, &target_inode);
+                    release_inode_number(fs, target);
+                } //End 
             } //End 
 
-            //printf("fs_remove: Return 7 - SUCCESS\n");
-            //Found the record, need to remove it from the directory, and remove any related file descriptors
-            char* empty_name = "\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0\0";
-            //dir_contents[i].name[0] = dir_contents[i].name[1] = dir_contents[i].name[2] = dir_contents[i].name[3] = '\0';
-            memcpy(dir_contents[i].name, empty_name, 64);
-            dir_contents[i].type = -1;
-            bitmap_reset(fs->inode_bitmap, dir_contents[i].inode_num);
-            cur_dir_inode->mdata.record_count -= 1;
-            //dir_inode->mdata.record_count -= 1;
-            write_inode(fs, cur_dir_inode, cur_dir_inode->mdata.self_inode_num);
-            free(dir_inode);
-            remove_files_file_descriptors(fs, dir_contents[i].inode_num);
-            dir_contents[i].inode_num = 0;
-
-            free(root);
-            free(dir_contents);
-            free(path_copy);
-            if (path_depth > 1)
-            {
-                free(cur_dir_inode);
-            } //End
-
-            return 0;
+            unlock_inode(fs, target);
+            break;
         } //End 
     } //End
 
-    free(root);
-    free(dir_contents);
-    free(path_copy);
-    if (path_depth > 1)
-    {
-        free(cur_dir_inode);
-    } //End 
+    unlock_inode(fs, dir_inode_num);
+    return result;
+} //End 
 
-    //printf("fs_remove: Return 8: file not found\n");
 
-    return -1;
-} //End 
+/***************************************************/
 
+int fs_remove(S17FS_t *fs, const char *path)
+{
+    journal_t *journal = fs ? fs->journal : NULL;
+    journal_begin(journal);
+    int result = remove_file(fs, path);
+    journal_end(journal);
+    return result;
+} //End 
 /***************************************************/
 
 dyn_array_t *fs_get_dir(S17FS_t *fs, const char *path)
@@ -1819,167 +987,203 @@ dyn_array_t *fs_get_dir(S17FS_t *fs, const char *path)
     //Check that the parameters are valid
     if (fs == NULL || path == NULL  || (strcmp(path, "") == 0) || strlen(path) >= FS_NAME_MAX || path[0] != '/' || (path[strlen(path)-1] == '/' && strlen(path) > 1))
     {
-        //printf("\nReturn 0\n");
         return NULL;
     } //End
-    //printf("\nPath: %s\n", path);
-
-    //Get the root directory
-    inode_t* root = get_root_dir(fs);
-    //printf("\nroot->data_ptrs[0] == %u", root->data_ptrs[0]);
 
-    if (root == NULL || (root->data_ptrs[0] <= 32 && root->data_ptrs[0] > 0))
+    //Every component has to be a directory, the last one included
+    //A lock-free snapshot is enough for a listing, the locks are only for when a writer keeps getting in the way
+    inode_t dir_inode;
+    dir_block_t dir_contents;
+    uint32_t version;
+    if (!peek_dir(fs, path, strlen(path), &dir_inode, &dir_contents, &version))
     {
-        //printf("\nroot == %p", root);
-        //printf("\nroot->data_ptrs[0] == %u", root->data_ptrs[0]);
-        //printf("\nReturn 1\n");
-        free(root);
-        return NULL;
+        if (!lookup_dir(fs, path, strlen(path), false, &dir_inode, &dir_contents))
+        {
+            return NULL;
+        } //End 
+        unlock_inode(fs, dir_inode.mdata.self_inode_num);
     } //End 
 
-    //Get the contents of the root directory
-    file_record_t* dir_contents = get_dir_contents(fs, root->data_ptrs[0]);
-    if (dir_contents == NULL)
+    dyn_array_t* da = dyn_array_create(fs->geo.dir_records, sizeof(file_record_t), NULL);
+    if (da)
     {
-        //printf("\nReturn 2\n");
-
-        free(root);
-        return NULL;
+        //Removed records leave an empty slot behind
+        for (size_t i = 0; i < fs->geo.dir_records; i++)
+        {
+            if (dir_contents.records[i].name[0] != '\0')
+            {
+                dyn_array_push_front(da, &dir_contents.records[i]);
+            } //End 
+        } //End
     } //End 
 
-    //Determine how long the path is
-    int path_depth = 1;
-    for (size_t i = 0; i < strlen(path) && strlen(path) > 1; i++)
-    {
-        //printf("%c", path[i]);
-        if (path[i] == '/')
+    return da;
+} //End 
+
+/***************************************************/
+
+//A run of ops from one fs_submit call that go one after the other, a lone op is a chain of one
+typedef struct {
+    S17FS_t *fs;
+    size_t count;
+    fs_op_t ops[];
+} async_chain_t;
+
+//Worker job, runs a chain and posts a completion per op as each one finishes
+static void run_async_chain(void *arg)
+{
+    async_chain_t *chain = (async_chain_t *)arg;
+    S17FS_t *fs = chain->fs;
+    bool failed = false;
+    for (size_t i = 0; i < chain->count; i++)
+    {
+        const fs_op_t *op = &chain->ops[i];
+        ssize_t result = -1;
+        if (!failed)
+        {
+            switch (op->opcode)
+            {
+                case FS_OP_NOP:
+                    result = 0;
+                    break;
+                case FS_OP_OPEN:
+                    result = fs_open(fs, op->path);
+                    break;
+                case FS_OP_CLOSE:
+                    result = fs_close(fs, op->fd);
+                    break;
+                case FS_OP_CREATE:
+                    result = fs_create(fs, op->path, op->type);
+                    break;
+                case FS_OP_REMOVE:
+                    result = fs_remove(fs, op->path);
+                    break;
+                case FS_OP_READ:
+                    result = fs_read(fs, op->fd, op->buf, op->nbyte);
+                    break;
+                case FS_OP_WRITE:
+                    result = fs_write(fs, op->fd, op->buf, op->nbyte);
+                    break;
+                case FS_OP_PREAD:
+                    result = fs_pread(fs, op->fd, op->buf, op->nbyte, op->offset);
+                    break;
+                case FS_OP_PWRITE:
+                    result = fs_pwrite(fs, op->fd, op->buf, op->nbyte, op->offset);
+                    break;
+                case FS_OP_FLUSH:
+                    result = fs_flush(fs, op->fd);
+                    break;
+            } //End switch (op->opcode)
+            failed = result < 0;
+        } //End 
+
+        fs_completion_t completion = {op->user_data, result};
+        pthread_mutex_lock(&fs->async_lock);
+        if (!dyn_array_push_back(fs->completions, &completion))
         {
-            path_depth++;
+            //Nowhere to keep it, don't leave a reaper waiting for it forever
+            fs->async_unreaped--;
         } //End 
+        fs->async_running--;
+        pthread_cond_broadcast(&fs->async_done);
+        pthread_mutex_unlock(&fs->async_lock);
     } //End 
+    free(chain);
+} //End 
 
-    //Tokenize the path and determine if the path exists
-    char* path_copy = (char *)malloc(sizeof(char)*64);
-    memcpy(path_copy, path, strlen(path)+1);
+/***************************************************/
 
-    char* token = NULL;
-    const char delims[2] = "/";
-    token = strtok(path_copy, delims);
+int fs_submit(S17FS_t *fs, const fs_op_t *ops, size_t n)
+{
+    if (fs == NULL || ops == NULL || n == 0 || n > INT_MAX)
+    {
+        return -1;
+    } //End 
 
-    inode_t* cur_dir_inode = NULL;
-    if (path_depth == 1)
+    worker_pool_t *pool = get_worker_pool(fs);
+    if (pool == NULL)
     {
-        //printf("\nPath: %s\nPath len == %d\n", path, path_depth);
-        cur_dir_inode = root;
+        return -1;
     } //End 
 
-    int cur_depth = 1;
-    int next_rec_found = 0;
-    int j = 0;
+    //Set up by whichever submit gets here first, and only ever looked at under the lock
+    pthread_mutex_lock(&fs->async_lock);
+    if (fs->completions == NULL)
+    {
+        fs->completions = dyn_array_create(n, sizeof(fs_completion_t), NULL);
+    } //End 
+    bool ready = fs->completions != NULL;
+    pthread_mutex_unlock(&fs->async_lock);
+    if (!ready)
+    {
+        return -1;
+    } //End 
 
-    //printf("\nToken before: %s", token);
-    while (token != NULL && path_depth > 1)
+    size_t queued = 0;
+    while (queued < n)
     {
-        //printf("\nMade it into the directory traversing loop\n");
-        //printf("/%s", token);
-        if(cur_depth == path_depth+1)
+        //A chain runs through every op flagged FS_OP_LINK, plus the one after the last of them
+        size_t count = 1;
+        while (queued + count < n && (ops[queued + count - 1].flags & FS_OP_LINK))
         {
-            //Found where the new record should go
-            //printf("\ncur_depth == path_depth+1\n");
-            break;
+            count++;
         } //End 
 
-        next_rec_found = 0;
-
-        for (j = 0; j < DIR_REC_MAX; j++)
+        async_chain_t *chain = (async_chain_t *)malloc(sizeof(async_chain_t) + count * sizeof(fs_op_t));
+        if (chain == NULL)
         {
-            if (strcmp(dir_contents[j].name, token) == 0 && dir_contents[j].type == FS_DIRECTORY)
-            {
-                //The current path was found
-                //printf("\nI happened!\n");
-                next_rec_found = 1;
-
-                //Get the data blocks of the next part of the path
-                free(cur_dir_inode);
-                cur_dir_inode = get_dir(fs, dir_contents[j].inode_num);
-
-                if (cur_dir_inode == NULL || (cur_dir_inode->data_ptrs[0] <= 32 && cur_dir_inode->data_ptrs[0] > 0))
-                {
-                    //printf("\nReturn 3: cur_dir-inode->data_ptrs[0] = %u\n", cur_dir_inode->data_ptrs[0]);
-
-                    free(root);
-                    free(dir_contents);
-                    free(path_copy);
-                    free(cur_dir_inode);
-                    return NULL;
-                } //End
-
-                if (block_store_read(fs->bs, cur_dir_inode->data_ptrs[0], dir_contents) <= 0)
-                {
-                    //printf("\nReturn 4\n");
-
-                    free(root);
-                    free(dir_contents);
-                    free(path_copy);
-                    free(cur_dir_inode);
-                    return NULL;
-                } //End 
+            break;
+        } //End 
+        chain->fs = fs;
+        chain->count = count;
+        memcpy(chain->ops, ops + queued, count * sizeof(fs_op_t));
 
-            } //End 
-        } //End
+        //Counted before it's queued so the worker can never take the counts below zero
+        pthread_mutex_lock(&fs->async_lock);
+        fs->async_running += count;
+        fs->async_unreaped += count;
+        pthread_mutex_unlock(&fs->async_lock);
 
-        if (next_rec_found == 0)
+        if (!worker_pool_submit(pool, run_async_chain, chain))
         {
-            //printf("\nReturn 5\n");
-            //Directory wasn't found
-            free(root);
-            free(dir_contents);
-            free(path_copy);
-            free(cur_dir_inode);
-            return NULL;
+            pthread_mutex_lock(&fs->async_lock);
+            fs->async_running -= count;
+            fs->async_unreaped -= count;
+            pthread_mutex_unlock(&fs->async_lock);
+            free(chain);
+            break;
         } //End 
-
-        token = strtok(NULL, delims);
-        cur_depth++;
+        queued += count;
     } //End 
-    //printf("\nToken after: %s", token);
 
-    dyn_array_t* da = dyn_array_create(DIR_REC_MAX, sizeof(file_record_t), NULL);
-    if (da)
-    {
-        //printf("\n");
-        //Search for the record in the target directory
-        for (size_t i = 0; i < DIR_REC_MAX && i < cur_dir_inode->mdata.record_count; i++)
-        {
-            //printf("Record: %s\n", dir_contents[i].name);
-            dyn_array_push_front(da, &dir_contents[i]);
-        } //End
+    return queued ? (int)queued : -1;
+} //End 
 
-        free(root);
-        free(dir_contents);
-        free(path_copy);
-        if (path_depth > 1)
-        {
-            free(cur_dir_inode);
-        } //End
+/***************************************************/
 
-        return da;
+int fs_reap(S17FS_t *fs, fs_completion_t *completions, size_t max)
+{
+    if (fs == NULL || completions == NULL || max == 0)
+    {
+        return -1;
     } //End 
 
-
-
-    free(root);
-    free(dir_contents);
-    free(path_copy);
-    if (path_depth > 1)
+    pthread_mutex_lock(&fs->async_lock);
+    while (fs->async_unreaped && dyn_array_empty(fs->completions))
     {
-        free(cur_dir_inode);
+        pthread_cond_wait(&fs->async_done, &fs->async_lock);
     } //End 
 
-
-    //printf("\nReturn 6\n");
-
-    return NULL;
+    //Oldest first, taken in one go so whatever is left only gets moved up once
+    size_t reaped = dyn_array_size(fs->completions);
+    reaped = reaped > max ? max : (reaped > INT_MAX ? INT_MAX : reaped);
+    if (reaped && !dyn_array_extract_range(fs->completions, 0, reaped, completions))
+    {
+        reaped = 0;
+    } //End 
+    fs->async_unreaped -= reaped;
+    pthread_mutex_unlock(&fs->async_lock);
+    return (int)reaped;
 } //End 
 
 /***************************************************/
@@ -1,6 +1,10 @@
 #include "backend.h"
 #include <backend.h>
+#include <errno.h>
+#include <limits.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
 #include <time.h>
 #include <stdio.h>
 
@@ -8,369 +12,3051 @@
 
 /**********************************************************/
 
-bool remove_files_file_descriptors(S17FS_t *const fs, const inode_ptr_t inode_number)
+//On a journaled volume the journal holds the newest copy of a metadata block until its commit sends it home
+static bool read_metadata(S17FS_t *fs, const size_t block, void *buffer)
+{
+    return journal_read(fs->journal, block, 0, fs->geo.block_size, buffer) || block_store_read(fs->bs, block, buffer) != 0;
+} //End 
+
+static bool write_metadata(S17FS_t *fs, const size_t block, const void *buffer)
+{
+    return fs->journal ? journal_write(fs->journal, block, buffer) : block_store_write(fs->bs, block, buffer) != 0;
+} //End 
+
+//Views have to see the journal's copy too, fs_read_view pins it so the copy outlives its commit
+static const uint8_t *view_metadata(S17FS_t *fs, const size_t block)
+{
+    const uint8_t *held = (const uint8_t *)journal_view(fs->journal, block);
+    return held ? held : (const uint8_t *)block_store_get_ptr(fs->bs, block);
+} //End 
+
+/**********************************************************/
+
+//Index into fs->table of the block holding an inode, inode 0 shares block 0 with the bitmap and superblock
+static size_t inode_block(const S17FS_t *fs, const inode_ptr_t inode_number)
+{
+    return inode_number ? inode_number / fs->geo.inodes_per_block + 1 : 0;
+} //End 
+
+/**********************************************************/
+
+//The table block holding an inode, NULL if the table hasn't grown that far
+static table_block_t *table_block(S17FS_t *fs, const inode_ptr_t inode_number)
+{
+    if (fs->table == NULL || inode_number >= fs->geo.inode_limit)
+    {
+        return NULL;
+    } //End 
+    return __atomic_load_n(&fs->table[inode_block(fs, inode_number)], __ATOMIC_ACQUIRE);
+} //End 
+
+/**********************************************************/
+
+static inode_sync_t *inode_sync(S17FS_t *fs, const inode_ptr_t inode_number)
+{
+    table_block_t *block = table_block(fs, inode_number);
+    return block ? &block->inodes[inode_number % fs->geo.inodes_per_block] : NULL;
+} //End 
+
+/**********************************************************/
+
+static void free_table_block(const S17FS_t *fs, table_block_t *block)
+{
+    if (block)
+    {
+        pthread_mutex_destroy(&block->table_lock);
+        for (size_t i = 0; i < fs->geo.inodes_per_block; i++)
+        {
+            pthread_rwlock_destroy(&block->inodes[i].lock);
+        } //End 
+        free(block);
+    } //End 
+} //End 
+
+/**********************************************************/
+
+//Makes the locks for a block joining the inode table, once it's in place any of its inodes can be used
+static bool add_table_block(S17FS_t *fs, const size_t index, const block_ptr_t block)
+{
+    table_block_t *entry = (table_block_t *)calloc(1, sizeof(table_block_t) + fs->geo.inodes_per_block * sizeof(inode_sync_t));
+    if (entry == NULL)
+    {
+        return false;
+    } //End 
+
+    entry->block = block;
+    bool valid = pthread_mutex_init(&entry->table_lock, NULL) == 0;
+    for (size_t i = 0; i < fs->geo.inodes_per_block; i++)
+    {
+        valid &= pthread_rwlock_init(&entry->inodes[i].lock, NULL) == 0;
+    } //End 
+    if (!valid)
+    {
+        free_table_block(fs, entry);
+        return false;
+    } //End 
+
+    __atomic_store_n(&fs->table[index], entry, __ATOMIC_RELEASE);
+    return true;
+} //End 
+
+/**********************************************************/
+
+//Sets up the blocks of the fixed table, the rest join as the table grows
+static bool create_inode_table(S17FS_t *fs)
+{
+    fs->table = (table_block_t **)calloc(fs->geo.table_max, sizeof(table_block_t *));
+    bool valid = fs->table != NULL;
+    for (size_t index = 0; index < fs->geo.table_blocks && valid; index++)
+    {
+        valid = add_table_block(fs, index, index);
+    } //End 
+    return valid;
+} //End 
+
+/**********************************************************/
+
+bool init_S17FS_locks(S17FS_t *fs)
+{
+    if (fs == NULL)
+    {
+        return false;
+    } //End 
+
+    bool valid = pthread_mutex_init(&fs->alloc_lock, NULL) == 0;
+    valid &= pthread_mutex_init(&fs->frag_lock, NULL) == 0;
+    valid &= pthread_mutex_init(&fs->pool_lock, NULL) == 0;
+    valid &= pthread_mutex_init(&fs->async_lock, NULL) == 0;
+    valid &= pthread_cond_init(&fs->async_done, NULL) == 0;
+    valid &= pthread_mutex_init(&fs->fd_table.status_lock, NULL) == 0;
+    valid &= pthread_mutex_init(&fs->grow_lock, NULL) == 0;
+    for (size_t i = 0; i < DESCRIPTOR_MAX; i++)
+    {
+        valid &= pthread_mutex_init(&fs->fd_table.fd_lock[i], NULL) == 0;
+    } //End 
+    return valid;
+} //End 
+
+/**********************************************************/
+
+void destroy_S17FS_locks(S17FS_t *fs)
 {
     if (fs)
     {
-        for (int i = 0; i < DESCRIPTOR_MAX; i++)
+        worker_pool_destroy(fs->pool);
+        fs->pool = NULL;
+        pthread_mutex_destroy(&fs->pool_lock);
+        pthread_cond_destroy(&fs->async_done);
+        pthread_mutex_destroy(&fs->async_lock);
+        dyn_array_destroy(fs->completions);
+        fs->completions = NULL;
+        pthread_mutex_destroy(&fs->alloc_lock);
+        pthread_mutex_destroy(&fs->frag_lock);
+        pthread_mutex_destroy(&fs->fd_table.status_lock);
+        pthread_mutex_destroy(&fs->grow_lock);
+        for (size_t i = 0; fs->table && i < fs->geo.table_max; i++)
+        {
+            free_table_block(fs, fs->table[i]);
+        } //End 
+        free(fs->table);
+        fs->table = NULL;
+        for (size_t i = 0; i < DESCRIPTOR_MAX; i++)
+        {
+            pthread_mutex_destroy(&fs->fd_table.fd_lock[i]);
+        } //End 
+    } //End 
+} //End 
+
+/**********************************************************/
+
+//An inode the table doesn't reach has nothing to lock, reading it fails anyway
+void lock_inode(S17FS_t *fs, const inode_ptr_t inode_number, const bool exclusive)
+{
+    inode_sync_t *sync = inode_sync(fs, inode_number);
+    if (sync && exclusive)
+    {
+        pthread_rwlock_wrlock(&sync->lock);
+    } //End 
+    else if (sync)
+    {
+        pthread_rwlock_rdlock(&sync->lock);
+    } //End else
+} //End 
+
+/**********************************************************/
+
+void unlock_inode(S17FS_t *fs, const inode_ptr_t inode_number)
+{
+    inode_sync_t *sync = inode_sync(fs, inode_number);
+    if (sync)
+    {
+        pthread_rwlock_unlock(&sync->lock);
+    } //End 
+} //End 
+
+/**********************************************************/
+
+//Checks the descriptor is open and gives back the inode it points at, under the status lock
+static bool descriptor_inode(S17FS_t *fs, const int fd, inode_ptr_t *inode_number)
+{
+    pthread_mutex_lock(&fs->fd_table.status_lock);
+    bool open = bitmap_test(fs->fd_table.fd_status, fd);
+    *inode_number = fs->fd_table.fd_inode[fd];
+    pthread_mutex_unlock(&fs->fd_table.status_lock);
+    return open;
+} //End 
+
+/**********************************************************/
+
+bool lock_descriptor(S17FS_t *fs, const int fd, const bool for_write)
+{
+    if (fs == NULL || fd < 0 || fd >= DESCRIPTOR_MAX)
+    {
+        return false;
+    } //End 
+
+    //Everything done through a descriptor is one journal update, opened ahead of any lock
+    journal_begin(fs->journal);
+    pthread_mutex_t *fd_lock = &fs->fd_table.fd_lock[fd];
+    pthread_mutex_lock(fd_lock);
+
+    inode_ptr_t inode_number;
+    if (!descriptor_inode(fs, fd, &inode_number))
+    {
+        pthread_mutex_unlock(fd_lock);
+        journal_end(fs->journal);
+        return false;
+    } //End 
+
+    //Readers only need the file share locked, unless write buffers are holding bytes they should see
+    bool exclusive = for_write || __atomic_load_n(&fs->fd_table.wbuf_pending, __ATOMIC_ACQUIRE) != 0;
+    lock_inode(fs, inode_number, exclusive);
+
+    //A remove can close the descriptor out from under us while we wait on the file
+    inode_ptr_t locked_inode;
+    if (!descriptor_inode(fs, fd, &locked_inode) || locked_inode != inode_number)
+    {
+        unlock_inode(fs, inode_number);
+        pthread_mutex_unlock(fd_lock);
+        journal_end(fs->journal);
+        return false;
+    } //End 
+
+    if (!for_write && exclusive && !flush_inode_write_buffers(fs, inode_number, -1))
+    {
+        unlock_inode(fs, inode_number);
+        pthread_mutex_unlock(fd_lock);
+        journal_end(fs->journal);
+        return false;
+    } //End 
+
+    return true;
+} //End 
+
+/**********************************************************/
+
+void unlock_descriptor(S17FS_t *fs, const int fd)
+{
+    unlock_inode(fs, fs->fd_table.fd_inode[fd]);
+    pthread_mutex_unlock(&fs->fd_table.fd_lock[fd]);
+    journal_end(fs->journal);
+} //End 
+
+/**********************************************************/
+
+worker_pool_t *get_worker_pool(S17FS_t *fs)
+{
+    worker_pool_t *pool = __atomic_load_n(&fs->pool, __ATOMIC_ACQUIRE);
+    if (pool == NULL)
+    {
+        //A core each, but always at least two so there's someone to hand work to
+        pthread_mutex_lock(&fs->pool_lock);
+        if ((pool = fs->pool) == NULL)
+        {
+            long cores = sysconf(_SC_NPROCESSORS_ONLN);
+            size_t threads = cores < 2 ? 2 : (cores > WORKER_MAX ? WORKER_MAX : (size_t) cores);
+            pool = worker_pool_create(threads);
+            __atomic_store_n(&fs->pool, pool, __ATOMIC_RELEASE);
+        } //End 
+        pthread_mutex_unlock(&fs->pool_lock);
+    } //End 
+    return pool;
+} //End 
+
+/**********************************************************/
+
+//Block 0 is rewritten whole, like any inode table block, the inodes sharing it with the slot keep what they had
+//Its table lock has to be held
+static bool rewrite_block_zero(S17FS_t *fs, const size_t slot, const void *contents, const size_t length)
+{
+    data_block_t buffer;
+    table_block_t *zero = fs->table[0];
+    bool written = false;
+    if (read_metadata(fs, 0, buffer))
+    {
+        memcpy(buffer + slot * INODE_CORE_BYTES, contents, length);
+        __atomic_add_fetch(&zero->table_seq, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+        written = write_metadata(fs, 0, buffer);
+        __atomic_add_fetch(&zero->table_seq, 1, __ATOMIC_RELEASE);
+    } //End 
+    return written;
+} //End 
+
+/**********************************************************/
+
+static bool write_block_zero_slot(S17FS_t *fs, const size_t slot, const void *contents, const size_t length)
+{
+    pthread_mutex_lock(&fs->table[0]->table_lock);
+    bool written = rewrite_block_zero(fs, slot, contents, length);
+    pthread_mutex_unlock(&fs->table[0]->table_lock);
+    return written;
+} //End 
+
+/**********************************************************/
+
+bool grow_volume(S17FS_t *fs, const size_t block_count)
+{
+    //Block 0's table lock comes first, the superblock in it changes along with the free block map
+    pthread_mutex_lock(&fs->table[0]->table_lock);
+    pthread_mutex_lock(&fs->alloc_lock);
+    bool grown = block_count <= fs->geo.block_count;
+    data_block_t buffer;
+    if (!grown && block_count <= fs->geo.block_limit && read_metadata(fs, 0, buffer))
+    {
+        superblock_t superblock;
+        memcpy(&superblock, buffer + SUPERBLOCK_SLOT * INODE_CORE_BYTES, sizeof(superblock_t));
+        superblock.block_count = block_count;
+
+        //Whoever sees a block past the old end got it through a lock taken after the geometry changed
+        if (block_store_grow(fs->bs, block_count))
+        {
+            fs->geo.block_count = block_count;
+            fs->geo.data_end = block_store_get_capacity(fs->bs);
+
+            //The new free block map is out before the superblock says where it is, and nothing is handed out
+            //until both are, so a crash in between finds the volume the size it was
+            grown = block_store_sync(fs->bs) && rewrite_block_zero(fs, SUPERBLOCK_SLOT, &superblock, sizeof(superblock_t))
+                    && block_store_sync(fs->bs);
+        } //End 
+    } //End 
+    pthread_mutex_unlock(&fs->alloc_lock);
+    pthread_mutex_unlock(&fs->table[0]->table_lock);
+    return grown;
+} //End 
+
+/**********************************************************/
+
+//The reservation of the write buffer this thread is flushing, if it's flushing one
+static __thread size_t *flush_reservation;
+
+//Whether count blocks can be handed out without eating into what write buffers were promised, alloc_lock has to be held
+static bool can_allocate(S17FS_t *fs, const size_t count)
+{
+    size_t own = flush_reservation ? *flush_reservation : 0;
+    size_t needed = count > own ? count - own : 0;
+    size_t free_blocks = block_store_get_free_blocks(fs->bs);
+    return free_blocks >= fs->blocks_reserved && needed <= free_blocks - fs->blocks_reserved;
+} //End 
+
+//Counts blocks just handed out against the flushing buffer's reservation, alloc_lock has to be held
+static void consume_reservation(S17FS_t *fs, const size_t count)
+{
+    size_t own = flush_reservation ? *flush_reservation : 0;
+    size_t used = count < own ? count : own;
+    if (used)
+    {
+        *flush_reservation -= used;
+        fs->blocks_reserved -= used;
+    } //End 
+} //End 
+
+static size_t allocate_unreserved(S17FS_t *fs, size_t *block_count)
+{
+    pthread_mutex_lock(&fs->alloc_lock);
+    size_t block = can_allocate(fs, 1) ? block_store_allocate(fs->bs) : SIZE_MAX;
+    if (block != SIZE_MAX)
+    {
+        consume_reservation(fs, 1);
+    } //End 
+    *block_count = fs->geo.block_count;
+    pthread_mutex_unlock(&fs->alloc_lock);
+    return block;
+} //End 
+
+size_t allocate_block(S17FS_t *fs)
+{
+    size_t block_count = 0;
+    size_t block = allocate_unreserved(fs, &block_count);
+
+    //Out of room, a volume that can grow doubles, up to its limit, and tries again
+    if (block == SIZE_MAX && block_count < fs->geo.block_limit)
+    {
+        size_t target = block_count < fs->geo.block_limit / 2 ? block_count * 2 : fs->geo.block_limit;
+        if (grow_volume(fs, target))
+        {
+            block = allocate_unreserved(fs, &block_count);
+        } //End 
+    } //End 
+    return block;
+} //End 
+
+/**********************************************************/
+
+//Blocks a buffer ending at hi could need, its data blocks past where the file ended plus the pointer blocks
+//that could come with them, the last block the file had counts as well since its tail may be packed or inline
+static size_t buffer_blocks_needed(const S17FS_t *fs, const int fd, const size_t hi)
+{
+    const fd_table_t *table = &fs->fd_table;
+    size_t first = table->fd_wbuf_block[fd] + table->fd_wbuf_lo[fd] / fs->geo.block_size;
+    size_t end = table->fd_wbuf_block[fd] + (hi + fs->geo.block_size - 1) / fs->geo.block_size;
+    first = first > table->fd_wbuf_from[fd] ? first : table->fd_wbuf_from[fd];
+    size_t data = end > first ? end - first : 0;
+    return data ? data + data / fs->geo.ptrs_per_block + 2 : 0;
+} //End 
+
+//Holds back free blocks for a write buffer's flush, so bytes it takes in always have somewhere to go
+static bool reserve_blocks(S17FS_t *fs, const int fd, const size_t count)
+{
+    //A volume that can still grow has its unused limit to promise too, the flush grows it when it gets there
+    pthread_mutex_lock(&fs->alloc_lock);
+    size_t free_blocks = block_store_get_free_blocks(fs->bs) + (fs->geo.block_limit - fs->geo.block_count);
+    bool reserved = free_blocks >= fs->blocks_reserved && count <= free_blocks - fs->blocks_reserved;
+    if (reserved)
+    {
+        fs->blocks_reserved += count;
+        fs->fd_table.fd_wbuf_reserved[fd] += count;
+    } //End 
+    pthread_mutex_unlock(&fs->alloc_lock);
+    return reserved;
+} //End 
+
+/**********************************************************/
+
+static void unreserve_blocks(S17FS_t *fs, const int fd)
+{
+    pthread_mutex_lock(&fs->alloc_lock);
+    fs->blocks_reserved -= fs->fd_table.fd_wbuf_reserved[fd];
+    fs->fd_table.fd_wbuf_reserved[fd] = 0;
+    pthread_mutex_unlock(&fs->alloc_lock);
+} //End 
+
+/**********************************************************/
+
+void release_block(S17FS_t *fs, const size_t block)
+{
+    //A journaled block stays taken until the transaction giving it up commits, so nothing reuses it before then
+    if (fs->journal)
+    {
+        journal_free(fs->journal, block);
+        return;
+    } //End 
+    pthread_mutex_lock(&fs->alloc_lock);
+    block_store_release(fs->bs, block);
+    pthread_mutex_unlock(&fs->alloc_lock);
+} //End 
+
+/**********************************************************/
+
+//Hands visit the block, and everything below it when it's a pointer block
+typedef bool (*block_visit_t)(S17FS_t *fs, const size_t block, void *arg);
+
+static bool walk_file_blocks(S17FS_t *fs, const block_ptr_t block, const size_t depth, block_visit_t visit, void *arg)
+{
+    if (!BLOCK_PTR_VALID(fs, block))
+    {
+        return true;
+    } //End 
+
+    if (!visit(fs, block, arg))
+    {
+        return false;
+    } //End 
+    if (depth == 0)
+    {
+        return true;
+    } //End 
+
+    data_block_t ptrs;
+    if (!read_metadata(fs, block, ptrs))
+    {
+        return false;
+    } //End 
+    bool complete = true;
+    for (size_t i = 0; i < fs->geo.ptrs_per_block; i++)
+    {
+        complete &= walk_file_blocks(fs, get_ptr(fs, ptrs, i), depth - 1, visit, arg);
+    } //End 
+    return complete;
+} //End 
+
+/**********************************************************/
+
+static bool walk_inode_blocks(S17FS_t *fs, const inode_t *inode, block_visit_t visit, void *arg)
+{
+    //An inline file's pointers are its data
+    bool complete = true;
+    for (size_t ptr = DIRECT; ptr < INODE_PTR_TOTAL && !(inode->mdata.flags & INODE_INLINE); ptr++)
+    {
+        size_t depth = ptr >= DBL_INDIRECT ? 2 : (ptr >= INDIRECT1 ? 1 : 0);
+        complete &= walk_file_blocks(fs, inode_ptr(inode, ptr), depth, visit, arg);
+    } //End 
+    return complete;
+} //End 
+
+/**********************************************************/
+
+static bool collect_block(S17FS_t *fs, const size_t block, void *arg)
+{
+    (void)fs;
+    return dyn_array_push_back((dyn_array_t *)arg, &block);
+} //End 
+
+static int compare_blocks(const void *a, const void *b)
+{
+    size_t left = *(const size_t *)a;
+    size_t right = *(const size_t *)b;
+    return left < right ? -1 : (left > right ? 1 : 0);
+} //End 
+
+/**********************************************************/
+
+//Fragments the tail of the given length took, rounded up
+static size_t fragment_count(const S17FS_t *fs, const size_t length)
+{
+    return (length + fs->geo.fragment_bytes - 1) / fs->geo.fragment_bytes;
+} //End 
+
+/**********************************************************/
+
+//Gives back a packed tail's fragments, and the whole block once nothing else is packed into it
+static bool free_fragments(S17FS_t *fs, const block_ptr_t block, const size_t first, const size_t count)
+{
+    data_block_t buffer;
+    pthread_mutex_lock(&fs->frag_lock);
+    bool freed = read_metadata(fs, block, buffer);
+    if (freed)
+    {
+        uint16_t used;
+        memcpy(&used, buffer, sizeof(used));
+        used &= ~(uint16_t)(((1u << count) - 1) << first);
+        memcpy(buffer, &used, sizeof(used));
+        if (used == 1)
+        {
+            release_block(fs, block);
+            fs->frag_block = fs->frag_block == block ? 0 : fs->frag_block;
+        } //End 
+        else
+        {
+            freed = write_metadata(fs, block, buffer);
+        } //End else
+    } //End 
+    pthread_mutex_unlock(&fs->frag_lock);
+    return freed;
+} //End 
+
+/**********************************************************/
+
+//Hands blocks back in one pass, neighbouring ones go to the host as one range
+static void release_blocks(S17FS_t *fs, size_t *blocks, const size_t count)
+{
+    if (count > 1)
+    {
+        qsort(blocks, count, sizeof(size_t), compare_blocks);
+    } //End 
+
+    pthread_mutex_lock(&fs->alloc_lock);
+    for (size_t i = 0; i < count; i++)
+    {
+        block_store_release(fs->bs, blocks[i]);
+    } //End 
+
+    //Holding the lock keeps the blocks free while they're punched out, and a view still out could be
+    //pointing into them, those keep their old contents until they're released
+    if (__atomic_load_n(&fs->views_outstanding, __ATOMIC_ACQUIRE) == 0)
+    {
+        size_t i = 0;
+        while (i < count)
+        {
+            size_t start = i++;
+            while (i < count && blocks[i] == blocks[i - 1] + 1)
+            {
+                i++;
+            } //End 
+            block_store_discard(fs->bs, blocks[start], i - start);
+        } //End 
+    } //End 
+    pthread_mutex_unlock(&fs->alloc_lock);
+} //End 
+
+/**********************************************************/
+
+bool release_file_blocks(S17FS_t *fs, const inode_t *inode)
+{
+    if (fs == NULL || inode == NULL)
+    {
+        return false;
+    } //End 
+
+    if (inode->mdata.flags & INODE_TAIL)
+    {
+        size_t first = 0;
+        block_ptr_t block = inode_tail(inode, &first);
+        if (!free_fragments(fs, block, first, fragment_count(fs, inode->mdata.size % fs->geo.block_size)))
+        {
+            return false;
+        } //End 
+    } //End 
+
+    //Only the file's own blocks are collected, so a small file costs the same on any size of volume
+    //A journaled volume gets them back once the transaction giving them up commits
+    dyn_array_t *freed = dyn_array_create(DIRECT_TOTAL, sizeof(size_t), NULL);
+    if (freed == NULL)
+    {
+        return false;
+    } //End 
+    bool complete = walk_inode_blocks(fs, inode, collect_block, freed);
+    size_t *blocks = (size_t *)dyn_array_front(freed);
+    size_t count = dyn_array_size(freed);
+    for (size_t i = 0; fs->journal && i < count; i++)
+    {
+        complete &= journal_free(fs->journal, blocks[i]);
+    } //End 
+    if (fs->journal == NULL)
+    {
+        release_blocks(fs, blocks, count);
+    } //End 
+
+    dyn_array_destroy(freed);
+    return complete;
+} //End 
+
+/**********************************************************/
+
+bool sync_store(S17FS_t *fs)
+{
+    //The free block map held in memory by some devices is written out too, so it can't be changing
+    pthread_mutex_lock(&fs->alloc_lock);
+    bool synced = block_store_sync(fs->bs);
+    pthread_mutex_unlock(&fs->alloc_lock);
+    return synced;
+} //End 
+
+/**********************************************************/
+
+//The table's own inode lives in block 0 with the superblock, next to the root
+static bool write_table_inode(S17FS_t *fs)
+{
+    return write_block_zero_slot(fs, TABLE_SLOT, &fs->table_inode, INODE_CORE_BYTES);
+} //End 
+
+/**********************************************************/
+
+//Adds blocks to the inode table, out of the data region, until it reaches the given inode
+static bool grow_inode_table(S17FS_t *fs, const inode_ptr_t inode_number)
+{
+    pthread_mutex_lock(&fs->grow_lock);
+    bool grown = true;
+    while (grown && table_block(fs, inode_number) == NULL)
+    {
+        //The table's inode maps its blocks past the fixed ones the same way a file's maps its data
+        size_t added = fs->table_inode.mdata.size / fs->geo.block_size;
+        block_ptr_t block = get_file_block(fs, &fs->table_inode, NULL, added, true);
+        grown = block != 0 && initialize_indirect_block(fs, block);
+        if (grown)
+        {
+            fs->table_inode.mdata.size += fs->geo.block_size;
+            grown = write_table_inode(fs) && add_table_block(fs, fs->geo.table_blocks + added, block);
+        } //End 
+    } //End 
+    pthread_mutex_unlock(&fs->grow_lock);
+    return grown;
+} //End 
+
+/**********************************************************/
+
+size_t allocate_inode_number(S17FS_t *fs)
+{
+    //The number is claimed right away so a create in another directory can't pick the same one
+    pthread_mutex_lock(&fs->alloc_lock);
+    size_t inode_number = bitmap_ffz(fs->inode_bitmap);
+    if (inode_number < fs->geo.inode_limit)
+    {
+        bitmap_set(fs->inode_bitmap, inode_number);
+    } //End 
+    else
+    {
+        inode_number = SIZE_MAX;
+    } //End else
+    pthread_mutex_unlock(&fs->alloc_lock);
+
+    //Past the fixed table the number may need a new table block first
+    if (inode_number != SIZE_MAX && table_block(fs, inode_number) == NULL && !grow_inode_table(fs, inode_number))
+    {
+        pthread_mutex_lock(&fs->alloc_lock);
+        bitmap_reset(fs->inode_bitmap, inode_number);
+        pthread_mutex_unlock(&fs->alloc_lock);
+        inode_number = SIZE_MAX;
+    } //End 
+    return inode_number;
+} //End 
+
+/**********************************************************/
+
+void release_inode_number(S17FS_t *fs, const size_t inode_number)
+{
+    //Past the fixed table the inode itself says it's in use, so it's cleared before the number can go to someone else
+    if (inode_number >= fs->geo.inode_total)
+    {
+        inode_t empty;
+        memset(&empty, 0, sizeof(inode_t));
+        write_inode(fs, &empty, inode_number);
+    } //End 
+
+    pthread_mutex_lock(&fs->alloc_lock);
+    bitmap_reset(fs->inode_bitmap, inode_number);
+    pthread_mutex_unlock(&fs->alloc_lock);
+} //End 
+
+/**********************************************************/
+
+int allocate_descriptor(S17FS_t *fs, const inode_ptr_t inode_number)
+{
+    pthread_mutex_lock(&fs->fd_table.status_lock);
+    size_t fd = bitmap_ffz(fs->fd_table.fd_status);
+    if (fd != SIZE_MAX)
+    {
+        fs->fd_table.fd_inode[fd] = inode_number;
+        fs->fd_table.fd_pos[fd] = 0;
+        fs->fd_table.fd_ra_prev[fd] = 0;
+        fs->fd_table.fd_ra_size[fd] = 0;
+        bitmap_set(fs->fd_table.fd_status, fd);
+    } //End 
+    pthread_mutex_unlock(&fs->fd_table.status_lock);
+    return fd != SIZE_MAX ? (int) fd : -1;
+} //End 
+
+/**********************************************************/
+
+void release_descriptor(S17FS_t *fs, const int fd)
+{
+    //Only for a descriptor nobody has seen yet, it has no buffer or position to clean up
+    pthread_mutex_lock(&fs->fd_table.status_lock);
+    bitmap_reset(fs->fd_table.fd_status, fd);
+    fs->fd_table.fd_inode[fd] = 0;
+    pthread_mutex_unlock(&fs->fd_table.status_lock);
+} //End 
+
+/**********************************************************/
+
+bool pin_descriptor(S17FS_t *fs, const int fd)
+{
+    if (fs == NULL || fd < 0 || fd >= DESCRIPTOR_MAX)
+    {
+        return false;
+    } //End 
+
+    //Without the file lock nothing may touch the buffers, so pending writes send the caller the locked way
+    pthread_mutex_t *fd_lock = &fs->fd_table.fd_lock[fd];
+    pthread_mutex_lock(fd_lock);
+    inode_ptr_t inode_number;
+    if (__atomic_load_n(&fs->fd_table.wbuf_pending, __ATOMIC_ACQUIRE) != 0 || !descriptor_inode(fs, fd, &inode_number))
+    {
+        pthread_mutex_unlock(fd_lock);
+        return false;
+    } //End 
+    return true;
+} //End 
+
+/**********************************************************/
+
+void unpin_descriptor(S17FS_t *fs, const int fd)
+{
+    pthread_mutex_unlock(&fs->fd_table.fd_lock[fd]);
+} //End 
+
+/**********************************************************/
+
+//Pulls in a directory's inode and records, root included
+static bool load_dir(S17FS_t *fs, const inode_ptr_t inode_number, inode_t *dir, dir_block_t *contents)
+{
+    if (!read_inode(fs, dir, inode_number) || (inode_ptr(dir, 0) < fs->geo.table_blocks && inode_ptr(dir, 0) > 0))
+    {
+        return false;
+    } //End 
+    return read_metadata(fs, inode_ptr(dir, 0), contents->block);
+} //End 
+
+/**********************************************************/
+
+//Steps the cursor past the next path component, handing back where it starts and how long it is
+static const char *next_component(const char **cursor, const char *end, size_t *name_length)
+{
+    const char *name = *cursor;
+    const char *next = name;
+    while (next < end && *next != '/')
+    {
+        next++;
+    } //End 
+    *name_length = next - name;
+    while (next < end && *next == '/')
+    {
+        next++;
+    } //End 
+    *cursor = next;
+    return name;
+} //End 
+
+/**********************************************************/
+
+//Index of the subdirectory record with the given name, -1 if there isn't one
+static int find_subdir(const S17FS_t *fs, const file_record_t *records, const char *name, const size_t name_length)
+{
+    for (int i = 0; i < (int) fs->geo.dir_records && name_length < FS_FNAME_MAX; i++)
+    {
+        if (records[i].type == FS_DIRECTORY && strncmp(records[i].name, name, name_length) == 0 && records[i].name[name_length] == '\0')
+        {
+            return i;
+        } //End 
+    } //End 
+    return -1;
+} //End 
+
+/**********************************************************/
+
+bool lookup_dir(S17FS_t *fs, const char *path, const size_t length, const bool exclusive, inode_t *dir, dir_block_t *contents)
+{
+    if (fs == NULL || path == NULL || dir == NULL || contents == NULL)
+    {
+        return false;
+    } //End 
+
+    const char *cursor = path;
+    const char *end = path + length;
+    while (cursor < end && *cursor == '/')
+    {
+        cursor++;
+    } //End 
+
+    //Hand over hand from the root, each directory stays locked until its child is
+    inode_ptr_t current = 0;
+    lock_inode(fs, current, exclusive && cursor == end);
+    if (!load_dir(fs, current, dir, contents))
+    {
+        unlock_inode(fs, current);
+        return false;
+    } //End 
+
+    while (cursor < end)
+    {
+        size_t name_length;
+        const char *name = next_component(&cursor, end, &name_length);
+        int found = find_subdir(fs, contents->records, name, name_length);
+        if (found < 0)
+        {
+            unlock_inode(fs, current);
+            return false;
+        } //End 
+
+        inode_ptr_t child = contents->records[found].inode_num;
+        lock_inode(fs, child, exclusive && cursor == end);
+        unlock_inode(fs, current);
+        current = child;
+
+        if (!load_dir(fs, current, dir, contents))
+        {
+            unlock_inode(fs, current);
+            return false;
+        } //End 
+    } //End 
+
+    return true;
+} //End 
+
+/**********************************************************/
+
+//Takes a consistent copy of a directory without locking it, false if a writer was in the middle of it
+static bool snapshot_dir(S17FS_t *fs, const inode_ptr_t inode_number, inode_t *dir, dir_block_t *contents, uint32_t *version)
+{
+    inode_sync_t *sync = inode_sync(fs, inode_number);
+    if (sync == NULL)
+    {
+        return false;
+    } //End 
+    *version = __atomic_load_n(&sync->dir_seq, __ATOMIC_ACQUIRE);
+    if (*version & 1)
+    {
+        return false;
+    } //End 
+
+    //Whatever we copied may be torn until the version checks out, so only look at it enough to stay in bounds
+    if (!read_inode(fs, dir, inode_number) || dir->mdata.type != FS_DIRECTORY || !BLOCK_PTR_VALID(fs, inode_ptr(dir, 0)))
+    {
+        return false;
+    } //End 
+    return read_metadata(fs, inode_ptr(dir, 0), contents->block) && dir_unchanged(fs, inode_number, *version);
+} //End 
+
+/**********************************************************/
+
+bool peek_dir(S17FS_t *fs, const char *path, const size_t length, inode_t *dir, dir_block_t *contents, uint32_t *version)
+{
+    if (fs == NULL || path == NULL || dir == NULL || contents == NULL || version == NULL)
+    {
+        return false;
+    } //End 
+
+    const char *cursor = path;
+    const char *end = path + length;
+    while (cursor < end && *cursor == '/')
+    {
+        cursor++;
+    } //End 
+
+    //Sized from FS_FNAME_MAX, a component takes at least a character and a slash, so this is
+    //FS_FNAME_MAX / 2 levels below the root, a path nested deeper gives up and the caller takes the locks
+    inode_ptr_t walked[FS_FNAME_MAX / 2 + 1];
+    uint32_t versions[FS_FNAME_MAX / 2 + 1];
+    size_t depth = 0;
+    inode_ptr_t current = 0;
+    while (true)
+    {
+        if (depth == sizeof(walked) / sizeof(walked[0]) || !snapshot_dir(fs, current, dir, contents, &versions[depth]))
+        {
+            return false;
+        } //End 
+        walked[depth++] = current;
+
+        if (cursor == end)
+        {
+            break;
+        } //End 
+
+        size_t name_length;
+        const char *name = next_component(&cursor, end, &name_length);
+        int found = find_subdir(fs, contents->records, name, name_length);
+        if (found < 0)
+        {
+            return false;
+        } //End 
+        current = contents->records[found].inode_num;
+    } //End 
+
+    //A remove further up could have freed a directory we walked through and handed its number
+    //to a new one, so the whole chain has to still be what we saw
+    for (size_t i = 0; i < depth; i++)
+    {
+        if (!dir_unchanged(fs, walked[i], versions[i]))
+        {
+            return false;
+        } //End 
+    } //End 
+
+    *version = versions[depth - 1];
+    return true;
+} //End 
+
+/**********************************************************/
+
+bool dir_unchanged(S17FS_t *fs, const inode_ptr_t inode_number, const uint32_t version)
+{
+    inode_sync_t *sync = inode_sync(fs, inode_number);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return sync && __atomic_load_n(&sync->dir_seq, __ATOMIC_RELAXED) == version;
+} //End 
+
+/**********************************************************/
+
+void begin_dir_update(S17FS_t *fs, const inode_ptr_t inode_number)
+{
+    //Odd while the update is running, lock-free readers back off until it's even again
+    inode_sync_t *sync = inode_sync(fs, inode_number);
+    if (sync)
+    {
+        __atomic_add_fetch(&sync->dir_seq, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_RELEASE);
+    } //End 
+} //End 
+
+/**********************************************************/
+
+void end_dir_update(S17FS_t *fs, const inode_ptr_t inode_number)
+{
+    inode_sync_t *sync = inode_sync(fs, inode_number);
+    if (sync)
+    {
+        __atomic_add_fetch(&sync->dir_seq, 1, __ATOMIC_RELEASE);
+    } //End 
+} //End 
+
+/**********************************************************/
+
+bool remove_files_file_descriptors(S17FS_t *const fs, const inode_ptr_t inode_number)
+{
+    if (fs)
+    {
+        pthread_mutex_lock(&fs->fd_table.status_lock);
+        for (int i = 0; i < DESCRIPTOR_MAX; i++)
+        {
+            if (fs->fd_table.fd_inode[i] == inode_number && bitmap_test(fs->fd_table.fd_status, i))
+            {
+                //The file is going away, so anything still buffered for it is dropped
+                if (fs->fd_table.fd_wbuf_lo[i] != fs->fd_table.fd_wbuf_hi[i])
+                {
+                    __atomic_sub_fetch(&fs->fd_table.wbuf_pending, 1, __ATOMIC_RELEASE);
+                } //End 
+                free(fs->fd_table.fd_wbuf[i]);
+                fs->fd_table.fd_wbuf[i] = NULL;
+                fs->fd_table.fd_wbuf_lo[i] = fs->fd_table.fd_wbuf_hi[i] = 0;
+                unreserve_blocks(fs, i);
+
+                fs->fd_table.fd_inode[i] = 0;
+                fs->fd_table.fd_pos[i] = 0;
+                bitmap_reset(fs->fd_table.fd_status, i);
+            } //End 
+        } //End 
+        pthread_mutex_unlock(&fs->fd_table.status_lock);
+
+        return true;
+    } //End 
+    return false;
+} //End 
+
+/**********************************************************/
+
+//Where an inode sits in its table block and how much of it is on the volume, root only has a core sized slot
+static size_t inode_offset(const S17FS_t *fs, const inode_ptr_t inode_number, size_t *length)
+{
+    *length = inode_number ? fs->geo.inode_size : INODE_CORE_BYTES;
+    return (inode_number % fs->geo.inodes_per_block) * fs->geo.inode_size;
+} //End 
+
+/**********************************************************/
+
+//Root sits in slot 0 of block 0 next to the inode bitmap and superblock, everything else in the blocks after
+//Whatever of inode_t isn't on the volume comes back zeroed
+bool read_inode(S17FS_t *fs, void *data, const inode_ptr_t inode_number)
+{
+    table_block_t *entry = fs && data ? table_block(fs, inode_number) : NULL;
+    if (entry)
+    {
+        size_t length = 0;
+        size_t offset = inode_offset(fs, inode_number, &length);
+        memset((uint8_t *)data + length, 0, sizeof(inode_t) - length);
+
+        //Copy the entry straight out of the table and retry if a writeback overlapped it
+        const uint8_t *table = (const uint8_t *)block_store_get_ptr(fs->bs, entry->block);
+        for (int attempt = 0; table && attempt < SEQ_RETRY_MAX; attempt++)
+        {
+            uint32_t version = __atomic_load_n(&entry->table_seq, __ATOMIC_ACQUIRE);
+            if (version & 1)
+            {
+                continue;
+            } //End 
+
+            //A block the journal holds isn't home yet, and only goes home before the journal lets go of it
+            if (!journal_read(fs->journal, entry->block, offset, length, data))
+            {
+                memcpy(data, table + offset, length);
+            } //End 
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&entry->table_seq, __ATOMIC_RELAXED) == version)
+            {
+                return true;
+            } //End 
+        } //End 
+
+        //Writers kept getting in the way, so wait our turn on the table lock instead
+        data_block_t buffer;
+        pthread_mutex_lock(&entry->table_lock);
+        bool read = read_metadata(fs, entry->block, buffer);
+        pthread_mutex_unlock(&entry->table_lock);
+
+        if (read)
+        {
+            memcpy(data, buffer + offset, length);
+            return true;
+        } //End 
+    } //End 
+    return false;
+} //End 
+
+/**********************************************************/
+
+block_ptr_t inode_ptr(const inode_t *inode, const size_t ptr)
+{
+    return (block_ptr_t) inode->data_ptrs[ptr] | (block_ptr_t) inode->mdata.ptrs_hi[ptr] << 16;
+} //End 
+
+/**********************************************************/
+
+void set_inode_ptr(inode_t *inode, const size_t ptr, const block_ptr_t block)
+{
+    inode->data_ptrs[ptr] = (uint16_t) block;
+    inode->mdata.ptrs_hi[ptr] = (uint16_t) (block >> 16);
+} //End 
+
+/**********************************************************/
+
+//A packed tail's block goes in the first four bytes of padding, its first fragment in the fifth
+block_ptr_t inode_tail(const inode_t *inode, size_t *fragment)
+{
+    uint32_t block;
+    memcpy(&block, inode->mdata.padding, sizeof(block));
+    *fragment = inode->mdata.padding[sizeof(block)];
+    return block;
+} //End 
+
+/**********************************************************/
+
+void set_inode_tail(inode_t *inode, const block_ptr_t block, const size_t fragment)
+{
+    uint32_t stored = block;
+    memcpy(inode->mdata.padding, &stored, sizeof(stored));
+    inode->mdata.padding[sizeof(stored)] = (uint8_t) fragment;
+} //End 
+
+/**********************************************************/
+
+//Pointer blocks hold 16 or 32 bit entries depending on the volume
+block_ptr_t get_ptr(const S17FS_t *fs, const void *ptr_block, const size_t index)
+{
+    if (fs->geo.ptr_bytes == sizeof(uint32_t))
+    {
+        return ((const uint32_t *)ptr_block)[index];
+    } //End 
+    return ((const uint16_t *)ptr_block)[index];
+} //End 
+
+/**********************************************************/
+
+void set_ptr(const S17FS_t *fs, void *ptr_block, const size_t index, const block_ptr_t block)
+{
+    if (fs->geo.ptr_bytes == sizeof(uint32_t))
+    {
+        ((uint32_t *)ptr_block)[index] = block;
+    } //End 
+    else
+    {
+        ((uint16_t *)ptr_block)[index] = (uint16_t) block;
+    } //End else
+} //End 
+
+/**********************************************************/
+
+bool fd_valid(S17FS_t *const fs, int fd)
+{
+    if (fs == NULL || fd < 0 || fd >= DESCRIPTOR_MAX)
+    {
+        return false;
+    } //End 
+
+    //Neighbouring descriptors share the byte, so even a test has to hold the status lock
+    pthread_mutex_lock(&fs->fd_table.status_lock);
+    bool open = bitmap_test(fs->fd_table.fd_status, fd);
+    pthread_mutex_unlock(&fs->fd_table.status_lock);
+    return open;
+}
+
+/**********************************************************/
+
+bool initialize_indirect_block(S17FS_t* fs, const block_ptr_t block)
+{
+    if (fs && block >= fs->geo.table_blocks)
+    {
+        data_block_t buffer;
+
+        if (read_metadata(fs, block, buffer))
+        {
+            uint8_t init_val = 0;
+            for (size_t i = 0; i < fs->geo.block_size/sizeof(uint8_t); i++)
+            {
+                buffer[i] = init_val;
+            } //End 
+            //memset(buffer, 0, BLOCK_SIZE);
+            return write_metadata(fs, block, buffer);
+        } //End 
+    } //End 
+
+    return false;
+} //End 
+
+/**********************************************************/
+
+file_record_t* get_dir_contents(S17FS_t* fs, const block_ptr_t block)
+{
+    if (fs)
+    {
+        file_record_t* dir_contents = (file_record_t *)malloc(sizeof(data_block_t));
+        if (dir_contents)
+        {
+            data_block_t buffer;
+
+            if (read_metadata(fs, block, buffer))
+            {
+                memcpy(dir_contents, buffer, fs->geo.block_size);
+
+                return dir_contents;
+            } //End 
+            free(dir_contents);
+            return NULL;
+        } //End 
+        return NULL;
+    } //End 
+
+    return NULL;
+} //End 
+
+/**********************************************************/
+
+inode_t* get_root_dir(S17FS_t* fs)
+{
+    return get_inode(fs, 0);
+} //End 
+
+/**********************************************************/
+
+inode_t* get_dir(S17FS_t* fs, const inode_ptr_t inode_num)
+{
+    return get_inode(fs, inode_num);
+} //End 
+
+/**********************************************************/
+
+bool write_record(S17FS_t *fs, const void *data, const block_ptr_t block_num, const uint8_t offset)
+{
+    if (fs && data)
+    {
+        //printf("\nwrite_record: block = %u -- offset = %u\n", block_num, offset);
+
+        ///*
+        data_block_t buffer;
+        if (read_metadata(fs, block_num, buffer))
+        {
+            memcpy(&buffer[offset * sizeof(file_record_t)], data, sizeof(file_record_t));
+            return write_metadata(fs, block_num, buffer);
+        } //End 
+        // */
+        //return true;
+    } //End 
+    return false;
+} //End 
+
+/**********************************************************/
+
+inode_t* get_inode(S17FS_t *fs, const inode_ptr_t inode_number)
+{
+    if (fs)
+    {
+        inode_t* inode = (inode_t *)malloc(sizeof(inode_t));
+        if (inode && read_inode(fs, inode, inode_number))
+        {
+            return inode;
+        } //End 
+        free(inode);
+    } //End 
+
+    return NULL;
+} //End 
+
+/**********************************************************/
+
+bool write_inode(S17FS_t *fs, const void *data, const inode_ptr_t inode_number)
+{
+    table_block_t *entry = fs && data ? table_block(fs, inode_number) : NULL;
+    if (entry)
+    {
+        data_block_t buffer;
+        size_t length = 0;
+        size_t offset = inode_offset(fs, inode_number, &length);
+
+        //Read-modify-write of the whole block, so writers of neighbouring inodes have to take turns,
+        //and the block's version is odd while it's going out so lock-free readers know to retry
+        pthread_mutex_lock(&entry->table_lock);
+        bool written = false;
+        if (read_metadata(fs, entry->block, buffer))
+        {
+            memcpy(buffer + offset, data, length);
+            __atomic_add_fetch(&entry->table_seq, 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            written = write_metadata(fs, entry->block, buffer);
+            __atomic_add_fetch(&entry->table_seq, 1, __ATOMIC_RELEASE);
+        } //End 
+        pthread_mutex_unlock(&entry->table_lock);
+        return written;
+    } //End 
+    return false;
+} //End 
+
+/**********************************************************/
+
+bool write_root_inode(S17FS_t *fs, const void *data, const inode_ptr_t inode_number)
+{
+    //Root is always inode 0, the number is only taken for symmetry with write_inode
+    (void) inode_number;
+    return write_inode(fs, data, 0);
+} //End 
+
+/**********************************************************/
+
+bool write_S17FS_to_block_store(S17FS_t *fs)
+{
+    if (fs)
+    {
+        data_block_t buffer;
+        table_block_t *zero = fs->table[0];
+
+        //Only the fixed table's inodes are kept here, the ones past it say themselves whether they're in use
+        pthread_mutex_lock(&zero->table_lock);
+        pthread_mutex_lock(&fs->alloc_lock);
+        bool written = false;
+        if (read_metadata(fs, 0, buffer)) 
+        {
+            memcpy(buffer + INODE_CORE_BYTES, bitmap_export(fs->inode_bitmap), (fs->geo.inode_total + 7) / 8);
+            __atomic_add_fetch(&zero->table_seq, 1, __ATOMIC_RELAXED);
+            __atomic_thread_fence(__ATOMIC_RELEASE);
+            written = write_metadata(fs, 0, buffer);
+            __atomic_add_fetch(&zero->table_seq, 1, __ATOMIC_RELEASE);
+        }
+        pthread_mutex_unlock(&fs->alloc_lock);
+        pthread_mutex_unlock(&zero->table_lock);
+        return written;
+    }
+    return false;
+} //End 
+
+/**********************************************************/
+
+static block_ptr_t allocate_file_block(S17FS_t *fs, file_map_t *map, const bool indirect)
+{
+    //Data blocks come off the run map_file_range set aside, pointer blocks never do
+    if (!indirect && map && map->run_left)
+    {
+        map->run_left--;
+        return map->run_next++;
+    } //End 
+
+    size_t block = allocate_block(fs);
+    if (block == SIZE_MAX || !BLOCK_PTR_VALID(fs, block))
+    {
+        return 0;
+    } //End 
+
+    //Indirect blocks have to start out with every pointer unused
+    if (indirect && !initialize_indirect_block(fs, block))
+    {
+        release_block(fs, block);
+        return 0;
+    } //End 
+
+    return block;
+} //End 
+
+/**********************************************************/
+
+block_ptr_t get_file_block(S17FS_t *fs, inode_t *inode, file_map_t *map, const size_t file_block, const bool allocate)
+{
+    //Inline files have no blocks until write_file_vec moves their data out
+    if (fs == NULL || inode == NULL || file_block >= fs->geo.file_blocks_max || (inode->mdata.flags & INODE_INLINE))
+    {
+        return 0;
+    } //End 
+
+    //Figure out which inode pointer covers the block, and the index into each level of indirection below it
+    const size_t per_block = fs->geo.ptrs_per_block;
+    size_t ptr = file_block;
+    size_t depth = 0;
+    size_t index[2] = {0, 0};
+    if (file_block >= DIRECT_TOTAL + 2 * per_block)
+    {
+        size_t relative = file_block - (DIRECT_TOTAL + 2 * per_block);
+        ptr = DBL_INDIRECT;
+        index[0] = relative / per_block;
+        index[1] = relative % per_block;
+        depth = 2;
+    } //End 
+    else if (file_block >= DIRECT_TOTAL)
+    {
+        size_t relative = file_block - DIRECT_TOTAL;
+        ptr = INDIRECT1 + relative / per_block;
+        index[0] = relative % per_block;
+        depth = 1;
+    } //End 
+
+    block_ptr_t block = inode_ptr(inode, ptr);
+    if (!BLOCK_PTR_VALID(fs, block))
+    {
+        if (!allocate || (block = allocate_file_block(fs, map, depth > 0)) == 0)
+        {
+            return 0;
+        } //End 
+        set_inode_ptr(inode, ptr, block);
+    } //End 
+
+    for (size_t level = 0; level < depth; level++)
+    {
+        //Only the last level can be served from the map, the double indirect block is read each time we leave it
+        data_block_t local;
+        uint8_t *ptrs = local;
+        if (map && level + 1 == depth)
+        {
+            ptrs = map->ptrs;
+            if (map->block != block)
+            {
+                map->block = 0;
+                if (!read_metadata(fs, block, ptrs))
+                {
+                    return 0;
+                } //End 
+                map->block = block;
+            } //End 
+        } //End 
+        else if (!read_metadata(fs, block, ptrs))
+        {
+            return 0;
+        } //End 
+
+        block_ptr_t next = get_ptr(fs, ptrs, index[level]);
+        if (!BLOCK_PTR_VALID(fs, next))
+        {
+            if (!allocate || (next = allocate_file_block(fs, map, level + 1 < depth)) == 0)
+            {
+                return 0;
+            } //End 
+
+            set_ptr(fs, ptrs, index[level], next);
+            if (!write_metadata(fs, block, ptrs))
+            {
+                return 0;
+            } //End 
+        } //End 
+        block = next;
+    } //End 
+
+    return block;
+} //End 
+
+/**********************************************************/
+
+size_t map_file_range(S17FS_t *fs, inode_t *inode, const size_t first, const size_t count)
+{
+    if (fs == NULL || inode == NULL || (inode->mdata.flags & INODE_INLINE) || first + count > fs->geo.file_blocks_max)
+    {
+        return 0;
+    } //End 
+
+    file_map_t map = {0, {0}, 0, 0};
+    size_t mapped = 0;
+    while (mapped < count)
+    {
+        //Blocks already there stay where they are
+        if (get_file_block(fs, inode, &map, first + mapped, false))
+        {
+            mapped++;
+            continue;
+        } //End 
+
+        size_t hole = 1;
+        while (mapped + hole < count && get_file_block(fs, inode, &map, first + mapped + hole, false) == 0)
+        {
+            hole++;
+        } //End 
+
+        //The whole hole as one run if there's room for it, halving until something fits, single
+        //blocks go through allocate_block so a full volume still gets to grow
+        size_t run = SIZE_MAX;
+        size_t length = hole;
+        while (length > 1)
+        {
+            pthread_mutex_lock(&fs->alloc_lock);
+            run = can_allocate(fs, length) ? block_store_allocate_run(fs->bs, length) : SIZE_MAX;
+            if (run != SIZE_MAX)
+            {
+                consume_reservation(fs, length);
+            } //End 
+            pthread_mutex_unlock(&fs->alloc_lock);
+            if (run != SIZE_MAX)
+            {
+                break;
+            } //End 
+            length /= 2;
+        } //End 
+        if (run != SIZE_MAX && BLOCK_PTR_VALID(fs, run + length - 1))
+        {
+            map.run_next = run;
+            map.run_left = length;
+        } //End 
+        else if (run != SIZE_MAX)
+        {
+            for (size_t i = 0; i < length; i++)
+            {
+                release_block(fs, run + i);
+            } //End 
+            length = 1;
+        } //End 
+
+        size_t placed = 0;
+        while (placed < length && get_file_block(fs, inode, &map, first + mapped + placed, true))
+        {
+            placed++;
+        } //End 
+        mapped += placed;
+
+        //Whatever a failed lookup left of the run goes back
+        while (map.run_left)
+        {
+            map.run_left--;
+            release_block(fs, map.run_next++);
+        } //End 
+        if (placed < length)
+        {
+            break;
+        } //End 
+    } //End 
+
+    return mapped;
+} //End 
+
+/**********************************************************/
+
+//Inline data runs through the pointer fields and the bytes nothing else uses, in this order, the
+//last piece only as far as the volume's inodes reach
+#define INLINE_PIECES (4)
+static const size_t inline_offsets[INLINE_PIECES] = {offsetof(inode_t, mdata.ptrs_hi), offsetof(inode_t, mdata.padding),
+                                                     offsetof(inode_t, data_ptrs), offsetof(inode_t, extra)};
+static const size_t inline_lengths[INLINE_PIECES - 1] = {sizeof(((mdata_t *)0)->ptrs_hi), sizeof(((mdata_t *)0)->padding),
+                                                         sizeof(((inode_t *)0)->data_ptrs)};
+
+static size_t inline_piece_length(const S17FS_t *fs, const size_t piece)
+{
+    return piece + 1 < INLINE_PIECES ? inline_lengths[piece] : fs->geo.inode_size - INODE_CORE_BYTES;
+} //End 
+
+/**********************************************************/
+
+//Copies between a flat buffer and the inline data of an inode laid out like inode_t, in memory or in its table block
+static void inline_copy(const S17FS_t *fs, uint8_t *inode, uint8_t *data, size_t offset, size_t length, const bool to_inode)
+{
+    for (size_t piece = 0; piece < INLINE_PIECES && length; piece++)
+    {
+        size_t piece_length = inline_piece_length(fs, piece);
+        if (offset >= piece_length)
+        {
+            offset -= piece_length;
+            continue;
+        } //End 
+
+        size_t chunk = piece_length - offset < length ? piece_length - offset : length;
+        uint8_t *at = inode + inline_offsets[piece] + offset;
+        memcpy(to_inode ? at : data, to_inode ? data : at, chunk);
+        data += chunk;
+        length -= chunk;
+        offset = 0;
+    } //End 
+} //End 
+
+/**********************************************************/
+
+//Turns an inline file into an ordinary one, what it held becomes the start of its first block
+//Left as it was if there's no block to be had
+static bool move_inline_data(S17FS_t *fs, inode_t *inode)
+{
+    uint8_t held[INODE_SIZE_MAX];
+    size_t size = inode->mdata.size;
+    inline_copy(fs, (uint8_t *)inode, held, 0, size, false);
+    memset(inode->mdata.ptrs_hi, 0, sizeof(inode->mdata.ptrs_hi));
+    memset(inode->mdata.padding, 0, sizeof(inode->mdata.padding));
+    memset(inode->data_ptrs, 0, sizeof(inode->data_ptrs));
+    memset(inode->extra, 0, sizeof(inode->extra));
+    inode->mdata.flags &= ~INODE_INLINE;
+    if (size == 0)
+    {
+        return true;
+    } //End 
+
+    //The inode isn't written back until the caller is done, so a crash before then still finds the data inline
+    data_block_t buffer = {0};
+    memcpy(buffer, held, size);
+    block_ptr_t block = get_file_block(fs, inode, NULL, 0, true);
+    if (block && block_store_write(fs->bs, block, buffer))
+    {
+        return true;
+    } //End 
+
+    if (block)
+    {
+        release_block(fs, block);
+        set_inode_ptr(inode, DIRECT, 0);
+    } //End 
+    inode->mdata.flags |= INODE_INLINE;
+    inline_copy(fs, (uint8_t *)inode, held, 0, size, true);
+    return false;
+} //End 
+
+/**********************************************************/
+
+//A packed tail lives in a fragment block, which is metadata the journal can be holding
+static bool packed_tail(const S17FS_t *fs, const inode_t *inode, const size_t file_block)
+{
+    return (inode->mdata.flags & INODE_TAIL) && file_block == inode->mdata.size / fs->geo.block_size;
+} //End 
+
+//Where a file block's bytes start on the volume, a packed tail starts partway into its fragment block
+static block_ptr_t find_file_data(S17FS_t *fs, inode_t *inode, file_map_t *map, const size_t file_block, size_t *shift)
+{
+    *shift = 0;
+    if (packed_tail(fs, inode, file_block))
+    {
+        size_t fragment = 0;
+        block_ptr_t block = inode_tail(inode, &fragment);
+        *shift = fragment * fs->geo.fragment_bytes;
+        return block;
+    } //End 
+    return get_file_block(fs, inode, map, file_block, false);
+} //End 
+
+/**********************************************************/
+
+//Copies a tail into free fragments of the block being packed, or of a new one when it has no run long enough
+//Returns the block, 0 when there's no block to be had
+static block_ptr_t store_fragments(S17FS_t *fs, const uint8_t *tail, const size_t length, size_t *first)
+{
+    const size_t count = fragment_count(fs, length);
+    data_block_t buffer;
+    uint16_t used = 0;
+    pthread_mutex_lock(&fs->frag_lock);
+    block_ptr_t block = fs->frag_block;
+    if (block && !read_metadata(fs, block, buffer))
+    {
+        block = 0;
+    } //End 
+    else if (block)
+    {
+        memcpy(&used, buffer, sizeof(used));
+    } //End 
+
+    *first = 1;
+    while (*first + count <= FRAGMENTS_PER_BLOCK && (used >> *first) & ((1u << count) - 1))
+    {
+        (*first)++;
+    } //End 
+    if (block == 0 || *first + count > FRAGMENTS_PER_BLOCK)
+    {
+        //Fragment 0 is the map, so a fresh block starts out with only that in use
+        size_t fresh = allocate_block(fs);
+        block = fresh == SIZE_MAX || !BLOCK_PTR_VALID(fs, fresh) ? 0 : (block_ptr_t) fresh;
+        memset(buffer, 0, sizeof(buffer));
+        used = 1;
+        *first = 1;
+    } //End 
+
+    if (block)
+    {
+        used |= (uint16_t)(((1u << count) - 1) << *first);
+        memcpy(buffer, &used, sizeof(used));
+        memcpy(buffer + *first * fs->geo.fragment_bytes, tail, length);
+        if (write_metadata(fs, block, buffer))
+        {
+            fs->frag_block = block;
+        } //End 
+        else
+        {
+            if (block != fs->frag_block)
+            {
+                release_block(fs, block);
+            } //End 
+            block = 0;
+        } //End else
+    } //End 
+    pthread_mutex_unlock(&fs->frag_lock);
+    return block;
+} //End 
+
+/**********************************************************/
+
+//Moves the last partial block of a file into fragments, files past their direct pointers keep theirs
+//Not having room for it isn't an error, the tail just stays where it is
+bool pack_tail(S17FS_t *fs, const inode_ptr_t inode_number)
+{
+    inode_t inode;
+    if (fs == NULL || !read_inode(fs, &inode, inode_number))
+    {
+        return false;
+    } //End 
+
+    //A view could still be pointing into the block that would be given up
+    size_t tail_block = inode.mdata.size / fs->geo.block_size;
+    size_t length = inode.mdata.size % fs->geo.block_size;
+    if (fs->geo.fragment_bytes == 0 || inode.mdata.type != FS_REGULAR || (inode.mdata.flags & (INODE_INLINE | INODE_TAIL))
+        || length == 0 || tail_block >= DIRECT_TOTAL || fragment_count(fs, length) >= FRAGMENTS_PER_BLOCK
+        || __atomic_load_n(&fs->views_outstanding, __ATOMIC_ACQUIRE))
+    {
+        return true;
+    } //End 
+
+    //Blocks preallocated past the end mean the file is still growing
+    if (get_file_block(fs, &inode, NULL, tail_block + 1, false))
+    {
+        return true;
+    } //End 
+
+    block_ptr_t old = inode_ptr(&inode, tail_block);
+    data_block_t tail;
+    if (!BLOCK_PTR_VALID(fs, old))
+    {
+        return true;
+    } //End 
+    if (!block_store_read(fs->bs, old, tail))
+    {
+        return false;
+    } //End 
+
+    //The fragments are written before the inode points at them, and the old block is only given up after
+    size_t first = 0;
+    block_ptr_t block = store_fragments(fs, tail, length, &first);
+    if (block == 0)
+    {
+        return true;
+    } //End 
+    set_inode_ptr(&inode, tail_block, 0);
+    set_inode_tail(&inode, block, first);
+    inode.mdata.flags |= INODE_TAIL;
+    if (!write_inode(fs, &inode, inode_number))
+    {
+        free_fragments(fs, block, first, fragment_count(fs, length));
+        return false;
+    } //End 
+    release_block(fs, old);
+    return true;
+} //End 
+
+/**********************************************************/
+
+//Gives a packed tail a block of its own again, ahead of a write that reaches it
+//Left as it was if there's no block to be had
+static bool unpack_tail(S17FS_t *fs, inode_t *inode)
+{
+    size_t first = 0;
+    block_ptr_t fragments = inode_tail(inode, &first);
+    size_t tail_block = inode->mdata.size / fs->geo.block_size;
+    size_t length = inode->mdata.size % fs->geo.block_size;
+    data_block_t buffer;
+    data_block_t tail = {0};
+    pthread_mutex_lock(&fs->frag_lock);
+    bool read = read_metadata(fs, fragments, buffer);
+    pthread_mutex_unlock(&fs->frag_lock);
+    if (!read)
+    {
+        return false;
+    } //End 
+    memcpy(tail, buffer + first * fs->geo.fragment_bytes, length);
+
+    inode->mdata.flags &= ~INODE_TAIL;
+    set_inode_tail(inode, 0, 0);
+    block_ptr_t block = get_file_block(fs, inode, NULL, tail_block, true);
+    if (block && block_store_write(fs->bs, block, tail))
+    {
+        //A map that can't be updated only costs the fragments, the data is safe in its block
+        free_fragments(fs, fragments, first, fragment_count(fs, length));
+        return true;
+    } //End 
+
+    if (block)
+    {
+        release_block(fs, block);
+        set_inode_ptr(inode, tail_block, 0);
+    } //End 
+    inode->mdata.flags |= INODE_TAIL;
+    set_inode_tail(inode, fragments, first);
+    return false;
+} //End 
+
+/**********************************************************/
+
+bool preallocate_file(S17FS_t *fs, inode_t *inode, const size_t offset, const size_t length)
+{
+    if (fs == NULL || inode == NULL || length == 0 || offset + length < offset
+        || (offset + length - 1) / fs->geo.block_size >= fs->geo.file_blocks_max)
+    {
+        return false;
+    } //End 
+
+    //An inline file already has room for anything that would stay inline
+    if (inode->mdata.flags & INODE_INLINE)
+    {
+        if (offset + length <= fs->geo.inline_max)
+        {
+            return true;
+        } //End 
+        if (!move_inline_data(fs, inode))
+        {
+            return false;
+        } //End 
+    } //End 
+
+    //A packed tail's block can't be mapped while the tail is still in its fragments
+    if ((inode->mdata.flags & INODE_TAIL) && offset + length > inode->mdata.size / fs->geo.block_size * fs->geo.block_size
+        && !unpack_tail(fs, inode))
+    {
+        return false;
+    } //End 
+
+    size_t first = offset / fs->geo.block_size;
+    size_t count = (offset + length - 1) / fs->geo.block_size + 1 - first;
+    return map_file_range(fs, inode, first, count) == count;
+} //End 
+
+/**********************************************************/
+
+//Inline data is viewed where it sits in the mapped inode table, one span per piece
+static ssize_t view_inline(S17FS_t *fs, const inode_t *inode, dyn_array_t *spans, const size_t nbyte, const size_t offset)
+{
+    table_block_t *entry = table_block(fs, inode->mdata.self_inode_num);
+    const uint8_t *table = entry ? view_metadata(fs, entry->block) : NULL;
+    if (table == NULL)
+    {
+        return -1;
+    } //End 
+
+    size_t length = 0;
+    const uint8_t *base = table + inode_offset(fs, inode->mdata.self_inode_num, &length);
+    size_t skip = offset;
+    size_t total_bytes_viewed = 0;
+    for (size_t piece = 0; piece < INLINE_PIECES && total_bytes_viewed < nbyte; piece++)
+    {
+        size_t piece_length = inline_piece_length(fs, piece);
+        if (skip >= piece_length)
+        {
+            skip -= piece_length;
+            continue;
+        } //End 
+
+        size_t chunk = piece_length - skip < nbyte - total_bytes_viewed ? piece_length - skip : nbyte - total_bytes_viewed;
+        fs_span_t span = {base + inline_offsets[piece] + skip, chunk};
+        if (!dyn_array_push_back(spans, &span))
+        {
+            return -1;
+        } //End 
+        total_bytes_viewed += chunk;
+        skip = 0;
+    } //End 
+    return total_bytes_viewed;
+} //End 
+
+/**********************************************************/
+
+ssize_t view_file(S17FS_t *fs, inode_t *inode, dyn_array_t *spans, const size_t nbyte, const size_t offset)
+{
+    //Without a mapping there's nothing to point at
+    if (fs == NULL || inode == NULL || spans == NULL || !block_store_is_mapped(fs->bs))
+    {
+        return -1;
+    } //End 
+
+    if (offset >= inode->mdata.size)
+    {
+        return 0;
+    } //End 
+    size_t wanted = nbyte < inode->mdata.size - offset ? nbyte : inode->mdata.size - offset;
+    if (inode->mdata.flags & INODE_INLINE)
+    {
+        return view_inline(fs, inode, spans, wanted, offset);
+    } //End 
+
+    file_map_t map = {0, {0}, 0, 0};
+    fs_span_t span = {NULL, 0};
+    size_t total_bytes_viewed = 0;
+    while (total_bytes_viewed < wanted)
+    {
+        size_t pos = offset + total_bytes_viewed;
+        size_t inner = pos % fs->geo.block_size;
+        size_t chunk = fs->geo.block_size - inner;
+        if (chunk > wanted - total_bytes_viewed)
+        {
+            chunk = wanted - total_bytes_viewed;
+        } //End 
+
+        size_t shift = 0;
+        block_ptr_t block = find_file_data(fs, inode, &map, pos / fs->geo.block_size, &shift);
+        const uint8_t *data = NULL;
+        if (block)
+        {
+            data = packed_tail(fs, inode, pos / fs->geo.block_size) ? view_metadata(fs, block) : (const uint8_t *)block_store_get_ptr(fs->bs, block);
+        } //End 
+        if (data == NULL)
+        {
+            break;
+        } //End 
+        data += shift + inner;
+
+        //Blocks that follow each other on the volume extend the current span
+        if (span.base && (const uint8_t *)span.base + span.len == data)
+        {
+            span.len += chunk;
+        } //End 
+        else
+        {
+            if (span.base && !dyn_array_push_back(spans, &span))
+            {
+                return -1;
+            } //End 
+            span.base = data;
+            span.len = chunk;
+        } //End else
+
+        total_bytes_viewed += chunk;
+    } //End 
+
+    if (span.base && !dyn_array_push_back(spans, &span))
+    {
+        return -1;
+    } //End 
+
+    return total_bytes_viewed;
+} //End 
+
+/**********************************************************/
+
+size_t iov_total(const struct iovec *iov, const int iovcnt)
+{
+    if (iovcnt < 0 || iovcnt > FS_IOV_MAX || (iov == NULL && iovcnt > 0))
+    {
+        return SIZE_MAX;
+    } //End 
+
+    size_t total = 0;
+    for (int i = 0; i < iovcnt; i++)
+    {
+        if ((iov[i].iov_base == NULL && iov[i].iov_len) || iov[i].iov_len > SSIZE_MAX - total)
+        {
+            return SIZE_MAX;
+        } //End 
+        total += iov[i].iov_len;
+    } //End 
+    return total;
+} //End 
+
+/**********************************************************/
+
+//Copies between a flat buffer and the iovec, picking up where the cursor left off
+static void iov_copy(const struct iovec *iov, iov_cursor_t *cursor, uint8_t *flat, size_t nbyte, const bool to_iov)
+{
+    while (nbyte)
+    {
+        size_t left = iov[cursor->index].iov_len - cursor->offset;
+        if (left == 0)
+        {
+            cursor->index++;
+            cursor->offset = 0;
+            continue;
+        } //End 
+
+        size_t chunk = left < nbyte ? left : nbyte;
+        uint8_t *segment = (uint8_t *)iov[cursor->index].iov_base + cursor->offset;
+        if (to_iov)
+        {
+            memcpy(segment, flat, chunk);
+        } //End 
+        else
+        {
+            memcpy(flat, segment, chunk);
+        } //End else
+        flat += chunk;
+        nbyte -= chunk;
+        cursor->offset += chunk;
+    } //End 
+} //End 
+
+/**********************************************************/
+
+//Points at the next nbyte bytes of the iovec if they are all in one segment, NULL otherwise
+static uint8_t *iov_contiguous(const struct iovec *iov, const int iovcnt, iov_cursor_t *cursor, const size_t nbyte)
+{
+    while (cursor->index < iovcnt && cursor->offset == iov[cursor->index].iov_len)
+    {
+        cursor->index++;
+        cursor->offset = 0;
+    } //End 
+
+    if (cursor->index < iovcnt && iov[cursor->index].iov_len - cursor->offset >= nbyte)
+    {
+        uint8_t *segment = (uint8_t *)iov[cursor->index].iov_base + cursor->offset;
+        cursor->offset += nbyte;
+        return segment;
+    } //End 
+    return NULL;
+} //End 
+
+/**********************************************************/
+
+// One worker's slice of a parallel transfer
+typedef struct {
+    S17FS_t *fs;
+    const block_ptr_t *blocks;
+    size_t count;
+    uint8_t *buffer;
+    bool to_file;
+    size_t done;
+} copy_job_t;
+
+/**********************************************************/
+
+static void copy_blocks(void *arg)
+{
+    copy_job_t *job = (copy_job_t *)arg;
+    while (job->done < job->count)
+    {
+        //Blocks that sit next to each other on the volume go in one copy
+        size_t first = job->done;
+        size_t run = 1;
+        while (first + run < job->count && job->blocks[first + run] == job->blocks[first] + run)
+        {
+            run++;
+        } //End 
+
+        uint8_t *buffer = job->buffer + first * job->fs->geo.block_size;
+        size_t copied = job->to_file ? block_store_write_blocks(job->fs->bs, job->blocks[first], run, buffer)
+            : block_store_read_blocks(job->fs->bs, job->blocks[first], run, buffer);
+        if (copied != run * job->fs->geo.block_size)
+        {
+            return;
+        } //End 
+        job->done += run;
+    } //End 
+} //End 
+
+/**********************************************************/
+
+//Moves count whole file blocks between the buffer and the file, splitting the copying across the worker pool
+//Blocks are looked up, and allocated when writing, here on the calling thread so metadata stays serialized
+//Returns how many blocks from the front made it
+static size_t transfer_blocks(S17FS_t *fs, inode_t *inode, file_map_t *map, const size_t first, const size_t count, uint8_t *buffer, const bool to_file)
+{
+    block_ptr_t *blocks = (block_ptr_t *)malloc(count * sizeof(block_ptr_t));
+    if (blocks == NULL)
+    {
+        return 0;
+    } //End 
+
+    size_t resolved = 0;
+    while (resolved < count && (blocks[resolved] = get_file_block(fs, inode, map, first + resolved, to_file)) != 0)
+    {
+        resolved++;
+    } //End 
+
+    //The calling thread takes a slice too
+    worker_pool_t *pool = get_worker_pool(fs);
+    size_t slices = pool ? worker_pool_threads(pool) + 1 : 1;
+    if (slices > resolved / fs->geo.parallel_chunk)
+    {
+        slices = resolved / fs->geo.parallel_chunk ? resolved / fs->geo.parallel_chunk : 1;
+    } //End 
+
+    copy_job_t jobs[WORKER_MAX + 1];
+    size_t per_slice = resolved / slices;
+    for (size_t i = 0; i < slices; i++)
+    {
+        size_t start = i * per_slice;
+        size_t length = i + 1 == slices ? resolved - start : per_slice;
+        copy_job_t job = {fs, blocks + start, length, buffer + start * fs->geo.block_size, to_file, 0};
+        jobs[i] = job;
+    } //End 
+
+    if (slices == 1 || !worker_pool_run(pool, copy_blocks, jobs, slices, sizeof(copy_job_t)))
+    {
+        for (size_t i = 0; i < slices; i++)
+        {
+            copy_blocks(&jobs[i]);
+        } //End 
+    } //End 
+
+    //Only an unbroken prefix counts
+    size_t done = 0;
+    for (size_t i = 0; i < slices && (i == 0 || jobs[i - 1].done == jobs[i - 1].count); i++)
+    {
+        done += jobs[i].done;
+    } //End 
+
+    free(blocks);
+    return done;
+} //End 
+
+/**********************************************************/
+
+static void prefetch_file_blocks(S17FS_t *fs, inode_t *inode, const size_t first, const size_t count)
+{
+    //Walking the map pulls in the indirect blocks, the data blocks get hinted in physically contiguous runs
+    file_map_t map = {0, {0}, 0, 0};
+    size_t run_start = 0;
+    size_t run_length = 0;
+    for (size_t file_block = first; file_block < first + count; file_block++)
+    {
+        block_ptr_t block = get_file_block(fs, inode, &map, file_block, false);
+        if (block == 0)
+        {
+            break;
+        } //End 
+
+        if (run_length && block == run_start + run_length)
+        {
+            run_length++;
+            continue;
+        } //End 
+
+        block_store_prefetch(fs->bs, run_start, run_length);
+        run_start = block;
+        run_length = 1;
+    } //End 
+    block_store_prefetch(fs->bs, run_start, run_length);
+} //End 
+
+/**********************************************************/
+
+ssize_t read_file_vec(S17FS_t *fs, inode_t *inode, const struct iovec *iov, const int iovcnt, const size_t offset)
+{
+    size_t nbyte = iov_total(iov, iovcnt);
+    if (fs == NULL || inode == NULL || nbyte == SIZE_MAX)
+    {
+        return -1;
+    } //End 
+
+    //Reading past EOF returns data up to EOF
+    if (offset >= inode->mdata.size)
+    {
+        return 0;
+    } //End 
+    size_t wanted = nbyte < inode->mdata.size - offset ? nbyte : inode->mdata.size - offset;
+
+    //Small files come straight out of the inode
+    iov_cursor_t cursor = {0, 0};
+    if (inode->mdata.flags & INODE_INLINE)
+    {
+        uint8_t held[INODE_SIZE_MAX];
+        inline_copy(fs, (uint8_t *)inode, held, offset, wanted, false);
+        iov_copy(iov, &cursor, held, wanted, true);
+        return wanted;
+    } //End 
+
+    //Without a mapping each missed block is a trip to the kernel, so queue them all
+    //up front and let the first block read below submit the lot in one go
+    size_t first_block = offset / fs->geo.block_size;
+    size_t block_count = (offset + wanted - 1) / fs->geo.block_size - first_block + 1;
+    if (block_count > 1 && block_count < fs->geo.parallel_min && !block_store_is_mapped(fs->bs))
+    {
+        prefetch_file_blocks(fs, inode, first_block, block_count);
+    } //End 
+
+    file_map_t map = {0, {0}, 0, 0};
+    data_block_t buffer;
+    size_t total_bytes_read = 0;
+    while (total_bytes_read < wanted)
+    {
+        size_t pos = offset + total_bytes_read;
+        size_t inner = pos % fs->geo.block_size;
+
+        //Long runs of whole blocks into a flat buffer are copied out in parallel
+        size_t whole_blocks = (wanted - total_bytes_read) / fs->geo.block_size;
+        if (inner == 0 && iovcnt == 1 && whole_blocks >= fs->geo.parallel_min)
+        {
+            size_t batch = whole_blocks < fs->geo.parallel_batch ? whole_blocks : fs->geo.parallel_batch;
+            size_t done = transfer_blocks(fs, inode, &map, pos / fs->geo.block_size, batch, (uint8_t *)iov[0].iov_base + cursor.offset, false);
+            cursor.offset += done * fs->geo.block_size;
+            total_bytes_read += done * fs->geo.block_size;
+            if (done < batch)
+            {
+                break;
+            } //End 
+            continue;
+        } //End 
+
+        size_t chunk = fs->geo.block_size - inner;
+        if (chunk > wanted - total_bytes_read)
+        {
+            chunk = wanted - total_bytes_read;
+        } //End 
+
+        size_t shift = 0;
+        block_ptr_t block = find_file_data(fs, inode, &map, pos / fs->geo.block_size, &shift);
+        if (block == 0)
+        {
+            break;
+        } //End 
+
+        //Whole blocks landing in a single segment go straight into the caller's buffer, a packed tail never is one
+        uint8_t *direct = chunk == fs->geo.block_size ? iov_contiguous(iov, iovcnt, &cursor, chunk) : NULL;
+        if (direct)
+        {
+            if (!block_store_read(fs->bs, block, direct))
+            {
+                break;
+            } //End 
+        } //End 
+        else
+        {
+            if (!(packed_tail(fs, inode, pos / fs->geo.block_size) ? read_metadata(fs, block, buffer) : block_store_read(fs->bs, block, buffer) != 0))
+            {
+                break;
+            } //End 
+            iov_copy(iov, &cursor, buffer + shift + inner, chunk, true);
+        } //End else
+
+        total_bytes_read += chunk;
+    } //End 
+
+    return total_bytes_read;
+} //End 
+
+/**********************************************************/
+
+ssize_t read_file(S17FS_t *fs, inode_t *inode, void *dst, const size_t nbyte, const size_t offset)
+{
+    struct iovec iov = {dst, nbyte};
+    return dst ? read_file_vec(fs, inode, &iov, 1, offset) : -1;
+} //End 
+
+/**********************************************************/
+
+ssize_t write_file_vec(S17FS_t *fs, inode_t *inode, const struct iovec *iov, const int iovcnt, const size_t offset)
+{
+    size_t nbyte = iov_total(iov, iovcnt);
+    if (fs == NULL || inode == NULL || nbyte == SIZE_MAX)
+    {
+        return -1;
+    } //End 
+
+    //An inline file stays that way while the write fits, past that it moves out to a block first
+    iov_cursor_t cursor = {0, 0};
+    if (inode->mdata.flags & INODE_INLINE)
+    {
+        if (nbyte && offset + nbyte <= fs->geo.inline_max)
+        {
+            uint8_t held[INODE_SIZE_MAX];
+            iov_copy(iov, &cursor, held, nbyte, false);
+            inline_copy(fs, (uint8_t *)inode, held, offset, nbyte, true);
+            if (offset + nbyte > inode->mdata.size)
+            {
+                inode->mdata.size = offset + nbyte;
+            } //End 
+            return nbyte;
+        } //End 
+        if (nbyte && !move_inline_data(fs, inode))
+        {
+            return 0;
+        } //End 
+    } //End 
+
+    //Same for a packed tail, once the write reaches its block
+    if ((inode->mdata.flags & INODE_TAIL) && nbyte && offset + nbyte > inode->mdata.size / fs->geo.block_size * fs->geo.block_size
+        && !unpack_tail(fs, inode))
+    {
+        return 0;
+    } //End 
+
+    //Blocks past the end are taken together, so a flushed buffer or a long append lands in one run
+    //Coming up short is fine, the loop below allocates what's left one block at a time
+    size_t bs = fs->geo.block_size;
+    size_t new_first = (offset > inode->mdata.size ? offset : inode->mdata.size + bs - 1) / bs;
+    size_t new_end = nbyte ? (offset + nbyte - 1) / bs + 1 : 0;
+    if (new_end > new_first + 1 && new_end <= fs->geo.file_blocks_max)
+    {
+        map_file_range(fs, inode, new_first, new_end - new_first);
+    } //End 
+
+    file_map_t map = {0, {0}, 0, 0};
+    data_block_t buffer;
+    size_t total_bytes_written = 0;
+    while (total_bytes_written < nbyte)
+    {
+        size_t pos = offset + total_bytes_written;
+        size_t inner = pos % fs->geo.block_size;
+
+        //Same for writes, the blocks get allocated up front and the copying is split up
+        size_t whole_blocks = (nbyte - total_bytes_written) / fs->geo.block_size;
+        if (inner == 0 && iovcnt == 1 && whole_blocks >= fs->geo.parallel_min)
+        {
+            size_t batch = whole_blocks < fs->geo.parallel_batch ? whole_blocks : fs->geo.parallel_batch;
+            size_t done = transfer_blocks(fs, inode, &map, pos / fs->geo.block_size, batch, (uint8_t *)iov[0].iov_base + cursor.offset, true);
+            cursor.offset += done * fs->geo.block_size;
+            total_bytes_written += done * fs->geo.block_size;
+            if (done < batch)
+            {
+                break;
+            } //End 
+            continue;
+        } //End 
+
+        size_t chunk = fs->geo.block_size - inner;
+        if (chunk > nbyte - total_bytes_written)
+        {
+            chunk = nbyte - total_bytes_written;
+        } //End 
+
+        //Running out of blocks just cuts the write short
+        block_ptr_t block = get_file_block(fs, inode, &map, pos / fs->geo.block_size, true);
+        if (block == 0)
+        {
+            break;
+        } //End 
+
+        //Whole blocks don't need the old contents, and can skip the bounce buffer if they sit in one segment
+        const uint8_t *direct = chunk == fs->geo.block_size ? iov_contiguous(iov, iovcnt, &cursor, chunk) : NULL;
+        if (direct == NULL)
+        {
+            if (chunk < fs->geo.block_size && !block_store_read(fs->bs, block, buffer))
+            {
+                break;
+            } //End 
+            iov_copy(iov, &cursor, buffer + inner, chunk, false);
+            direct = buffer;
+        } //End 
+
+        if (!block_store_write(fs->bs, block, direct))
+        {
+            break;
+        } //End 
+
+        total_bytes_written += chunk;
+    } //End 
+
+    if (offset + total_bytes_written > inode->mdata.size)
+    {
+        inode->mdata.size = offset + total_bytes_written;
+    } //End 
+
+    return total_bytes_written;
+} //End 
+
+/**********************************************************/
+
+ssize_t write_file(S17FS_t *fs, inode_t *inode, const void *src, const size_t nbyte, const size_t offset)
+{
+    struct iovec iov = {(void *)src, nbyte};
+    return src ? write_file_vec(fs, inode, &iov, 1, offset) : -1;
+} //End 
+
+/**********************************************************/
+
+void readahead(S17FS_t *fs, const int fd, inode_t *inode, const size_t offset, const size_t nbyte)
+{
+    if (!fd_valid(fs, fd) || inode == NULL || nbyte == 0)
+    {
+        return;
+    } //End 
+
+    fd_table_t *table = &fs->fd_table;
+    size_t first_block = offset / fs->geo.block_size;
+    size_t end_block = (offset + nbyte - 1) / fs->geo.block_size + 1;
+    size_t file_blocks = (inode->mdata.size + fs->geo.block_size - 1) / fs->geo.block_size;
+    bool sequential = offset == table->fd_ra_prev[fd];
+    table->fd_ra_prev[fd] = offset + nbyte;
+
+    //Random access drops the stream, the next sequential read starts over with a small window
+    if (!sequential)
+    {
+        table->fd_ra_size[fd] = 0;
+        return;
+    } //End 
+
+    if (table->fd_ra_size[fd] == 0)
+    {
+        //New stream, start at twice the request size so the next read is already covered
+        size_t window = fs->geo.readahead_min;
+        while (window < 2 * (end_block - first_block) && window < fs->geo.readahead_max)
+        {
+            window *= 2;
+        } //End 
+        table->fd_ra_size[fd] = window;
+        table->fd_ra_end[fd] = end_block;
+    } //End 
+    else if (end_block + table->fd_ra_size[fd] / 2 >= table->fd_ra_end[fd])
+    {
+        //The reader has eaten into the back half of the last window, double it and keep going
+        table->fd_ra_size[fd] = table->fd_ra_size[fd] * 2 < fs->geo.readahead_max ? table->fd_ra_size[fd] * 2 : fs->geo.readahead_max;
+        if (table->fd_ra_end[fd] < end_block)
+        {
+            table->fd_ra_end[fd] = end_block;
+        } //End 
+    } //End 
+    else
+    {
+        //Still well inside what was already prefetched
+        return;
+    } //End 
+
+    size_t start = table->fd_ra_end[fd];
+    if (start >= file_blocks)
+    {
+        return;
+    } //End 
+    size_t count = table->fd_ra_size[fd] < file_blocks - start ? table->fd_ra_size[fd] : file_blocks - start;
+    prefetch_file_blocks(fs, inode, start, count);
+    table->fd_ra_end[fd] = start + count;
+} //End 
+
+/**********************************************************/
+
+bool flush_write_buffer(S17FS_t *fs, const int fd)
+{
+    if (!fd_valid(fs, fd))
+    {
+        return false;
+    } //End 
+
+    fd_table_t *table = &fs->fd_table;
+    if (table->fd_wbuf[fd] == NULL || table->fd_wbuf_lo[fd] == table->fd_wbuf_hi[fd])
+    {
+        return true;
+    } //End 
+
+    size_t lo = table->fd_wbuf_lo[fd];
+    size_t pending = table->fd_wbuf_hi[fd] - lo;
+    size_t offset = table->fd_wbuf_block[fd] * fs->geo.block_size + lo;
+    ssize_t written = 0;
+
+    //Blocks the write allocates come out of what was held back for the buffer, whatever's left goes back after
+    inode_t inode;
+    flush_reservation = &table->fd_wbuf_reserved[fd];
+    if (read_inode(fs, &inode, table->fd_inode[fd]))
+    {
+        written = write_file(fs, &inode, table->fd_wbuf[fd] + lo, pending, offset);
+        if (written < 0 || !write_inode(fs, &inode, table->fd_inode[fd]))
+        {
+            written = 0;
+        } //End 
+    } //End 
+    flush_reservation = NULL;
+    unreserve_blocks(fs, fd);
+
+    table->fd_wbuf_lo[fd] = table->fd_wbuf_hi[fd] = 0;
+    __atomic_sub_fetch(&table->wbuf_pending, 1, __ATOMIC_RELEASE);
+
+    //The buffer always ends at fd_pos, so pull the position back to what actually made it out
+    if ((size_t)written < pending)
+    {
+        table->fd_pos[fd] = offset + written;
+        return false;
+    } //End 
+    return true;
+} //End 
+
+/**********************************************************/
+
+bool flush_inode_write_buffers(S17FS_t *fs, const inode_ptr_t inode_number, const int skip_fd)
+{
+    if (fs == NULL)
+    {
+        return false;
+    } //End 
+
+    if (__atomic_load_n(&fs->fd_table.wbuf_pending, __ATOMIC_ACQUIRE) == 0)
+    {
+        return true;
+    } //End 
+
+    //Only the descriptors on this file are ours to touch, the caller holds it exclusively
+    //so none of them can close or start buffering while we work through the list
+    int fds[DESCRIPTOR_MAX];
+    int count = 0;
+    pthread_mutex_lock(&fs->fd_table.status_lock);
+    for (int i = 0; i < DESCRIPTOR_MAX; i++)
+    {
+        if (i != skip_fd && fs->fd_table.fd_inode[i] == inode_number && bitmap_test(fs->fd_table.fd_status, i))
         {
-            if (fs->fd_table.fd_inode[i] == inode_number)
-            {
-                fs->fd_table.fd_inode[i] = 0;
-                fs->fd_table.fd_pos[i] = 0;
-                bitmap_reset(fs->fd_table.fd_status, i);
-            } //End 
+            fds[count++] = i;
         } //End 
+    } //End 
+    pthread_mutex_unlock(&fs->fd_table.status_lock);
 
-        return true;
+    bool flushed = true;
+    for (int i = 0; i < count; i++)
+    {
+        if (fs->fd_table.fd_wbuf_lo[fds[i]] != fs->fd_table.fd_wbuf_hi[fds[i]])
+        {
+            flushed &= flush_write_buffer(fs, fds[i]);
+        } //End 
     } //End 
-    return false;
+    return flushed;
 } //End 
 
 /**********************************************************/
 
-bool read_inode(const S17FS_t *fs, void *data, const inode_ptr_t inode_number)
+ssize_t write_buffered(S17FS_t *fs, const int fd, const void *src, const size_t nbyte)
 {
-    if (fs && data)
+    if (!fd_valid(fs, fd) || src == NULL || fs->fd_table.fd_wbuf[fd] == NULL)
+    {
+        return -1;
+    } //End 
+
+    fd_table_t *table = &fs->fd_table;
+
+    //Anything another descriptor is holding for this file has to land first to keep writes ordered
+    size_t own_pending = table->fd_wbuf_lo[fd] != table->fd_wbuf_hi[fd] ? 1 : 0;
+    if (__atomic_load_n(&table->wbuf_pending, __ATOMIC_ACQUIRE) > own_pending && !flush_inode_write_buffers(fs, table->fd_inode[fd], fd))
+    {
+        return -1;
+    } //End 
+
+    size_t start_pos = table->fd_pos[fd];
+    size_t copied = 0;
+    while (copied < nbyte)
     {
-        inode_t buffer[INODES_PER_BLOCK];
-        if (block_store_read(fs->bs, INODE_TO_BLOCK(inode_number), buffer))
+        bool starting = table->fd_wbuf_lo[fd] == table->fd_wbuf_hi[fd];
+        if (starting)
         {
-            memcpy(data, &buffer[INODE_INNER_IDX(inode_number)], sizeof(inode_t));
-            return true;
-        }
-    }
-    return false;
-}
+            //Nobody else can change the file while we hold bytes for it, so its end is looked up once
+            inode_t inode;
+            if (!read_inode(fs, &inode, table->fd_inode[fd]))
+            {
+                break;
+            } //End 
+            table->fd_wbuf_from[fd] = inode.mdata.size / fs->geo.block_size;
+            table->fd_wbuf_block[fd] = table->fd_pos[fd] / fs->geo.block_size;
+            table->fd_wbuf_lo[fd] = table->fd_wbuf_hi[fd] = table->fd_pos[fd] % fs->geo.block_size;
+        } //End 
+
+        size_t hi = table->fd_wbuf_hi[fd];
+        size_t chunk = fs->geo.writeback_bytes - hi;
+        if (chunk > nbyte - copied)
+        {
+            chunk = nbyte - copied;
+        } //End 
+
+        //The flush can't fail for room, so bytes only come in once the blocks they need are held back
+        size_t needed = buffer_blocks_needed(fs, fd, hi + chunk);
+        if (needed > table->fd_wbuf_reserved[fd] && !reserve_blocks(fs, fd, needed - table->fd_wbuf_reserved[fd]))
+        {
+            errno = ENOSPC;
+            break;
+        } //End 
+        if (starting)
+        {
+            __atomic_add_fetch(&table->wbuf_pending, 1, __ATOMIC_RELEASE);
+        } //End 
+
+        memcpy(table->fd_wbuf[fd] + hi, (const uint8_t *)src + copied, chunk);
+        table->fd_wbuf_hi[fd] += chunk;
+        table->fd_pos[fd] += chunk;
+        copied += chunk;
+
+        //Full buffer, write it out in one go, its blocks get allocated together then
+        if (table->fd_wbuf_hi[fd] == fs->geo.writeback_bytes && !flush_write_buffer(fs, fd))
+        {
+            return table->fd_pos[fd] > start_pos ? (ssize_t)(table->fd_pos[fd] - start_pos) : 0;
+        } //End 
+    } //End 
 
+    return copied ? (ssize_t)copied : -1;
+} //End 
 
 /**********************************************************/
 
-bool fd_valid(const S17FS_t *const fs, int fd)
+//An inode bitmap covering everything the table can grow to
+static bitmap_t *create_inode_bitmap(S17FS_t *fs)
 {
-    return fs && fd >= 0 && fd < DESCRIPTOR_MAX && bitmap_test(fs->fd_table.fd_status, fd);
-}
+    bitmap_t *bitmap = bitmap_create(fs->geo.inode_limit);
+    if (bitmap)
+    {
+        //The last fixed block's slots past inode_total aren't in the bitmap block 0 keeps, so they're never handed out
+        size_t grown_first = (fs->geo.table_blocks - 1) * fs->geo.inodes_per_block;
+        for (size_t i = fs->geo.inode_total; i < fs->geo.inode_limit && i < grown_first; i++)
+        {
+            bitmap_set(bitmap, i);
+        } //End 
+    } //End 
+    return bitmap;
+} //End 
 
 /**********************************************************/
 
-bool initialize_indirect_block(S17FS_t* fs, const block_ptr_t block)
+//Brings back the table blocks added since format, the inodes in them that are in use carry their own number
+static bool load_grown_table(S17FS_t *fs)
 {
-    if (fs && block > 32)
+    file_map_t map = {0, {0}, 0, 0};
+    size_t added = fs->table_inode.mdata.size / fs->geo.block_size;
+    if (fs->geo.table_blocks + added > fs->geo.table_max)
     {
-        data_block_t buffer;
+        return false;
+    } //End 
 
-        if (block_store_read(fs->bs, block, buffer))
+    data_block_t buffer;
+    for (size_t k = 0; k < added; k++)
+    {
+        size_t index = fs->geo.table_blocks + k;
+        block_ptr_t block = get_file_block(fs, &fs->table_inode, &map, k, false);
+        if (block == 0 || !block_store_read(fs->bs, block, buffer) || !add_table_block(fs, index, block))
         {
-            uint8_t init_val = 0;
-            for (size_t i = 0; i < BLOCK_SIZE/sizeof(uint8_t); i++)
+            return false;
+        } //End 
+
+        for (size_t slot = 0; slot < fs->geo.inodes_per_block; slot++)
+        {
+            size_t inode_number = (index - 1) * fs->geo.inodes_per_block + slot;
+            mdata_t mdata;
+            memcpy(&mdata, buffer + slot * fs->geo.inode_size, sizeof(mdata_t));
+            if (inode_number < fs->geo.inode_limit && mdata.self_inode_num == inode_number)
             {
-                buffer[i] = init_val;
+                bitmap_set(fs->inode_bitmap, inode_number);
             } //End 
-            //memset(buffer, 0, BLOCK_SIZE);
-            return block_store_write(fs->bs, block, buffer);
         } //End 
     } //End 
-
-    return false;
+    return true;
 } //End 
 
 /**********************************************************/
 
-file_record_t* get_dir_contents(S17FS_t* fs, const block_ptr_t block)
+bool load_S17FS(S17FS_t *fs)
 {
     if (fs)
     {
-        file_record_t* dir_contents = (file_record_t *)malloc(sizeof(data_block_t));
-        if (dir_contents)
-        {
-            data_block_t buffer;
+        data_block_t buffer;
 
-            if (block_store_read(fs->bs, block, buffer))
+        if (block_store_read(fs->bs, 0, buffer)) 
+        {
+            //memcpy(&buffer[1], bitmap_export(fs->inode_bitmap), bitmap_get_bytes(fs->inode_bitmap));
+            //fs->inode_bitmap = bitmap_overlay(INODE_TOTAL);
+            bitmap_t *fixed = bitmap_import(fs->geo.inode_total, buffer + INODE_CORE_BYTES);
+            fs->inode_bitmap = fixed ? create_inode_bitmap(fs) : NULL;
+            for (size_t i = 0; fs->inode_bitmap && i < fs->geo.inode_total; i++)
             {
-                memcpy(dir_contents, buffer, BLOCK_SIZE);
+                if (bitmap_test(fixed, i))
+                {
+                    bitmap_set(fs->inode_bitmap, i);
+                } //End 
+            } //End 
+            bitmap_destroy(fixed);
 
-                return dir_contents;
+            memcpy(&fs->table_inode, buffer + TABLE_SLOT * INODE_CORE_BYTES, INODE_CORE_BYTES);
+            if (fs->inode_bitmap && load_grown_table(fs))
+            {
+                return true;
             } //End 
-            free(dir_contents);
-            return NULL;
+            //return block_store_write(fs->bs, 0, buffer);
         } //End 
-        return NULL;
     } //End 
+    return false;
+} //End 
 
-    return NULL;
+/**********************************************************/
+
+//Blocks the free block map takes off the end, worked out the same way the block store does
+static size_t free_map_blocks(const size_t block_size, const size_t block_count)
+{
+    return ((block_count + 7) / 8 + block_size - 1) / block_size;
 } //End 
 
 /**********************************************************/
 
-inode_t* get_root_dir(S17FS_t* fs)
+//Checks the superblock describes a layout we can run, with room for everything format puts down
+static bool superblock_valid(const superblock_t *superblock)
 {
-    //void* root_block = (data_block_t *)malloc(sizeof(data_block_t));
-    inode_t* root_block = (inode_t *)malloc(sizeof(inode_t));
-    if (root_block == NULL)
+    const size_t block_size = superblock->block_size;
+    if (superblock->magic != SUPERBLOCK_MAGIC || superblock->version != SUPERBLOCK_VERSION || block_size < BLOCK_SIZE_MIN
+        || block_size > BLOCK_SIZE_MAX || (block_size & (block_size - 1))
+        || (superblock->ptr_bytes != sizeof(uint16_t) && superblock->ptr_bytes != sizeof(uint32_t))
+        || superblock->block_count > (superblock->ptr_bytes == sizeof(uint16_t) ? DATA_BLOCK_MAX : WIDE_BLOCK_MAX)
+        || (superblock->block_limit && (superblock->block_limit < superblock->block_count
+                                        || superblock->block_limit > (superblock->ptr_bytes == sizeof(uint16_t) ? DATA_BLOCK_MAX : WIDE_BLOCK_MAX)))
+        || superblock->inode_count < 2 || superblock->inode_count > INODE_TOTAL
+        || (superblock->inode_limit && (superblock->inode_limit < superblock->inode_count || superblock->inode_limit > INODE_LIMIT_MAX))
+        || superblock->dir_records < 1
+        || superblock->dir_records > block_size / sizeof(file_record_t)
+        || (superblock->inode_size && superblock->inode_size != INODE_CORE_BYTES && superblock->inode_size != 2 * INODE_CORE_BYTES
+            && superblock->inode_size != INODE_SIZE_MAX)
+        || (superblock->features & ~(SUPERBLOCK_INLINE | SUPERBLOCK_TAILS)))
     {
-        return NULL;
+        return false;
     } //End 
 
-    inode_t buffer[INODES_PER_BLOCK];
-
-    if (block_store_read(fs->bs, 0, buffer) <= 0)
+    //The inode table, the root directory's block, the journal, and at least one block for files ahead of the free block map
+    size_t inode_size = superblock->inode_size ? superblock->inode_size : INODE_CORE_BYTES;
+    size_t table_blocks = (superblock->inode_count - 1) / (block_size / inode_size) + 2;
+    size_t fbm_blocks = free_map_blocks(block_size, superblock->block_count);
+    if (superblock->block_count < table_blocks + 2 + superblock->journal_blocks + fbm_blocks)
     {
-        free(root_block);
-        return NULL;
+        return false;
     } //End 
 
-    memcpy(root_block, buffer, sizeof(inode_t));
-
-    return (inode_t *)root_block;
+    //The journal starts out right below the free block map, and stays put when the volume grows
+    size_t data_end = superblock->block_count - fbm_blocks;
+    return superblock->journal_blocks ? superblock->journal_blocks >= JOURNAL_BLOCKS_MIN && superblock->journal_start > table_blocks
+                                        && superblock->journal_start + superblock->journal_blocks <= data_end
+                                      : superblock->journal_start == 0;
 } //End 
 
 /**********************************************************/
 
-inode_t* get_dir(S17FS_t* fs, const inode_ptr_t inode_num)
+bool default_superblock(superblock_t *superblock, const fs_format_opts_t *opts)
 {
-    //void* inode_block = (data_block_t *)malloc(sizeof(data_block_t));
-    inode_t* dir = (inode_t *)malloc(sizeof(inode_t));
-    if (dir == NULL)
+    if (superblock == NULL)
     {
-        return NULL;
+        return false;
     } //End 
 
-    inode_t buffer[INODES_PER_BLOCK];
-
-    //Determine the inode block, and offset
-    size_t block = inode_num / (BLOCK_SIZE / sizeof(inode_t)) + 1; //The inode blocks are blocks 1-32, thus the + 1
-    size_t offset = inode_num % (BLOCK_SIZE / sizeof(inode_t));
-
-    //printf("\nget_dir: inum = %u -- block = %zu -- offset = %zu\n", inode_num, block, offset);
-
-    if (block_store_read(fs->bs, block, buffer) <= 0)
+    size_t block_size = opts && opts->block_size ? opts->block_size : BLOCK_SIZE;
+    size_t block_count = opts && opts->block_count ? opts->block_count : DATA_BLOCK_MAX;
+    size_t inode_count = opts && opts->inode_count ? opts->inode_count : INODE_TOTAL;
+    size_t dir_records = opts && opts->dir_records ? opts->dir_records : block_size / sizeof(file_record_t);
+    size_t journal_blocks = opts ? opts->journal_blocks : 0;
+    size_t inode_limit = opts ? opts->inode_limit : 0;
+    size_t block_limit = opts ? opts->block_limit : 0;
+    size_t inode_size = opts ? opts->inode_size : 0;
+    //Pointers stay 16 bits unless asked for, or the volume is, or can grow, too big for them
+    size_t largest = block_limit > block_count ? block_limit : block_count;
+    size_t ptr_bytes = opts && opts->pointer_bytes ? opts->pointer_bytes : (largest > DATA_BLOCK_MAX ? sizeof(uint32_t) : sizeof(uint16_t));
+    if (block_size > UINT32_MAX || block_count > UINT32_MAX || inode_count > UINT32_MAX || dir_records > UINT32_MAX || journal_blocks > UINT32_MAX
+        || ptr_bytes > UINT32_MAX || inode_limit > UINT32_MAX || block_limit > UINT32_MAX || inode_size > UINT32_MAX)
     {
-        free(dir);
-        return NULL;
+        return false;
     } //End 
 
-    //Copy over the specific inode from the block of inodes
-    memcpy(dir, &buffer[offset], sizeof(inode_t));
+    //Checked without the journal first, so its start is only worked out from a block size and count that make sense
+    memset(superblock, 0, sizeof(superblock_t));
+    superblock->magic = SUPERBLOCK_MAGIC;
+    superblock->version = SUPERBLOCK_VERSION;
+    superblock->block_size = block_size;
+    superblock->block_count = block_count;
+    superblock->inode_count = inode_count;
+    superblock->dir_records = dir_records;
+    superblock->ptr_bytes = ptr_bytes;
+    superblock->inode_limit = inode_limit;
+    superblock->block_limit = block_limit;
+    superblock->inode_size = inode_size;
+    superblock->features = (opts && opts->inline_data ? SUPERBLOCK_INLINE : 0) | (opts && opts->tail_packing ? SUPERBLOCK_TAILS : 0);
+    if (!superblock_valid(superblock))
+    {
+        return false;
+    } //End 
 
-    return dir;
-    //return (inode_t *)inode_block;
+    if (journal_blocks)
+    {
+        size_t data_end = block_count - free_map_blocks(block_size, block_count);
+        superblock->journal_blocks = journal_blocks;
+        superblock->journal_start = journal_blocks < data_end ? data_end - journal_blocks : 0;
+    } //End 
+    return superblock_valid(superblock);
 } //End 
 
 /**********************************************************/
 
-bool write_record(S17FS_t *fs, const void *data, const block_ptr_t block_num, const uint8_t offset)
+bool read_superblock(const char *path, superblock_t *superblock)
 {
-    if (fs && data)
+    if (path == NULL || superblock == NULL)
     {
-        //printf("\nwrite_record: block = %u -- offset = %u\n", block_num, offset);
+        return false;
+    } //End 
 
-        ///*
-        data_block_t buffer;
-        if (block_store_read(fs->bs, block_num, buffer))
-        {
-            memcpy(&buffer[offset * sizeof(file_record_t)], data, sizeof(file_record_t));
-            return block_store_write(fs->bs, block_num, buffer);
-        } //End 
-        // */
-        //return true;
+    //Its byte offset doesn't depend on the block size, so it can be read before the volume is opened
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
     } //End 
-    return false;
+    ssize_t got = pread(fd, superblock, sizeof(superblock_t), SUPERBLOCK_SLOT * INODE_CORE_BYTES);
+    close(fd);
+    if (got != (ssize_t) sizeof(superblock_t))
+    {
+        return false;
+    } //End 
+
+    //Volumes from before there was a superblock have zeros here, and were all laid out the default way
+    if (superblock->magic == 0)
+    {
+        return default_superblock(superblock, NULL);
+    } //End 
+
+    //Version 1 had no pointer width, it was always 16 bits
+    if (superblock->magic == SUPERBLOCK_MAGIC && superblock->version == 1 && superblock->ptr_bytes == 0)
+    {
+        superblock->version = SUPERBLOCK_VERSION;
+        superblock->ptr_bytes = sizeof(uint16_t);
+    } //End 
+    return superblock_valid(superblock);
 } //End 
 
 /**********************************************************/
 
-inode_t* get_inode(S17FS_t *fs, const inode_ptr_t inode_number)
+block_store_t *open_block_store(const char *path, const bool format, const fs_backend_t backend, const superblock_t *superblock)
 {
-    if (fs)
+    block_store_device_t device;
+    switch (backend)
     {
-        inode_t buffer[INODES_PER_BLOCK];
-
-        //Determine the inode block, and offset
-        size_t block = inode_number / (BLOCK_SIZE / sizeof(inode_t)) + 1; //The inode blocks are blocks 1-32, thus the + 1
-        size_t offset = inode_number % (BLOCK_SIZE / sizeof(inode_t)); 
+        case FS_BACKEND_URING:
+            device = BLOCK_STORE_URING;
+            break;
+        case FS_BACKEND_FILE:
+            device = BLOCK_STORE_FILE;
+            break;
+        default:
+            device = BLOCK_STORE_MAPPED;
+            break;
+    } //End switch (backend)
+
+    return format ? block_store_create_ex(path, device, superblock->block_size, superblock->block_count, superblock->block_limit)
+                  : block_store_open_ex(path, device, superblock->block_size, superblock->block_count, superblock->block_limit);
+} //End 
 
-        //printf("get_inode: inum = %u -- block = %zu -- offset = %zu\n", inode_number, block, offset);
+/**********************************************************/
 
-        if (block_store_read(fs->bs, block, buffer)) 
+S17FS_t *ready_file(const char *path, const bool format, const fs_backend_t backend, const superblock_t *superblock) {
+    //Without one handed in, a format gets the defaults and a mount finds out from the file
+    superblock_t found;
+    if (superblock == NULL)
+    {
+        if (format ? !default_superblock(&found, NULL) : !read_superblock(path, &found))
         {
-            //printf("\nbuffer[offset]: self_inum = %u - data_ptrs[0] = %u\n", buffer[offset].mdata.self_inode_num, buffer[offset].data_ptrs[0]);
-            inode_t* inode = (inode_t *)malloc(sizeof(inode_t));
-            if (inode)
-            {
-                memcpy(inode, &(buffer[offset]), sizeof(inode_t));
-                //printf("inode[offset]: self_inum = %u - data_ptrs[0] = %u\n", inode->mdata.self_inode_num, inode->data_ptrs[0]);
-                return inode;
-            } //End 
+            return NULL;
         } //End 
+        superblock = &found;
     } //End 
+    return ready_volume(open_block_store(path, format, backend, superblock), path, format, superblock);
+}
 
-    return NULL;
+/**********************************************************/
+
+static void set_geometry(S17FS_t *fs, const superblock_t *superblock)
+{
+    geometry_t *geo = &fs->geo;
+    geo->block_size = superblock->block_size;
+    geo->block_count = superblock->block_count;
+    geo->block_limit = superblock->block_limit ? superblock->block_limit : superblock->block_count;
+    geo->data_end = block_store_get_capacity(fs->bs);
+    geo->inode_total = superblock->inode_count;
+    geo->inode_limit = superblock->inode_limit ? superblock->inode_limit : superblock->inode_count;
+    geo->inode_size = superblock->inode_size ? superblock->inode_size : INODE_CORE_BYTES;
+    geo->inodes_per_block = geo->block_size / geo->inode_size;
+    geo->inline_max = superblock->features & SUPERBLOCK_INLINE ? geo->inode_size - INODE_CORE_BYTES + INLINE_CORE_BYTES : 0;
+    geo->fragment_bytes = superblock->features & SUPERBLOCK_TAILS ? geo->block_size / FRAGMENTS_PER_BLOCK : 0;
+    geo->table_blocks = (geo->inode_total - 1) / geo->inodes_per_block + 2;
+    geo->table_max = (geo->inode_limit - 1) / geo->inodes_per_block + 2;
+    geo->ptr_bytes = superblock->ptr_bytes;
+    geo->ptrs_per_block = geo->block_size / geo->ptr_bytes;
+    geo->dir_records = superblock->dir_records;
+    geo->journal_start = superblock->journal_start;
+    geo->journal_blocks = superblock->journal_blocks;
+
+    //Blocks are BLOCK_SIZE_MAX at most, so none of these come out zero
+    geo->readahead_min = READAHEAD_MIN_BYTES / geo->block_size;
+    geo->readahead_max = READAHEAD_MAX_BYTES / geo->block_size;
+    geo->parallel_min = PARALLEL_MIN_BYTES / geo->block_size;
+    geo->parallel_chunk = PARALLEL_CHUNK_BYTES / geo->block_size;
+    geo->parallel_batch = PARALLEL_BATCH_BYTES / geo->block_size;
+    geo->writeback_bytes = WRITEBACK_BYTES / geo->block_size * geo->block_size;
+
+    //Sizes are kept in 32 bits, so a file can't reach past that whatever its pointers cover
+    geo->file_blocks_max = DIRECT_TOTAL + 2 * geo->ptrs_per_block + geo->ptrs_per_block * geo->ptrs_per_block;
+    if (geo->file_blocks_max > UINT32_MAX / geo->block_size)
+    {
+        geo->file_blocks_max = UINT32_MAX / geo->block_size;
+    } //End 
 } //End 
 
 /**********************************************************/
 
-bool write_inode(S17FS_t *fs, const void *data, const inode_ptr_t inode_number)
+static bool write_superblock(S17FS_t *fs, const superblock_t *superblock)
 {
-    if (fs && data)
+    data_block_t buffer;
+    if (!block_store_read(fs->bs, 0, buffer))
     {
-        inode_t buffer[INODES_PER_BLOCK];
+        return false;
+    } //End 
+    memcpy(buffer + SUPERBLOCK_SLOT * INODE_CORE_BYTES, superblock, sizeof(superblock_t));
+    return block_store_write(fs->bs, 0, buffer) != 0;
+} //End 
 
-        //Determine the inode block, and offset
-        size_t block = inode_number / (BLOCK_SIZE / sizeof(inode_t)) + 1; //The inode blocks are blocks 1-32, thus the + 1
-        size_t offset = inode_number % (BLOCK_SIZE / sizeof(inode_t)); 
+/**********************************************************/
 
-        //printf("write_inode: inum = %u -- block = %zu -- offset = %zu -- record_count = %u\n", inode_number, block, offset, ((inode_t *)data)->mdata.record_count);
-        ///*
-        if (block_store_read(fs->bs, block, buffer)) 
-        {
-            memcpy(&(buffer[offset]), data, sizeof(inode_t));
-            return block_store_write(fs->bs, block, buffer);
-        }
-        //*/
-        //return true;
-    }
-    return false;
-}
+//Sets the journal area aside right below the free block map
+static bool create_journal_area(S17FS_t *fs)
+{
+    bool valid = true;
+    for (size_t block = fs->geo.journal_start; block < fs->geo.journal_start + fs->geo.journal_blocks && valid; block++)
+    {
+        valid = block_store_request(fs->bs, block);
+    } //End 
+    return valid && journal_format(fs->bs, fs->geo.journal_start, fs->geo.journal_blocks, fs->geo.block_size);
+} //End 
 
 /**********************************************************/
 
-bool write_root_inode(S17FS_t *fs, const void *data, const inode_ptr_t inode_number)
+//A replay puts metadata back the way the last commit left it, but the free block map is updated in place
+//and may have moved on since, so it's worked out again from the files themselves
+static bool claim_block(S17FS_t *fs, const size_t block, void *arg)
 {
-    if (fs && data) {
-        inode_t buffer[INODES_PER_BLOCK];
+    (void)arg;
+    block_store_request(fs->bs, block);
+    return true;
+} //End 
 
-        //Determine the inode block, and offset
-        //size_t block = inode_number / (BLOCK_SIZE / sizeof(inode_t)); //The inode blocks are blocks 1-32, thus the + 1
-        //size_t offset = inode_number % (BLOCK_SIZE / sizeof(inode_t)); 
-        if (inode_number)
+static bool rebuild_free_map(S17FS_t *fs)
+{
+    //The map is rebuilt in place, everything up through the root directory's block, and the journal
+    //area, was set aside at format and stays that way, the rest is cleared and then claimed again
+    for (size_t block = fs->geo.table_blocks + 1; block < fs->geo.data_end; block++)
+    {
+        if (block == fs->geo.journal_start)
         {
-        }
+            block += fs->geo.journal_blocks - 1;
+            continue;
+        } //End 
+        block_store_release(fs->bs, block);
+    } //End 
 
-        if (block_store_read(fs->bs, 0, buffer)) 
+    bool complete = walk_inode_blocks(fs, &fs->table_inode, claim_block, NULL);
+    for (size_t inode_number = 0; inode_number < fs->geo.inode_limit && complete; inode_number++)
+    {
+        inode_t inode;
+        if (bitmap_test(fs->inode_bitmap, inode_number))
         {
-            memcpy(buffer, data, sizeof(inode_t));
-            return block_store_write(fs->bs, 0, buffer);
-        }
-    }
-    return false;
-}
+            complete = read_inode(fs, &inode, inode_number) && walk_inode_blocks(fs, &inode, claim_block, NULL);
+
+            //Fragment blocks are shared, the other tails in one just claim it again
+            size_t fragment = 0;
+            complete = complete && (!(inode.mdata.flags & INODE_TAIL) || walk_file_blocks(fs, inode_tail(&inode, &fragment), 0, claim_block, NULL));
+        } //End 
+    } //End 
+    return complete;
+} //End 
 
 /**********************************************************/
 
-bool write_S17FS_to_block_store(S17FS_t *fs)
+static void prepare_commit(void *arg)
 {
-    if (fs)
-    {
-        inode_t buffer[INODES_PER_BLOCK];
-
-        if (block_store_read(fs->bs, 0, buffer)) 
-        {
-            memcpy(&buffer[1], bitmap_export(fs->inode_bitmap), bitmap_get_bytes(fs->inode_bitmap));
-            return block_store_write(fs->bs, 0, buffer);
-        }
-    }
-    return false;
+    //The inode bitmap only lives in memory, it has to be in block 0 when block 0 is logged
+    write_S17FS_to_block_store((S17FS_t *) arg);
 } //End 
 
 /**********************************************************/
 
-bool load_S17FS(S17FS_t *fs)
+static bool sync_commit(void *arg)
 {
-    if (fs)
-    {
-        inode_t buffer[INODES_PER_BLOCK];
+    return sync_store((S17FS_t *) arg);
+} //End 
 
-        if (block_store_read(fs->bs, 0, buffer)) 
-        {
-            //memcpy(&buffer[1], bitmap_export(fs->inode_bitmap), bitmap_get_bytes(fs->inode_bitmap));
-            //fs->inode_bitmap = bitmap_overlay(INODE_TOTAL);
-            fs->inode_bitmap = bitmap_import(INODE_TOTAL, &buffer[1]);
+/**********************************************************/
 
-            if (fs->inode_bitmap)
-            {
-                return true;
-            } //End 
-            //return block_store_write(fs->bs, 0, buffer);
-        } //End 
-    } //End 
-    return false;
+static void release_commit(void *arg, size_t *blocks, const size_t count)
+{
+    release_blocks((S17FS_t *) arg, blocks, count);
 } //End 
 
 /**********************************************************/
 
-S17FS_t *ready_file(const char *path, const bool format) {
-    S17FS_t *fs = (S17FS_t *) calloc(1, sizeof(S17FS_t));
-    if (fs)
+//Picks up the journal a volume was formatted with, when mounting whatever the last commits
+//left in it is replayed before the rest of the volume is loaded
+//A replay can bring back block 0 from before a growable volume last grew, the superblock it was opened with goes back over it
+static bool open_journal(S17FS_t *fs, const bool format, const superblock_t *superblock)
+{
+    const geometry_t *geo = &fs->geo;
+    if (!format)
     {
-        fs->origin = (char *)malloc(strlen(path) + 1);
-        if (fs->origin)
+        int replayed = geo->journal_blocks ? journal_replay(fs->bs, geo->journal_start, geo->journal_blocks, geo->block_size) : 0;
+        if (replayed < 0 || (replayed > 0 && superblock->block_limit && !write_superblock(fs, superblock)) || !load_S17FS(fs)
+            || (replayed > 0 && !rebuild_free_map(fs)))
         {
-            memcpy(fs->origin, path, strlen(path)+1);
+            return false;
         } //End 
-        //printf("\nOrigin: %s\n", fs->origin);
+    } //End 
 
-        if (format)
-        {
+    if (geo->journal_blocks)
+    {
+        fs->journal = journal_create(fs->bs, geo->journal_start, geo->journal_blocks, geo->block_size, prepare_commit, sync_commit,
+                                     release_commit, fs);
+        return fs->journal != NULL;
+    } //End 
+    return true;
+} //End 
 
+/**********************************************************/
 
-            fs->bs = block_store_create(path);
+S17FS_t *ready_volume(block_store_t *bs, const char *origin, const bool format, const superblock_t *superblock) {
+    superblock_t defaults;
+    if (superblock == NULL && !default_superblock(&defaults, NULL))
+    {
+        block_store_destroy(bs);
+        return NULL;
+    } //End 
+    superblock = superblock ? superblock : &defaults;
+    if (bs == NULL)
+    {
+        return NULL;
+    } //End 
 
-            if (fs->bs)
-            {
-                bool valid = true;
-                for (int i = INODE_BLOCK_OFFSET; i < (DATA_BLOCK_OFFSET+2) && valid; ++i)
-                {
-                    //printf("i: %d\n", i);
-                    valid &= block_store_request(fs->bs, i);
-                } //End 
+    S17FS_t *fs = (S17FS_t *) calloc(1, sizeof(S17FS_t));
+    if (fs && !init_S17FS_locks(fs))
+    {
+        destroy_S17FS_locks(fs);
+        free(fs);
+        fs = NULL;
+    } //End 
 
-                if (valid)
-                {
-                    uint32_t right_now = time(NULL);
-                    inode_t root_inode = {
-                        {1, 0, 0, right_now, right_now, 0, FS_DIRECTORY, {0}},
-                        {DATA_BLOCK_OFFSET+1, 0, 0, 0, 0, 0, 0, 0}};
-                    valid &= write_root_inode(fs, &root_inode, 0);
-                    //bitmap_set(fs->bs, 0);
-                } //End 
+    if (fs == NULL)
+    {
+        block_store_destroy(bs);
+        return NULL;
+    } //End 
 
-                if (!valid)
-                {
-                    block_store_destroy(fs->bs);
-                    fs->bs = NULL;
-                } //End 
-            } //End 
+    //Memory volumes don't come from anywhere
+    bool valid = true;
+    if (origin)
+    {
+        fs->origin = (char *)malloc(strlen(origin) + 1);
+        valid = fs->origin != NULL;
+        if (valid)
+        {
+            memcpy(fs->origin, origin, strlen(origin)+1);
+        } //End 
+    } //End 
 
+    fs->bs = bs;
+    set_geometry(fs, superblock);
+    valid = valid && create_inode_table(fs);
+    if (format)
+    {
+        for (size_t i = INODE_BLOCK_OFFSET; i < (fs->geo.table_blocks+1) && valid; ++i)
+        {
+            valid &= block_store_request(fs->bs, i);
+        } //End 
 
-            fs->inode_bitmap = bitmap_create(INODE_TOTAL);
+        if (valid)
+        {
+            uint32_t right_now = time(NULL);
+            inode_t root_inode = {
+                {1, 0, 0, right_now, right_now, 0, FS_DIRECTORY, {0}, 0, 0, {0}},
+                {(uint16_t) fs->geo.table_blocks, 0, 0, 0, 0, 0, 0, 0}, {0}};
+            valid &= write_root_inode(fs, &root_inode, 0);
+        } //End 
 
-            if (fs->inode_bitmap)
-            {
-                bitmap_format(fs->inode_bitmap, 0);
-                bitmap_set(fs->inode_bitmap, 0);
-            } //End
+        if (valid && fs->geo.journal_blocks)
+        {
+            valid = create_journal_area(fs);
         } //End 
-        else
+
+        valid = valid && write_superblock(fs, superblock);
+
+        fs->inode_bitmap = valid ? create_inode_bitmap(fs) : NULL;
+        valid = fs->inode_bitmap != NULL;
+        if (valid)
         {
-            fs->bs = block_store_open(path);
-            //fs->bs = block_store_deserialize(path);
-            if (!load_S17FS(fs))
-            {
-                block_store_destroy(fs->bs);
-                fs->bs = NULL;
-            } //End 
-        } //End else
+            bitmap_set(fs->inode_bitmap, 0);
+        } //End
+    } //End 
 
-        if (fs->bs)
+    valid = valid && open_journal(fs, format, superblock);
+    if (valid)
+    {
+        fs->fd_table.fd_status = bitmap_create(DESCRIPTOR_MAX);
+        if (fs->fd_table.fd_status)
         {
-            fs->fd_table.fd_status = bitmap_create(DESCRIPTOR_MAX);
-            if (fs->fd_table.fd_status)
-            {
-                return fs;
-            } //End 
+            return fs;
         } //End 
-        free(fs);
     } //End 
 
+    //Whatever did get set up goes, the journal first since clearing it writes to the device
+    journal_destroy(fs->journal);
+    block_store_destroy(fs->bs);
+    bitmap_destroy(fs->inode_bitmap);
+    destroy_S17FS_locks(fs);
+    free(fs->origin);
+    free(fs);
     return NULL;
 }
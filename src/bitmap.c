@@ -95,26 +95,52 @@ void bitmap_invert(bitmap_t *const bitmap) {
     }
 }
 
-size_t bitmap_ffs(const bitmap_t *const bitmap) {
-    if (bitmap) {
-        size_t result = 0;
-        for (; result < bitmap->bit_count && !bitmap_test(bitmap, result); ++result) {
+// Both searches skip whole bytes, eight at a time where they can, before looking at single bits
+//  A volume with millions of blocks mostly in use would otherwise test them one by one
+static size_t bitmap_find(const bitmap_t *const bitmap, const size_t start, const uint8_t skip) {
+    if (bitmap == NULL || start >= bitmap->bit_count) {
+        return SIZE_MAX;
+    }
+    size_t bit = start;
+    // Finish the byte we start partway into
+    for (; (bit & 0x07) && bit < bitmap->bit_count; ++bit) {
+        if (((bitmap->data[bit >> 3] & mask[bit & 0x07]) != 0) != (skip != 0)) {
+            return bit;
+        }
+    }
+    size_t byte = bit >> 3;
+    const uint64_t skip_word = skip ? UINT64_MAX : 0;
+    for (; byte + 8 <= bitmap->byte_count; byte += 8) {
+        uint64_t word;
+        memcpy(&word, &bitmap->data[byte], sizeof(word));
+        if (word != skip_word) {
+            break;
+        }
+    }
+    for (; byte < bitmap->byte_count && bitmap->data[byte] == skip; ++byte) {
+    }
+    for (bit = byte << 3; bit < bitmap->bit_count; ++bit) {
+        if (((bitmap->data[bit >> 3] & mask[bit & 0x07]) != 0) != (skip != 0)) {
+            return bit;
         }
-        return (result == bitmap->bit_count ? SIZE_MAX : result);
     }
     return SIZE_MAX;
 }
 
+size_t bitmap_ffs(const bitmap_t *const bitmap) {
+    return bitmap_find(bitmap, 0, 0x00);
+}
+
 size_t bitmap_ffz(const bitmap_t *const bitmap) {
-    if (bitmap) {
-        size_t result = 0;
-        //printf("bitmap-bit_count = %zu", bitmap->bit_count);
-        for (; result < bitmap->bit_count && bitmap_test(bitmap, result); ++result) {
-        }
-        //printf(" - BIT: %zu\n", (result == bitmap->bit_count ? SIZE_MAX : result));
-        return (result == bitmap->bit_count ? SIZE_MAX : result);
-    }
-    return SIZE_MAX;
+    return bitmap_find(bitmap, 0, 0xFF);
+}
+
+size_t bitmap_ffz_from(const bitmap_t *const bitmap, const size_t start) {
+    return bitmap_find(bitmap, start, 0xFF);
+}
+
+size_t bitmap_ffs_from(const bitmap_t *const bitmap, const size_t start) {
+    return bitmap_find(bitmap, start, 0x00);
 }
 
 size_t bitmap_total_set(const bitmap_t *const bitmap) {
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE  // MAP_ANONYMOUS, fallocate
+
 #include <stdint.h>
 #include <errno.h>
 #include <string.h>
@@ -8,29 +10,396 @@
 #include <sys/mman.h>
 #include <sys/types.h>
 #include "block_store.h"
+#include "block_uring.h"
 #include "bitmap.h"
 #include <stdio.h>
 
-#define BLOCK_STORE_NUM_BLOCKS 65536   // 2^16 blocks.
+#define BLOCK_STORE_NUM_BLOCKS 65536   // 2^16 blocks, unless the device is created with its own geometry
 //#define BLOCK_STORE_AVAIL_BLOCKS 65534 // Last two blocks consumed by the FBM
 #define BLOCK_STORE_AVAIL_BLOCKS 65520
-#define BLOCK_SIZE_BITS 4096         // 2^9 BYTES per block *2^3 BITS per BYTES
-#define BLOCK_SIZE_BYTES 512         // 2^9 BYTES per block
-#define BLOCK_STORE_NUM_BYTES (BLOCK_STORE_NUM_BLOCKS * BLOCK_SIZE_BYTES)  // 2^16 blocks of 2^9 bytes.
+#define BLOCK_SIZE_BYTES 512         // 2^9 BYTES per block, again unless told otherwise
+#define BLOCK_SIZE_MIN_BYTES 512
+#define BLOCK_SIZE_MAX_BYTES 65536
+#define SERIALIZE_CHUNK_BYTES (1024 * 1024)  // Copied out at a time when serializing a device that isn't in memory
+
+// Bytes in the whole image, and in the FBM blocks at the end of it
+#define IMAGE_BYTES(bs) ((bs)->block_count * (bs)->block_size)
+#define FBM_BYTES(bs) (((bs)->block_count - (bs)->avail_blocks) * (bs)->block_size)
+// Bytes the image can grow to, a mapping reserves this much address space up front
+#define RESERVED_BYTES(bs) ((bs)->reserved_blocks * (bs)->block_size)
+
 
+// What each kind of device does, the public functions check their arguments and dispatch through it
+//  Adding a device means writing a table and a constructor that fills in the fields it uses
+typedef struct block_store_ops {
+    size_t (*read)(const block_store_t *const bs, const size_t block_id, const size_t count, void *buffer);
+    size_t (*write)(block_store_t *const bs, const size_t block_id, const size_t count, const void *buffer);
+    size_t (*allocate)(block_store_t *const bs);
+    void (*release)(block_store_t *const bs, const size_t block_id);
+    bool (*sync)(block_store_t *const bs);
+    const void *(*get_ptr)(const block_store_t *const bs, const size_t block_id);  // NULL if blocks can't be reached in place
+    void (*prefetch)(const block_store_t *const bs, const size_t block_id, const size_t count);  // Optional
+    void (*discard)(block_store_t *const bs, const size_t block_id, const size_t count);  // Optional, whole pages only
+    uint8_t *(*grow)(block_store_t *const bs, const size_t block_count, const size_t avail_blocks);  // Optional, gives where the FBM goes
+    void (*close)(block_store_t *const bs);
+} block_store_ops_t;
 
 struct block_store {
-    int fd;
-    uint8_t *data_blocks;
+    const block_store_ops_t *ops;
+    int fd;                 // -1 for anonymous memory
+    size_t block_size;      // Bytes per block
+    size_t block_count;     // Every block on the device, the FBM's included
+    size_t reserved_blocks; // Most blocks the device can grow to
+    size_t avail_blocks;    // Blocks ahead of the FBM, the only ones that get handed out
+    uint8_t *data_blocks;   // Whole image, for the mapped and memory devices
     bitmap_t *fbm;
+    size_t fbm_hint;        // Every block below this one is in use, allocation searches from here
+    size_t free_blocks;     // Clear bits ahead of the FBM, kept up by everything that sets or clears one
+    block_uring_t *uring;   // Block cache the io_uring device goes through
+    uint8_t *fbm_blocks;    // In-memory copy of the FBM blocks, for devices without an image in memory
+    size_t page_blocks;     // Blocks per page, at least one, for dirty tracking and discards
+    uint64_t *dirty_pages;  // Pages of the mapped device written since the last sync, a bit each
 };
 
+///
+///-- Devices that hold the whole image in memory: mmap'd files and anonymous memory
+///
+
+static size_t image_read(const block_store_t *const bs, const size_t block_id, const size_t count, void *buffer) {
+    memcpy(buffer, bs->data_blocks + block_id * bs->block_size, count * bs->block_size);
+    return count * bs->block_size;
+}
+
+static size_t image_write(block_store_t *const bs, const size_t block_id, const size_t count, const void *buffer) {
+    memcpy(bs->data_blocks + block_id * bs->block_size, buffer, count * bs->block_size);
+    return count * bs->block_size;
+}
+
+// Set after the copy lands, so a sync that clears the bit first still sees the data, or leaves it for the next one
+static void mark_dirty(block_store_t *const bs, const size_t block_id, const size_t count) {
+    for (size_t page = block_id / bs->page_blocks; page <= (block_id + count - 1) / bs->page_blocks; ++page) {
+        __atomic_fetch_or(&bs->dirty_pages[page / 64], (uint64_t) 1 << (page % 64), __ATOMIC_RELEASE);
+    }
+}
+
+static size_t mapped_write(block_store_t *const bs, const size_t block_id, const size_t count, const void *buffer) {
+    image_write(bs, block_id, count, buffer);
+    mark_dirty(bs, block_id, count);
+    return count * bs->block_size;
+}
+
+static const void *image_get_ptr(const block_store_t *const bs, const size_t block_id) {
+    return bs->data_blocks + block_id * bs->block_size;
+}
+
+static void image_prefetch(const block_store_t *const bs, const size_t block_id, const size_t count) {
+    // madvise wants a page aligned start, so round down to the page holding the first block
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+    size_t start_byte = (block_id * bs->block_size) & ~(page - 1);
+    size_t end_byte = (block_id + count) * bs->block_size;
+    posix_madvise(bs->data_blocks + start_byte, end_byte - start_byte, POSIX_MADV_WILLNEED);
+}
+
+static void mapped_discard(block_store_t *const bs, const size_t block_id, const size_t count) {
+#ifdef MADV_REMOVE
+    // Frees the page cache and punches the same range out of the file
+    madvise(bs->data_blocks + block_id * bs->block_size, count * bs->block_size, MADV_REMOVE);
+#else
+    (void) bs, (void) block_id, (void) count;
+#endif
+}
+
+// Starts write-back of a run of dirty pages, mapped_sync waits for all of them at once
+static bool mapped_write_back(block_store_t *const bs, const size_t page, const size_t count) {
+    size_t page_bytes = bs->page_blocks * bs->block_size;
+    return sync_file_range(bs->fd, (off_t)(page * page_bytes), (off_t)(count * page_bytes), SYNC_FILE_RANGE_WRITE) == 0;
+}
+
+static bool mapped_sync(block_store_t *const bs) {
+    // Only pages written since the last sync get written back, neighbouring ones as a single range
+    // The FBM is changed in place through its overlay, so it always goes
+    mark_dirty(bs, bs->avail_blocks, bs->block_count - bs->avail_blocks);
+    size_t pages = (bs->block_count + bs->page_blocks - 1) / bs->page_blocks;
+    bool synced = true;
+    size_t run = pages;
+    for (size_t word = 0; word * 64 < pages; ++word) {
+        uint64_t bits = __atomic_exchange_n(&bs->dirty_pages[word], 0, __ATOMIC_ACQUIRE);
+        for (size_t bit = 0; bit < 64; ++bit) {
+            size_t page = word * 64 + bit;
+            bool dirty = page < pages && (bits >> bit) & 1;
+            if (dirty && run == pages) {
+                run = page;
+            } else if (!dirty && run != pages) {
+                synced &= mapped_write_back(bs, run, page - run);
+                run = pages;
+            }
+        }
+    }
+    if (run != pages) {
+        synced &= mapped_write_back(bs, run, pages - run);
+    }
+    // One wait and one journal commit for all of it, rather than one per range
+    return fdatasync(bs->fd) == 0 && synced;
+}
+
+// The new blocks go over the address space reserved past the image, so nothing already mapped moves
+static uint8_t *mapped_grow(block_store_t *const bs, const size_t block_count, const size_t avail_blocks) {
+    size_t image_bytes = IMAGE_BYTES(bs);
+    void *tail = mmap(bs->data_blocks + image_bytes, block_count * bs->block_size - image_bytes, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_FIXED, bs->fd, (off_t) image_bytes);
+    return tail != MAP_FAILED ? bs->data_blocks + avail_blocks * bs->block_size : NULL;
+}
+
+static void mapped_close(block_store_t *const bs) {
+    munmap(bs->data_blocks, RESERVED_BYTES(bs));
+    free(bs->dirty_pages);
+    close(bs->fd);
+}
+
+static bool memory_sync(block_store_t *const bs) {
+    // Nowhere to write it to
+    (void) bs;
+    return true;
+}
+
+static void memory_discard(block_store_t *const bs, const size_t block_id, const size_t count) {
+    // Private anonymous pages come back zero filled
+    madvise(bs->data_blocks + block_id * bs->block_size, count * bs->block_size, MADV_DONTNEED);
+}
+
+static void memory_close(block_store_t *const bs) {
+    munmap(bs->data_blocks, IMAGE_BYTES(bs));
+}
+
+///
+///-- Devices that reach the file with explicit I/O and keep the FBM blocks in memory
+///
+
+// Most of a run that isn't FBM blocks, those are served from memory
+static size_t device_blocks(const block_store_t *const bs, const size_t block_id, const size_t count) {
+    return block_id + count > bs->avail_blocks ? bs->avail_blocks - block_id : count;
+}
+
+// Moves the whole range between memory and the file, a piece at a time if it has to
+static bool file_transfer(const int fd, uint8_t *buffer, const size_t length, const off_t offset, const bool write) {
+    size_t done = 0;
+    while (done < length) {
+        ssize_t moved = write ? pwrite(fd, buffer + done, length - done, offset + done)
+                              : pread(fd, buffer + done, length - done, offset + done);
+        if (moved < 0 && errno == EINTR) {
+            continue;
+        }
+        if (moved <= 0) {
+            return false;
+        }
+        done += (size_t) moved;
+    }
+    return true;
+}
+
+static bool fbm_write_back(block_store_t *const bs) {
+    return file_transfer(bs->fd, bs->fbm_blocks, FBM_BYTES(bs),
+                         (off_t) bs->avail_blocks * bs->block_size, true);
+}
+
+static size_t file_read(const block_store_t *const bs, const size_t block_id, const size_t count, void *buffer) {
+    size_t data = device_blocks(bs, block_id, count);
+    if (data && !file_transfer(bs->fd, (uint8_t *) buffer, data * bs->block_size, (off_t) block_id * bs->block_size, false)) {
+        return 0;
+    }
+    if (data < count) {
+        memcpy((uint8_t *) buffer + data * bs->block_size, bs->fbm_blocks, bs->block_size);
+    }
+    return count * bs->block_size;
+}
+
+static size_t file_write(block_store_t *const bs, const size_t block_id, const size_t count, const void *buffer) {
+    size_t data = device_blocks(bs, block_id, count);
+    if (data && !file_transfer(bs->fd, (uint8_t *) buffer, data * bs->block_size, (off_t) block_id * bs->block_size, true)) {
+        return 0;
+    }
+    if (data < count) {
+        memcpy(bs->fbm_blocks, (const uint8_t *) buffer + data * bs->block_size, bs->block_size);
+    }
+    return count * bs->block_size;
+}
+
+static void file_prefetch(const block_store_t *const bs, const size_t block_id, const size_t count) {
+    posix_fadvise(bs->fd, (off_t) block_id * bs->block_size, (off_t) count * bs->block_size, POSIX_FADV_WILLNEED);
+}
+
+static void file_discard(block_store_t *const bs, const size_t block_id, const size_t count) {
+#ifdef FALLOC_FL_PUNCH_HOLE
+    fallocate(bs->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, (off_t) block_id * bs->block_size,
+              (off_t) count * bs->block_size);
+#else
+    (void) bs, (void) block_id, (void) count;
+#endif
+}
+
+// The FBM blocks are only ever in memory until they're written back, a fresh copy is all they need
+static uint8_t *file_grow(block_store_t *const bs, const size_t block_count, const size_t avail_blocks) {
+    return (uint8_t *) calloc(block_count - avail_blocks, bs->block_size);
+}
+
+static bool file_sync(block_store_t *const bs) {
+    return fbm_write_back(bs) && fdatasync(bs->fd) == 0;
+}
+
+static void file_close(block_store_t *const bs) {
+    fbm_write_back(bs);
+    free(bs->fbm_blocks);
+    close(bs->fd);
+}
 
-int create_file(const char *const fname) {
+static size_t uring_read(const block_store_t *const bs, const size_t block_id, const size_t count, void *buffer) {
+    size_t data = device_blocks(bs, block_id, count);
+    if (data && !block_uring_read(bs->uring, block_id, data, buffer)) {
+        return 0;
+    }
+    if (data < count) {
+        memcpy((uint8_t *) buffer + data * bs->block_size, bs->fbm_blocks, bs->block_size);
+    }
+    return count * bs->block_size;
+}
+
+static size_t uring_write(block_store_t *const bs, const size_t block_id, const size_t count, const void *buffer) {
+    size_t data = device_blocks(bs, block_id, count);
+    if (data && !block_uring_write(bs->uring, block_id, data, buffer)) {
+        return 0;
+    }
+    if (data < count) {
+        memcpy(bs->fbm_blocks, (const uint8_t *) buffer + data * bs->block_size, bs->block_size);
+    }
+    return count * bs->block_size;
+}
+
+static void uring_prefetch(const block_store_t *const bs, const size_t block_id, const size_t count) {
+    block_uring_prefetch(bs->uring, block_id, device_blocks(bs, block_id, count));
+}
+
+static void uring_discard(block_store_t *const bs, const size_t block_id, const size_t count) {
+    // Otherwise a dirty copy would get written back into the hole later
+    block_uring_forget(bs->uring, block_id, count);
+    file_discard(bs, block_id, count);
+}
+
+static bool uring_sync(block_store_t *const bs) {
+    return block_uring_flush(bs->uring) && file_sync(bs);
+}
+
+static void uring_close(block_store_t *const bs) {
+    block_uring_destroy(bs->uring);
+    file_close(bs);
+}
+
+///
+///-- Free block map handling, the same for every device so far
+///
+
+static size_t fbm_allocate(block_store_t *const bs) {
+    //-- find first zero in the bitmap
+    size_t id;
+    id = bitmap_ffz_from(bs->fbm, bs->fbm_hint); // index of the first free block
+    //if (id == bs->avail_blocks) {
+    if (id >= bs->avail_blocks || id == SIZE_MAX) {
+        //printf("ERROR: BIT = %zu\n", id);
+        return SIZE_MAX; // return SIZE_MAX since the last block is not available for storing data
+    }
+    bitmap_set(bs->fbm, id); // mark it as in use
+    bs->fbm_hint = id + 1;
+    --bs->free_blocks;
+    //  bitmap_destroy(bs->fbm); // destruct and destroy bitmap object
+    //printf("SUCCESS: BIT = %zu", id);
+    return id;
+}
+
+// Free runs are walked from the hint, each one ends at the next block in use
+static size_t fbm_allocate_run(block_store_t *const bs, const size_t count) {
+    size_t start = bitmap_ffz_from(bs->fbm, bs->fbm_hint);
+    while (start < bs->avail_blocks && count <= bs->avail_blocks - start) {
+        size_t end = bitmap_ffs_from(bs->fbm, start);
+        end = end < bs->avail_blocks ? end : bs->avail_blocks;
+        if (end - start >= count) {
+            for (size_t block_id = start; block_id < start + count; ++block_id) {
+                bitmap_set(bs->fbm, block_id);
+            }
+            bs->free_blocks -= count;
+            if (start == bs->fbm_hint) {
+                bs->fbm_hint = start + count;
+            }
+            return start;
+        }
+        start = end < bs->avail_blocks ? bitmap_ffz_from(bs->fbm, end) : SIZE_MAX;
+    }
+    return SIZE_MAX;
+}
+
+static void fbm_release(block_store_t *const bs, const size_t block_id) {
+    bool success = 0;
+    success = bitmap_test(bs->fbm, block_id); // check if the block is in use
+    if (success) {
+        bitmap_reset(bs->fbm, block_id); // clear requested bit in bitmap
+        ++bs->free_blocks;
+        if (block_id < bs->fbm_hint) {
+            bs->fbm_hint = block_id;
+        }
+        //        bitmap_destroy(bs->fbm); // destruct and destroy bitmap object
+    }
+}
+
+static const block_store_ops_t mapped_ops = {image_read, mapped_write, fbm_allocate, fbm_release, mapped_sync,
+                                             image_get_ptr, image_prefetch, mapped_discard, mapped_grow, mapped_close};
+static const block_store_ops_t memory_ops = {image_read, image_write, fbm_allocate, fbm_release, memory_sync,
+                                             image_get_ptr, NULL, memory_discard, NULL, memory_close};
+static const block_store_ops_t file_ops = {file_read, file_write, fbm_allocate, fbm_release, file_sync,
+                                           NULL, file_prefetch, file_discard, file_grow, file_close};
+static const block_store_ops_t uring_ops = {uring_read, uring_write, fbm_allocate, fbm_release, uring_sync,
+                                            NULL, uring_prefetch, uring_discard, file_grow, uring_close};
+
+
+// The FBM gets a bit per block, and the whole blocks it takes up come off the end
+static size_t fbm_block_count(const size_t block_size, const size_t block_count) {
+    return ((block_count + 7) / 8 + block_size - 1) / block_size;
+}
+
+// Sets up an empty device object with the given shape, NULL if the shape doesn't work
+static block_store_t *new_device(const size_t block_size, const size_t block_count, const size_t reserved_blocks) {
+    if (block_size < BLOCK_SIZE_MIN_BYTES || block_size > BLOCK_SIZE_MAX_BYTES || (block_size & (block_size - 1))
+        || block_count < 2 || reserved_blocks < block_count || reserved_blocks > SIZE_MAX / block_size) {
+        return NULL;
+    }
+    size_t fbm_blocks = fbm_block_count(block_size, block_count);
+    block_store_t *bs = fbm_blocks < block_count ? (block_store_t *) calloc(1, sizeof(block_store_t)) : NULL;
+    if (bs) {
+        bs->fd = -1;
+        bs->block_size = block_size;
+        bs->block_count = block_count;
+        bs->reserved_blocks = reserved_blocks;
+        bs->avail_blocks = block_count - fbm_blocks;
+        size_t page_size = (size_t) sysconf(_SC_PAGESIZE);
+        bs->page_blocks = page_size > block_size ? page_size / block_size : 1;
+    }
+    return bs;
+}
+
+// A fresh FBM has nothing but its own blocks in use
+static void claim_fbm(block_store_t *const bs) {
+    for (size_t block_id = bs->avail_blocks; block_id < bs->block_count; ++block_id) {
+        bitmap_set(bs->fbm, block_id);
+    }
+}
+
+// Counted once when the FBM is loaded or rebuilt, the FBM's own bits are always set
+static void count_free(block_store_t *const bs) {
+    bs->free_blocks = bs->block_count - bitmap_total_set(bs->fbm);
+}
+
+int create_file(const char *const fname, const size_t bytes) {
     if (fname) {
         int fd = open(fname, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
         if (fd != -1) {
-            if (ftruncate(fd, BLOCK_STORE_NUM_BYTES) != -1) {
+            if (ftruncate(fd, bytes) != -1) {
                 return fd;
             }
             close(fd);
@@ -38,15 +407,16 @@ int create_file(const char *const fname) {
     }
     return -1;
 }
-int check_file(const char *const fname) {
+int check_file(const char *const fname, const size_t bytes) {
     if (fname) {
         //printf("\n1 - 1\n");
         int fd = open(fname, O_RDWR, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
         if (fd != -1) {
             //printf("\n1 - 2\n");
             struct stat file_info;
-            //if (fstat(fd, &file_info) != -1 && file_info.st_size == BLOCK_STORE_NUM_BYTES) {
-            if (fstat(fd, &file_info) != -1 && (file_info.st_size >= BLOCK_STORE_NUM_BYTES && file_info.st_size <= BLOCK_STORE_NUM_BYTES + BLOCK_STORE_NUM_BYTES/8))
+            //if (fstat(fd, &file_info) != -1 && file_info.st_size == bytes) {
+            // Anything past the image is left over from growing it, and is ignored until it grows again
+            if (fstat(fd, &file_info) != -1 && (size_t) file_info.st_size >= bytes)
             {
                 //printf("\n1 - 3\n");
                 return fd;
@@ -58,30 +428,83 @@ int check_file(const char *const fname) {
         return -1;
     }
 
-    block_store_t *block_store_init(const bool init, const char *const fname) {
+    // Maps the image at the start of the address space reserved for it, so growing never has to move it
+    static uint8_t *map_image(const block_store_t *const bs) {
+        if (bs->reserved_blocks == bs->block_count) {
+            return (uint8_t *) mmap(NULL, IMAGE_BYTES(bs), PROT_READ | PROT_WRITE, MAP_SHARED, bs->fd, 0);
+        }
+        uint8_t *reserved = (uint8_t *) mmap(NULL, RESERVED_BYTES(bs), PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (reserved != (uint8_t *) MAP_FAILED
+            && mmap(reserved, IMAGE_BYTES(bs), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, bs->fd, 0) == MAP_FAILED) {
+            munmap(reserved, RESERVED_BYTES(bs));
+            return (uint8_t *) MAP_FAILED;
+        }
+        return reserved;
+    }
+
+    block_store_t *block_store_init(const bool init, const char *const fname, const size_t block_size, const size_t block_count,
+                                    const size_t reserved_blocks) {
         if (fname) {
-            block_store_t *bs = (block_store_t *) malloc(sizeof(block_store_t));
+            block_store_t *bs = new_device(block_size, block_count, reserved_blocks);
             if (bs) {
-                bs->fd = init ? create_file(fname) : check_file(fname);
-                if (bs->fd != -1) {
-                    bs->data_blocks = (uint8_t *) mmap(NULL, BLOCK_STORE_NUM_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, bs->fd, 0);
+                bs->fd = init ? create_file(fname, IMAGE_BYTES(bs)) : check_file(fname, IMAGE_BYTES(bs));
+                // Sized for everything it can grow to, writers mark pages without taking any lock
+                size_t pages = (bs->reserved_blocks + bs->page_blocks - 1) / bs->page_blocks;
+                bs->dirty_pages = bs->fd != -1 ? (uint64_t *) calloc((pages + 63) / 64, sizeof(uint64_t)) : NULL;
+                if (bs->dirty_pages) {
+                    bs->data_blocks = map_image(bs);
                     if (bs->data_blocks != (uint8_t *) MAP_FAILED) {
+                        bs->fbm = bitmap_overlay(bs->block_count, bs->data_blocks + (bs->avail_blocks) *bs->block_size);
 
-                        if (init) {
-                            memset(bs->data_blocks, 0X00, BLOCK_STORE_NUM_BYTES);
-                            bs->data_blocks[BLOCK_STORE_NUM_BYTES - 1] = 0xFF;
-                            bs->data_blocks[BLOCK_STORE_NUM_BYTES - 2] = 0xFF;
-
-                            //bs->data_blocks[BLOCK_STORE_NUM_BYTES - 1] = 0xC0;
-
+                        if (bs->fbm) {
+                            if (init) {
+                                // create_file leaves the file truncated, so it already reads back as zeros
+                                // and only the pages touched from here on get faulted in and written back
+                                claim_fbm(bs);
+                            }
+                            count_free(bs);
+                            bs->ops = &mapped_ops;
+                            return bs;
                         }
+                        munmap(bs->data_blocks, RESERVED_BYTES(bs));
+                    }
+                }
+                free(bs->dirty_pages);
+                if (bs->fd != -1) {
+                    close(bs->fd);
+                }
+                free(bs);
+            }
+        }
+        return NULL;
+    }
 
-                        bs->fbm = bitmap_overlay(BLOCK_STORE_NUM_BLOCKS, bs->data_blocks + (BLOCK_STORE_AVAIL_BLOCKS) *BLOCK_SIZE_BYTES);
 
+    // Opens a device that does explicit I/O on the file, the FBM blocks are read in once and kept in memory
+    block_store_t *block_store_init_file(const bool init, const char *const fname, const block_store_ops_t *const ops,
+                                         const size_t block_size, const size_t block_count, const size_t reserved_blocks) {
+        if (fname) {
+            block_store_t *bs = new_device(block_size, block_count, reserved_blocks);
+            if (bs) {
+                bs->fd = init ? create_file(fname, IMAGE_BYTES(bs)) : check_file(fname, IMAGE_BYTES(bs));
+                if (bs->fd != -1) {
+                    bs->fbm_blocks = (uint8_t *) calloc(1, FBM_BYTES(bs));
+                    if (bs->fbm_blocks) {
+                        bool loaded = init || file_transfer(bs->fd, bs->fbm_blocks, FBM_BYTES(bs),
+                                                            (off_t) bs->avail_blocks * bs->block_size, false);
+                        bs->fbm = loaded ? bitmap_overlay(bs->block_count, bs->fbm_blocks) : NULL;
                         if (bs->fbm) {
-                            return bs;
+                            if (init) {
+                                claim_fbm(bs);
+                            }
+                            count_free(bs);
+                            if (ops != &uring_ops || (bs->uring = block_uring_create(bs->fd, bs->block_size)) != NULL) {
+                                bs->ops = ops;
+                                return bs;
+                            }
+                            bitmap_destroy(bs->fbm);
                         }
-                        munmap(bs->data_blocks, BLOCK_STORE_NUM_BYTES);
+                        free(bs->fbm_blocks);
                     }
                     close(bs->fd);
                 }
@@ -97,11 +520,103 @@ int check_file(const char *const fname) {
     ///-- Return pointer to the new block storage device, NULL on error
     ///
     block_store_t *block_store_create(const char *const fname) {
-        return block_store_init(true, fname);
+        return block_store_init(true, fname, BLOCK_SIZE_BYTES, BLOCK_STORE_NUM_BLOCKS, BLOCK_STORE_NUM_BLOCKS);
     }
     //
     block_store_t *block_store_open(const char *const fname) {
-        return block_store_init(false, fname);
+        return block_store_init(false, fname, BLOCK_SIZE_BYTES, BLOCK_STORE_NUM_BLOCKS, BLOCK_STORE_NUM_BLOCKS);
+    }
+    ///
+    ///-- Create a new BS device that reaches the file through io_uring and a block cache
+    ///
+    block_store_t *block_store_create_uring(const char *const fname) {
+        return block_store_init_file(true, fname, &uring_ops, BLOCK_SIZE_BYTES, BLOCK_STORE_NUM_BLOCKS, BLOCK_STORE_NUM_BLOCKS);
+    }
+    //
+    block_store_t *block_store_open_uring(const char *const fname) {
+        return block_store_init_file(false, fname, &uring_ops, BLOCK_SIZE_BYTES, BLOCK_STORE_NUM_BLOCKS, BLOCK_STORE_NUM_BLOCKS);
+    }
+    ///
+    ///-- Create a new BS device that reaches the file with plain pread and pwrite
+    ///
+    block_store_t *block_store_create_file(const char *const fname) {
+        return block_store_init_file(true, fname, &file_ops, BLOCK_SIZE_BYTES, BLOCK_STORE_NUM_BLOCKS, BLOCK_STORE_NUM_BLOCKS);
+    }
+    //
+    block_store_t *block_store_open_file(const char *const fname) {
+        return block_store_init_file(false, fname, &file_ops, BLOCK_SIZE_BYTES, BLOCK_STORE_NUM_BLOCKS, BLOCK_STORE_NUM_BLOCKS);
+    }
+    ///
+    ///-- Create or open a BS device of any kind, with its own block size and count
+    ///
+    block_store_t *block_store_create_ex(const char *const fname, const block_store_device_t device,
+                                         const size_t block_size, const size_t block_count, const size_t block_limit) {
+        size_t reserved = block_limit ? block_limit : block_count;
+        switch (device) {
+            case BLOCK_STORE_MAPPED:
+                return block_store_init(true, fname, block_size, block_count, reserved);
+            case BLOCK_STORE_URING:
+                return block_store_init_file(true, fname, &uring_ops, block_size, block_count, reserved);
+            case BLOCK_STORE_FILE:
+                return block_store_init_file(true, fname, &file_ops, block_size, block_count, reserved);
+        }
+        return NULL;
+    }
+    //
+    block_store_t *block_store_open_ex(const char *const fname, const block_store_device_t device,
+                                       const size_t block_size, const size_t block_count, const size_t block_limit) {
+        size_t reserved = block_limit ? block_limit : block_count;
+        switch (device) {
+            case BLOCK_STORE_MAPPED:
+                return block_store_init(false, fname, block_size, block_count, reserved);
+            case BLOCK_STORE_URING:
+                return block_store_init_file(false, fname, &uring_ops, block_size, block_count, reserved);
+            case BLOCK_STORE_FILE:
+                return block_store_init_file(false, fname, &file_ops, block_size, block_count, reserved);
+        }
+        return NULL;
+    }
+    ///
+    ///-- Create a new BS device in anonymous memory, gone once it's destroyed
+    ///
+    block_store_t *block_store_create_memory(const bool huge_pages) {
+        return block_store_create_memory_ex(BLOCK_SIZE_BYTES, BLOCK_STORE_NUM_BLOCKS, huge_pages);
+    }
+    //
+    block_store_t *block_store_create_memory_ex(const size_t block_size, const size_t block_count, const bool huge_pages) {
+        block_store_t *bs = new_device(block_size, block_count, block_count);
+        if (bs) {
+            bs->data_blocks = (uint8_t *) MAP_FAILED;
+#ifdef MAP_HUGETLB
+            if (huge_pages) {
+                // Only works with pages reserved ahead of time, so not getting them is fine
+                bs->data_blocks = (uint8_t *) mmap(NULL, IMAGE_BYTES(bs), PROT_READ | PROT_WRITE,
+                                                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            }
+#endif
+            if (bs->data_blocks == (uint8_t *) MAP_FAILED) {
+                bs->data_blocks = (uint8_t *) mmap(NULL, IMAGE_BYTES(bs), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+                if (huge_pages && bs->data_blocks != (uint8_t *) MAP_FAILED) {
+                    // Transparent huge pages are the next best thing
+                    madvise(bs->data_blocks, IMAGE_BYTES(bs), MADV_HUGEPAGE);
+                }
+#endif
+            }
+            if (bs->data_blocks != (uint8_t *) MAP_FAILED) {
+                // Fresh anonymous pages are already zero
+                bs->fbm = bitmap_overlay(bs->block_count, bs->data_blocks + bs->avail_blocks * bs->block_size);
+                if (bs->fbm) {
+                    claim_fbm(bs);
+                    count_free(bs);
+                    bs->ops = &memory_ops;
+                    return bs;
+                }
+                munmap(bs->data_blocks, IMAGE_BYTES(bs));
+            }
+            free(bs);
+        }
+        return NULL;
     }
     ///
     ///-- Destroy the provided block storage device
@@ -110,12 +625,74 @@ int check_file(const char *const fname) {
     void block_store_destroy(block_store_t *const bs) {
         if (bs) {
             bitmap_destroy(bs->fbm);
-            munmap(bs->data_blocks, BLOCK_STORE_NUM_BYTES);
-            close(bs->fd);
+            bs->ops->close(bs);
             free(bs);
         }
     }
 
+    ///
+    ///-- Writes everything the device holds back to where it's kept, and waits for it to get there
+    /// \param bs BS device
+    /// \return boolean indicating success of operation
+    ///
+    bool block_store_sync(block_store_t *const bs) {
+        return bs && bs->ops->sync(bs);
+    }
+
+    ///
+    ///-- Makes the device longer and moves the FBM to the new end, the blocks it leaves behind are free
+    /// \param bs BS device
+    /// \param block_count Blocks the device has afterwards, the FBM's included
+    /// \return boolean indicating success of operation
+    ///
+    bool block_store_grow(block_store_t *const bs, const size_t block_count) {
+        if (bs == NULL || bs->ops->grow == NULL || block_count < bs->block_count || block_count > bs->reserved_blocks) {
+            return false;
+        }
+        if (block_count == bs->block_count) {
+            return true;
+        }
+        size_t avail_blocks = block_count - fbm_block_count(bs->block_size, block_count);
+
+        // Put together on the side first, the new FBM can land on top of the old one
+        bitmap_t *fbm = bitmap_create(block_count);
+        if (fbm == NULL) {
+            return false;
+        }
+        for (size_t block_id = 0; block_id < bs->avail_blocks; ++block_id) {
+            if (bitmap_test(bs->fbm, block_id)) {
+                bitmap_set(fbm, block_id);
+            }
+        }
+        for (size_t block_id = avail_blocks; block_id < block_count; ++block_id) {
+            bitmap_set(fbm, block_id);
+        }
+
+        // A failure past the truncate only leaves the file longer than the image, and that's ignored
+        uint8_t *fbm_blocks = ftruncate(bs->fd, (off_t)(block_count * bs->block_size)) == 0
+                              ? bs->ops->grow(bs, block_count, avail_blocks) : NULL;
+        bitmap_t *overlay = fbm_blocks ? bitmap_overlay(block_count, fbm_blocks) : NULL;
+        if (overlay == NULL) {
+            if (fbm_blocks && bs->fbm_blocks) {
+                free(fbm_blocks);
+            }
+            bitmap_destroy(fbm);
+            return false;
+        }
+        memcpy(fbm_blocks, bitmap_export(fbm), (block_count + 7) / 8);
+        bitmap_destroy(fbm);
+        bitmap_destroy(bs->fbm);
+        bs->fbm = overlay;
+        if (bs->fbm_blocks) {
+            free(bs->fbm_blocks);
+            bs->fbm_blocks = fbm_blocks;
+        }
+        bs->block_count = block_count;
+        bs->avail_blocks = avail_blocks;
+        count_free(bs);
+        return true;
+    }
+
     ///*
     //<<<<<<< HEAD
     ///
@@ -127,22 +704,18 @@ int check_file(const char *const fname) {
         if (bs == NULL) {
             return SIZE_MAX; // return SIZE_MAX if the input is a null pointer
         }
-        //-- find first zero in the bitmap
-        size_t id;
-        id = bitmap_ffz(bs->fbm); // index of the first free block
-        //if (id == BLOCK_STORE_AVAIL_BLOCKS) {
-        if (id >= BLOCK_STORE_AVAIL_BLOCKS || id == SIZE_MAX) {
-            //printf("ERROR: BIT = %zu\n", id);
-            return SIZE_MAX; // return SIZE_MAX since the last block is not available for storing data
-        }
-        bitmap_set(bs->fbm, id); // mark it as in use
-        //  bitmap_destroy(bs->fbm); // destruct and destroy bitmap object
-        //printf("SUCCESS: BIT = %zu", id);
-        return id;
+        return bs->ops->allocate(bs);
     }
     //=======
     //*/
 
+    size_t block_store_allocate_run(block_store_t *const bs, const size_t count) {
+        if (bs == NULL || count == 0) {
+            return SIZE_MAX;
+        }
+        return count == 1 ? bs->ops->allocate(bs) : fbm_allocate_run(bs, count);
+    }
+
     ///
     ///-- Attempts to allocate the requested block id
     /// \param bs the block store object
@@ -150,7 +723,7 @@ int check_file(const char *const fname) {
     /// \return boolean indicating succes of operation
     ///
     bool block_store_request(block_store_t *const bs, const size_t block_id) {
-        if (block_id > BLOCK_STORE_AVAIL_BLOCKS || bs == NULL) {
+        if (block_id > bs->avail_blocks || bs == NULL) {
             return false;
         }
         bool blockUsed = 0;
@@ -161,6 +734,7 @@ int check_file(const char *const fname) {
         }
         else { // if this block is not in use
             bitmap_set(bs->fbm, block_id); // mark the block as in use
+            --bs->free_blocks;
             //bitmap_destroy(bs->fbm); // destruct and destroy bitmap object
             return true;
         }
@@ -172,17 +746,41 @@ int check_file(const char *const fname) {
     /// \param block_id The block to free
     ///
     void block_store_release(block_store_t *const bs, const size_t block_id) {
-        if (block_id <= BLOCK_STORE_AVAIL_BLOCKS && bs != NULL) {
-            bool success = 0;
-            success = bitmap_test(bs->fbm, block_id); // check if the block is in use
-            if (success) {
-                bitmap_reset(bs->fbm, block_id); // clear requested bit in bitmap
-                //        bitmap_destroy(bs->fbm); // destruct and destroy bitmap object
-            }
+        if (block_id <= bs->avail_blocks && bs != NULL) {
+            bs->ops->release(bs, block_id);
         }
         //// Some error message here ////
     }
 
+    ///
+    ///-- Hands the storage behind the free pages of a run back to the host
+    ///
+    void block_store_discard(block_store_t *const bs, const size_t block_id, const size_t count) {
+        if (bs == NULL || bs->ops->discard == NULL || block_id >= bs->avail_blocks) {
+            return;
+        }
+        // Only pages the run covers completely, a page sharing a block with something else keeps it
+        size_t per_page = bs->page_blocks;
+        size_t end = count < bs->avail_blocks - block_id ? block_id + count : bs->avail_blocks;
+        size_t page = (block_id + per_page - 1) / per_page * per_page;
+        size_t run = page;
+        for (; page + per_page <= end; page += per_page) {
+            bool free_page = true;
+            for (size_t i = page; i < page + per_page && free_page; ++i) {
+                free_page = !bitmap_test(bs->fbm, i);
+            }
+            if (!free_page) {
+                if (run < page) {
+                    bs->ops->discard(bs, run, page - run);
+                }
+                run = page + per_page;
+            }
+        }
+        if (run < page) {
+            bs->ops->discard(bs, run, page - run);
+        }
+    }
+
     ///
     ///-- Counts the number of blocks marked as in use
     /// \param bs BS device
@@ -205,12 +803,8 @@ int check_file(const char *const fname) {
     ///
     size_t block_store_get_free_blocks(const block_store_t *const bs) {
         if (bs) {
-            size_t numSet = 0;
-            size_t numZero = 0;
-            numSet = bitmap_total_set(bs->fbm); // count all bits set
-            //bitmap_destroy(bs->fbm); // destruct and destroy bitmap object
-            numZero = BLOCK_STORE_AVAIL_BLOCKS - numSet; // count zero bits
-            return numZero;
+            // Kept as blocks come and go, so asking costs nothing
+            return bs->free_blocks;
         }
         return SIZE_MAX;
     }
@@ -224,6 +818,24 @@ int check_file(const char *const fname) {
         return BLOCK_STORE_AVAIL_BLOCKS;
     }
 
+    ///
+    ///-- Returns the number of user-addressable blocks on this device, which may not be the default
+    /// \param bs BS device
+    /// \return Total blocks, 0 on error
+    ///
+    size_t block_store_get_capacity(const block_store_t *const bs) {
+        return bs ? bs->avail_blocks : 0;
+    }
+
+    ///
+    ///-- Returns the size of one block on this device
+    /// \param bs BS device
+    /// \return Bytes per block, 0 on error
+    ///
+    size_t block_store_get_block_size(const block_store_t *const bs) {
+        return bs ? bs->block_size : 0;
+    }
+
     ///
     ///-- Reads data from the specified block and writes it to the designated buffer
     /// \param bs BS device
@@ -232,11 +844,7 @@ int check_file(const char *const fname) {
     /// \return Number of bytes read, 0 on error
     ///
     size_t block_store_read(const block_store_t *const bs, const size_t block_id, void *buffer) {
-        if (bs && buffer && block_id <= BLOCK_STORE_AVAIL_BLOCKS) {
-            memcpy(buffer, bs->data_blocks+block_id*BLOCK_SIZE_BYTES, BLOCK_SIZE_BYTES);
-            return BLOCK_SIZE_BYTES;
-        }
-        return 0;
+        return block_store_read_blocks(bs, block_id, 1, buffer);
     }
 
     ///
@@ -247,13 +855,79 @@ int check_file(const char *const fname) {
     /// \return Number of bytes written, 0 on error
     ///
     size_t block_store_write(block_store_t *const bs, const size_t block_id, const void *buffer) {
-        if (bs && buffer && block_id <= BLOCK_STORE_AVAIL_BLOCKS) {
-            memcpy(bs->data_blocks+block_id*BLOCK_SIZE_BYTES, buffer, BLOCK_SIZE_BYTES);
-            return BLOCK_SIZE_BYTES;
+        return block_store_write_blocks(bs, block_id, 1, buffer);
+    }
+
+    ///
+    ///-- Reads a run of consecutive blocks into the designated buffer
+    /// \param bs BS device
+    /// \param block_id First block of the run
+    /// \param count Number of blocks in the run
+    /// \param buffer Data buffer to write to, count blocks long
+    /// \return Number of bytes read, 0 on error
+    ///
+    size_t block_store_read_blocks(const block_store_t *const bs, const size_t block_id, const size_t count, void *buffer) {
+        if (bs && buffer && count && block_id <= bs->avail_blocks && count <= bs->avail_blocks + 1 - block_id) {
+            return bs->ops->read(bs, block_id, count, buffer);
+        }
+        return 0;
+    }
+
+    ///
+    ///-- Writes a run of consecutive blocks from the designated buffer
+    /// \param bs BS device
+    /// \param block_id First block of the run
+    /// \param count Number of blocks in the run
+    /// \param buffer Data buffer to read from, count blocks long
+    /// \return Number of bytes written, 0 on error
+    ///
+    size_t block_store_write_blocks(block_store_t *const bs, const size_t block_id, const size_t count, const void *buffer) {
+        if (bs && buffer && count && block_id <= bs->avail_blocks && count <= bs->avail_blocks + 1 - block_id) {
+            return bs->ops->write(bs, block_id, count, buffer);
         }
         return 0;
     }
 
+    ///
+    ///-- Gets a pointer straight into the mapping for the specified block
+    /// \param bs BS device
+    /// \param block_id The block to look up
+    /// \return Pointer to the start of the block, NULL on error
+    ///
+    const void *block_store_get_ptr(const block_store_t *const bs, const size_t block_id) {
+        if (bs && bs->ops->get_ptr && block_id <= bs->avail_blocks) {
+            return bs->ops->get_ptr(bs, block_id);
+        }
+        return NULL;
+    }
+
+    ///
+    ///-- Tells whether the blocks can be reached in place through block_store_get_ptr
+    /// \param bs BS device
+    /// \return true if the image is mapped
+    ///
+    bool block_store_is_mapped(const block_store_t *const bs) {
+        return bs && bs->ops->get_ptr;
+    }
+
+    ///
+    ///-- Hints that the given range of blocks will be read soon
+    /// \param bs BS device
+    /// \param block_id First block of the range
+    /// \param count Number of blocks in the range
+    ///
+    void block_store_prefetch(const block_store_t *const bs, const size_t block_id, const size_t count) {
+        if (bs && count && block_id < bs->avail_blocks) {
+            size_t end = block_id + count;
+            if (end > bs->avail_blocks) {
+                end = bs->avail_blocks;
+            }
+            if (bs->ops->prefetch) {
+                bs->ops->prefetch(bs, block_id, end - block_id);
+            }
+        }
+    }
+
     ///
     ///-- Imports BS device from the given file - for grads/bonus
     /// \param filename The file to load
@@ -268,8 +942,8 @@ int check_file(const char *const fname) {
             block_store_t *bs = NULL;
             bs = block_store_create(filename);
             int df_read1, df_read2;
-            df_read1 = read(fd, bs->data_blocks, BLOCK_STORE_AVAIL_BLOCKS*BLOCK_SIZE_BYTES); // read bs->Data from the file
-            df_read2 = read(fd, bs->fbm, BLOCK_STORE_NUM_BLOCKS/8); // read bs->FBM from the file
+            df_read1 = read(fd, bs->data_blocks, bs->avail_blocks*bs->block_size); // read bs->Data from the file
+            df_read2 = read(fd, bs->fbm, bs->block_count/8); // read bs->FBM from the file
             if (df_read1 < 0 || df_read2 < 0) { // if the system call returns an error
                 return 0;
             }
@@ -284,17 +958,48 @@ int check_file(const char *const fname) {
     /// \param filename The file to write to
     /// \return Number of bytes written, 0 on error
     ///
-    size_t block_store_serialize(const block_store_t *const bs, const char *const filename) {
-        if (bs && filename) {
-            int fd = open(filename, O_WRONLY | O_CREAT, S_IRUSR | S_IWUSR); // open file (write only)
+    size_t block_store_serialize(block_store_t *const bs, const char *const filename) {
+        if (bs && filename && filename[0]) {
+            // The device's own file only needs to catch up, replacing it would leave the device writing to a dead file
+            struct stat own, target;
+            if (bs->fd >= 0 && fstat(bs->fd, &own) == 0 && stat(filename, &target) == 0
+                && own.st_dev == target.st_dev && own.st_ino == target.st_ino) {
+                return block_store_sync(bs) ? IMAGE_BYTES(bs) : 0;
+            }
+
+            // Built next to the target and renamed over it, so a failed write leaves the old file alone
+            char *temp = (char *) malloc(strlen(filename) + sizeof(".tmp"));
+            if (temp == NULL) {
+                return 0;
+            }
+            strcpy(temp, filename);
+            strcat(temp, ".tmp");
+            int fd = open(temp, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
             if (fd < 0) { // if opening file fails
+                free(temp);
                 return 0;
             }
-            write(fd, bs->data_blocks, BLOCK_STORE_AVAIL_BLOCKS*BLOCK_SIZE_BYTES); // write bs->Data to file
-            write(fd, bs->fbm, BLOCK_STORE_NUM_BLOCKS/8); // write bs->FBM to file
-            close(fd); // close file
-            size_t wr_size = block_store_get_used_blocks(bs); // number of block in use
-            return (wr_size*BLOCK_SIZE_BYTES); // return number of bytes written
+
+            // The same layout as a mapped image, data blocks then the FBM, so it opens on any device
+            size_t chunk = SERIALIZE_CHUNK_BYTES / bs->block_size ? SERIALIZE_CHUNK_BYTES / bs->block_size : 1;
+            uint8_t *buffer = bs->ops->get_ptr ? NULL : (uint8_t *) malloc(chunk * bs->block_size);
+            bool written = bs->ops->get_ptr || buffer;
+            for (size_t block_id = 0; written && block_id < bs->avail_blocks; block_id += chunk) {
+                size_t count = bs->avail_blocks - block_id < chunk ? bs->avail_blocks - block_id : chunk;
+                const uint8_t *data = bs->ops->get_ptr ? (const uint8_t *) bs->ops->get_ptr(bs, block_id) : buffer;
+                written = (data != buffer || bs->ops->read(bs, block_id, count, buffer) == count * bs->block_size)
+                          && file_transfer(fd, (uint8_t *) data, count * bs->block_size, (off_t) block_id * bs->block_size, true);
+            }
+            const uint8_t *fbm = bs->fbm_blocks ? bs->fbm_blocks : bs->data_blocks + bs->avail_blocks * bs->block_size;
+            written = written && file_transfer(fd, (uint8_t *) fbm, FBM_BYTES(bs),
+                                               (off_t) bs->avail_blocks * bs->block_size, true);
+            free(buffer);
+            written = close(fd) == 0 && written && rename(temp, filename) == 0;
+            if (!written) {
+                unlink(temp);
+            }
+            free(temp);
+            return written ? IMAGE_BYTES(bs) : 0;
         }
         return 0;
     }
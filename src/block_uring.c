@@ -0,0 +1,557 @@
+#define _DEFAULT_SOURCE  // syscall()
+
+#include "block_uring.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#ifdef __NR_io_uring_setup
+#include <linux/io_uring.h>
+#endif
+
+#define URING_ENTRIES 128         // Submission queue depth, and the most requests between drains
+#define URING_CACHE_BLOCKS 8192   // Direct mapped, block n lives in slot n % URING_CACHE_BLOCKS
+#define URING_BYPASS_BLOCKS 1024  // Runs at least this long go straight between the file and the caller
+#define URING_EMPTY SIZE_MAX      // Tag of an unused slot, and the slot of a request that skips the cache
+
+// One read or write handed to the kernel, user_data is its index
+typedef struct {
+    size_t slot;  // First cache slot it covers, URING_EMPTY if it's on a caller's buffer
+    size_t count;
+    uint8_t *addr;
+    uint64_t offset;
+    bool write;
+} uring_request_t;
+
+struct block_uring {
+    int fd;
+    size_t block_size;
+    pthread_mutex_t lock;
+
+    uint8_t *slots;
+    size_t *tags;   // Block held by each slot
+    bool *dirty;    // Newer than the file
+    bool *pending;  // A read into the slot is queued or in flight
+
+    int ring_fd;  // -1 on the pread/pwrite fallback
+    bool fixed;   // The slots are registered, so slot I/O uses the _FIXED opcodes
+    void *sq_ptr;
+    size_t sq_size;
+    void *cq_ptr;
+    size_t cq_size;
+    void *sqes;
+    size_t sqes_size;
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    void *cqes;
+
+    uring_request_t requests[URING_ENTRIES];
+    size_t used;      // Requests made since the last drain
+    size_t queued;    // In the submission queue, not yet handed over
+    size_t inflight;  // Handed over, completion not reaped yet
+    bool failed;      // Something since the last drain didn't make it
+};
+
+// Does the request the slow way, a piece at a time until it's all there
+static bool uring_sync_io(const block_uring_t *const ring, const uring_request_t *const req) {
+    size_t length = req->count * ring->block_size;
+    size_t done = 0;
+    while (done < length) {
+        ssize_t moved = req->write ? pwrite(ring->fd, req->addr + done, length - done, req->offset + done)
+                                   : pread(ring->fd, req->addr + done, length - done, req->offset + done);
+        if (moved < 0 && errno == EINTR) {
+            continue;
+        }
+        if (moved <= 0) {
+            return false;
+        }
+        done += (size_t) moved;
+    }
+    return true;
+}
+
+// Settles a finished request, a failed read leaves its slots empty
+static void uring_complete(block_uring_t *const ring, const uring_request_t *const req, const bool ok) {
+    if (req->slot != URING_EMPTY) {
+        for (size_t i = 0; i < req->count; ++i) {
+            ring->pending[req->slot + i] = false;
+            if (!ok && !req->write) {
+                ring->tags[req->slot + i] = URING_EMPTY;
+            }
+        }
+    }
+    if (!ok) {
+        ring->failed = true;
+    }
+}
+
+#ifdef __NR_io_uring_setup
+
+static int uring_setup(const unsigned entries, struct io_uring_params *params) {
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(const int ring_fd, const unsigned to_submit, const unsigned min_complete, const unsigned flags) {
+    return (int) syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int uring_register(const int ring_fd, const unsigned opcode, const void *arg, const unsigned nr_args) {
+    return (int) syscall(__NR_io_uring_register, ring_fd, opcode, arg, nr_args);
+}
+
+// Takes down whatever part of the ring got set up and switches over to the fallback
+static void uring_teardown(block_uring_t *const ring) {
+    if (ring->fixed) {
+        uring_register(ring->ring_fd, IORING_UNREGISTER_BUFFERS, NULL, 0);
+        ring->fixed = false;
+    }
+    if (ring->sqes) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ptr && ring->cq_ptr != ring->sq_ptr) {
+        munmap(ring->cq_ptr, ring->cq_size);
+    }
+    if (ring->sq_ptr) {
+        munmap(ring->sq_ptr, ring->sq_size);
+    }
+    ring->sqes = ring->cq_ptr = ring->sq_ptr = NULL;
+    if (ring->ring_fd >= 0) {
+        close(ring->ring_fd);
+    }
+    ring->ring_fd = -1;
+}
+
+// Maps the queues and registers the slots, leaves the fallback in place if the kernel says no
+static void uring_setup_ring(block_uring_t *const ring) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring->ring_fd = uring_setup(URING_ENTRIES, &params);
+    if (ring->ring_fd < 0) {
+        ring->ring_fd = -1;
+        return;
+    }
+    if (params.sq_entries < URING_ENTRIES) {
+        uring_teardown(ring);
+        return;
+    }
+
+    ring->sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single) {
+        ring->sq_size = ring->cq_size = ring->sq_size > ring->cq_size ? ring->sq_size : ring->cq_size;
+    }
+    ring->sq_ptr = mmap(NULL, ring->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->ring_fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED) {
+        ring->sq_ptr = NULL;
+        uring_teardown(ring);
+        return;
+    }
+    ring->cq_ptr = single ? ring->sq_ptr
+                          : mmap(NULL, ring->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->ring_fd, IORING_OFF_CQ_RING);
+    if (ring->cq_ptr == MAP_FAILED) {
+        ring->cq_ptr = NULL;
+        uring_teardown(ring);
+        return;
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED, ring->ring_fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        uring_teardown(ring);
+        return;
+    }
+
+    uint8_t *sq = (uint8_t *) ring->sq_ptr;
+    uint8_t *cq = (uint8_t *) ring->cq_ptr;
+    ring->sq_head = (unsigned *) (sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+    ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = cq + params.cq_off.cqes;
+
+    // Registered slots save the kernel pinning them on every request, but it's
+    // only an optimization, a low memlock limit just means plain reads and writes
+    struct iovec slots = {ring->slots, URING_CACHE_BLOCKS * ring->block_size};
+    ring->fixed = uring_register(ring->ring_fd, IORING_REGISTER_BUFFERS, &slots, 1) == 0;
+}
+
+// Puts a request in the submission queue without telling the kernel yet
+static void uring_push(block_uring_t *const ring, const size_t index) {
+    const uring_request_t *req = &ring->requests[index];
+    unsigned tail = *ring->sq_tail;
+    unsigned entry = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = (struct io_uring_sqe *) ring->sqes + entry;
+    memset(sqe, 0, sizeof(*sqe));
+    bool fixed = ring->fixed && req->slot != URING_EMPTY;
+    if (req->write) {
+        sqe->opcode = fixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    } else {
+        sqe->opcode = fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    }
+    sqe->fd = ring->fd;
+    sqe->addr = (uint64_t) (uintptr_t) req->addr;
+    sqe->len = (uint32_t) (req->count * ring->block_size);
+    sqe->off = req->offset;
+    sqe->user_data = index;
+    ring->sq_array[entry] = entry;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->queued++;
+}
+
+// Submits everything queued and waits for all of it in a single call, barring interruptions
+static void uring_wait_all(block_uring_t *const ring) {
+    while (ring->queued || ring->inflight) {
+        int submitted = uring_enter(ring->ring_fd, (unsigned) ring->queued, (unsigned) (ring->queued + ring->inflight),
+                                    IORING_ENTER_GETEVENTS);
+        if (submitted < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            if (ring->queued) {
+                // The kernel never saw them, pull them back out and do them here
+                *ring->sq_tail -= (unsigned) ring->queued;
+                for (size_t i = ring->used - ring->queued; i < ring->used; ++i) {
+                    uring_complete(ring, &ring->requests[i], uring_sync_io(ring, &ring->requests[i]));
+                }
+                ring->queued = 0;
+                continue;
+            }
+            // Nothing left to try, whatever is still out there is lost
+            ring->failed = true;
+            ring->inflight = 0;
+            break;
+        }
+        ring->queued -= (size_t) submitted;
+        ring->inflight += (size_t) submitted;
+
+        unsigned head = *ring->cq_head;
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; ++head) {
+            const struct io_uring_cqe *cqe = (const struct io_uring_cqe *) ring->cqes + (head & *ring->cq_mask);
+            const uring_request_t *req = &ring->requests[cqe->user_data];
+            // Short transfers and retryable errors get finished off synchronously
+            bool ok = cqe->res == (int32_t) (req->count * ring->block_size) || uring_sync_io(ring, req);
+            uring_complete(ring, req, ok);
+            ring->inflight--;
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+#else
+
+static void uring_setup_ring(block_uring_t *const ring) {
+    ring->ring_fd = -1;
+}
+
+static void uring_teardown(block_uring_t *const ring) {
+    ring->ring_fd = -1;
+}
+
+static void uring_push(block_uring_t *const ring, const size_t index) {
+    (void) ring;
+    (void) index;
+}
+
+static void uring_wait_all(block_uring_t *const ring) {
+    (void) ring;
+}
+
+#endif
+
+// Gets everything made since the last drain done, reports whether all of it worked
+static bool uring_drain(block_uring_t *const ring) {
+    if (ring->ring_fd >= 0) {
+        uring_wait_all(ring);
+    }
+    bool ok = !ring->failed;
+    ring->used = 0;
+    ring->failed = false;
+    return ok;
+}
+
+// Adds a request to the current batch, on the fallback it just happens right away
+// A full batch gets drained first, the outcome of that shows up on the next drain
+static void uring_queue(block_uring_t *const ring, const size_t slot, const size_t count, uint8_t *addr,
+                        const size_t block_id, const bool write) {
+    if (ring->used == URING_ENTRIES) {
+        bool ok = uring_drain(ring);
+        ring->failed = !ok;
+    }
+    size_t index = ring->used++;
+    uring_request_t req = {slot, count, addr, (uint64_t) block_id * ring->block_size, write};
+    ring->requests[index] = req;
+    if (ring->ring_fd < 0) {
+        uring_complete(ring, &ring->requests[index], uring_sync_io(ring, &ring->requests[index]));
+        return;
+    }
+    if (slot != URING_EMPTY && !write) {
+        for (size_t i = 0; i < count; ++i) {
+            ring->pending[slot + i] = true;
+        }
+    }
+    uring_push(ring, index);
+}
+
+static uint8_t *uring_slot(const block_uring_t *const ring, const size_t slot) {
+    return ring->slots + slot * ring->block_size;
+}
+
+// Queues a write-back of every dirty slot in the run that's about to hold other blocks
+// Returns whether anything was queued
+static bool uring_evict(block_uring_t *const ring, const size_t block_id, const size_t count) {
+    bool evicted = false;
+    for (size_t i = 0; i < count; ++i) {
+        size_t slot = (block_id + i) % URING_CACHE_BLOCKS;
+        if (ring->tags[slot] != block_id + i && ring->dirty[slot]) {
+            uring_queue(ring, slot, 1, uring_slot(ring, slot), ring->tags[slot], true);
+            ring->dirty[slot] = false;
+            evicted = true;
+        }
+    }
+    return evicted;
+}
+
+// Copies a run between the caller and the slots, at most URING_CACHE_BLOCKS long so it wraps at most once
+static void uring_copy(block_uring_t *const ring, const size_t block_id, const size_t count, uint8_t *buffer,
+                       const bool to_cache) {
+    size_t first = block_id % URING_CACHE_BLOCKS;
+    size_t head = count < URING_CACHE_BLOCKS - first ? count : URING_CACHE_BLOCKS - first;
+    size_t pieces[2][2] = {{first, head}, {0, count - head}};
+    for (size_t i = 0; i < 2; ++i) {
+        size_t length = pieces[i][1] * ring->block_size;
+        if (length) {
+            if (to_cache) {
+                memcpy(uring_slot(ring, pieces[i][0]), buffer, length);
+            } else {
+                memcpy(buffer, uring_slot(ring, pieces[i][0]), length);
+            }
+            buffer += length;
+        }
+    }
+}
+
+block_uring_t *block_uring_create(const int fd, const size_t block_size) {
+    if (fd < 0 || block_size == 0) {
+        return NULL;
+    }
+    block_uring_t *ring = (block_uring_t *) calloc(1, sizeof(block_uring_t));
+    if (ring) {
+        ring->fd = fd;
+        ring->block_size = block_size;
+        ring->ring_fd = -1;
+        void *slots = NULL;
+        if (posix_memalign(&slots, (size_t) sysconf(_SC_PAGESIZE), URING_CACHE_BLOCKS * block_size) == 0) {
+            ring->slots = (uint8_t *) slots;
+            ring->tags = (size_t *) malloc(URING_CACHE_BLOCKS * sizeof(size_t));
+            ring->dirty = (bool *) calloc(URING_CACHE_BLOCKS, sizeof(bool));
+            ring->pending = (bool *) calloc(URING_CACHE_BLOCKS, sizeof(bool));
+            if (ring->tags && ring->dirty && ring->pending && pthread_mutex_init(&ring->lock, NULL) == 0) {
+                for (size_t i = 0; i < URING_CACHE_BLOCKS; ++i) {
+                    ring->tags[i] = URING_EMPTY;
+                }
+                uring_setup_ring(ring);
+                return ring;
+            }
+            free(ring->pending);
+            free(ring->dirty);
+            free(ring->tags);
+            free(ring->slots);
+        }
+        free(ring);
+    }
+    return NULL;
+}
+
+void block_uring_destroy(block_uring_t *const ring) {
+    if (ring) {
+        block_uring_flush(ring);
+        uring_teardown(ring);
+        pthread_mutex_destroy(&ring->lock);
+        free(ring->pending);
+        free(ring->dirty);
+        free(ring->tags);
+        free(ring->slots);
+        free(ring);
+    }
+}
+
+bool block_uring_read(block_uring_t *const ring, const size_t block_id, const size_t count, void *buffer) {
+    if (ring == NULL || buffer == NULL || count == 0) {
+        return false;
+    }
+    pthread_mutex_lock(&ring->lock);
+    bool ok = true;
+    if (count >= URING_BYPASS_BLOCKS) {
+        // Straight into the caller's buffer, then patch in whatever the cache has that the file doesn't yet
+        ok = uring_drain(ring);
+        uring_queue(ring, URING_EMPTY, count, (uint8_t *) buffer, block_id, false);
+        ok &= uring_drain(ring);
+        for (size_t i = 0; i < count; ++i) {
+            size_t slot = (block_id + i) % URING_CACHE_BLOCKS;
+            if (ring->tags[slot] == block_id + i && ring->dirty[slot]) {
+                memcpy((uint8_t *) buffer + i * ring->block_size, uring_slot(ring, slot), ring->block_size);
+            }
+        }
+        pthread_mutex_unlock(&ring->lock);
+        return ok;
+    }
+
+    // A slot still waiting on someone else's read can't be handed to another block yet
+    for (size_t i = 0; i < count; ++i) {
+        size_t slot = (block_id + i) % URING_CACHE_BLOCKS;
+        if (ring->tags[slot] != block_id + i && ring->pending[slot]) {
+            ok &= uring_drain(ring);
+            break;
+        }
+    }
+    if (uring_evict(ring, block_id, count)) {
+        ok &= uring_drain(ring);
+    }
+
+    // Misses in neighbouring slots share a request
+    size_t i = 0;
+    while (i < count) {
+        size_t slot = (block_id + i) % URING_CACHE_BLOCKS;
+        if (ring->tags[slot] == block_id + i) {
+            ++i;
+            continue;
+        }
+        size_t start = i;
+        while (i < count && ring->tags[(block_id + i) % URING_CACHE_BLOCKS] != block_id + i
+               && (block_id + i) % URING_CACHE_BLOCKS == slot + (i - start)) {
+            ring->tags[slot + (i - start)] = block_id + i;
+            ++i;
+        }
+        uring_queue(ring, slot, i - start, uring_slot(ring, slot), block_id + start, false);
+    }
+
+    // One trip to the kernel for these, along with any prefetches queued before them
+    ok &= uring_drain(ring);
+    if (ok) {
+        uring_copy(ring, block_id, count, (uint8_t *) buffer, false);
+    }
+    pthread_mutex_unlock(&ring->lock);
+    return ok;
+}
+
+bool block_uring_write(block_uring_t *const ring, const size_t block_id, const size_t count, const void *buffer) {
+    if (ring == NULL || buffer == NULL || count == 0) {
+        return false;
+    }
+    pthread_mutex_lock(&ring->lock);
+    // Queued prefetches could land on top of what's written here, so they go first
+    bool ok = uring_drain(ring);
+    if (count >= URING_BYPASS_BLOCKS) {
+        uring_queue(ring, URING_EMPTY, count, (uint8_t *) buffer, block_id, true);
+        ok &= uring_drain(ring);
+        // Cached copies are older than the file now
+        for (size_t i = 0; i < count; ++i) {
+            size_t slot = (block_id + i) % URING_CACHE_BLOCKS;
+            if (ring->tags[slot] == block_id + i) {
+                ring->tags[slot] = URING_EMPTY;
+                ring->dirty[slot] = false;
+            }
+        }
+    } else {
+        if (uring_evict(ring, block_id, count)) {
+            ok &= uring_drain(ring);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            size_t slot = (block_id + i) % URING_CACHE_BLOCKS;
+            ring->tags[slot] = block_id + i;
+            ring->dirty[slot] = true;
+        }
+        uring_copy(ring, block_id, count, (uint8_t *) buffer, true);
+    }
+    pthread_mutex_unlock(&ring->lock);
+    return ok;
+}
+
+void block_uring_prefetch(block_uring_t *const ring, const size_t block_id, const size_t count) {
+    // The fallback would have to read them right here, which is no better than waiting
+    if (ring == NULL || ring->ring_fd < 0) {
+        return;
+    }
+    pthread_mutex_lock(&ring->lock);
+    size_t end = count < URING_CACHE_BLOCKS ? count : URING_CACHE_BLOCKS;
+    size_t i = 0;
+    while (i < end) {
+        size_t slot = (block_id + i) % URING_CACHE_BLOCKS;
+        if (ring->tags[slot] == block_id + i || ring->dirty[slot] || ring->pending[slot]) {
+            ++i;
+            continue;
+        }
+        size_t start = i;
+        while (i < end && (block_id + i) % URING_CACHE_BLOCKS == slot + (i - start)
+               && ring->tags[slot + (i - start)] != block_id + i && !ring->dirty[slot + (i - start)]
+               && !ring->pending[slot + (i - start)]) {
+            ring->tags[slot + (i - start)] = block_id + i;
+            ++i;
+        }
+        uring_queue(ring, slot, i - start, uring_slot(ring, slot), block_id + start, false);
+    }
+    pthread_mutex_unlock(&ring->lock);
+}
+
+void block_uring_forget(block_uring_t *const ring, const size_t block_id, const size_t count) {
+    if (ring == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&ring->lock);
+    // Reads still queued into these slots have to land before the slots can be emptied
+    uring_drain(ring);
+    for (size_t i = 0; i < count; ++i) {
+        size_t slot = (block_id + i) % URING_CACHE_BLOCKS;
+        if (ring->tags[slot] == block_id + i) {
+            ring->tags[slot] = URING_EMPTY;
+            ring->dirty[slot] = false;
+        }
+    }
+    pthread_mutex_unlock(&ring->lock);
+}
+
+bool block_uring_flush(block_uring_t *const ring) {
+    if (ring == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&ring->lock);
+    bool ok = uring_drain(ring);
+    // Dirty slots holding neighbouring blocks go out as one write
+    size_t slot = 0;
+    while (slot < URING_CACHE_BLOCKS) {
+        if (!ring->dirty[slot]) {
+            ++slot;
+            continue;
+        }
+        size_t start = slot;
+        while (slot < URING_CACHE_BLOCKS && ring->dirty[slot] && ring->tags[slot] == ring->tags[start] + (slot - start)) {
+            ring->dirty[slot] = false;
+            ++slot;
+        }
+        uring_queue(ring, start, slot - start, uring_slot(ring, start), ring->tags[start], true);
+    }
+    ok &= uring_drain(ring);
+    pthread_mutex_unlock(&ring->lock);
+    return ok;
+}
+
+bool block_uring_active(const block_uring_t *const ring) {
+    return ring && ring->ring_fd >= 0;
+}
@@ -187,6 +187,11 @@ bool dyn_array_extract(dyn_array_t *const dyn_array, const size_t index, void *c
            && dyn_shift_remove(dyn_array, index, 1, MODE_EXTRACT, object);
 }
 
+bool dyn_array_extract_range(dyn_array_t *const dyn_array, const size_t index, const size_t count, void *const object) {
+    return dyn_array && object && count && index < dyn_array->size && count <= dyn_array->size - index
+           && dyn_shift_remove(dyn_array, index, count, MODE_EXTRACT, object);
+}
+
 
 
 
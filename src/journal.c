@@ -0,0 +1,628 @@
+#include "journal.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define JOURNAL_MAGIC 0x4A373153   // "S17J", starts the descriptor
+#define COMMIT_MAGIC 0x43373153    // "S17C", starts the commit block
+#define HEADER_WORDS 4             // magic, sequence, count and revoked count, ahead of the block ids
+
+// On disk a transaction is its descriptor blocks (header, logged block ids, then the ids of blocks it
+// gave up), the block images in the same order, then a commit block carrying a checksum of everything
+// before it. A given up block can be handed out again once its transaction commits, so replay must not
+// put an older transaction's copy of it back over whatever it holds now
+// The area is split in two halves and commits take turns, so the one before stays whole until the
+// sync after this one has made its blocks durable at home. A transaction too big for a half takes
+// the whole area, after a sync of its own
+// Changed blocks don't go home until their transaction is durable in the log, until then the
+// journal holds the newest copy and reads have to look here first
+
+typedef struct {
+    size_t block;
+    uint8_t *running;  // Changed in the running transaction, NULL if it hasn't been
+    uint8_t *taken;    // As the transaction being committed left it, NULL if it isn't in it
+} held_block_t;
+
+typedef struct {
+    size_t block;
+    const uint8_t *image;
+} logged_block_t;
+
+typedef enum { REGION_FIRST, REGION_SECOND, REGION_WHOLE } region_t;
+
+struct journal {
+    block_store_t *bs;
+    size_t start;
+    size_t blocks;
+    size_t block_size;
+    journal_prepare_t prepare;
+    journal_sync_t sync;
+    journal_release_t release;
+    void *arg;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed;  // Broadcast when handles drain, and when a commit starts or finishes writing
+    size_t updates;          // Handles open on the running transaction
+    bool closing;            // A commit is waiting to take the running transaction, no new handles
+    bool writing;            // A taken transaction is being written out
+    uint32_t running;        // Sequence number of the running transaction
+    uint32_t committed;      // Newest transaction known durable
+    bool failed;             // The last commit didn't make it
+    bool lost;               // A commit nobody was waiting on failed, the next caller hears about it
+
+    held_block_t *held;      // Every block with a copy here, in block order
+    size_t held_count;
+    size_t held_size;
+    size_t dirty_count;      // Held blocks changed in the running transaction
+    size_t *freed;           // Blocks given up in the running transaction
+    size_t freed_count;
+    size_t freed_size;
+    size_t pins;             // Views that could be pointing at held copies
+    uint8_t **retired;       // Copies let go while pinned, freed once nothing is
+    size_t retired_count;
+    size_t retired_size;
+    region_t last;           // Where the newest commit was logged
+    bool unsynced;           // Its blocks went home after the last sync
+};
+
+// Handles held by this thread, so nested ones don't wait on a commit their outer handle is holding up
+static __thread journal_t *held_journal;
+static __thread size_t held_depth;
+
+static size_t descriptor_blocks(const size_t ids, const size_t block_size) {
+    return ((HEADER_WORDS + ids) * sizeof(uint32_t) + block_size - 1) / block_size;
+}
+
+// Blocks a transaction takes in the log, commit block included
+static size_t log_length(const size_t count, const size_t revoked, const size_t block_size) {
+    return descriptor_blocks(count + revoked, block_size) + count + 1;
+}
+
+// FNV-1a, only has to catch a transaction that didn't get all the way out
+static uint32_t checksum(const uint8_t *data, const size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static bool valid_area(const block_store_t *const bs, const size_t blocks, const size_t block_size) {
+    return bs && blocks >= JOURNAL_BLOCKS_MIN && block_size >= (HEADER_WORDS + 1) * sizeof(uint32_t);
+}
+
+static size_t region_start(const journal_t *const journal, const region_t region) {
+    return journal->start + (region == REGION_SECOND ? journal->blocks / 2 : 0);
+}
+
+// Zeroes the first block of each half, so neither holds a descriptor
+static bool clear_area(block_store_t *const bs, const size_t start, const size_t blocks, const size_t block_size) {
+    uint8_t *zeros = (uint8_t *) calloc(1, block_size);
+    bool cleared = zeros && block_store_write(bs, start, zeros) == block_size
+                   && block_store_write(bs, start + blocks / 2, zeros) == block_size;
+    free(zeros);
+    return cleared;
+}
+
+bool journal_format(block_store_t *const bs, const size_t start, const size_t blocks, const size_t block_size) {
+    return valid_area(bs, blocks, block_size) && clear_area(bs, start, blocks, block_size);
+}
+
+typedef struct {
+    uint32_t sequence;
+    size_t descriptors;
+    size_t count;
+    size_t revoked;
+    uint8_t *log;
+    const uint32_t *ids;  // Logged blocks, then the revoked ones
+} found_log_t;
+
+// Reads the transaction logged at the start of a run, its log stays NULL if there isn't a whole one
+static bool find_log(block_store_t *const bs, const size_t start, const size_t blocks, const size_t block_size,
+                     found_log_t *found) {
+    found->log = NULL;
+    uint32_t *header = (uint32_t *) malloc(block_size);
+    if (header == NULL || block_store_read(bs, start, header) != block_size) {
+        free(header);
+        return false;
+    }
+    found->sequence = header[1];
+    found->count = header[2];
+    found->revoked = header[3];
+    found->descriptors = descriptor_blocks(found->count + found->revoked, block_size);
+    bool present = header[0] == JOURNAL_MAGIC && found->count + found->revoked > 0 && found->count < blocks
+                   && found->revoked < blocks * block_size && found->descriptors + found->count + 1 <= blocks;
+    free(header);
+    if (!present) {
+        return true;
+    }
+
+    // Descriptors and images are read as one run, the commit block right after them says if it all made it
+    size_t logged = found->descriptors + found->count + 1;
+    uint8_t *log = (uint8_t *) malloc(logged * block_size);
+    if (log == NULL || block_store_read_blocks(bs, start, logged, log) != logged * block_size) {
+        free(log);
+        return false;
+    }
+    const uint32_t *commit = (const uint32_t *) (log + (logged - 1) * block_size);
+    if (commit[0] == COMMIT_MAGIC && commit[1] == found->sequence && commit[2] == found->count
+        && commit[3] == checksum(log, (logged - 1) * block_size)) {
+        found->log = log;
+        found->ids = (const uint32_t *) log + HEADER_WORDS;
+    } else {
+        free(log);
+    }
+    return true;
+}
+
+// Given up in a transaction, so nothing older may be put back over it
+static bool revoked_by(const found_log_t *const found, const uint32_t block_id) {
+    for (size_t i = 0; i < found->revoked; ++i) {
+        if (found->ids[found->count + i] == block_id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int journal_replay(block_store_t *const bs, const size_t start, const size_t blocks, const size_t block_size) {
+    if (!valid_area(bs, blocks, block_size)) {
+        return -1;
+    }
+    // The first half can hold a transaction that took the whole area, the second half's is stale then
+    found_log_t logs[2];
+    bool read = find_log(bs, start, blocks, block_size, &logs[0]);
+    size_t first_end = logs[0].log ? logs[0].descriptors + logs[0].count + 1 : 0;
+    logs[1].log = NULL;
+    read = read && (first_end > blocks / 2 || find_log(bs, start + blocks / 2, blocks - blocks / 2, block_size, &logs[1]));
+
+    // The older one goes home first, the newer one has the last word on any block both hold
+    int replayed = read ? 0 : -1;
+    bool swap = logs[0].log && logs[1].log && logs[0].sequence > logs[1].sequence;
+    for (size_t n = 0; n < 2; ++n) {
+        const found_log_t *found = &logs[swap ? 1 - n : n];
+        const found_log_t *newer = n == 0 ? &logs[swap ? 0 : 1] : NULL;
+        for (size_t i = 0; found->log && replayed >= 0 && i < found->count; ++i) {
+            uint32_t id = found->ids[i];
+            if (newer && newer->log && revoked_by(newer, id)) {
+                continue;
+            }
+            // Nothing logged can live inside the journal itself
+            if ((id >= start && id < start + blocks)
+                || block_store_write(bs, id, found->log + (found->descriptors + i) * block_size) != block_size) {
+                replayed = -1;
+            } else {
+                replayed = 1;
+            }
+        }
+    }
+    free(logs[0].log);
+    free(logs[1].log);
+
+    // The blocks have to be home for good before the log that rebuilds them goes away
+    if (replayed > 0 && (!block_store_sync(bs) || !clear_area(bs, start, blocks, block_size) || !block_store_sync(bs))) {
+        replayed = -1;
+    }
+    return replayed;
+}
+
+journal_t *journal_create(block_store_t *const bs, const size_t start, const size_t blocks, const size_t block_size,
+                          const journal_prepare_t prepare, const journal_sync_t sync, const journal_release_t release,
+                          void *arg) {
+    if (!valid_area(bs, blocks, block_size) || sync == NULL || release == NULL) {
+        return NULL;
+    }
+    journal_t *journal = (journal_t *) calloc(1, sizeof(journal_t));
+    if (journal) {
+        journal->bs = bs;
+        journal->start = start;
+        journal->blocks = blocks;
+        journal->block_size = block_size;
+        journal->prepare = prepare;
+        journal->sync = sync;
+        journal->release = release;
+        journal->arg = arg;
+        journal->running = 1;
+        journal->last = REGION_SECOND;
+        if (pthread_mutex_init(&journal->lock, NULL) == 0) {
+            if (pthread_cond_init(&journal->changed, NULL) == 0) {
+                return journal;
+            }
+            pthread_mutex_destroy(&journal->lock);
+        }
+        free(journal);
+    }
+    return NULL;
+}
+
+// A copy nothing points at any more, views keep it around until they're all released
+static void retire_image(journal_t *const journal, uint8_t *image) {
+    if (image && journal->pins) {
+        if (journal->retired_count == journal->retired_size) {
+            size_t size = journal->retired_size ? journal->retired_size * 2 : 16;
+            uint8_t **retired = (uint8_t **) realloc(journal->retired, size * sizeof(uint8_t *));
+            if (retired == NULL) {
+                // Leaked rather than freed under a view
+                return;
+            }
+            journal->retired = retired;
+            journal->retired_size = size;
+        }
+        journal->retired[journal->retired_count++] = image;
+    } else {
+        free(image);
+    }
+}
+
+void journal_destroy(journal_t *const journal) {
+    if (journal) {
+        // Everything it held is home by now, a stale transaction would only be replayed over it
+        clear_area(journal->bs, journal->start, journal->blocks, journal->block_size);
+        for (size_t i = 0; i < journal->held_count; ++i) {
+            free(journal->held[i].running);
+            free(journal->held[i].taken);
+        }
+        for (size_t i = 0; i < journal->retired_count; ++i) {
+            free(journal->retired[i]);
+        }
+        pthread_cond_destroy(&journal->changed);
+        pthread_mutex_destroy(&journal->lock);
+        free(journal->held);
+        free(journal->freed);
+        free(journal->retired);
+        free(journal);
+    }
+}
+
+void journal_begin(journal_t *const journal) {
+    if (journal == NULL) {
+        return;
+    }
+    if (held_journal == journal) {
+        ++held_depth;
+        return;
+    }
+    pthread_mutex_lock(&journal->lock);
+    while (journal->closing) {
+        pthread_cond_wait(&journal->changed, &journal->lock);
+    }
+    ++journal->updates;
+    pthread_mutex_unlock(&journal->lock);
+    held_journal = journal;
+    held_depth = 1;
+}
+
+void journal_end(journal_t *const journal) {
+    if (journal == NULL || held_journal != journal) {
+        return;
+    }
+    if (--held_depth) {
+        return;
+    }
+    held_journal = NULL;
+    pthread_mutex_lock(&journal->lock);
+    --journal->updates;
+    if (journal->updates == 0 && journal->closing) {
+        pthread_cond_broadcast(&journal->changed);
+    }
+    // Half full leaves room for the updates that land while it's being taken
+    bool full = log_length(journal->dirty_count, journal->freed_count, journal->block_size) * 2 > journal->blocks / 2
+                && !journal->closing && !journal->writing;
+    pthread_mutex_unlock(&journal->lock);
+    if (full && !journal_commit(journal)) {
+        pthread_mutex_lock(&journal->lock);
+        journal->lost = true;
+        pthread_mutex_unlock(&journal->lock);
+    }
+}
+
+// Where the block is in the held list, or where it would go, journal lock has to be held
+static size_t find_held(const journal_t *const journal, const size_t block_id) {
+    size_t low = 0;
+    size_t high = journal->held_count;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if (journal->held[middle].block < block_id) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return low;
+}
+
+static bool is_held(const journal_t *const journal, const size_t index, const size_t block_id) {
+    return index < journal->held_count && journal->held[index].block == block_id;
+}
+
+// Drops a held block with no copy left
+static void forget_held(journal_t *const journal, const size_t index) {
+    if (journal->held[index].running == NULL && journal->held[index].taken == NULL) {
+        memmove(journal->held + index, journal->held + index + 1, (journal->held_count - index - 1) * sizeof(held_block_t));
+        --journal->held_count;
+    }
+}
+
+bool journal_write(journal_t *const journal, const size_t block_id, const void *data) {
+    if (journal == NULL || data == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&journal->lock);
+    size_t index = find_held(journal, block_id);
+    bool written = true;
+    if (!is_held(journal, index, block_id)) {
+        if (journal->held_count == journal->held_size) {
+            size_t size = journal->held_size ? journal->held_size * 2 : 64;
+            held_block_t *held = (held_block_t *) realloc(journal->held, size * sizeof(held_block_t));
+            written = held != NULL;
+            if (held) {
+                journal->held = held;
+                journal->held_size = size;
+            }
+        }
+        if (written) {
+            memmove(journal->held + index + 1, journal->held + index, (journal->held_count - index) * sizeof(held_block_t));
+            journal->held[index].block = block_id;
+            journal->held[index].running = NULL;
+            journal->held[index].taken = NULL;
+            ++journal->held_count;
+        }
+    }
+    held_block_t *held = written ? &journal->held[index] : NULL;
+    if (held && held->running == NULL) {
+        held->running = (uint8_t *) malloc(journal->block_size);
+        if (held->running) {
+            ++journal->dirty_count;
+        } else {
+            forget_held(journal, index);
+            written = false;
+        }
+    }
+    if (written) {
+        memcpy(journal->held[index].running, data, journal->block_size);
+    }
+    pthread_mutex_unlock(&journal->lock);
+    return written;
+}
+
+bool journal_read(journal_t *const journal, const size_t block_id, const size_t offset, const size_t length, void *buffer) {
+    if (journal == NULL || buffer == NULL || offset + length > journal->block_size) {
+        return false;
+    }
+    pthread_mutex_lock(&journal->lock);
+    size_t index = find_held(journal, block_id);
+    const uint8_t *image = NULL;
+    if (is_held(journal, index, block_id)) {
+        image = journal->held[index].running ? journal->held[index].running : journal->held[index].taken;
+        memcpy(buffer, image + offset, length);
+    }
+    pthread_mutex_unlock(&journal->lock);
+    return image != NULL;
+}
+
+const void *journal_view(journal_t *const journal, const size_t block_id) {
+    if (journal == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&journal->lock);
+    size_t index = find_held(journal, block_id);
+    const uint8_t *image = NULL;
+    if (is_held(journal, index, block_id)) {
+        image = journal->held[index].running ? journal->held[index].running : journal->held[index].taken;
+    }
+    pthread_mutex_unlock(&journal->lock);
+    return image;
+}
+
+void journal_pin(journal_t *const journal) {
+    if (journal) {
+        pthread_mutex_lock(&journal->lock);
+        ++journal->pins;
+        pthread_mutex_unlock(&journal->lock);
+    }
+}
+
+void journal_unpin(journal_t *const journal) {
+    if (journal == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&journal->lock);
+    if (journal->pins && --journal->pins == 0) {
+        for (size_t i = 0; i < journal->retired_count; ++i) {
+            free(journal->retired[i]);
+        }
+        journal->retired_count = 0;
+    }
+    pthread_mutex_unlock(&journal->lock);
+}
+
+// Adds a block to the list given back after the running transaction commits, journal lock has to be held
+static bool add_freed(journal_t *const journal, const size_t block_id) {
+    if (journal->freed_count == journal->freed_size) {
+        size_t size = journal->freed_size ? journal->freed_size * 2 : 64;
+        size_t *freed = (size_t *) realloc(journal->freed, size * sizeof(size_t));
+        if (freed == NULL) {
+            return false;
+        }
+        journal->freed = freed;
+        journal->freed_size = size;
+    }
+    journal->freed[journal->freed_count++] = block_id;
+    return true;
+}
+
+bool journal_free(journal_t *const journal, const size_t block_id) {
+    if (journal == NULL) {
+        return false;
+    }
+    pthread_mutex_lock(&journal->lock);
+    // A copy from the running transaction would otherwise go home over whatever the block holds next
+    size_t index = find_held(journal, block_id);
+    if (is_held(journal, index, block_id) && journal->held[index].running) {
+        retire_image(journal, journal->held[index].running);
+        journal->held[index].running = NULL;
+        --journal->dirty_count;
+        forget_held(journal, index);
+    }
+    bool added = add_freed(journal, block_id);
+    pthread_mutex_unlock(&journal->lock);
+    return added;
+}
+
+// Writes the taken blocks to the log region, the caller waits for them
+static bool write_log(journal_t *const journal, const region_t region, const uint32_t sequence,
+                      const logged_block_t *taken, const size_t count, const size_t *freed, const size_t freed_count) {
+    size_t descriptors = descriptor_blocks(count + freed_count, journal->block_size);
+    size_t logged = descriptors + count + 1;
+    uint8_t *log = (uint8_t *) calloc(logged, journal->block_size);
+    if (log == NULL) {
+        return false;
+    }
+    uint32_t *header = (uint32_t *) log;
+    header[0] = JOURNAL_MAGIC;
+    header[1] = sequence;
+    header[2] = (uint32_t) count;
+    header[3] = (uint32_t) freed_count;
+    for (size_t i = 0; i < count; ++i) {
+        header[HEADER_WORDS + i] = (uint32_t) taken[i].block;
+        memcpy(log + (descriptors + i) * journal->block_size, taken[i].image, journal->block_size);
+    }
+    for (size_t i = 0; i < freed_count; ++i) {
+        header[HEADER_WORDS + count + i] = (uint32_t) freed[i];
+    }
+    uint32_t *commit = (uint32_t *) (log + (logged - 1) * journal->block_size);
+    commit[0] = COMMIT_MAGIC;
+    commit[1] = sequence;
+    commit[2] = (uint32_t) count;
+    commit[3] = checksum(log, (logged - 1) * journal->block_size);
+    bool written = block_store_write_blocks(journal->bs, region_start(journal, region), logged, log)
+                   == logged * journal->block_size;
+    free(log);
+    return written;
+}
+
+// Sends the taken blocks home, and when the commit failed hands them back to the running transaction
+// so the next one logs them, journal lock has to be held
+static void settle_taken(journal_t *const journal, const bool committed) {
+    for (size_t i = journal->held_count; i-- > 0;) {
+        held_block_t *held = &journal->held[i];
+        if (held->taken == NULL) {
+            continue;
+        }
+        if (!committed && held->running == NULL) {
+            held->running = held->taken;
+            ++journal->dirty_count;
+        } else {
+            retire_image(journal, held->taken);
+        }
+        held->taken = NULL;
+        forget_held(journal, i);
+    }
+}
+
+bool journal_commit(journal_t *const journal) {
+    if (journal == NULL || held_journal == journal) {
+        // A handle of our own would hold up the commit forever
+        return false;
+    }
+    pthread_mutex_lock(&journal->lock);
+    // Whatever this caller changed is in the running transaction or an older one
+    uint32_t target = journal->running;
+    while (journal->committed < target && (journal->closing || journal->writing)) {
+        pthread_cond_wait(&journal->changed, &journal->lock);
+    }
+    bool lost = journal->lost;
+    journal->lost = false;
+    if (journal->committed >= target) {
+        bool ok = !journal->failed && !lost;
+        pthread_mutex_unlock(&journal->lock);
+        return ok;
+    }
+
+    // Our turn, new handles wait until the open ones finish and the transaction is taken
+    journal->closing = true;
+    while (journal->updates) {
+        pthread_cond_wait(&journal->changed, &journal->lock);
+    }
+    pthread_mutex_unlock(&journal->lock);
+    if (journal->prepare) {
+        journal->prepare(journal->arg);
+    }
+    pthread_mutex_lock(&journal->lock);
+    uint32_t sequence = journal->running++;
+    size_t count = journal->dirty_count;
+    logged_block_t *taken = count ? (logged_block_t *) malloc(count * sizeof(logged_block_t)) : NULL;
+    bool ok = count == 0 || taken != NULL;
+    size_t *freed = ok ? journal->freed : NULL;
+    size_t freed_count = ok ? journal->freed_count : 0;
+    for (size_t i = 0, n = 0; ok && i < journal->held_count; ++i) {
+        held_block_t *held = &journal->held[i];
+        if (held->running) {
+            held->taken = held->running;
+            held->running = NULL;
+            taken[n].block = held->block;
+            taken[n++].image = held->taken;
+        }
+    }
+    if (ok) {
+        journal->dirty_count = 0;
+        journal->freed = NULL;
+        journal->freed_count = journal->freed_size = 0;
+    }
+    journal->closing = false;
+    journal->writing = true;
+    pthread_cond_broadcast(&journal->changed);
+    pthread_mutex_unlock(&journal->lock);
+
+    // The half the last commit didn't use held the one before, which the last commit's sync made durable
+    // at home. Anywhere else overlaps the last commit's log, which has to wait for a sync of its own
+    // Blocks given up are logged too, even alone, or a crash could replay an older copy over their next use
+    region_t region = journal->last == REGION_FIRST ? REGION_SECOND : REGION_FIRST;
+    size_t length = log_length(count, freed_count, journal->block_size);
+    bool changed = count || freed_count;
+    bool logged = length <= journal->blocks;
+    region = length > journal->blocks / 2 ? REGION_WHOLE : region;
+    if (ok && journal->unsynced && (region == REGION_WHOLE || journal->last == REGION_WHOLE)) {
+        ok = journal->sync(journal->arg);
+    }
+    if (ok && changed && logged) {
+        ok = write_log(journal, region, sequence, taken, count, freed, freed_count) && journal->sync(journal->arg);
+        journal->last = ok ? region : journal->last;
+    } else if (ok && changed) {
+        // Too big to log even in the whole area, so it goes straight home with nothing older left to replay
+        // over it, and the commit fails to say it wasn't atomic
+        ok = clear_area(journal->bs, journal->start, journal->blocks, journal->block_size) && journal->sync(journal->arg);
+        journal->last = REGION_WHOLE;
+    } else if (ok) {
+        ok = journal->sync(journal->arg);
+    }
+
+    // Durable in the log, so the blocks can go home, and the ones given up can be handed out again
+    for (size_t i = 0; ok && i < count; ++i) {
+        ok = block_store_write(journal->bs, taken[i].block, taken[i].image) == journal->block_size;
+    }
+    free(taken);
+    journal->unsynced = ok && count;
+    if (ok && !logged) {
+        journal->sync(journal->arg);
+        journal->unsynced = false;
+    }
+    if (ok && freed_count) {
+        journal->release(journal->arg, freed, freed_count);
+    }
+
+    pthread_mutex_lock(&journal->lock);
+    settle_taken(journal, ok);
+    for (size_t i = 0; !ok && i < freed_count; ++i) {
+        add_freed(journal, freed[i]);
+    }
+    journal->writing = false;
+    journal->committed = sequence;
+    journal->failed = !ok || !logged;
+    pthread_cond_broadcast(&journal->changed);
+    pthread_mutex_unlock(&journal->lock);
+    free(freed);
+    return ok && logged && !lost;
+}
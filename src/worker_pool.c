@@ -0,0 +1,215 @@
+#include "worker_pool.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef struct worker_batch worker_batch_t;
+
+// One queued job, batch is NULL for fire-and-forget submissions
+typedef struct worker_item {
+    worker_job_t job;
+    void *arg;
+    worker_batch_t *batch;
+    struct worker_item *next;
+} worker_item_t;
+
+// Tracks the jobs of one worker_pool_run call
+struct worker_batch {
+    size_t remaining;
+};
+
+struct worker_pool {
+    pthread_mutex_t lock;
+    pthread_cond_t work;  // Signalled when a job is queued or the pool is stopping
+    pthread_cond_t done;  // Broadcast whenever a batch job finishes
+    worker_item_t *head;
+    worker_item_t *tail;
+    bool stopping;
+    size_t thread_count;
+    pthread_t *threads;
+};
+
+// Pops the first item of the queue, or the first one from the given batch, NULL if there's none
+// Pool lock has to be held
+static worker_item_t *worker_take(worker_pool_t *const pool, const worker_batch_t *const batch) {
+    worker_item_t *prev = NULL;
+    worker_item_t *item = pool->head;
+    while (item && batch && item->batch != batch) {
+        prev = item;
+        item = item->next;
+    }
+    if (item) {
+        if (prev) {
+            prev->next = item->next;
+        } else {
+            pool->head = item->next;
+        }
+        if (pool->tail == item) {
+            pool->tail = prev;
+        }
+        item->next = NULL;
+    }
+    return item;
+}
+
+// Runs an item with the pool unlocked, and marks it off its batch once it's done
+// Pool lock has to be held, and is again on return
+static void worker_execute(worker_pool_t *const pool, worker_item_t *const item) {
+    pthread_mutex_unlock(&pool->lock);
+    item->job(item->arg);
+    pthread_mutex_lock(&pool->lock);
+    if (item->batch) {
+        // Batch items live in the caller's array, it cleans them up
+        if (--item->batch->remaining == 0) {
+            pthread_cond_broadcast(&pool->done);
+        }
+    } else {
+        free(item);
+    }
+}
+
+static void *worker_main(void *arg) {
+    worker_pool_t *pool = (worker_pool_t *) arg;
+    pthread_mutex_lock(&pool->lock);
+    while (true) {
+        worker_item_t *item = worker_take(pool, NULL);
+        if (item) {
+            worker_execute(pool, item);
+        } else if (pool->stopping) {
+            break;
+        } else {
+            pthread_cond_wait(&pool->work, &pool->lock);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+worker_pool_t *worker_pool_create(const size_t threads) {
+    if (threads == 0) {
+        return NULL;
+    }
+    worker_pool_t *pool = (worker_pool_t *) calloc(1, sizeof(worker_pool_t));
+    if (pool) {
+        pool->threads = (pthread_t *) calloc(threads, sizeof(pthread_t));
+        if (pool->threads) {
+            if (pthread_mutex_init(&pool->lock, NULL) == 0) {
+                if (pthread_cond_init(&pool->work, NULL) == 0) {
+                    if (pthread_cond_init(&pool->done, NULL) == 0) {
+                        for (; pool->thread_count < threads; ++pool->thread_count) {
+                            if (pthread_create(&pool->threads[pool->thread_count], NULL, worker_main, pool) != 0) {
+                                break;
+                            }
+                        }
+                        if (pool->thread_count == threads) {
+                            return pool;
+                        }
+                        // Couldn't start them all, put down the ones that did start
+                        worker_pool_destroy(pool);
+                        return NULL;
+                    }
+                    pthread_cond_destroy(&pool->work);
+                }
+                pthread_mutex_destroy(&pool->lock);
+            }
+            free(pool->threads);
+        }
+        free(pool);
+    }
+    return NULL;
+}
+
+void worker_pool_destroy(worker_pool_t *const pool) {
+    if (pool) {
+        pthread_mutex_lock(&pool->lock);
+        pool->stopping = true;
+        pthread_cond_broadcast(&pool->work);
+        pthread_mutex_unlock(&pool->lock);
+
+        for (size_t i = 0; i < pool->thread_count; ++i) {
+            pthread_join(pool->threads[i], NULL);
+        }
+
+        pthread_cond_destroy(&pool->done);
+        pthread_cond_destroy(&pool->work);
+        pthread_mutex_destroy(&pool->lock);
+        free(pool->threads);
+        free(pool);
+    }
+}
+
+size_t worker_pool_threads(const worker_pool_t *const pool) {
+    return pool ? pool->thread_count : 0;
+}
+
+bool worker_pool_submit(worker_pool_t *const pool, const worker_job_t job, void *arg) {
+    if (pool && job) {
+        worker_item_t *item = (worker_item_t *) calloc(1, sizeof(worker_item_t));
+        if (item) {
+            item->job = job;
+            item->arg = arg;
+
+            pthread_mutex_lock(&pool->lock);
+            if (!pool->stopping) {
+                if (pool->tail) {
+                    pool->tail->next = item;
+                } else {
+                    pool->head = item;
+                }
+                pool->tail = item;
+                pthread_cond_signal(&pool->work);
+                pthread_mutex_unlock(&pool->lock);
+                return true;
+            }
+            pthread_mutex_unlock(&pool->lock);
+            free(item);
+        }
+    }
+    return false;
+}
+
+bool worker_pool_run(worker_pool_t *const pool, const worker_job_t job, void *args, const size_t count,
+                     const size_t arg_size) {
+    if (pool == NULL || job == NULL || (args == NULL && count)) {
+        return false;
+    }
+    if (count == 0) {
+        return true;
+    }
+
+    worker_item_t *items = (worker_item_t *) calloc(count, sizeof(worker_item_t));
+    if (items == NULL) {
+        return false;
+    }
+
+    worker_batch_t batch = {count};
+    pthread_mutex_lock(&pool->lock);
+    for (size_t i = 0; i < count; ++i) {
+        items[i].job = job;
+        items[i].arg = (uint8_t *) args + i * arg_size;
+        items[i].batch = &batch;
+        if (pool->tail) {
+            pool->tail->next = &items[i];
+        } else {
+            pool->head = &items[i];
+        }
+        pool->tail = &items[i];
+    }
+    pthread_cond_broadcast(&pool->work);
+
+    // Help out with our own batch instead of just waiting, that way a job that
+    // runs a batch of its own can't tie up every worker waiting on the queue
+    while (batch.remaining) {
+        worker_item_t *item = worker_take(pool, &batch);
+        if (item) {
+            worker_execute(pool, item);
+        } else {
+            pthread_cond_wait(&pool->done, &pool->lock);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    free(items);
+    return true;
+}
@@ -0,0 +1,129 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <vector>
+#include <sys/stat.h>
+extern "C" {
+#include "S17FS.h"
+}
+
+// Quick throughput numbers for the hot paths, run by hand: ./fs_bench
+// Each benchmark formats its own image in the working directory.
+
+static double time_it(const std::function<void()> &work) {
+    auto start = std::chrono::steady_clock::now();
+    work();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count();
+}
+
+static void bench_small_appends(bool buffered) {
+    const size_t appends = 64 * 1024;  // 4 MB of 64 byte records
+    S17FS_t *fs = fs_format("bench_append.S17FS");
+    if (!fs || fs_create(fs, "/log", FS_REGULAR) < 0) {
+        std::printf("append: setup failed\n");
+        std::exit(1);
+    }
+    int fd = fs_open(fs, "/log");
+    if (buffered) {
+        fs_set_write_buffer(fs, fd, true);
+    }
+    char record[64];
+    std::memset(record, 'x', sizeof(record));
+    size_t failures = 0;
+    double seconds = time_it([&] {
+        for (size_t i = 0; i < appends; ++i) {
+            failures += fs_write(fs, fd, record, sizeof(record)) != (ssize_t) sizeof(record);
+        }
+        fs_close(fs, fd);
+    });
+    std::printf("64B append (%s): %zu appends in %.3fs, %.0f appends/s, %.1f MB/s%s\n",
+                buffered ? "buffered" : "unbuffered", appends, seconds, appends / seconds,
+                appends * sizeof(record) / seconds / (1024 * 1024), failures ? " (WRITE FAILURES)" : "");
+    fs_unmount(fs);
+}
+
+static void bench_large_copy(fs_backend_t backend, const char *label) {
+    const size_t bytes = 24 * 1024 * 1024;  // Most of the volume, through the double indirect blocks
+    S17FS_t *fs = fs_format_backend("bench_copy.S17FS", backend);
+    if (!fs || fs_create(fs, "/big", FS_REGULAR) < 0) {
+        std::printf("copy: setup failed\n");
+        std::exit(1);
+    }
+    int fd = fs_open(fs, "/big");
+    std::vector<char> data(bytes, 'y');
+    std::vector<char> back(bytes);
+    ssize_t written = 0;
+    ssize_t read = 0;
+    double write_seconds = time_it([&] { written = fs_write(fs, fd, data.data(), bytes); });
+    fs_seek(fs, fd, 0, FS_SEEK_SET);
+    double read_seconds = time_it([&] { read = fs_read(fs, fd, back.data(), bytes); });
+    std::printf("24MB copy (%s): write %.1f MB/s, read %.1f MB/s%s\n", label, bytes / write_seconds / (1024 * 1024),
+                bytes / read_seconds / (1024 * 1024),
+                written != (ssize_t) bytes || read != (ssize_t) bytes || back != data ? " (COPY MISMATCH)" : "");
+    fs_close(fs, fd);
+    fs_unmount(fs);
+}
+
+static void bench_format(fs_backend_t backend, const char *label) {
+    const size_t formats = 200;
+    size_t failures = 0;
+    double seconds = time_it([&] {
+        for (size_t i = 0; i < formats; ++i) {
+            S17FS_t *fs = fs_format_backend("bench_format.S17FS", backend);
+            failures += !fs || fs_unmount(fs) != 0;
+        }
+    });
+    // A fresh image should stay sparse, only the blocks format writes take up space
+    struct stat image;
+    double allocated = stat("bench_format.S17FS", &image) == 0 ? image.st_blocks * 512.0 / 1024 : -1;
+    std::printf("format + unmount (%s): %.3f ms each, %.0f KB allocated on disk%s\n", label, seconds * 1000 / formats,
+                allocated, failures ? " (FORMAT FAILURES)" : "");
+}
+
+static void bench_fsync(fs_backend_t backend, const char *label) {
+    const size_t rounds = 200;
+    S17FS_t *fs = fs_format_backend("bench_sync.S17FS", backend);
+    if (!fs || fs_create(fs, "/log", FS_REGULAR) < 0) {
+        std::printf("fsync: setup failed\n");
+        std::exit(1);
+    }
+    int fd = fs_open(fs, "/log");
+    // Fill most of the volume first, so a sync that wrote everything back would show
+    std::vector<char> filler(16 * 1024 * 1024, 'f');
+    fs_write(fs, fd, filler.data(), filler.size());
+    fs_sync(fs);
+    char record[4096];
+    std::memset(record, 'r', sizeof(record));
+    size_t failures = 0;
+    double seconds = time_it([&] {
+        for (size_t i = 0; i < rounds; ++i) {
+            failures += fs_write(fs, fd, record, sizeof(record)) != (ssize_t) sizeof(record) || fs_fsync(fs, fd) != 0;
+        }
+    });
+    std::printf("4KB write + fsync (%s): %.3f ms each%s\n", label, seconds * 1000 / rounds,
+                failures ? " (SYNC FAILURES)" : "");
+    fs_close(fs, fd);
+    fs_unmount(fs);
+}
+
+int main() {
+    bench_format(FS_BACKEND_MMAP, "mmap");
+    bench_format(FS_BACKEND_URING, "io_uring");
+    bench_format(FS_BACKEND_FILE, "pread");
+    bench_small_appends(false);
+    bench_small_appends(true);
+    bench_large_copy(FS_BACKEND_MMAP, "mmap");
+    bench_large_copy(FS_BACKEND_URING, "io_uring");
+    bench_large_copy(FS_BACKEND_FILE, "pread");
+    bench_fsync(FS_BACKEND_MMAP, "mmap");
+    bench_fsync(FS_BACKEND_URING, "io_uring");
+    bench_fsync(FS_BACKEND_FILE, "pread");
+    std::remove("bench_append.S17FS");
+    std::remove("bench_copy.S17FS");
+    std::remove("bench_format.S17FS");
+    std::remove("bench_sync.S17FS");
+    return 0;
+}
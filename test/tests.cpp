@@ -1,7 +1,13 @@
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstdlib>
+#include <fstream>
 #include <iostream>
 #include <new>
+#include <thread>
 #include <vector>
+#include <sys/stat.h>
 using std::vector;
 using std::string;
 #include <gtest/gtest.h>
@@ -28,6 +34,23 @@ class GradeEnvironment : public testing::Environment {
             std::cout << "SCORE: " << score << '/' << total << std::endl;
         }
 };
+// Builds format options by name, anything not set stays 0, so new fields don't touch existing tests
+struct format_opts {
+    fs_format_opts_t opts;
+    explicit format_opts(fs_backend_t backend = FS_BACKEND_MMAP) : opts() { opts.backend = backend; }
+    format_opts &block_size(size_t value) { opts.block_size = value; return *this; }
+    format_opts &block_count(size_t value) { opts.block_count = value; return *this; }
+    format_opts &inode_count(size_t value) { opts.inode_count = value; return *this; }
+    format_opts &dir_records(size_t value) { opts.dir_records = value; return *this; }
+    format_opts &journal_blocks(size_t value) { opts.journal_blocks = value; return *this; }
+    format_opts &pointer_bytes(size_t value) { opts.pointer_bytes = value; return *this; }
+    format_opts &inode_limit(size_t value) { opts.inode_limit = value; return *this; }
+    format_opts &block_limit(size_t value) { opts.block_limit = value; return *this; }
+    format_opts &inode_size(size_t value) { opts.inode_size = value; return *this; }
+    format_opts &inline_data(bool value) { opts.inline_data = value; return *this; }
+    format_opts &tail_packing(bool value) { opts.tail_packing = value; return *this; }
+    operator fs_format_opts_t() const { return opts; }
+};
 bool find_in_directory(const dyn_array_t *const record_arr, const char *fname) {
     if (record_arr && fname) {
         for (size_t i = 0; i < dyn_array_size(record_arr); ++i) {
@@ -38,6 +61,47 @@ bool find_in_directory(const dyn_array_t *const record_arr, const char *fname) {
     }
     return false;
 }
+// Whether path reads back as exactly the length bytes at expected
+::testing::AssertionResult file_holds(S17FS *fs, const char *path, const uint8_t *expected, size_t length) {
+    int fd = fs_open(fs, path);
+    if (fd < 0) {
+        return ::testing::AssertionFailure() << path << " doesn't open";
+    }
+    vector<uint8_t> back(length + 1);
+    ssize_t got = fs_read(fs, fd, back.data(), back.size());
+    fs_close(fs, fd);
+    if (got != (ssize_t) length) {
+        return ::testing::AssertionFailure() << path << " reads " << got << " bytes, not " << length;
+    }
+    if (memcmp(back.data(), expected, length) != 0) {
+        return ::testing::AssertionFailure() << path << " doesn't read back what was written";
+    }
+    return ::testing::AssertionSuccess();
+}
+// Formats a volume on every backend, runs write(fs, backend) on it, then remounts it on the same backend for check(fs)
+// A failed assertion only leaves the lambda it's in, so wrap the call in ASSERT_NO_FATAL_FAILURE
+template <typename Write, typename Check>
+void on_every_backend(const char *fname, fs_format_opts_t opts, Write write, Check check) {
+    fs_backend_t backends[3] = {FS_BACKEND_MMAP, FS_BACKEND_URING, FS_BACKEND_FILE};
+    for (fs_backend_t backend : backends) {
+        SCOPED_TRACE(::testing::Message() << "backend " << backend);
+        opts.backend = backend;
+        S17FS *fs = fs_format_ex(fname, &opts);
+        ASSERT_NE(fs, nullptr);
+        write(fs, backend);
+        if (::testing::Test::HasFatalFailure()) {
+            return;
+        }
+        ASSERT_EQ(fs_unmount(fs), 0);
+        fs = fs_mount_backend(fname, backend);
+        ASSERT_NE(fs, nullptr);
+        check(fs);
+        if (::testing::Test::HasFatalFailure()) {
+            return;
+        }
+        ASSERT_EQ(fs_unmount(fs), 0);
+    }
+}
 /*
    S17FS * fs_format(const char *const fname);
    1   Normal
@@ -723,7 +787,7 @@ TEST(e_tests, remove_file) {
                 "more/bad_req",
             "/folder/withfilethatiswayyyyytoolongwhydoyoumakefilesthataretoobigEXACT!", "/", "/mystery_file"};
     vector<const char *> a_fnames{"/file_a", "/file_b", "/file_c", "/file_d"};
-    const char *(test_fname[2]) = {"e_tests_a.S17FS", "e_tests_b.S17FS"};
+    const char *test_fname[2] = {"e_tests_a.S17FS", "e_tests_b.S17FS"};
     ASSERT_EQ(system("cp d_tests_full.S17FS e_tests_a.S17FS"), 0);
     ASSERT_EQ(system("cp c_tests.S17FS e_tests_b.S17FS"), 0);
     S17FS *fs = fs_mount(test_fname[1]);
@@ -911,6 +975,2340 @@ TEST(h_tests, read) {
     score += 20;
 }
 //*/
+/*
+   int fs_set_write_buffer(S17FS *fs, int fd, bool enable);
+   int fs_flush(S17FS *fs, int fd);
+   1. Normal, many small appends, read back through a second descriptor
+   2. Normal, seek ends the run and reports the buffered size
+   3. Normal, unbuffered write from another descriptor lands after the buffered data
+   4. Normal, close flushes, data survives a remount
+   5. Error, NULL fs
+   6. Error, bad fd
+   */
+///*
+TEST(k_tests, write_buffer) {
+    const char *test_fname = "k_tests.S17FS";
+    S17FS *fs = fs_format(test_fname);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/log", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/log");
+    ASSERT_GE(fd, 0);
+    int reader = fs_open(fs, "/log");
+    ASSERT_GE(reader, 0);
+    ASSERT_EQ(fs_set_write_buffer(fs, fd, true), 0);
+    uint8_t record[64];
+    uint8_t expected[64 * 100 + 512];
+    // FS_WRITE_BUFFER 1
+    for (int i = 0; i < 100; ++i) {
+        memset(record, i, 64);
+        memcpy(expected + i * 64, record, 64);
+        ASSERT_EQ(fs_write(fs, fd, record, 64), 64);
+    }
+    uint8_t read_space[64 * 100 + 512] = {0};
+    ASSERT_EQ(fs_read(fs, reader, read_space, sizeof(read_space)), 64 * 100);
+    ASSERT_EQ(memcmp(read_space, expected, 64 * 100), 0);
+    // FS_WRITE_BUFFER 2
+    ASSERT_EQ(fs_write(fs, fd, record, 10), 10);
+    memcpy(expected + 6400, record, 10);
+    ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_END), 6410);
+    // FS_WRITE_BUFFER 3
+    ASSERT_EQ(fs_write(fs, fd, record, 20), 20);
+    memcpy(expected + 6410, record, 20);
+    ASSERT_EQ(fs_seek(fs, reader, 0, FS_SEEK_END), 6430);
+    memset(record, 0xEE, 64);
+    ASSERT_EQ(fs_write(fs, reader, record, 64), 64);
+    memcpy(expected + 6430, record, 64);
+    // FS_WRITE_BUFFER 4
+    ASSERT_EQ(fs_write(fs, fd, record, 6), 6);
+    ASSERT_EQ(fs_flush(fs, fd), 0);
+    ASSERT_EQ(fs_close(fs, fd), 0);
+    fs_unmount(fs);
+    fs = fs_mount(test_fname);
+    ASSERT_NE(fs, nullptr);
+    fd = fs_open(fs, "/log");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_read(fs, fd, read_space, sizeof(read_space)), 6494);
+    ASSERT_EQ(memcmp(read_space, expected, 6494), 0);
+    // FS_WRITE_BUFFER 5
+    ASSERT_LT(fs_set_write_buffer(NULL, fd, true), 0);
+    ASSERT_LT(fs_flush(NULL, fd), 0);
+    // FS_WRITE_BUFFER 6
+    ASSERT_LT(fs_set_write_buffer(fs, 90, true), 0);
+    ASSERT_LT(fs_flush(fs, -1), 0);
+    fs_unmount(fs);
+    score += 10;
+}
+//*/
+/*
+   Read-ahead is only a hint, so this just makes sure streams read back right
+   1. Normal, small sequential reads from BOF through the double indirect blocks to EOF
+   2. Normal, random reads break the stream and still return the right data
+   */
+///*
+TEST(l_tests, sequential_read) {
+    const char *test_fname = "l_tests.S17FS";
+    S17FS *fs = fs_format(test_fname);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/stream", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/stream");
+    ASSERT_GE(fd, 0);
+    const size_t file_size = 600 * 512 + 100;
+    vector<uint8_t> data(file_size);
+    for (size_t i = 0; i < file_size; ++i) {
+        data[i] = (uint8_t)(i * 7 + i / 512);
+    }
+    ASSERT_EQ(fs_write(fs, fd, data.data(), file_size), (ssize_t) file_size);
+    ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_SET), 0);
+    // READAHEAD 1
+    uint8_t read_space[300];
+    size_t total_read = 0;
+    ssize_t nbyte = 0;
+    while ((nbyte = fs_read(fs, fd, read_space, sizeof(read_space))) > 0) {
+        ASSERT_EQ(memcmp(read_space, data.data() + total_read, nbyte), 0);
+        total_read += nbyte;
+    }
+    ASSERT_EQ(nbyte, 0);
+    ASSERT_EQ(total_read, file_size);
+    // READAHEAD 2
+    const size_t offsets[] = {517 * 512 + 3, 12, 299 * 512, 5 * 512 - 1, file_size - 10};
+    for (size_t offset : offsets) {
+        ASSERT_EQ(fs_seek(fs, fd, offset, FS_SEEK_SET), (off_t) offset);
+        size_t expected = file_size - offset < sizeof(read_space) ? file_size - offset : sizeof(read_space);
+        ASSERT_EQ(fs_read(fs, fd, read_space, sizeof(read_space)), (ssize_t) expected);
+        ASSERT_EQ(memcmp(read_space, data.data() + offset, expected), 0);
+    }
+    fs_unmount(fs);
+    score += 5;
+}
+//*/
+/*
+   ssize_t fs_pread(S17FS *fs, int fd, void *dst, size_t nbyte, off_t offset);
+   ssize_t fs_pwrite(S17FS *fs, int fd, const void *src, size_t nbyte, off_t offset);
+   1. Normal, pwrite at EOF extends the file, position untouched
+   2. Normal, pwrite inside the file overwrites without growing it
+   3. Normal, pread inside the file and across EOF, position untouched
+   4. Normal, pread at EOF
+   5. Error, pwrite past EOF
+   6. Error, NULL fs / NULL buffer / negative offset / bad fd
+   */
+///*
+TEST(m_tests, positional_io) {
+    const char *test_fname = "m_tests.S17FS";
+    S17FS *fs = fs_format(test_fname);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/records", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/records");
+    ASSERT_GE(fd, 0);
+    uint8_t data[2048];
+    for (size_t i = 0; i < sizeof(data); ++i) {
+        data[i] = (uint8_t) i;
+    }
+    // FS_PWRITE 1
+    ASSERT_EQ(fs_pwrite(fs, fd, data, 1000, 0), 1000);
+    ASSERT_EQ(fs_pwrite(fs, fd, data + 1000, 1048, 1000), 1048);
+    ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_CUR), 0);
+    ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_END), 2048);
+    // FS_PWRITE 2
+    uint8_t patch[100];
+    memset(patch, 0xAB, sizeof(patch));
+    ASSERT_EQ(fs_pwrite(fs, fd, patch, sizeof(patch), 500), 100);
+    memcpy(data + 500, patch, sizeof(patch));
+    ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_END), 2048);
+    // FS_PREAD 3
+    ASSERT_EQ(fs_seek(fs, fd, 10, FS_SEEK_SET), 10);
+    uint8_t read_space[1024];
+    ASSERT_EQ(fs_pread(fs, fd, read_space, 700, 450), 700);
+    ASSERT_EQ(memcmp(read_space, data + 450, 700), 0);
+    ASSERT_EQ(fs_pread(fs, fd, read_space, 1024, 2000), 48);
+    ASSERT_EQ(memcmp(read_space, data + 2000, 48), 0);
+    ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_CUR), 10);
+    // FS_PREAD 4
+    ASSERT_EQ(fs_pread(fs, fd, read_space, 1024, 2048), 0);
+    // FS_PWRITE 5
+    ASSERT_LT(fs_pwrite(fs, fd, patch, sizeof(patch), 2049), 0);
+    // FS_PREAD/FS_PWRITE 6
+    ASSERT_LT(fs_pread(NULL, fd, read_space, 10, 0), 0);
+    ASSERT_LT(fs_pwrite(NULL, fd, patch, 10, 0), 0);
+    ASSERT_LT(fs_pread(fs, fd, NULL, 10, 0), 0);
+    ASSERT_LT(fs_pwrite(fs, fd, NULL, 10, 0), 0);
+    ASSERT_LT(fs_pread(fs, fd, read_space, 10, -1), 0);
+    ASSERT_LT(fs_pwrite(fs, fd, patch, 10, -1), 0);
+    ASSERT_LT(fs_pread(fs, 90, read_space, 10, 0), 0);
+    ASSERT_LT(fs_pwrite(fs, 90, patch, 10, 0), 0);
+    fs_unmount(fs);
+    score += 5;
+}
+//*/
+/*
+   ssize_t fs_readv(S17FS *fs, int fd, const struct iovec *iov, int iovcnt);
+   ssize_t fs_writev(S17FS *fs, int fd, const struct iovec *iov, int iovcnt);
+   1. Normal, header + payload records written as pairs
+   2. Normal, read back into split buffers that straddle blocks
+   3. Normal, readv past EOF
+   4. Normal, buffered descriptor takes small pairs
+   5. Normal, empty vector
+   6. Error, NULL fs / bad fd / bad iovcnt / NULL segment
+   */
+///*
+TEST(n_tests, vectored_io) {
+    const char *test_fname = "n_tests.S17FS";
+    S17FS *fs = fs_format(test_fname);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/records", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/records");
+    ASSERT_GE(fd, 0);
+    uint8_t header[16];
+    uint8_t payload[1000];
+    vector<uint8_t> expected;
+    // FS_WRITEV 1
+    for (int i = 0; i < 5; ++i) {
+        memset(header, 0xA0 + i, sizeof(header));
+        memset(payload, i, sizeof(payload));
+        struct iovec iov[2] = {{header, sizeof(header)}, {payload, sizeof(payload)}};
+        ASSERT_EQ(fs_writev(fs, fd, iov, 2), (ssize_t)(sizeof(header) + sizeof(payload)));
+        expected.insert(expected.end(), header, header + sizeof(header));
+        expected.insert(expected.end(), payload, payload + sizeof(payload));
+    }
+    ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_CUR), 5080);
+    // FS_READV 2
+    ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_SET), 0);
+    uint8_t first[700], second[1200], third[2000];
+    struct iovec read_iov[3] = {{first, sizeof(first)}, {second, sizeof(second)}, {third, sizeof(third)}};
+    ASSERT_EQ(fs_readv(fs, fd, read_iov, 3), 3900);
+    ASSERT_EQ(memcmp(first, expected.data(), 700), 0);
+    ASSERT_EQ(memcmp(second, expected.data() + 700, 1200), 0);
+    ASSERT_EQ(memcmp(third, expected.data() + 1900, 2000), 0);
+    // FS_READV 3
+    ASSERT_EQ(fs_readv(fs, fd, read_iov, 3), 1180);
+    ASSERT_EQ(memcmp(first, expected.data() + 3900, 700), 0);
+    ASSERT_EQ(memcmp(second, expected.data() + 4600, 480), 0);
+    ASSERT_EQ(fs_readv(fs, fd, read_iov, 3), 0);
+    // FS_WRITEV 4
+    ASSERT_EQ(fs_set_write_buffer(fs, fd, true), 0);
+    struct iovec small_iov[2] = {{header, 4}, {payload, 60}};
+    ASSERT_EQ(fs_writev(fs, fd, small_iov, 2), 64);
+    ASSERT_EQ(fs_writev(fs, fd, small_iov, 2), 64);
+    expected.insert(expected.end(), header, header + 4);
+    expected.insert(expected.end(), payload, payload + 60);
+    expected.insert(expected.end(), header, header + 4);
+    expected.insert(expected.end(), payload, payload + 60);
+    ASSERT_EQ(fs_pread(fs, fd, third, sizeof(third), 4000), 1208);
+    ASSERT_EQ(memcmp(third, expected.data() + 4000, 1208), 0);
+    // FS_WRITEV 5
+    ASSERT_EQ(fs_writev(fs, fd, small_iov, 0), 0);
+    ASSERT_EQ(fs_readv(fs, fd, read_iov, 0), 0);
+    // FS_READV/FS_WRITEV 6
+    ASSERT_LT(fs_writev(NULL, fd, small_iov, 2), 0);
+    ASSERT_LT(fs_readv(NULL, fd, read_iov, 3), 0);
+    ASSERT_LT(fs_writev(fs, 90, small_iov, 2), 0);
+    ASSERT_LT(fs_readv(fs, 90, read_iov, 3), 0);
+    ASSERT_LT(fs_writev(fs, fd, small_iov, -1), 0);
+    ASSERT_LT(fs_readv(fs, fd, read_iov, FS_IOV_MAX + 1), 0);
+    ASSERT_LT(fs_writev(fs, fd, NULL, 2), 0);
+    struct iovec bad_iov[2] = {{header, 4}, {NULL, 60}};
+    ASSERT_LT(fs_writev(fs, fd, bad_iov, 2), 0);
+    ASSERT_LT(fs_readv(fs, fd, bad_iov, 2), 0);
+    fs_unmount(fs);
+    score += 5;
+}
+//*/
+/*
+   ssize_t fs_read_view(S17FS *fs, int fd, off_t offset, size_t nbyte, dyn_array_t **spans_out);
+   int fs_release_view(S17FS *fs, dyn_array_t *spans);
+   1. Normal, whole file across the direct/indirect transition
+   2. Normal, unaligned range in the middle
+   3. Normal, range running past EOF, and at EOF
+   4. Normal, sees buffered writes
+   5. Error, NULL fs / NULL spans_out / negative offset / bad fd / bad release
+   */
+///*
+static vector<uint8_t> gather_spans(const dyn_array_t *spans) {
+    vector<uint8_t> gathered;
+    for (size_t i = 0; i < dyn_array_size(spans); ++i) {
+        const fs_span_t *span = (const fs_span_t *) dyn_array_at(spans, i);
+        const uint8_t *base = (const uint8_t *) span->base;
+        gathered.insert(gathered.end(), base, base + span->len);
+    }
+    return gathered;
+}
+TEST(o_tests, read_view) {
+    const char *test_fname = "o_tests.S17FS";
+    S17FS *fs = fs_format(test_fname);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/blob", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/blob");
+    ASSERT_GE(fd, 0);
+    vector<uint8_t> data(512 * 8 + 77);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (uint8_t)(i * 13);
+    }
+    ASSERT_EQ(fs_write(fs, fd, data.data(), data.size()), (ssize_t) data.size());
+    // FS_READ_VIEW 1
+    dyn_array_t *spans = NULL;
+    ASSERT_EQ(fs_read_view(fs, fd, 0, data.size(), &spans), (ssize_t) data.size());
+    ASSERT_NE(spans, nullptr);
+    ASSERT_TRUE(gather_spans(spans) == data);
+    ASSERT_EQ(fs_release_view(fs, spans), 0);
+    // FS_READ_VIEW 2
+    ASSERT_EQ(fs_read_view(fs, fd, 700, 1000, &spans), 1000);
+    ASSERT_TRUE(gather_spans(spans) == vector<uint8_t>(data.begin() + 700, data.begin() + 1700));
+    ASSERT_EQ(fs_release_view(fs, spans), 0);
+    // FS_READ_VIEW 3
+    ASSERT_EQ(fs_read_view(fs, fd, 4000, 4096, &spans), (ssize_t) data.size() - 4000);
+    ASSERT_TRUE(gather_spans(spans) == vector<uint8_t>(data.begin() + 4000, data.end()));
+    ASSERT_EQ(fs_release_view(fs, spans), 0);
+    ASSERT_EQ(fs_read_view(fs, fd, data.size(), 10, &spans), 0);
+    ASSERT_EQ(dyn_array_size(spans), 0u);
+    ASSERT_EQ(fs_release_view(fs, spans), 0);
+    // FS_READ_VIEW 4
+    ASSERT_EQ(fs_set_write_buffer(fs, fd, true), 0);
+    uint8_t tail[10];
+    memset(tail, 0x5A, sizeof(tail));
+    ASSERT_EQ(fs_write(fs, fd, tail, sizeof(tail)), 10);
+    data.insert(data.end(), tail, tail + sizeof(tail));
+    ASSERT_EQ(fs_read_view(fs, fd, 0, data.size(), &spans), (ssize_t) data.size());
+    ASSERT_TRUE(gather_spans(spans) == data);
+    ASSERT_EQ(fs_release_view(fs, spans), 0);
+    // FS_READ_VIEW 5
+    ASSERT_LT(fs_read_view(NULL, fd, 0, 10, &spans), 0);
+    ASSERT_LT(fs_read_view(fs, fd, 0, 10, NULL), 0);
+    ASSERT_LT(fs_read_view(fs, fd, -1, 10, &spans), 0);
+    ASSERT_LT(fs_read_view(fs, 90, 0, 10, &spans), 0);
+    ASSERT_LT(fs_release_view(fs, NULL), 0);
+    ASSERT_LT(fs_release_view(NULL, spans), 0);
+    fs_unmount(fs);
+    score += 5;
+}
+//*/
+/*
+   Concurrent use of one S17FS from several threads
+   1. Normal, each thread appends to its own file, half of them buffered
+   2. Normal, every thread preads a shared file while the appends run
+   3. Normal, create/remove churn in a shared directory
+   4. Normal, everything checks out once the threads are done
+   */
+///*
+static uint8_t stress_byte(int thread, size_t pos) {
+    return (uint8_t)(thread * 37 + pos * 7 + pos / 251);
+}
+TEST(p_tests, concurrent_access) {
+    const char *test_fname = "p_tests.S17FS";
+    const int threads = 4;
+    const size_t records = 200;
+    const size_t record_len = 300;
+    S17FS *fs = fs_format(test_fname);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/shared", FS_DIRECTORY), 0);
+    ASSERT_EQ(fs_create(fs, "/common", FS_REGULAR), 0);
+    vector<uint8_t> common(512 * 64 + 100);
+    for (size_t i = 0; i < common.size(); ++i) {
+        common[i] = stress_byte(99, i);
+    }
+    int common_fd = fs_open(fs, "/common");
+    ASSERT_GE(common_fd, 0);
+    ASSERT_EQ(fs_write(fs, common_fd, common.data(), common.size()), (ssize_t) common.size());
+    ASSERT_EQ(fs_close(fs, common_fd), 0);
+
+    std::atomic<int> failures(0);
+    vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.push_back(std::thread([&, t]() {
+            char fname[32];
+            snprintf(fname, sizeof(fname), "/file%d", t);
+            if (fs_create(fs, fname, FS_REGULAR) != 0) {
+                failures++;
+                return;
+            }
+            int fd = fs_open(fs, fname);
+            int reader = fs_open(fs, "/common");
+            if (fd < 0 || reader < 0 || (t % 2 && fs_set_write_buffer(fs, fd, true) != 0)) {
+                failures++;
+                return;
+            }
+            uint8_t record[300];
+            uint8_t check[512];
+            char churn[32];
+            snprintf(churn, sizeof(churn), "/shared/churn%d", t);
+            for (size_t i = 0; i < records; ++i) {
+                // CASE 1
+                for (size_t j = 0; j < record_len; ++j) {
+                    record[j] = stress_byte(t, i * record_len + j);
+                }
+                if (fs_write(fs, fd, record, record_len) != (ssize_t) record_len) {
+                    failures++;
+                }
+                // CASE 2
+                size_t offset = (i * 977 + t * 131) % (common.size() - sizeof(check));
+                if (fs_pread(fs, reader, check, sizeof(check), offset) != (ssize_t) sizeof(check)
+                    || memcmp(check, common.data() + offset, sizeof(check)) != 0) {
+                    failures++;
+                }
+                // CASE 3
+                if (i % 4 == 0 && (fs_create(fs, churn, i % 8 ? FS_REGULAR : FS_DIRECTORY) != 0 || fs_remove(fs, churn) != 0)) {
+                    failures++;
+                }
+            }
+            if (fs_close(fs, fd) != 0 || fs_close(fs, reader) != 0) {
+                failures++;
+            }
+        }));
+    }
+    for (std::thread &worker : workers) {
+        worker.join();
+    }
+    ASSERT_EQ(failures.load(), 0);
+
+    // CASE 4
+    vector<uint8_t> contents(records * record_len + 1);
+    for (int t = 0; t < threads; ++t) {
+        char fname[32];
+        snprintf(fname, sizeof(fname), "/file%d", t);
+        int fd = fs_open(fs, fname);
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_read(fs, fd, contents.data(), contents.size()), (ssize_t)(records * record_len));
+        for (size_t pos = 0; pos < records * record_len; ++pos) {
+            ASSERT_EQ(contents[pos], stress_byte(t, pos));
+        }
+        ASSERT_EQ(fs_close(fs, fd), 0);
+    }
+    dyn_array_t *listing = fs_get_dir(fs, "/shared");
+    ASSERT_NE(listing, nullptr);
+    ASSERT_EQ(dyn_array_size(listing), 0u);
+    dyn_array_destroy(listing);
+    listing = fs_get_dir(fs, "/");
+    ASSERT_NE(listing, nullptr);
+    ASSERT_EQ(dyn_array_size(listing), (size_t)(threads + 2));
+    dyn_array_destroy(listing);
+    fs_unmount(fs);
+    score += 5;
+}
+//*/
+/*
+   Lock-free lookups: fs_open, fs_get_dir and fs_seek(FS_SEEK_END) while writers run
+   1. Normal, open/close and listings stay right while another directory churns
+   2. Normal, seek to end tracks a file another thread keeps appending to
+   3. Normal, a removed file can't be opened, a recreated one can
+   4. Normal, seek to end still counts bytes sitting in a write buffer
+   */
+///*
+TEST(q_tests, optimistic_lookup) {
+    const char *test_fname = "q_tests.S17FS";
+    S17FS *fs = fs_format(test_fname);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/stable", FS_DIRECTORY), 0);
+    ASSERT_EQ(fs_create(fs, "/stable/a", FS_REGULAR), 0);
+    ASSERT_EQ(fs_create(fs, "/stable/b", FS_REGULAR), 0);
+    ASSERT_EQ(fs_create(fs, "/busy", FS_DIRECTORY), 0);
+
+    const int appends = 64;
+    std::atomic<int> failures(0);
+    std::atomic<bool> done(false);
+    std::thread writer([&]() {
+        int fd = fs_open(fs, "/stable/b");
+        uint8_t block[512];
+        memset(block, 0x3C, sizeof(block));
+        char fname[32];
+        for (int i = 0; i < appends * 4; ++i) {
+            snprintf(fname, sizeof(fname), "/busy/x%d", i % 5);
+            if (fs_create(fs, fname, i % 2 ? FS_REGULAR : FS_DIRECTORY) != 0 || fs_remove(fs, fname) != 0) {
+                failures++;
+            }
+            if (i % 4 == 0 && fs_write(fs, fd, block, sizeof(block)) != (ssize_t) sizeof(block)) {
+                failures++;
+            }
+        }
+        fs_close(fs, fd);
+        done = true;
+    });
+    vector<std::thread> readers;
+    for (int t = 0; t < 3; ++t) {
+        readers.push_back(std::thread([&]() {
+            int sized = fs_open(fs, "/stable/b");
+            off_t last = 0;
+            do {
+                // CASE 1
+                int fd = fs_open(fs, "/stable/a");
+                if (fd < 0 || fs_close(fs, fd) != 0) {
+                    failures++;
+                }
+                dyn_array_t *listing = fs_get_dir(fs, "/stable");
+                if (listing == NULL || dyn_array_size(listing) != 2 || !find_in_directory(listing, "a")) {
+                    failures++;
+                }
+                dyn_array_destroy(listing);
+                // CASE 2
+                off_t end = fs_seek(fs, sized, 0, FS_SEEK_END);
+                if (end < last || end % 512 != 0 || end > 512 * appends) {
+                    failures++;
+                }
+                last = end;
+            } while (!done);
+            fs_close(fs, sized);
+        }));
+    }
+    writer.join();
+    for (std::thread &reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQ(failures.load(), 0);
+    dyn_array_t *listing = fs_get_dir(fs, "/busy");
+    ASSERT_NE(listing, nullptr);
+    ASSERT_EQ(dyn_array_size(listing), 0u);
+    dyn_array_destroy(listing);
+
+    // CASE 3
+    ASSERT_EQ(fs_remove(fs, "/stable/a"), 0);
+    ASSERT_LT(fs_open(fs, "/stable/a"), 0);
+    ASSERT_EQ(fs_create(fs, "/stable/a", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/stable/a");
+    ASSERT_GE(fd, 0);
+
+    // CASE 4
+    ASSERT_EQ(fs_set_write_buffer(fs, fd, true), 0);
+    ASSERT_EQ(fs_write(fs, fd, "seqlock", 7), 7);
+    ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_END), 7);
+    ASSERT_EQ(fs_close(fs, fd), 0);
+    fs_unmount(fs);
+    score += 5;
+}
+//*/
+/*
+   Large transfers split across the worker pool
+   1. Normal, unaligned write big enough to go parallel, read back in one go
+   2. Normal, unaligned pread from the middle
+   3. Normal, two threads reading big ranges at once
+   4. Normal, overwrite in place keeps the size
+   */
+///*
+TEST(r_tests, parallel_transfer) {
+    const char *test_fname = "r_tests.S17FS";
+    S17FS *fs = fs_format(test_fname);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/big", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/big");
+    ASSERT_GE(fd, 0);
+    vector<uint8_t> data(512 * 6000 + 333);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (uint8_t)(i * 31 + i / 512);
+    }
+    // CASE 1
+    ASSERT_EQ(fs_write(fs, fd, data.data(), 100), 100);
+    ASSERT_EQ(fs_write(fs, fd, data.data() + 100, data.size() - 100), (ssize_t)(data.size() - 100));
+    vector<uint8_t> back(data.size() + 512);
+    ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_SET), 0);
+    ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), (ssize_t) data.size());
+    ASSERT_TRUE(memcmp(back.data(), data.data(), data.size()) == 0);
+    // CASE 2
+    ASSERT_EQ(fs_pread(fs, fd, back.data(), 512 * 4000, 1234), 512 * 4000);
+    ASSERT_TRUE(memcmp(back.data(), data.data() + 1234, 512 * 4000) == 0);
+    // CASE 3
+    std::atomic<int> failures(0);
+    vector<std::thread> readers;
+    for (int t = 0; t < 2; ++t) {
+        readers.push_back(std::thread([&, t]() {
+            vector<uint8_t> mine(512 * 3000);
+            size_t offset = t * 512 * 2500;
+            if (fs_pread(fs, fd, mine.data(), mine.size(), offset) != (ssize_t) mine.size()
+                || memcmp(mine.data(), data.data() + offset, mine.size()) != 0) {
+                failures++;
+            }
+        }));
+    }
+    for (std::thread &reader : readers) {
+        reader.join();
+    }
+    ASSERT_EQ(failures.load(), 0);
+    // CASE 4
+    for (size_t i = 0; i < 512 * 3000; ++i) {
+        data[512 + i] ^= 0xFF;
+    }
+    ASSERT_EQ(fs_pwrite(fs, fd, data.data() + 512, 512 * 3000, 512), 512 * 3000);
+    ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_END), (off_t) data.size());
+    ASSERT_EQ(fs_pread(fs, fd, back.data(), back.size(), 0), (ssize_t) data.size());
+    ASSERT_TRUE(memcmp(back.data(), data.data(), data.size()) == 0);
+    fs_close(fs, fd);
+    fs_unmount(fs);
+    score += 5;
+}
+//*/
+/*
+   Async submission and completion
+   1. Normal, pipeline creates, then opens, then writes and reads, matched up by user_data
+   2. Normal, a linked chain runs in order, and the rest of it is skipped after a failure
+   3. Normal, reaping with nothing outstanding returns 0
+   4. Error, bad parameters
+   5. Normal, unmount with completions left unreaped
+   */
+///*
+TEST(s_tests, async_submit) {
+    const char *test_fname = "s_tests.S17FS";
+    S17FS *fs = fs_format(test_fname);
+    ASSERT_NE(fs, nullptr);
+    const size_t file_count = 16;
+    const char *paths[file_count] = {"/a0", "/a1", "/a2", "/a3", "/a4", "/a5", "/a6", "/a7",
+                                     "/b0", "/b1", "/b2", "/b3", "/b4", "/b5", "/b6", "/b7"};
+    fs_op_t ops[file_count * 2];
+    fs_completion_t done[file_count * 2];
+    // CASE 1
+    memset(ops, 0, sizeof(ops));
+    for (size_t i = 0; i < file_count; ++i) {
+        ops[i].opcode = FS_OP_CREATE;
+        ops[i].path = paths[i];
+        ops[i].type = FS_REGULAR;
+        ops[i].user_data = i;
+    }
+    // The root only holds 7, so some creates have to fail
+    ASSERT_EQ(fs_submit(fs, ops, file_count), (int) file_count);
+    size_t reaped = 0;
+    size_t created = 0;
+    vector<bool> made(file_count, false);
+    while (reaped < file_count) {
+        int got = fs_reap(fs, done, 3);
+        ASSERT_GT(got, 0);
+        ASSERT_LE(got, 3);
+        for (int i = 0; i < got; ++i) {
+            ASSERT_LT(done[i].user_data, file_count);
+            if (done[i].result == 0) {
+                made[done[i].user_data] = true;
+                ++created;
+            }
+        }
+        reaped += got;
+    }
+    ASSERT_EQ(created, (size_t) 7);
+    ASSERT_EQ(fs_reap(fs, done, file_count), 0);
+
+    memset(ops, 0, sizeof(ops));
+    for (size_t i = 0; i < file_count; ++i) {
+        ops[i].opcode = FS_OP_OPEN;
+        ops[i].path = paths[i];
+        ops[i].user_data = i;
+    }
+    ASSERT_EQ(fs_submit(fs, ops, file_count), (int) file_count);
+    vector<int> fds(file_count, -1);
+    for (reaped = 0; reaped < file_count;) {
+        int got = fs_reap(fs, done, file_count);
+        ASSERT_GT(got, 0);
+        for (int i = 0; i < got; ++i) {
+            fds[done[i].user_data] = (int) done[i].result;
+            ASSERT_EQ(done[i].result >= 0, (bool) made[done[i].user_data]);
+        }
+        reaped += got;
+    }
+
+    vector<vector<uint8_t>> contents;
+    vector<vector<uint8_t>> back;
+    size_t op_count = 0;
+    memset(ops, 0, sizeof(ops));
+    for (size_t i = 0; i < file_count; ++i) {
+        if (fds[i] >= 0) {
+            contents.push_back(vector<uint8_t>(700 + 512 * i, (uint8_t) i));
+            back.push_back(vector<uint8_t>(contents.back().size()));
+            ops[op_count].opcode = FS_OP_WRITE;
+            ops[op_count].fd = fds[i];
+            ops[op_count].buf = contents.back().data();
+            ops[op_count].nbyte = contents.back().size();
+            ops[op_count].flags = FS_OP_LINK;
+            ops[op_count].user_data = op_count;
+            ++op_count;
+            ops[op_count].opcode = FS_OP_PREAD;
+            ops[op_count].fd = fds[i];
+            ops[op_count].buf = back.back().data();
+            ops[op_count].nbyte = back.back().size() + 100;
+            ops[op_count].offset = 0;
+            ops[op_count].user_data = op_count;
+            ++op_count;
+        }
+    }
+    ASSERT_EQ(fs_submit(fs, ops, op_count), (int) op_count);
+    for (reaped = 0; reaped < op_count;) {
+        int got = fs_reap(fs, done, op_count);
+        ASSERT_GT(got, 0);
+        for (int i = 0; i < got; ++i) {
+            ASSERT_EQ(done[i].result, (ssize_t) contents[done[i].user_data / 2].size());
+        }
+        reaped += got;
+    }
+    for (size_t i = 0; i < contents.size(); ++i) {
+        ASSERT_TRUE(back[i] == contents[i]);
+    }
+
+    // CASE 2
+    memset(ops, 0, sizeof(ops));
+    ops[0].opcode = FS_OP_CREATE;
+    ops[0].path = "/a0/nope";
+    ops[0].type = FS_REGULAR;
+    ops[0].flags = FS_OP_LINK;
+    ops[0].user_data = 100;
+    ops[1].opcode = FS_OP_NOP;
+    ops[1].flags = FS_OP_LINK;
+    ops[1].user_data = 101;
+    ops[2].opcode = FS_OP_NOP;
+    ops[2].user_data = 102;
+    ops[3].opcode = FS_OP_NOP;
+    ops[3].user_data = 103;
+    ASSERT_EQ(fs_submit(fs, ops, 4), 4);
+    vector<ssize_t> results(4, 1);
+    vector<size_t> order;
+    for (reaped = 0; reaped < 4;) {
+        int got = fs_reap(fs, done, 4);
+        ASSERT_GT(got, 0);
+        for (int i = 0; i < got; ++i) {
+            results[done[i].user_data - 100] = done[i].result;
+            if (done[i].user_data < 103) {
+                order.push_back(done[i].user_data);
+            }
+        }
+        reaped += got;
+    }
+    ASSERT_EQ(results[0], -1);
+    ASSERT_EQ(results[1], -1);
+    ASSERT_EQ(results[2], -1);
+    ASSERT_EQ(results[3], 0);
+    ASSERT_TRUE(order == vector<size_t>({100, 101, 102}));
+
+    // CASE 3
+    ASSERT_EQ(fs_reap(fs, done, 4), 0);
+
+    // CASE 4
+    ASSERT_LT(fs_submit(NULL, ops, 1), 0);
+    ASSERT_LT(fs_submit(fs, NULL, 1), 0);
+    ASSERT_LT(fs_submit(fs, ops, 0), 0);
+    ASSERT_LT(fs_reap(NULL, done, 1), 0);
+    ASSERT_LT(fs_reap(fs, NULL, 1), 0);
+    ASSERT_LT(fs_reap(fs, done, 0), 0);
+
+    // CASE 5
+    for (size_t i = 0; i < contents.size(); ++i) {
+        ops[i].opcode = FS_OP_READ;
+        ops[i].fd = fds[i];
+        ops[i].buf = back[i].data();
+        ops[i].nbyte = back[i].size();
+        ops[i].flags = 0;
+    }
+    ASSERT_EQ(fs_submit(fs, ops, contents.size()), (int) contents.size());
+    ASSERT_EQ(fs_unmount(fs), 0);
+    score += 5;
+}
+//*/
+/*
+   io_uring backed volumes
+   1. Normal, small, unaligned, and large writes read back on a fresh URING volume
+   2. Normal, more data than the block cache holds, written in small pieces and read back
+   3. Normal, remount on either backend sees the same files
+   4. Normal, a volume made on MMAP reads back the same on URING
+   5. Error, views need a mapped volume
+   6. Error, bad parameters
+   */
+///*
+TEST(t_tests, uring_backend) {
+    const char *test_fname = "t_tests.S17FS";
+    S17FS *fs = fs_format_backend(test_fname, FS_BACKEND_URING);
+    ASSERT_NE(fs, nullptr);
+    vector<uint8_t> small(1000);
+    vector<uint8_t> large(512 * 3000 + 77);
+    vector<uint8_t> many(512 * 10000);
+    for (size_t i = 0; i < many.size(); ++i) {
+        if (i < small.size()) {
+            small[i] = (uint8_t)(i * 7);
+        }
+        if (i < large.size()) {
+            large[i] = (uint8_t)(i * 13 + i / 512);
+        }
+        many[i] = (uint8_t)(i * 3 + i / 4096);
+    }
+    vector<uint8_t> back(many.size() + 512);
+    // CASE 1
+    ASSERT_EQ(fs_create(fs, "/small", FS_REGULAR), 0);
+    ASSERT_EQ(fs_create(fs, "/large", FS_REGULAR), 0);
+    ASSERT_EQ(fs_create(fs, "/dir", FS_DIRECTORY), 0);
+    ASSERT_EQ(fs_create(fs, "/dir/many", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/small");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, small.data(), 300), 300);
+    ASSERT_EQ(fs_write(fs, fd, small.data() + 300, 700), 700);
+    ASSERT_EQ(fs_pread(fs, fd, back.data(), back.size(), 0), (ssize_t) small.size());
+    ASSERT_TRUE(memcmp(back.data(), small.data(), small.size()) == 0);
+    fs_close(fs, fd);
+    fd = fs_open(fs, "/large");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, large.data(), 100), 100);
+    ASSERT_EQ(fs_write(fs, fd, large.data() + 100, large.size() - 100), (ssize_t)(large.size() - 100));
+    ASSERT_EQ(fs_pread(fs, fd, back.data(), back.size(), 0), (ssize_t) large.size());
+    ASSERT_TRUE(memcmp(back.data(), large.data(), large.size()) == 0);
+    ASSERT_EQ(fs_pread(fs, fd, back.data(), 5000, 2000), 5000);
+    ASSERT_TRUE(memcmp(back.data(), large.data() + 2000, 5000) == 0);
+    // CASE 5
+    dyn_array_t *spans = NULL;
+    ASSERT_LT(fs_read_view(fs, fd, 0, 512, &spans), 0);
+    fs_close(fs, fd);
+    // CASE 2
+    fd = fs_open(fs, "/dir/many");
+    ASSERT_GE(fd, 0);
+    for (size_t i = 0; i < many.size(); i += 1536) {
+        size_t chunk = many.size() - i < 1536 ? many.size() - i : 1536;
+        ASSERT_EQ(fs_write(fs, fd, many.data() + i, chunk), (ssize_t) chunk);
+    }
+    for (size_t i = 0; i < many.size(); i += 3000) {
+        size_t chunk = many.size() - i < 3000 ? many.size() - i : 3000;
+        ASSERT_EQ(fs_pread(fs, fd, back.data(), chunk, i), (ssize_t) chunk);
+        ASSERT_TRUE(memcmp(back.data(), many.data() + i, chunk) == 0);
+    }
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 3
+    fs_backend_t backends[2] = {FS_BACKEND_URING, FS_BACKEND_MMAP};
+    for (fs_backend_t backend : backends) {
+        fs = fs_mount_backend(test_fname, backend);
+        ASSERT_NE(fs, nullptr);
+        const char *paths[3] = {"/small", "/large", "/dir/many"};
+        vector<uint8_t> *expected[3] = {&small, &large, &many};
+        for (size_t i = 0; i < 3; ++i) {
+            fd = fs_open(fs, paths[i]);
+            ASSERT_GE(fd, 0);
+            ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), (ssize_t) expected[i]->size());
+            ASSERT_TRUE(memcmp(back.data(), expected[i]->data(), expected[i]->size()) == 0);
+            fs_close(fs, fd);
+        }
+        dyn_array_t *record_results = fs_get_dir(fs, "/");
+        ASSERT_NE(record_results, nullptr);
+        ASSERT_EQ(dyn_array_size(record_results), (size_t) 3);
+        dyn_array_destroy(record_results);
+        ASSERT_EQ(fs_unmount(fs), 0);
+    }
+    // CASE 4
+    fs = fs_format(test_fname);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/mapped", FS_REGULAR), 0);
+    fd = fs_open(fs, "/mapped");
+    ASSERT_EQ(fs_write(fs, fd, large.data(), large.size()), (ssize_t) large.size());
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    fs = fs_mount_backend(test_fname, FS_BACKEND_URING);
+    ASSERT_NE(fs, nullptr);
+    fd = fs_open(fs, "/mapped");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), (ssize_t) large.size());
+    ASSERT_TRUE(memcmp(back.data(), large.data(), large.size()) == 0);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 6
+    ASSERT_EQ(fs_format_backend(NULL, FS_BACKEND_URING), nullptr);
+    ASSERT_EQ(fs_format_backend("", FS_BACKEND_URING), nullptr);
+    ASSERT_EQ(fs_mount_backend(test_fname, (fs_backend_t) 7), nullptr);
+    ASSERT_EQ(fs_mount_backend("t_tests_missing.S17FS", FS_BACKEND_URING), nullptr);
+    score += 5;
+}
+//*/
+/*
+   Block device backends
+   1. Normal, the same work on each backend leaves the same image behind
+   2. Normal, a FILE volume remounts on every backend
+   3. Normal, threads sharing a FILE volume
+   */
+///*
+TEST(u_tests, block_devices) {
+    const char *test_fname = "u_tests.S17FS";
+    vector<uint8_t> data(512 * 700 + 19);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (uint8_t)(i * 11 + i / 512);
+    }
+    vector<uint8_t> back(data.size() + 512);
+    fs_backend_t backends[3] = {FS_BACKEND_MMAP, FS_BACKEND_URING, FS_BACKEND_FILE};
+    // CASE 1
+    vector<vector<char>> images;
+    for (fs_backend_t backend : backends) {
+        S17FS *fs = fs_format_backend(test_fname, backend);
+        ASSERT_NE(fs, nullptr);
+        ASSERT_EQ(fs_create(fs, "/d", FS_DIRECTORY), 0);
+        ASSERT_EQ(fs_create(fs, "/d/f", FS_REGULAR), 0);
+        int fd = fs_open(fs, "/d/f");
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_write(fs, fd, data.data(), 1000), 1000);
+        ASSERT_EQ(fs_write(fs, fd, data.data() + 1000, data.size() - 1000), (ssize_t)(data.size() - 1000));
+        ASSERT_EQ(fs_pread(fs, fd, back.data(), back.size(), 0), (ssize_t) data.size());
+        ASSERT_TRUE(memcmp(back.data(), data.data(), data.size()) == 0);
+        fs_close(fs, fd);
+        ASSERT_EQ(fs_unmount(fs), 0);
+        std::ifstream image(test_fname, std::ios::binary | std::ios::ate);
+        images.push_back(vector<char>((size_t) image.tellg()));
+        image.seekg(0);
+        ASSERT_TRUE((bool) image.read(images.back().data(), images.back().size()));
+    }
+    // Timestamps are the only thing allowed to differ, and only in the inode table
+    ASSERT_EQ(images[0].size(), images[1].size());
+    ASSERT_EQ(images[0].size(), images[2].size());
+    ASSERT_TRUE(memcmp(images[0].data() + 512 * 33, images[1].data() + 512 * 33, images[0].size() - 512 * 33) == 0);
+    ASSERT_TRUE(memcmp(images[0].data() + 512 * 33, images[2].data() + 512 * 33, images[0].size() - 512 * 33) == 0);
+    // CASE 2
+    for (fs_backend_t backend : backends) {
+        S17FS *fs = fs_mount_backend(test_fname, backend);
+        ASSERT_NE(fs, nullptr);
+        int fd = fs_open(fs, "/d/f");
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), (ssize_t) data.size());
+        ASSERT_TRUE(memcmp(back.data(), data.data(), data.size()) == 0);
+        fs_close(fs, fd);
+        ASSERT_EQ(fs_unmount(fs), 0);
+    }
+    // CASE 3
+    S17FS *fs = fs_mount_backend(test_fname, FS_BACKEND_FILE);
+    ASSERT_NE(fs, nullptr);
+    std::atomic<int> failures(0);
+    vector<std::thread> threads;
+    for (int t = 0; t < 3; ++t) {
+        threads.push_back(std::thread([&, t]() {
+            char path[16];
+            snprintf(path, sizeof(path), "/d/t%d", t);
+            vector<uint8_t> mine(512 * 40 + t);
+            if (fs_create(fs, path, FS_REGULAR) != 0) {
+                failures++;
+                return;
+            }
+            int tfd = fs_open(fs, path);
+            int rfd = fs_open(fs, "/d/f");
+            if (fs_write(fs, tfd, data.data(), 512 * 40 + t) != 512 * 40 + t
+                || fs_pread(fs, tfd, mine.data(), mine.size(), 0) != (ssize_t) mine.size()
+                || memcmp(mine.data(), data.data(), mine.size()) != 0
+                || fs_pread(fs, rfd, mine.data(), mine.size(), 512 * t) != (ssize_t) mine.size()
+                || memcmp(mine.data(), data.data() + 512 * t, mine.size()) != 0) {
+                failures++;
+            }
+            fs_close(fs, tfd);
+            fs_close(fs, rfd);
+        }));
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(failures.load(), 0);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    score += 5;
+}
+//*/
+/*
+   In-memory volumes
+   1. Normal, a memory volume serialized to a file mounts like any other
+   2. Normal, huge pages asked for
+   3. Normal, a mapped volume serialized onto its own file while in use
+   4. Error, bad params
+   5. Normal, a memory volume with its own layout keeps it through a serialize, one that would grow is refused
+   */
+///*
+TEST(v_tests, memory_volume) {
+    const char *test_fname = "v_tests.S17FS";
+    vector<uint8_t> data(512 * 300 + 7);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (uint8_t)(i * 13 + i / 512);
+    }
+    vector<uint8_t> back(data.size() + 512);
+    // CASE 1
+    S17FS *fs = fs_format_memory(false);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/d", FS_DIRECTORY), 0);
+    ASSERT_EQ(fs_create(fs, "/d/f", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/d/f");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_set_write_buffer(fs, fd, true), 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), data.size()), (ssize_t) data.size());
+    ASSERT_EQ(fs_serialize(fs, test_fname), 0);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    fs = fs_mount(test_fname);
+    ASSERT_NE(fs, nullptr);
+    fd = fs_open(fs, "/d/f");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), (ssize_t) data.size());
+    ASSERT_TRUE(memcmp(back.data(), data.data(), data.size()) == 0);
+    fs_close(fs, fd);
+    // CASE 3
+    ASSERT_EQ(fs_create(fs, "/d/g", FS_REGULAR), 0);
+    fd = fs_open(fs, "/d/g");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), 1000), 1000);
+    ASSERT_EQ(fs_serialize(fs, test_fname), 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data() + 1000, 1000), 1000);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    fs = fs_mount(test_fname);
+    ASSERT_NE(fs, nullptr);
+    fd = fs_open(fs, "/d/g");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), 2000);
+    ASSERT_TRUE(memcmp(back.data(), data.data(), 2000) == 0);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 2
+    fs = fs_format_memory(true);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/f", FS_REGULAR), 0);
+    fd = fs_open(fs, "/f");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), data.size()), (ssize_t) data.size());
+    ASSERT_EQ(fs_pread(fs, fd, back.data(), back.size(), 0), (ssize_t) data.size());
+    ASSERT_TRUE(memcmp(back.data(), data.data(), data.size()) == 0);
+    fs_close(fs, fd);
+    // CASE 4
+    ASSERT_LT(fs_serialize(NULL, test_fname), 0);
+    ASSERT_LT(fs_serialize(fs, NULL), 0);
+    ASSERT_LT(fs_serialize(fs, ""), 0);
+    ASSERT_LT(fs_serialize(fs, "v_tests_missing/v_tests.S17FS"), 0);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 5
+    fs_format_opts_t opts = format_opts().block_size(4096).block_count(1024).inline_data(true);
+    fs = fs_format_memory_ex(&opts, false);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/f", FS_REGULAR), 0);
+    fd = fs_open(fs, "/f");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), data.size()), (ssize_t) data.size());
+    ASSERT_EQ(fs_serialize(fs, test_fname), 0);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    struct stat info;
+    ASSERT_EQ(stat(test_fname, &info), 0);
+    ASSERT_EQ(info.st_size, 4096 * 1024);
+    fs = fs_mount(test_fname);
+    ASSERT_NE(fs, nullptr);
+    fd = fs_open(fs, "/f");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), (ssize_t) data.size());
+    ASSERT_TRUE(memcmp(back.data(), data.data(), data.size()) == 0);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    opts.block_limit = 4096;
+    ASSERT_EQ(fs_format_memory_ex(&opts, false), nullptr);
+    score += 5;
+}
+//*/
+/*
+   Giving removed files' blocks back
+   1. Normal, removing a file frees its blocks for the next one, on every backend
+   2. Normal, the image gets sparse again, on every backend
+   3. Normal, a view held across the remove keeps what it saw
+   */
+///*
+static long long allocated_bytes(const char *fname) {
+    struct stat info;
+    return stat(fname, &info) == 0 ? (long long) info.st_blocks * 512 : -1;
+}
+TEST(w_tests, hole_punching) {
+    const char *test_fname = "w_tests.S17FS";
+    vector<uint8_t> data(512 * 8192 + 33);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (uint8_t)(i * 7 + i / 512);
+    }
+    vector<uint8_t> back(data.size());
+    auto write = [&](S17FS *fs, fs_backend_t) {
+        // CASE 1
+        // Ten rounds of 4MB is more than the volume holds, so it only works if removes free blocks
+        for (int round = 0; round < 10; ++round) {
+            ASSERT_EQ(fs_create(fs, "/tmp", FS_REGULAR), 0);
+            int fd = fs_open(fs, "/tmp");
+            ASSERT_GE(fd, 0);
+            data[0] = (uint8_t) round;
+            ASSERT_EQ(fs_write(fs, fd, data.data(), data.size()), (ssize_t) data.size());
+            ASSERT_EQ(fs_pread(fs, fd, back.data(), back.size(), 0), (ssize_t) data.size());
+            ASSERT_TRUE(back == data);
+            fs_close(fs, fd);
+            if (round == 9) {
+                break;
+            }
+            // Serializing onto its own file syncs it, so the blocks are really allocated on disk
+            ASSERT_EQ(fs_serialize(fs, test_fname), 0);
+            long long before_remove = allocated_bytes(test_fname);
+            ASSERT_EQ(fs_remove(fs, "/tmp"), 0);
+            // CASE 2
+            ASSERT_LT(allocated_bytes(test_fname), before_remove - 1024 * 1024 * 3);
+        }
+    };
+    auto check = [&](S17FS *fs) {
+        ASSERT_TRUE(file_holds(fs, "/tmp", data.data(), data.size()));
+    };
+    ASSERT_NO_FATAL_FAILURE(on_every_backend(test_fname, format_opts(), write, check));
+    // CASE 3
+    S17FS *fs = fs_format(test_fname);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/seen", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/seen");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), 512 * 64), 512 * 64);
+    dyn_array_t *spans = NULL;
+    ASSERT_EQ(fs_read_view(fs, fd, 0, 512 * 64, &spans), 512 * 64);
+    ASSERT_EQ(fs_remove(fs, "/seen"), 0);
+    size_t checked = 0;
+    for (size_t i = 0; i < dyn_array_size(spans); ++i) {
+        const fs_span_t *span = (const fs_span_t *) dyn_array_at(spans, i);
+        ASSERT_TRUE(memcmp(span->base, data.data() + checked, span->len) == 0);
+        checked += span->len;
+    }
+    ASSERT_EQ(checked, (size_t) 512 * 64);
+    ASSERT_EQ(fs_release_view(fs, spans), 0);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    score += 5;
+}
+//*/
+/*
+   Durability points
+   1. Normal, fs_fsync gets a descriptor's buffered writes into the image, on every backend
+   2. Normal, fs_sync gets every file's writes into the image, on every backend
+   3. Normal, syncing a memory volume
+   4. Error, NULL fs / bad fd
+   */
+///*
+static bool image_contains(const char *fname, const vector<uint8_t> &pattern) {
+    std::ifstream image(fname, std::ios::binary | std::ios::ate);
+    vector<uint8_t> contents((size_t) image.tellg());
+    image.seekg(0);
+    image.read((char *) contents.data(), contents.size());
+    return std::search(contents.begin(), contents.end(), pattern.begin(), pattern.end()) != contents.end();
+}
+TEST(x_tests, sync) {
+    const char *test_fname = "x_tests.S17FS";
+    vector<uint8_t> first(512 * 3 + 11);
+    vector<uint8_t> second(512 * 4 + 3);
+    for (size_t i = 0; i < first.size(); ++i) {
+        first[i] = (uint8_t)(i * 29 + 1);
+    }
+    for (size_t i = 0; i < second.size(); ++i) {
+        second[i] = (uint8_t)(i * 37 + 5);
+    }
+    fs_backend_t backends[3] = {FS_BACKEND_MMAP, FS_BACKEND_URING, FS_BACKEND_FILE};
+    for (fs_backend_t backend : backends) {
+        S17FS *fs = fs_format_backend(test_fname, backend);
+        ASSERT_NE(fs, nullptr);
+        ASSERT_EQ(fs_create(fs, "/a", FS_REGULAR), 0);
+        ASSERT_EQ(fs_create(fs, "/b", FS_REGULAR), 0);
+        int fd_a = fs_open(fs, "/a");
+        int fd_b = fs_open(fs, "/b");
+        ASSERT_GE(fd_a, 0);
+        ASSERT_GE(fd_b, 0);
+        // CASE 1
+        ASSERT_EQ(fs_set_write_buffer(fs, fd_a, true), 0);
+        ASSERT_EQ(fs_write(fs, fd_a, first.data(), first.size()), (ssize_t) first.size());
+        ASSERT_EQ(fs_fsync(fs, fd_a), 0);
+        ASSERT_TRUE(image_contains(test_fname, first));
+        // CASE 2
+        ASSERT_EQ(fs_set_write_buffer(fs, fd_b, true), 0);
+        ASSERT_EQ(fs_write(fs, fd_b, second.data(), 100), 100);
+        ASSERT_EQ(fs_write(fs, fd_b, second.data() + 100, second.size() - 100), (ssize_t)(second.size() - 100));
+        ASSERT_EQ(fs_sync(fs), 0);
+        ASSERT_TRUE(image_contains(test_fname, second));
+        ASSERT_EQ(fs_sync(fs), 0);
+        fs_close(fs, fd_a);
+        fs_close(fs, fd_b);
+        ASSERT_EQ(fs_unmount(fs), 0);
+    }
+    // CASE 3
+    S17FS *fs = fs_format_memory(false);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/a", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/a");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, first.data(), first.size()), (ssize_t) first.size());
+    ASSERT_EQ(fs_fsync(fs, fd), 0);
+    ASSERT_EQ(fs_sync(fs), 0);
+    // CASE 4
+    ASSERT_LT(fs_sync(NULL), 0);
+    ASSERT_LT(fs_fsync(NULL, fd), 0);
+    ASSERT_LT(fs_fsync(fs, -1), 0);
+    ASSERT_LT(fs_fsync(fs, 256), 0);
+    fs_close(fs, fd);
+    ASSERT_LT(fs_fsync(fs, fd), 0);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    score += 5;
+}
+//*/
+/*
+   Metadata journal
+   1. Normal, a journaled volume works and remounts, on every backend
+   2. Normal, a mount replays the last commit over metadata that didn't make it home
+   3. Normal, changes after the last commit are rolled back, and their blocks come free again
+   4. Normal, a block the last commit didn't touch is rolled back too, on every backend
+   5. Normal, threads committing at once
+   6. Error, a transaction too big for the whole journal still goes home, but its commit fails
+   7. Error, bad path / backend
+   */
+///*
+static void copy_image(const char *from, const char *to) {
+    std::ifstream src(from, std::ios::binary);
+    std::ofstream dst(to, std::ios::binary | std::ios::trunc);
+    dst << src.rdbuf();
+}
+static void zero_image_block(const char *fname, size_t block) {
+    std::fstream image(fname, std::ios::binary | std::ios::in | std::ios::out);
+    vector<char> zeros(512);
+    image.seekp(block * 512);
+    image.write(zeros.data(), zeros.size());
+}
+TEST(y_tests, journal) {
+    const char *test_fname = "y_tests.S17FS";
+    const char *crash_fname = "y_tests_crash.S17FS";
+    vector<uint8_t> data(512 * 300 + 17);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (uint8_t)(i * 13 + 3);
+    }
+    vector<uint8_t> back(data.size());
+    fs_backend_t backends[3] = {FS_BACKEND_MMAP, FS_BACKEND_URING, FS_BACKEND_FILE};
+    for (fs_backend_t backend : backends) {
+        // CASE 1
+        S17FS *fs = fs_format_journaled(test_fname, backend);
+        ASSERT_NE(fs, nullptr);
+        ASSERT_EQ(fs_create(fs, "/dir", FS_DIRECTORY), 0);
+        ASSERT_EQ(fs_create(fs, "/dir/file", FS_REGULAR), 0);
+        ASSERT_EQ(fs_create(fs, "/gone", FS_REGULAR), 0);
+        int fd = fs_open(fs, "/dir/file");
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_write(fs, fd, data.data(), data.size()), (ssize_t) data.size());
+        ASSERT_EQ(fs_fsync(fs, fd), 0);
+        fs_close(fs, fd);
+        ASSERT_EQ(fs_remove(fs, "/gone"), 0);
+        ASSERT_EQ(fs_sync(fs), 0);
+        ASSERT_EQ(fs_unmount(fs), 0);
+        fs = fs_mount_backend(test_fname, backend);
+        ASSERT_NE(fs, nullptr);
+        dyn_array_t *records = fs_get_dir(fs, "/");
+        ASSERT_NE(records, nullptr);
+        ASSERT_TRUE(find_in_directory(records, "dir"));
+        ASSERT_FALSE(find_in_directory(records, "gone"));
+        dyn_array_destroy(records);
+        fd = fs_open(fs, "/dir/file");
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), (ssize_t) data.size());
+        ASSERT_TRUE(back == data);
+        fs_close(fs, fd);
+        ASSERT_EQ(fs_unmount(fs), 0);
+    }
+    // CASE 2
+    S17FS *fs = fs_format_journaled(test_fname, FS_BACKEND_MMAP);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/keep", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/keep");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), data.size()), (ssize_t) data.size());
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_sync(fs), 0);
+    // CASE 3
+    ASSERT_EQ(fs_create(fs, "/later", FS_REGULAR), 0);
+    fd = fs_open(fs, "/later");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), data.size()), (ssize_t) data.size());
+    fs_close(fs, fd);
+    // What a crash right now would leave, with the root directory's block never written
+    copy_image(test_fname, crash_fname);
+    zero_image_block(crash_fname, 33);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    fs = fs_mount(crash_fname);
+    ASSERT_NE(fs, nullptr);
+    dyn_array_t *records = fs_get_dir(fs, "/");
+    ASSERT_NE(records, nullptr);
+    ASSERT_TRUE(find_in_directory(records, "keep"));
+    ASSERT_FALSE(find_in_directory(records, "later"));
+    dyn_array_destroy(records);
+    ASSERT_EQ(fs_create(fs, "/after", FS_REGULAR), 0);
+    fd = fs_open(fs, "/after");
+    ASSERT_GE(fd, 0);
+    vector<uint8_t> other(data.size(), 0x5A);
+    ASSERT_EQ(fs_write(fs, fd, other.data(), other.size()), (ssize_t) other.size());
+    fs_close(fs, fd);
+    fd = fs_open(fs, "/keep");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), (ssize_t) data.size());
+    ASSERT_TRUE(back == data);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 4
+    for (fs_backend_t backend : backends) {
+        fs = fs_format_journaled(test_fname, backend);
+        ASSERT_NE(fs, nullptr);
+        ASSERT_EQ(fs_create(fs, "/dir", FS_DIRECTORY), 0);
+        ASSERT_EQ(fs_create(fs, "/dir/keep", FS_REGULAR), 0);
+        ASSERT_EQ(fs_sync(fs), 0);
+        // The last commit only touches the file, neither directory's block is in it
+        fd = fs_open(fs, "/dir/keep");
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_write(fs, fd, data.data(), data.size()), (ssize_t) data.size());
+        ASSERT_EQ(fs_fsync(fs, fd), 0);
+        fs_close(fs, fd);
+        ASSERT_EQ(fs_create(fs, "/dir/later", FS_REGULAR), 0);
+        ASSERT_EQ(fs_create(fs, "/later", FS_DIRECTORY), 0);
+        copy_image(test_fname, crash_fname);
+        ASSERT_EQ(fs_unmount(fs), 0);
+        fs = fs_mount_backend(crash_fname, backend);
+        ASSERT_NE(fs, nullptr);
+        records = fs_get_dir(fs, "/");
+        ASSERT_NE(records, nullptr);
+        ASSERT_TRUE(find_in_directory(records, "dir"));
+        ASSERT_FALSE(find_in_directory(records, "later"));
+        dyn_array_destroy(records);
+        records = fs_get_dir(fs, "/dir");
+        ASSERT_NE(records, nullptr);
+        ASSERT_EQ(dyn_array_size(records), (size_t) 1);
+        ASSERT_TRUE(find_in_directory(records, "keep"));
+        dyn_array_destroy(records);
+        fd = fs_open(fs, "/dir/keep");
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), (ssize_t) data.size());
+        ASSERT_TRUE(back == data);
+        fs_close(fs, fd);
+        ASSERT_EQ(fs_create(fs, "/dir/later", FS_REGULAR), 0);
+        ASSERT_EQ(fs_unmount(fs), 0);
+    }
+    // CASE 5
+    fs = fs_format_journaled(test_fname, FS_BACKEND_FILE);
+    ASSERT_NE(fs, nullptr);
+    std::atomic<int> failures(0);
+    vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([fs, t, &failures, &data]() {
+            string dir = "/d" + std::to_string(t);
+            failures += fs_create(fs, dir.c_str(), FS_DIRECTORY) != 0;
+            for (int i = 0; i < 5; ++i) {
+                string name = dir + "/f" + std::to_string(i);
+                failures += fs_create(fs, name.c_str(), FS_REGULAR) != 0;
+                int file = fs_open(fs, name.c_str());
+                failures += fs_write(fs, file, data.data(), 512 * (i + 1)) != 512 * (i + 1);
+                failures += fs_fsync(fs, file) != 0;
+                failures += fs_close(fs, file) != 0;
+            }
+            failures += fs_sync(fs) != 0;
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    ASSERT_EQ(failures.load(), 0);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    fs = fs_mount_backend(test_fname, FS_BACKEND_FILE);
+    ASSERT_NE(fs, nullptr);
+    for (int t = 0; t < 4; ++t) {
+        string dir = "/d" + std::to_string(t);
+        records = fs_get_dir(fs, dir.c_str());
+        ASSERT_NE(records, nullptr);
+        ASSERT_EQ(dyn_array_size(records), (size_t) 5);
+        dyn_array_destroy(records);
+    }
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 6
+    fs_format_opts_t opts = format_opts().journal_blocks(6);
+    fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    vector<uint8_t> big(4 << 20);
+    for (size_t i = 0; i < big.size(); ++i) {
+        big[i] = (uint8_t)(i * 7 + 1);
+    }
+    ASSERT_EQ(fs_create(fs, "/big", FS_REGULAR), 0);
+    fd = fs_open(fs, "/big");
+    ASSERT_GE(fd, 0);
+    // One write, so every pointer block it fills lands in one transaction
+    ASSERT_EQ(fs_write(fs, fd, big.data(), big.size()), (ssize_t) big.size());
+    ASSERT_EQ(fs_fsync(fs, fd), -1);
+    ASSERT_EQ(fs_fsync(fs, fd), 0);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    fs = fs_mount(test_fname);
+    ASSERT_NE(fs, nullptr);
+    fd = fs_open(fs, "/big");
+    ASSERT_GE(fd, 0);
+    vector<uint8_t> big_back(big.size());
+    ASSERT_EQ(fs_read(fs, fd, big_back.data(), big_back.size()), (ssize_t) big.size());
+    ASSERT_TRUE(big_back == big);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 7
+    ASSERT_EQ(fs_format_journaled(NULL, FS_BACKEND_MMAP), nullptr);
+    ASSERT_EQ(fs_format_journaled("", FS_BACKEND_MMAP), nullptr);
+    ASSERT_EQ(fs_format_journaled(test_fname, (fs_backend_t) 42), nullptr);
+    score += 5;
+}
+//*/
+/*
+   Volume geometry
+   1. Normal, 4 KB blocks, a small volume and a short inode table, remounted on every backend
+   2. Normal, the directory record count and inode count given are the limits
+   3. Normal, a journal on a non-default geometry
+   4. Normal, NULL options make the same volume fs_format does
+   5. Error, bad layouts / path / backend
+   */
+///*
+TEST(z_tests, geometry) {
+    const char *test_fname = "z_tests.S17FS";
+    vector<uint8_t> data(4096 * 20 + 5);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (uint8_t)(i * 7 + 1);
+    }
+    vector<uint8_t> back(data.size());
+    fs_backend_t backends[3] = {FS_BACKEND_MMAP, FS_BACKEND_URING, FS_BACKEND_FILE};
+    for (fs_backend_t backend : backends) {
+        // CASE 1
+        fs_format_opts_t opts = format_opts(backend).block_size(4096).block_count(2048).inode_count(40);
+        S17FS *fs = fs_format_ex(test_fname, &opts);
+        ASSERT_NE(fs, nullptr);
+        struct stat st;
+        ASSERT_EQ(stat(test_fname, &st), 0);
+        ASSERT_EQ(st.st_size, 4096 * 2048);
+        ASSERT_EQ(fs_create(fs, "/dir", FS_DIRECTORY), 0);
+        ASSERT_EQ(fs_create(fs, "/dir/file", FS_REGULAR), 0);
+        int fd = fs_open(fs, "/dir/file");
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_write(fs, fd, data.data(), data.size()), (ssize_t) data.size());
+        fs_close(fs, fd);
+        ASSERT_EQ(fs_unmount(fs), 0);
+        fs = fs_mount_backend(test_fname, backend);
+        ASSERT_NE(fs, nullptr);
+        fd = fs_open(fs, "/dir/file");
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), (ssize_t) data.size());
+        ASSERT_TRUE(back == data);
+        fs_close(fs, fd);
+        ASSERT_EQ(fs_unmount(fs), 0);
+    }
+    // CASE 2
+    fs_format_opts_t opts = format_opts().inode_count(6).dir_records(3);
+    S17FS *fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/a", FS_DIRECTORY), 0);
+    ASSERT_EQ(fs_create(fs, "/b", FS_REGULAR), 0);
+    ASSERT_EQ(fs_create(fs, "/c", FS_REGULAR), 0);
+    ASSERT_LT(fs_create(fs, "/d", FS_REGULAR), 0);
+    ASSERT_EQ(fs_create(fs, "/a/d", FS_REGULAR), 0);
+    ASSERT_EQ(fs_create(fs, "/a/e", FS_REGULAR), 0);
+    ASSERT_LT(fs_create(fs, "/a/f", FS_REGULAR), 0);
+    ASSERT_EQ(fs_remove(fs, "/c"), 0);
+    ASSERT_EQ(fs_create(fs, "/a/f", FS_REGULAR), 0);
+    // Root and five files use every inode, though the root directory has a free record
+    ASSERT_LT(fs_create(fs, "/g", FS_REGULAR), 0);
+    dyn_array_t *records = fs_get_dir(fs, "/a");
+    ASSERT_NE(records, nullptr);
+    ASSERT_EQ(dyn_array_size(records), 3u);
+    dyn_array_destroy(records);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 3
+    opts = format_opts(FS_BACKEND_URING).block_size(1024).block_count(8192).inode_count(64).journal_blocks(32);
+    fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/j", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/j");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), data.size()), (ssize_t) data.size());
+    ASSERT_EQ(fs_fsync(fs, fd), 0);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    fs = fs_mount(test_fname);
+    ASSERT_NE(fs, nullptr);
+    fd = fs_open(fs, "/j");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), (ssize_t) data.size());
+    ASSERT_TRUE(back == data);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 4
+    fs = fs_format_ex(test_fname, NULL);
+    ASSERT_NE(fs, nullptr);
+    struct stat st;
+    ASSERT_EQ(stat(test_fname, &st), 0);
+    ASSERT_EQ(st.st_size, 512 * 65536);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    fs = fs_mount(test_fname);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 5
+    fs_format_opts_t bad[] = {
+        format_opts().block_size(1000),
+        format_opts().block_size(256),
+        format_opts().block_size(8192),
+        format_opts().block_count(65537).pointer_bytes(2),
+        format_opts().block_count(8),
+        format_opts().inode_count(1),
+        format_opts().inode_count(257),
+        format_opts().dir_records(8),
+        format_opts().block_size(4096).dir_records(57),
+        format_opts().journal_blocks(2),
+        format_opts().block_count(64).journal_blocks(64),
+        format_opts((fs_backend_t) 42),
+    };
+    for (const fs_format_opts_t &layout : bad) {
+        ASSERT_EQ(fs_format_ex(test_fname, &layout), nullptr);
+    }
+    ASSERT_EQ(fs_format_ex(NULL, &opts), nullptr);
+    ASSERT_EQ(fs_format_ex("", &opts), nullptr);
+    score += 5;
+}
+//*/
+/*
+   Page sized blocks
+   1. Normal, a file reaching into the double indirect range, remounted on every backend
+   2. Normal, views of a mapped volume hand out whole pages
+   3. Normal, a removed file's blocks are punched out even when they sit between another file's
+   */
+///*
+TEST(za_tests, page_blocks) {
+    const char *test_fname = "za_tests.S17FS";
+    // Past the direct and single indirect blocks, 5 + 2 * 2048 of them
+    vector<uint8_t> data(FS_PAGE_BLOCK_SIZE * 5000 + 123);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (uint8_t)(i * 11 + i / FS_PAGE_BLOCK_SIZE);
+    }
+    vector<uint8_t> back(data.size());
+    vector<uint8_t> block(FS_PAGE_BLOCK_SIZE, 0x3C);
+    fs_backend_t backends[3] = {FS_BACKEND_MMAP, FS_BACKEND_URING, FS_BACKEND_FILE};
+    for (fs_backend_t backend : backends) {
+        // CASE 1
+        fs_format_opts_t opts = format_opts(backend).block_size(FS_PAGE_BLOCK_SIZE).block_count(8192);
+        S17FS *fs = fs_format_ex(test_fname, &opts);
+        ASSERT_NE(fs, nullptr);
+        ASSERT_EQ(fs_create(fs, "/big", FS_REGULAR), 0);
+        int fd = fs_open(fs, "/big");
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_write(fs, fd, data.data(), data.size()), (ssize_t) data.size());
+        fs_close(fs, fd);
+        ASSERT_EQ(fs_unmount(fs), 0);
+        fs = fs_mount_backend(test_fname, backend);
+        ASSERT_NE(fs, nullptr);
+        fd = fs_open(fs, "/big");
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), (ssize_t) data.size());
+        ASSERT_TRUE(back == data);
+        // CASE 2
+        if (backend == FS_BACKEND_MMAP) {
+            dyn_array_t *spans = NULL;
+            ASSERT_EQ(fs_read_view(fs, fd, FS_PAGE_BLOCK_SIZE * 3, FS_PAGE_BLOCK_SIZE * 64, &spans), FS_PAGE_BLOCK_SIZE * 64);
+            for (size_t i = 0; i < dyn_array_size(spans); ++i) {
+                const fs_span_t *span = (const fs_span_t *) dyn_array_at(spans, i);
+                ASSERT_EQ((uintptr_t) span->base % FS_PAGE_BLOCK_SIZE, 0u);
+                ASSERT_EQ(span->len % FS_PAGE_BLOCK_SIZE, 0u);
+            }
+            ASSERT_TRUE(gather_spans(spans) == vector<uint8_t>(data.begin() + FS_PAGE_BLOCK_SIZE * 3, data.begin() + FS_PAGE_BLOCK_SIZE * 67));
+            ASSERT_EQ(fs_release_view(fs, spans), 0);
+        }
+        fs_close(fs, fd);
+        ASSERT_EQ(fs_remove(fs, "/big"), 0);
+        // CASE 3
+        ASSERT_EQ(fs_create(fs, "/odd", FS_REGULAR), 0);
+        ASSERT_EQ(fs_create(fs, "/even", FS_REGULAR), 0);
+        int odd = fs_open(fs, "/odd");
+        int even = fs_open(fs, "/even");
+        ASSERT_GE(odd, 0);
+        ASSERT_GE(even, 0);
+        for (int i = 0; i < 256; ++i) {
+            ASSERT_EQ(fs_write(fs, odd, block.data(), block.size()), (ssize_t) block.size());
+            ASSERT_EQ(fs_write(fs, even, block.data(), block.size()), (ssize_t) block.size());
+        }
+        fs_close(fs, odd);
+        fs_close(fs, even);
+        ASSERT_EQ(fs_sync(fs), 0);
+        long long before_remove = allocated_bytes(test_fname);
+        ASSERT_EQ(fs_remove(fs, "/odd"), 0);
+        ASSERT_EQ(fs_sync(fs), 0);
+        ASSERT_LE(allocated_bytes(test_fname), before_remove - FS_PAGE_BLOCK_SIZE * 200);
+        ASSERT_EQ(fs_unmount(fs), 0);
+    }
+    score += 5;
+}
+//*/
+/*
+   32 bit block pointers
+   1. Normal, a volume past 65536 blocks fills beyond them and remounts, on every backend
+   2. Normal, files are capped by what 32 bit pointer blocks reach
+   3. Error, pointer widths that can't work
+   */
+///*
+TEST(zb_tests, wide_pointers) {
+    const char *test_fname = "zb_tests.S17FS";
+    const size_t file_bytes = 8 * 1024 * 1024;
+    vector<uint8_t> data(file_bytes);
+    vector<uint8_t> back(file_bytes);
+    fs_backend_t backends[3] = {FS_BACKEND_MMAP, FS_BACKEND_URING, FS_BACKEND_FILE};
+    for (fs_backend_t backend : backends) {
+        // CASE 1
+        // Five 8MB files are 40MB, past what 16 bit pointers to 512 byte blocks reach
+        fs_format_opts_t opts = format_opts(backend).block_count(100000);
+        S17FS *fs = fs_format_ex(test_fname, &opts);
+        ASSERT_NE(fs, nullptr);
+        for (int f = 0; f < 5; ++f) {
+            string name = "/f" + std::to_string(f);
+            for (size_t i = 0; i < data.size(); ++i) {
+                data[i] = (uint8_t)(i * 7 + i / 512 + f);
+            }
+            ASSERT_EQ(fs_create(fs, name.c_str(), FS_REGULAR), 0);
+            int fd = fs_open(fs, name.c_str());
+            ASSERT_GE(fd, 0);
+            ASSERT_EQ(fs_write(fs, fd, data.data(), data.size()), (ssize_t) data.size());
+            fs_close(fs, fd);
+        }
+        ASSERT_EQ(fs_unmount(fs), 0);
+        fs = fs_mount_backend(test_fname, backend);
+        ASSERT_NE(fs, nullptr);
+        for (int f = 4; f >= 0; --f) {
+            string name = "/f" + std::to_string(f);
+            for (size_t i = 0; i < data.size(); ++i) {
+                data[i] = (uint8_t)(i * 7 + i / 512 + f);
+            }
+            int fd = fs_open(fs, name.c_str());
+            ASSERT_GE(fd, 0);
+            ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), (ssize_t) data.size());
+            ASSERT_TRUE(back == data);
+            fs_close(fs, fd);
+        }
+        ASSERT_EQ(fs_unmount(fs), 0);
+    }
+    // CASE 2
+    // 512 byte pointer blocks hold 128 of them, so 5 + 2 * 128 + 128 * 128 blocks at most
+    fs_format_opts_t opts = format_opts().pointer_bytes(4);
+    S17FS *fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    vector<uint8_t> more(file_bytes + 1024 * 1024);
+    ASSERT_EQ(fs_create(fs, "/capped", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/capped");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, more.data(), more.size()), (ssize_t)((5 + 2 * 128 + 128 * 128) * 512));
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 3
+    fs_format_opts_t bad[] = {
+        format_opts().pointer_bytes(3),
+        format_opts().pointer_bytes(8),
+        format_opts().block_count(100000).pointer_bytes(2),
+    };
+    for (const fs_format_opts_t &layout : bad) {
+        ASSERT_EQ(fs_format_ex(test_fname, &layout), nullptr);
+    }
+    score += 5;
+}
+//*/
+/*
+   Growing inode table
+   1. Normal, hundreds of files past the fixed table, remounted, on every backend
+   2. Normal, freed numbers are reused and the limit holds, across a remount
+   3. Normal, the fixed table's last block past inode_count is never handed out
+   4. Error, limits that can't work
+   */
+///*
+TEST(zc_tests, dynamic_inodes) {
+    const char *test_fname = "zc_tests.S17FS";
+    fs_backend_t backends[3] = {FS_BACKEND_MMAP, FS_BACKEND_URING, FS_BACKEND_FILE};
+    for (fs_backend_t backend : backends) {
+        // CASE 1
+        // 16 directories of 55 files, 897 inodes with the root against a fixed table of 256
+        fs_format_opts_t opts = format_opts(backend).block_size(4096).block_count(8192).dir_records(56).inode_limit(1000);
+        S17FS *fs = fs_format_ex(test_fname, &opts);
+        ASSERT_NE(fs, nullptr);
+        for (int d = 0; d < 16; ++d) {
+            string dir = "/d" + std::to_string(d);
+            ASSERT_EQ(fs_create(fs, dir.c_str(), FS_DIRECTORY), 0);
+            for (int f = 0; f < 55; ++f) {
+                string name = dir + "/f" + std::to_string(f);
+                ASSERT_EQ(fs_create(fs, name.c_str(), FS_REGULAR), 0);
+            }
+        }
+        int fd = fs_open(fs, "/d15/f54");
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_write(fs, fd, test_fname, 14), 14);
+        fs_close(fs, fd);
+        ASSERT_EQ(fs_unmount(fs), 0);
+        fs = fs_mount_backend(test_fname, backend);
+        ASSERT_NE(fs, nullptr);
+        for (int d = 0; d < 16; ++d) {
+            string dir = "/d" + std::to_string(d);
+            dyn_array_t *records = fs_get_dir(fs, dir.c_str());
+            ASSERT_NE(records, nullptr);
+            ASSERT_EQ(dyn_array_size(records), 55);
+            ASSERT_TRUE(find_in_directory(records, "f54"));
+            dyn_array_destroy(records);
+        }
+        char back[14];
+        fd = fs_open(fs, "/d15/f54");
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_read(fs, fd, back, 14), 14);
+        ASSERT_EQ(memcmp(back, test_fname, 14), 0);
+        fs_close(fs, fd);
+        // CASE 2
+        // Emptying one directory frees its 56 numbers for another, then 2 more directories take the last 103
+        for (int f = 0; f < 55; ++f) {
+            string name = "/d3/f" + std::to_string(f);
+            ASSERT_EQ(fs_remove(fs, name.c_str()), 0);
+        }
+        ASSERT_EQ(fs_remove(fs, "/d3"), 0);
+        ASSERT_EQ(fs_create(fs, "/e", FS_DIRECTORY), 0);
+        for (int f = 0; f < 55; ++f) {
+            string name = "/e/f" + std::to_string(f);
+            ASSERT_EQ(fs_create(fs, name.c_str(), FS_REGULAR), 0);
+        }
+        ASSERT_EQ(fs_create(fs, "/h0", FS_DIRECTORY), 0);
+        ASSERT_EQ(fs_create(fs, "/h1", FS_DIRECTORY), 0);
+        int created = 0;
+        for (int f = 0; f < 112; ++f) {
+            string name = "/h" + std::to_string(f % 2) + "/f" + std::to_string(f);
+            if (fs_create(fs, name.c_str(), FS_REGULAR) == 0) {
+                ++created;
+            }
+        }
+        ASSERT_EQ(created, 101);
+        ASSERT_EQ(fs_unmount(fs), 0);
+        fs = fs_mount_backend(test_fname, backend);
+        ASSERT_NE(fs, nullptr);
+        ASSERT_LT(fs_create(fs, "/h0/one_more", FS_REGULAR), 0);
+        ASSERT_EQ(fs_remove(fs, "/e/f7"), 0);
+        ASSERT_EQ(fs_create(fs, "/h0/one_more", FS_REGULAR), 0);
+        ASSERT_EQ(fs_unmount(fs), 0);
+    }
+    // CASE 3
+    // 20 fixed inodes fill 3 blocks of 8, the 4 slots left in the last one stay out of use
+    fs_format_opts_t opts = format_opts().inode_count(20).dir_records(7).inode_limit(60);
+    S17FS *fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    int created = 0;
+    for (int d = 0; d < 7; ++d) {
+        string dir = "/a" + std::to_string(d);
+        created += fs_create(fs, dir.c_str(), FS_DIRECTORY) == 0;
+        for (int f = 0; f < 7; ++f) {
+            string name = dir + "/b" + std::to_string(f);
+            created += fs_create(fs, name.c_str(), FS_REGULAR) == 0;
+        }
+    }
+    ASSERT_EQ(created, 55);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 4
+    fs_format_opts_t bad[] = {
+        format_opts().inode_count(100).inode_limit(50),
+        format_opts().inode_limit(65537),
+    };
+    for (const fs_format_opts_t &layout : bad) {
+        ASSERT_EQ(fs_format_ex(test_fname, &layout), nullptr);
+    }
+    score += 5;
+}
+//*/
+/*
+   Growing a volume
+   1. Normal, a small image grows as a file fills it, stops at its limit, and remounts, on every backend
+   2. Normal, fs_grow ahead of time on a journaled volume, then filling it past the journal
+   3. Normal, a view taken before the image grows still reads the same
+   4. Error, growing past the limit or a volume without one, and limits that can't work
+   */
+///*
+TEST(zd_tests, online_growth) {
+    const char *test_fname = "zd_tests.S17FS";
+    const size_t file_bytes = 3 * 1024 * 1024;
+    vector<uint8_t> data(file_bytes);
+    vector<uint8_t> back(file_bytes);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (uint8_t)(i * 13 + i / 512);
+    }
+    struct stat st;
+    fs_backend_t backends[3] = {FS_BACKEND_MMAP, FS_BACKEND_URING, FS_BACKEND_FILE};
+    for (fs_backend_t backend : backends) {
+        // CASE 1
+        // 256 blocks to start with, doubling up to 8192 as the first 3MB go in, the second file gets what's left
+        fs_format_opts_t opts = format_opts(backend).block_count(256).block_limit(8192);
+        S17FS *fs = fs_format_ex(test_fname, &opts);
+        ASSERT_NE(fs, nullptr);
+        ASSERT_EQ(stat(test_fname, &st), 0);
+        ASSERT_EQ(st.st_size, 512 * 256);
+        ASSERT_EQ(fs_create(fs, "/first", FS_REGULAR), 0);
+        int fd = fs_open(fs, "/first");
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_write(fs, fd, data.data(), data.size()), (ssize_t) data.size());
+        fs_close(fs, fd);
+        ASSERT_EQ(stat(test_fname, &st), 0);
+        ASSERT_EQ(st.st_size, 512 * 8192);
+        ASSERT_EQ(fs_create(fs, "/second", FS_REGULAR), 0);
+        fd = fs_open(fs, "/second");
+        ASSERT_GE(fd, 0);
+        ssize_t partial = fs_write(fs, fd, data.data(), data.size());
+        ASSERT_GT(partial, 0);
+        ASSERT_LT(partial, (ssize_t) data.size());
+        fs_close(fs, fd);
+        ASSERT_EQ(fs_unmount(fs), 0);
+        fs = fs_mount_backend(test_fname, backend);
+        ASSERT_NE(fs, nullptr);
+        fd = fs_open(fs, "/first");
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), (ssize_t) data.size());
+        ASSERT_TRUE(back == data);
+        fs_close(fs, fd);
+        fd = fs_open(fs, "/second");
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), partial);
+        ASSERT_EQ(memcmp(back.data(), data.data(), partial), 0);
+        fs_close(fs, fd);
+        ASSERT_EQ(fs_unmount(fs), 0);
+    }
+    // CASE 2
+    fs_format_opts_t opts = format_opts().block_count(512).journal_blocks(16).block_limit(16384);
+    S17FS *fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_grow(fs, 1024), 0);
+    ASSERT_EQ(fs_grow(fs, 600), 0);
+    ASSERT_EQ(stat(test_fname, &st), 0);
+    ASSERT_EQ(st.st_size, 512 * 1024);
+    ASSERT_EQ(fs_create(fs, "/logged", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/logged");
+    ASSERT_GE(fd, 0);
+    // In pieces, a single write would fill more pointer blocks than the journal can log at once
+    for (size_t done = 0; done < data.size(); done += 64 * 1024) {
+        ASSERT_EQ(fs_write(fs, fd, data.data() + done, 64 * 1024), 64 * 1024);
+    }
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_sync(fs), 0);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    fs = fs_mount_backend(test_fname, FS_BACKEND_MMAP);
+    ASSERT_NE(fs, nullptr);
+    fd = fs_open(fs, "/logged");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), (ssize_t) data.size());
+    ASSERT_TRUE(back == data);
+    fs_close(fs, fd);
+    // CASE 4
+    ASSERT_LT(fs_grow(fs, 16385), 0);
+    ASSERT_LT(fs_grow(NULL, 1024), 0);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 3
+    opts = format_opts().block_count(256).block_limit(8192);
+    fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/viewed", FS_REGULAR), 0);
+    fd = fs_open(fs, "/viewed");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), 4096), 4096);
+    dyn_array_t *spans = NULL;
+    ASSERT_EQ(fs_read_view(fs, fd, 0, 4096, &spans), 4096);
+    ASSERT_EQ(fs_grow(fs, 4096), 0);
+    ASSERT_TRUE(gather_spans(spans) == vector<uint8_t>(data.begin(), data.begin() + 4096));
+    ASSERT_EQ(fs_release_view(fs, spans), 0);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 4
+    fs = fs_format_ex(test_fname, NULL);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_LT(fs_grow(fs, 65537), 0);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    fs_format_opts_t bad[] = {
+        format_opts().block_count(4096).block_limit(2048),
+        format_opts().block_count(4096).pointer_bytes(2).block_limit(65537),
+    };
+    for (const fs_format_opts_t &layout : bad) {
+        ASSERT_EQ(fs_format_ex(test_fname, &layout), nullptr);
+    }
+    score += 5;
+}
+//*/
+/*
+   Inline data
+   1. Normal, small files on an inline volume take no blocks, and read back after a remount, on every backend
+   2. Normal, a file that outgrows its inode moves out to a block, through plain and buffered writes
+   3. Normal, 256 byte inodes hold more, and inline files can be viewed
+   4. Error, inode sizes that aren't 64, 128 or 256
+   */
+///*
+static ssize_t fill_volume(S17FS *fs, const char *path, const vector<uint8_t> &data) {
+    if (fs_create(fs, path, FS_REGULAR) != 0) {
+        return -1;
+    }
+    int fd = fs_open(fs, path);
+    ssize_t written = fd < 0 ? -1 : fs_write(fs, fd, data.data(), data.size());
+    fs_close(fs, fd);
+    return written;
+}
+// Directories /d0 and up, for spreading small files over
+static bool make_dirs(S17FS *fs, size_t count) {
+    char name[32];
+    for (size_t i = 0; i < count; ++i) {
+        snprintf(name, sizeof(name), "/d%zu", i);
+        if (fs_create(fs, name, FS_DIRECTORY) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+TEST(ze_tests, inline_data) {
+    const char *test_fname = "ze_tests.S17FS";
+    vector<uint8_t> data(2 * 1024 * 1024);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (uint8_t)(i * 11 + i / 251);
+    }
+    vector<uint8_t> back(1024);
+    char name[32];
+    // CASE 1
+    // A volume without the small files takes as much of the big one
+    ssize_t room = 0;
+    auto write = [&](S17FS *fs, fs_backend_t) {
+        ASSERT_TRUE(make_dirs(fs, 6));
+        for (size_t i = 0; i <= 40; ++i) {
+            snprintf(name, sizeof(name), "/d%zu/small%zu", i / 7, i);
+            ASSERT_EQ(fs_create(fs, name, FS_REGULAR), 0);
+            int fd = fs_open(fs, name);
+            ASSERT_GE(fd, 0);
+            ASSERT_EQ(fs_write(fs, fd, data.data() + i, i), (ssize_t) i);
+            fs_close(fs, fd);
+        }
+        ASSERT_EQ(fill_volume(fs, "/big", data), room);
+    };
+    auto check = [&](S17FS *fs) {
+        for (size_t i = 0; i <= 40; ++i) {
+            snprintf(name, sizeof(name), "/d%zu/small%zu", i / 7, i);
+            ASSERT_TRUE(file_holds(fs, name, data.data() + i, i));
+        }
+    };
+    fs_format_opts_t opts = format_opts().block_count(2048).inline_data(true);
+    S17FS *fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_TRUE(make_dirs(fs, 6));
+    room = fill_volume(fs, "/big", data);
+    ASSERT_GT(room, 0);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    ASSERT_NO_FATAL_FAILURE(on_every_backend(test_fname, opts, write, check));
+    // CASE 2
+    opts = format_opts().inline_data(true);
+    fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/grows", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/grows");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), 30), 30);
+    ASSERT_EQ(fs_write(fs, fd, data.data() + 30, 670), 670);
+    ASSERT_EQ(fs_pread(fs, fd, back.data(), back.size(), 0), 700);
+    ASSERT_EQ(memcmp(back.data(), data.data(), 700), 0);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_create(fs, "/buffered", FS_REGULAR), 0);
+    fd = fs_open(fs, "/buffered");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_set_write_buffer(fs, fd, true), 0);
+    for (size_t i = 0; i < 100; i += 10) {
+        ASSERT_EQ(fs_write(fs, fd, data.data() + i, 10), 10);
+    }
+    ASSERT_EQ(fs_flush(fs, fd), 0);
+    ASSERT_EQ(fs_pread(fs, fd, back.data(), back.size(), 0), 100);
+    ASSERT_EQ(memcmp(back.data(), data.data(), 100), 0);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    fs = fs_mount(test_fname);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_TRUE(file_holds(fs, "/grows", data.data(), 700));
+    ASSERT_EQ(fs_remove(fs, "/grows"), 0);
+    ASSERT_EQ(fs_remove(fs, "/buffered"), 0);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 3
+    opts = format_opts().inode_size(256).inline_data(true);
+    fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/viewed", FS_REGULAR), 0);
+    fd = fs_open(fs, "/viewed");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), 232), 232);
+    dyn_array_t *spans = NULL;
+    ASSERT_EQ(fs_read_view(fs, fd, 10, 300, &spans), 222);
+    ASSERT_TRUE(gather_spans(spans) == vector<uint8_t>(data.begin() + 10, data.begin() + 232));
+    ASSERT_EQ(fs_release_view(fs, spans), 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data() + 232, 1), 1);
+    ASSERT_EQ(fs_read_view(fs, fd, 0, 300, &spans), 233);
+    ASSERT_EQ(dyn_array_size(spans), (size_t) 1);
+    ASSERT_TRUE(gather_spans(spans) == vector<uint8_t>(data.begin(), data.begin() + 233));
+    ASSERT_EQ(fs_release_view(fs, spans), 0);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    fs = fs_mount(test_fname);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_TRUE(file_holds(fs, "/viewed", data.data(), 233));
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 4
+    fs_format_opts_t bad[] = {
+        format_opts().inode_size(32).inline_data(true),
+        format_opts().inode_size(100),
+        format_opts().inode_size(512).inline_data(true),
+    };
+    for (const fs_format_opts_t &layout : bad) {
+        ASSERT_EQ(fs_format_ex(test_fname, &layout), nullptr);
+    }
+    score += 5;
+}
+//*/
+/*
+   Tail packing
+   1. Normal, 600 byte files take a block and a share of a fragment block, and read back after a remount, on every backend
+   2. Normal, appending to a packed file moves its tail back out, and packs it again on close, buffered too
+   3. Normal, removing the files gives the fragment blocks back
+   4. Normal, a view reaches into the fragment block, and small files stay inline on a volume doing both
+   5. Normal, a file still open on another descriptor isn't packed until that one closes too
+   */
+///*
+TEST(zf_tests, tail_packing) {
+    const char *test_fname = "zf_tests.S17FS";
+    vector<uint8_t> data(2 * 1024 * 1024);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (uint8_t)(i * 17 + i / 509);
+    }
+    vector<uint8_t> back(4096);
+    char name[32];
+    // CASE 1
+    // Five 88 byte tails share each fragment block, so 40 files take 48 blocks instead of 80
+    ssize_t room = 0;
+    auto write = [&](S17FS *fs, fs_backend_t) {
+        ASSERT_TRUE(make_dirs(fs, 6));
+        for (size_t i = 0; i < 40; ++i) {
+            snprintf(name, sizeof(name), "/d%zu/small%zu", i / 7, i);
+            ASSERT_EQ(fs_create(fs, name, FS_REGULAR), 0);
+            int fd = fs_open(fs, name);
+            ASSERT_GE(fd, 0);
+            ASSERT_EQ(fs_write(fs, fd, data.data() + i, 600), 600);
+            ASSERT_EQ(fs_close(fs, fd), 0);
+        }
+        ssize_t left = fill_volume(fs, "/big", data);
+        ASSERT_LE(left, room - 48 * 512);
+        ASSERT_GT(left, room - 50 * 512);
+    };
+    auto check = [&](S17FS *fs) {
+        for (size_t i = 0; i < 40; ++i) {
+            snprintf(name, sizeof(name), "/d%zu/small%zu", i / 7, i);
+            ASSERT_TRUE(file_holds(fs, name, data.data() + i, 600));
+        }
+    };
+    fs_format_opts_t opts = format_opts().block_count(2048).tail_packing(true);
+    S17FS *fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_TRUE(make_dirs(fs, 6));
+    room = fill_volume(fs, "/big", data);
+    ASSERT_GT(room, 0);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    ASSERT_NO_FATAL_FAILURE(on_every_backend(test_fname, opts, write, check));
+    // CASE 2
+    fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    room = fill_volume(fs, "/big", data);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/grows", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/grows");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), 600), 600);
+    ASSERT_EQ(fs_close(fs, fd), 0);
+    fd = fs_open(fs, "/grows");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_pwrite(fs, fd, data.data() + 100, 50, 100), 50);
+    ASSERT_EQ(fs_seek(fs, fd, 600, FS_SEEK_SET), 600);
+    ASSERT_EQ(fs_write(fs, fd, data.data() + 600, 1000), 1000);
+    ASSERT_EQ(fs_pread(fs, fd, back.data(), back.size(), 0), 1600);
+    ASSERT_EQ(memcmp(back.data(), data.data(), 1600), 0);
+    ASSERT_EQ(fs_close(fs, fd), 0);
+    fd = fs_open(fs, "/grows");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_set_write_buffer(fs, fd, true), 0);
+    ASSERT_EQ(fs_seek(fs, fd, 1600, FS_SEEK_SET), 1600);
+    for (size_t i = 1600; i < 2000; i += 40) {
+        ASSERT_EQ(fs_write(fs, fd, data.data() + i, 40), 40);
+    }
+    ASSERT_EQ(fs_close(fs, fd), 0);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    fs = fs_mount(test_fname);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_TRUE(file_holds(fs, "/grows", data.data(), 2000));
+    // CASE 3
+    ASSERT_EQ(fs_remove(fs, "/grows"), 0);
+    ASSERT_EQ(fill_volume(fs, "/big", data), room);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 4
+    opts = format_opts().inline_data(true).tail_packing(true);
+    fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/tiny", FS_REGULAR), 0);
+    ASSERT_EQ(fs_create(fs, "/viewed", FS_REGULAR), 0);
+    fd = fs_open(fs, "/tiny");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), 20), 20);
+    ASSERT_EQ(fs_close(fs, fd), 0);
+    fd = fs_open(fs, "/viewed");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), 600), 600);
+    ASSERT_EQ(fs_close(fs, fd), 0);
+    fd = fs_open(fs, "/viewed");
+    ASSERT_GE(fd, 0);
+    dyn_array_t *spans = NULL;
+    ASSERT_EQ(fs_read_view(fs, fd, 500, 4096, &spans), 100);
+    ASSERT_TRUE(gather_spans(spans) == vector<uint8_t>(data.begin() + 500, data.begin() + 600));
+    ASSERT_EQ(fs_release_view(fs, spans), 0);
+    fs_close(fs, fd);
+    ASSERT_TRUE(file_holds(fs, "/tiny", data.data(), 20));
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 5
+    // The first file's tail starts a fragment block, the second one's would join it
+    opts = format_opts().block_count(2048).tail_packing(true);
+    fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/first", FS_REGULAR), 0);
+    ASSERT_EQ(fs_create(fs, "/shared", FS_REGULAR), 0);
+    fd = fs_open(fs, "/first");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), 600), 600);
+    ASSERT_EQ(fs_close(fs, fd), 0);
+    fd = fs_open(fs, "/shared");
+    int other = fs_open(fs, "/shared");
+    ASSERT_GE(fd, 0);
+    ASSERT_GE(other, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), 600), 600);
+    ASSERT_EQ(fs_close(fs, fd), 0);
+    ssize_t left = fill_volume(fs, "/big", data);
+    ASSERT_LE(left, room - 4 * 512);
+    ASSERT_EQ(fs_close(fs, other), 0);
+    ASSERT_EQ(fs_remove(fs, "/big"), 0);
+    ASSERT_GT(fill_volume(fs, "/big", data), left);
+    ASSERT_TRUE(file_holds(fs, "/shared", data.data(), 600));
+    ASSERT_EQ(fs_unmount(fs), 0);
+    score += 5;
+}
+//*/
+/*
+   Delayed allocation
+   1. Normal, two buffered descriptors appending small records to two files in turns leave each one in a single run
+   2. Normal, longer appends take one run per buffer flushed, and everything reads back after a remount, on every backend
+   3. Normal, a buffered append into free space broken up into single blocks still makes it all the way out
+   4. Error, a buffered write on a full volume is turned away with ENOSPC instead of lost at the flush
+   */
+///*
+static size_t count_spans(S17FS *fs, int fd, size_t nbyte) {
+    dyn_array_t *spans = NULL;
+    if (fs_read_view(fs, fd, 0, nbyte, &spans) != (ssize_t) nbyte) {
+        return 0;
+    }
+    size_t count = dyn_array_size(spans);
+    fs_release_view(fs, spans);
+    return count;
+}
+TEST(zg_tests, delayed_allocation) {
+    const char *test_fname = "zg_tests.S17FS";
+    vector<uint8_t> data(256 * 1024);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (uint8_t)(i * 13 + i / 487);
+    }
+    vector<uint8_t> back(data.size());
+    const char *names[2] = {"/first", "/second"};
+    auto write = [&](S17FS *fs, fs_backend_t backend) {
+        // CASE 1
+        // 48KB each, so nothing goes out until close, block at a time they'd alternate
+        int fds[2];
+        for (int f = 0; f < 2; ++f) {
+            ASSERT_EQ(fs_create(fs, names[f], FS_REGULAR), 0);
+            fds[f] = fs_open(fs, names[f]);
+            ASSERT_GE(fds[f], 0);
+            ASSERT_EQ(fs_set_write_buffer(fs, fds[f], true), 0);
+        }
+        for (size_t pos = 0; pos < 48 * 1024; pos += 100) {
+            size_t length = 48 * 1024 - pos < 100 ? 48 * 1024 - pos : 100;
+            for (int f = 0; f < 2; ++f) {
+                ASSERT_EQ(fs_write(fs, fds[f], data.data() + pos + f, length), (ssize_t) length);
+            }
+        }
+        for (int f = 0; f < 2; ++f) {
+            ASSERT_EQ(fs_close(fs, fds[f]), 0);
+            if (backend == FS_BACKEND_MMAP) {
+                int fd = fs_open(fs, names[f]);
+                ASSERT_GE(fd, 0);
+                ASSERT_EQ(count_spans(fs, fd, 48 * 1024), 1u);
+                fs_close(fs, fd);
+            }
+        }
+        // CASE 2
+        // Another 200KB each, three 64KB flushes and what's left at close
+        for (int f = 0; f < 2; ++f) {
+            fds[f] = fs_open(fs, names[f]);
+            ASSERT_GE(fds[f], 0);
+            ASSERT_EQ(fs_set_write_buffer(fs, fds[f], true), 0);
+            ASSERT_EQ(fs_seek(fs, fds[f], 0, FS_SEEK_END), 48 * 1024);
+        }
+        for (size_t pos = 48 * 1024; pos < 248 * 1024; pos += 100) {
+            size_t length = 248 * 1024 - pos < 100 ? 248 * 1024 - pos : 100;
+            for (int f = 0; f < 2; ++f) {
+                ASSERT_EQ(fs_write(fs, fds[f], data.data() + pos + f, length), (ssize_t) length);
+            }
+        }
+        for (int f = 0; f < 2; ++f) {
+            ASSERT_EQ(fs_close(fs, fds[f]), 0);
+            if (backend == FS_BACKEND_MMAP) {
+                int fd = fs_open(fs, names[f]);
+                ASSERT_GE(fd, 0);
+                size_t spans = count_spans(fs, fd, 248 * 1024);
+                ASSERT_GE(spans, 1u);
+                ASSERT_LE(spans, 5u);
+                fs_close(fs, fd);
+            }
+        }
+    };
+    auto check = [&](S17FS *fs) {
+        for (int f = 0; f < 2; ++f) {
+            ASSERT_TRUE(file_holds(fs, names[f], data.data() + f, 248 * 1024));
+        }
+    };
+    ASSERT_NO_FATAL_FAILURE(on_every_backend(test_fname, format_opts(), write, check));
+    // CASE 3
+    // Single block writes in turns fill the volume, dropping one file leaves free space in single blocks
+    fs_format_opts_t opts = format_opts().block_count(2048);
+    S17FS *fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    int fds[2];
+    for (int f = 0; f < 2; ++f) {
+        ASSERT_EQ(fs_create(fs, names[f], FS_REGULAR), 0);
+        fds[f] = fs_open(fs, names[f]);
+        ASSERT_GE(fds[f], 0);
+    }
+    bool full = false;
+    for (size_t pos = 0; !full; pos = (pos + 512) % data.size()) {
+        for (int f = 0; f < 2; ++f) {
+            full = full || fs_write(fs, fds[f], data.data() + pos, 512) != 512;
+        }
+    }
+    fs_close(fs, fds[0]);
+    fs_close(fs, fds[1]);
+    ASSERT_EQ(fs_remove(fs, names[1]), 0);
+    ASSERT_EQ(fs_create(fs, "/third", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/third");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_set_write_buffer(fs, fd, true), 0);
+    for (size_t pos = 0; pos < 100 * 1024; pos += 100) {
+        ASSERT_EQ(fs_write(fs, fd, data.data() + pos, 100), 100);
+    }
+    ASSERT_EQ(fs_close(fs, fd), 0);
+    fd = fs_open(fs, "/third");
+    ASSERT_GE(fd, 0);
+    ASSERT_GT(count_spans(fs, fd, 100 * 1024), 150u);
+    ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), 100 * 1024);
+    ASSERT_EQ(memcmp(back.data(), data.data(), 100 * 1024), 0);
+    fs_close(fs, fd);
+    // CASE 4
+    // The rest of the volume goes to the first file, the buffered one has nowhere to put anything
+    fd = fs_open(fs, "/third");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_set_write_buffer(fs, fd, true), 0);
+    ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_END), 100 * 1024);
+    fds[0] = fs_open(fs, names[0]);
+    ASSERT_GE(fds[0], 0);
+    ASSERT_GT(fs_seek(fs, fds[0], 0, FS_SEEK_END), 0);
+    while (fs_write(fs, fds[0], data.data(), 512) == 512) {
+    }
+    errno = 0;
+    ASSERT_EQ(fs_write(fs, fd, data.data(), 100), -1);
+    ASSERT_EQ(errno, ENOSPC);
+    ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_CUR), 100 * 1024);
+    fs_close(fs, fds[0]);
+    ASSERT_EQ(fs_remove(fs, names[0]), 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data() + 100 * 1024, 100), 100);
+    ASSERT_EQ(fs_close(fs, fd), 0);
+    fd = fs_open(fs, "/third");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_read(fs, fd, back.data(), back.size()), 100 * 1024 + 100);
+    ASSERT_EQ(memcmp(back.data(), data.data(), 100 * 1024 + 100), 0);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    score += 5;
+}
+//*/
+/*
+   int fs_fallocate(S17FS *fs, int fd, off_t offset, size_t len);
+   1. Normal, an 8MB segment mapped up front is written in full on a volume that's filled up in between, comes out
+      in one run, and reads back after a remount, on every backend
+   2. Normal, inline files and packed tails keep their data when a range reaches past them
+   3. Normal, mapped blocks are left alone, a range that doesn't fit fails, and removing the file gives everything back
+   4. Error, NULL fs / bad fd / negative offset / empty range / range past what a file can hold
+   */
+///*
+TEST(zh_tests, fallocate) {
+    const char *test_fname = "zh_tests.S17FS";
+    const size_t segment = 8 * 1024 * 1024;
+    vector<uint8_t> data(segment);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = (uint8_t)(i * 7 + i / 1021);
+    }
+    vector<uint8_t> back(data.size());
+    vector<uint8_t> filler(32 * 1024 * 1024, 0x5a);
+    auto write = [&](S17FS *fs, fs_backend_t backend) {
+        // CASE 1
+        ASSERT_EQ(fs_create(fs, "/segment", FS_REGULAR), 0);
+        int fd = fs_open(fs, "/segment");
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(fs_fallocate(fs, fd, 0, segment), 0);
+        ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_END), 0);
+        ASSERT_LT(fill_volume(fs, "/big", filler), (ssize_t) filler.size());
+        for (size_t pos = 0; pos < segment; pos += 65536) {
+            ASSERT_EQ(fs_write(fs, fd, data.data() + pos, 65536), 65536);
+        }
+        ASSERT_EQ(fs_close(fs, fd), 0);
+        if (backend == FS_BACKEND_MMAP) {
+            fd = fs_open(fs, "/segment");
+            ASSERT_GE(fd, 0);
+            ASSERT_EQ(count_spans(fs, fd, segment), 1u);
+            fs_close(fs, fd);
+        }
+    };
+    auto check = [&](S17FS *fs) {
+        ASSERT_TRUE(file_holds(fs, "/segment", data.data(), segment));
+    };
+    ASSERT_NO_FATAL_FAILURE(on_every_backend(test_fname, format_opts(), write, check));
+    // CASE 2
+    fs_format_opts_t opts = format_opts().block_count(2048).inline_data(true).tail_packing(true);
+    S17FS *fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/tiny", FS_REGULAR), 0);
+    ASSERT_EQ(fs_create(fs, "/packed", FS_REGULAR), 0);
+    int fd = fs_open(fs, "/tiny");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), 20), 20);
+    ASSERT_EQ(fs_fallocate(fs, fd, 0, 30), 0);
+    ASSERT_EQ(fs_fallocate(fs, fd, 0, 4096), 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data() + 20, 1000), 1000);
+    ASSERT_EQ(fs_close(fs, fd), 0);
+    fd = fs_open(fs, "/packed");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), 600), 600);
+    ASSERT_EQ(fs_close(fs, fd), 0);
+    fd = fs_open(fs, "/packed");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_fallocate(fs, fd, 512, 4096), 0);
+    ASSERT_EQ(fs_seek(fs, fd, 0, FS_SEEK_END), 600);
+    ASSERT_EQ(fs_close(fs, fd), 0);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    fs = fs_mount(test_fname);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_TRUE(file_holds(fs, "/tiny", data.data(), 1020));
+    fd = fs_open(fs, "/packed");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_read(fs, fd, back.data(), 4096), 600);
+    ASSERT_EQ(memcmp(back.data(), data.data(), 600), 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data() + 600, 3000), 3000);
+    ASSERT_EQ(fs_pread(fs, fd, back.data(), 4096, 0), 3600);
+    ASSERT_EQ(memcmp(back.data(), data.data(), 3600), 0);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    // CASE 3
+    opts = format_opts().block_count(2048);
+    fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    ssize_t room = fill_volume(fs, "/big", data);
+    ASSERT_GT(room, 0);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    fs = fs_format_ex(test_fname, &opts);
+    ASSERT_NE(fs, nullptr);
+    ASSERT_EQ(fs_create(fs, "/huge", FS_REGULAR), 0);
+    fd = fs_open(fs, "/huge");
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(fs_write(fs, fd, data.data(), 5000), 5000);
+    ASSERT_EQ(fs_fallocate(fs, fd, 0, 5000), 0);
+    ASSERT_EQ(fs_pread(fs, fd, back.data(), 8192, 0), 5000);
+    ASSERT_EQ(memcmp(back.data(), data.data(), 5000), 0);
+    ASSERT_LT(fs_fallocate(fs, fd, 0, 2 * 1024 * 1024), 0);
+    ASSERT_EQ(fs_pread(fs, fd, back.data(), 8192, 0), 5000);
+    ASSERT_EQ(memcmp(back.data(), data.data(), 5000), 0);
+    // CASE 4
+    ASSERT_LT(fs_fallocate(NULL, fd, 0, 512), 0);
+    ASSERT_LT(fs_fallocate(fs, 90, 0, 512), 0);
+    ASSERT_LT(fs_fallocate(fs, fd, -1, 512), 0);
+    ASSERT_LT(fs_fallocate(fs, fd, 0, 0), 0);
+    ASSERT_LT(fs_fallocate(fs, fd, 0, (size_t) 1 << 40), 0);
+    fs_close(fs, fd);
+    ASSERT_EQ(fs_remove(fs, "/huge"), 0);
+    ASSERT_EQ(fill_volume(fs, "/big", data), room);
+    ASSERT_EQ(fs_unmount(fs), 0);
+    score += 5;
+}
+//*/
 /*
 #ifdef GRAD_TESTS
 